@@ -0,0 +1,13 @@
+# Configuration for "benchmark" flavour:
+# Build executable that runs micro-benchmarks.
+
+# Optimisation flags, same as "opt" flavour.
+CXXFLAGS+=-O3 -DNDEBUG -ffast-math -DBENCHMARK
+# Uncomment to measure lazy flag evaluation in the CPU emulation instead of
+# the default strategy (see USE_LAZY_FLAGS in src/cpu/CPUCore.cc).
+#CXXFLAGS+=-DUSE_LAZY_FLAGS
+
+# Strip executable?
+OPENMSX_STRIP:=false
+
+BENCHMARK:=true
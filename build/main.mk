@@ -65,7 +65,8 @@ endif
 # Logical targets which require dependency files.
 DEPEND_TARGETS:=all default install run bindist
 # Logical targets which do not require dependency files.
-NODEPEND_TARGETS:=clean config probe 3rdparty run-3rdparty staticbindist
+NODEPEND_TARGETS:=clean config probe 3rdparty run-3rdparty staticbindist \
+	benchmark
 # Mark all logical targets as such.
 .PHONY: $(DEPEND_TARGETS) $(NODEPEND_TARGETS)
 
@@ -196,6 +197,7 @@ TARGET_FLAGS+=$(shell $(PYTHON) build/cpu2flags.py $(OPENMSX_TARGET_CPU))
 include build/flavour-$(OPENMSX_FLAVOUR).mk
 
 UNITTEST?=false
+BENCHMARK?=false
 
 
 # Paths
@@ -307,6 +309,12 @@ else
 SOURCES_FULL:=$(filter-out src/unittest/%.cc,$(SOURCES_FULL))
 endif
 
+ifeq ($(BENCHMARK),true)
+SOURCES_FULL:=$(filter-out src/main.cc,$(SOURCES_FULL))
+else
+SOURCES_FULL:=$(filter-out src/benchmark/%.cc,$(SOURCES_FULL))
+endif
+
 # Apply subset to sources list.
 SOURCES_FULL:=$(filter $(SOURCES_PATH)/$(OPENMSX_SUBSET)%,$(SOURCES_FULL))
 ifeq ($(SOURCES_FULL),)
@@ -574,7 +582,18 @@ $(LIBRARY_FULL): $(OBJECTS_FULL) $(RESOURCE_OBJ)
 # Run executable.
 run: all
 	$(SUM) "Running $(notdir $(BINARY_FULL))..."
-	$(CMD)$(BINARY_FULL)
+	$(CMD)$(BINARY_FULL) $(RUN_ARGS)
+
+# Build and run the "benchmark" flavour, see src/benchmark.
+# The results are also written to a file, so they can be compared later.
+BENCHMARK_RESULTS?=derived/$(PLATFORM)-benchmark/benchmark-results.txt
+benchmark:
+	$(MAKE) -f build/main.mk run \
+		OPENMSX_TARGET_CPU=$(OPENMSX_TARGET_CPU) \
+		OPENMSX_TARGET_OS=$(OPENMSX_TARGET_OS) \
+		OPENMSX_FLAVOUR=benchmark \
+		RUN_ARGS="-o $(BENCHMARK_RESULTS) $(BENCHMARK_FILTER)" \
+		PYTHON=$(PYTHON)
 
 
 # Installation and Binary Packaging
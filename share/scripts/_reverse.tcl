@@ -84,6 +84,50 @@ proc go_forward_one_step {} {
 	goto_time_delta [expr { $::speed / 100.0}]
 }
 
+# reverse profiles
+
+variable profiles [dict create \
+	default  {reverse_interval 1.0 reverse_dense_history 25 reverse_cpu_budget 0} \
+	dense    {reverse_interval 0.2 reverse_dense_history 30 reverse_cpu_budget 0} \
+	sparse   {reverse_interval 5.0 reverse_dense_history 60 reverse_cpu_budget 0} \
+	adaptive {reverse_interval 1.0 reverse_dense_history 25 reverse_cpu_budget 5}]
+
+set_help_text reverse_profile \
+{Sets the reverse_interval, reverse_dense_history and reverse_cpu_budget\
+settings to a predefined combination:
+  default  : a snapshot every second, all snapshots of the last 25s are kept
+  dense    : 5 snapshots per second, all snapshots of the last 30s are kept
+  sparse   : a snapshot every 5 seconds, uses little memory and CPU time
+  adaptive : like default, but the interval grows when taking snapshots\
+takes more than 5% of the time
+Without argument, shows the profile that matches the current settings.
+}
+set_tabcompletion_proc reverse_profile [namespace code reverse_profile_tabcompletion]
+proc reverse_profile_tabcompletion {args} {
+	variable profiles
+	return [dict keys $profiles]
+}
+proc reverse_profile {{name ""}} {
+	variable profiles
+	if {$name eq ""} {
+		dict for {profile values} $profiles {
+			set match true
+			dict for {setting value} $values {
+				if {[set ::$setting] != $value} {set match false}
+			}
+			if {$match} {return $profile}
+		}
+		return "custom"
+	}
+	if {![dict exists $profiles $name]} {
+		error "Unknown profile: $name, must be one of [join [dict keys $profiles] {, }]"
+	}
+	dict for {setting value} [dict get $profiles $name] {
+		set ::$setting $value
+	}
+	return $name
+}
+
 
 # reverse bookmarks
 
@@ -280,6 +324,7 @@ namespace export reverse_next
 namespace export goto_time_delta
 namespace export go_back_one_step
 namespace export go_forward_one_step
+namespace export reverse_profile
 namespace export reverse_bookmarks
 
 } ;# namespace reverse
@@ -0,0 +1,382 @@
+#include "BatchRunner.hh"
+#include "Reactor.hh"
+#include "MSXMotherBoard.hh"
+#include "MSXCPU.hh"
+#include "MSXCPUInterface.hh"
+#include "MSXCliComm.hh"
+#include "MSXMixer.hh"
+#include "RealTime.hh"
+#include "HardwareConfig.hh"
+#include "Display.hh"
+#include "RenderSettings.hh"
+#include "CommandException.hh"
+#include "MSXException.hh"
+#include "FileContext.hh"
+#include "TclObject.hh"
+#include "Thread.hh"
+#include "Timer.hh"
+#include "checked_cast.hh"
+#include "memory.hh"
+#include "outer.hh"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using std::string;
+using std::vector;
+
+namespace openmsx {
+
+// Granularity (in emulated time) at which the memory pattern stop condition
+// is checked. The time and breakpoint conditions are exact.
+static const EmuDuration SLICE = EmuDuration::msec(20);
+
+BatchRunner::BatchRunner(Reactor& reactor_)
+	: reactor(reactor_)
+	, batchCommand(reactor.getCommandController())
+{
+}
+
+BatchRunner::~BatchRunner() = default;
+
+void BatchRunner::checkRenderer() const
+{
+	if (reactor.getDisplay().getRenderSettings().getRenderer() !=
+	    RenderSettings::DUMMY) {
+		throw CommandException(
+			"Batch machines require the dummy renderer, "
+			"use 'set renderer none' first.");
+	}
+}
+
+void BatchRunner::add(array_ref<TclObject> tokens, TclObject& result)
+{
+	if (tokens.size() < 3) {
+		throw SyntaxError();
+	}
+	checkRenderer();
+	auto& interp = batchCommand.getInterpreter();
+
+	auto job = make_unique<Job>();
+	job->duration = EmuDuration::sec(60);
+	job->stopAddress = -1;
+	job->patternAddress = -1;
+	job->emuTime = 0.0;
+	job->hostTime = 0.0;
+	for (unsigned i = 3; i < tokens.size(); ++i) {
+		string_view option = tokens[i].getString();
+		unsigned numArgs = (option == "-pattern") ? 2 : 1;
+		if ((i + numArgs) >= tokens.size()) {
+			throw CommandException("Missing argument for option ", option);
+		}
+		if (option == "-cart") {
+			job->rom = tokens[++i].getString().str();
+		} else if (option == "-time") {
+			double t = tokens[++i].getDouble(interp);
+			if (t <= 0.0) {
+				throw CommandException("Time must be positive");
+			}
+			job->duration = EmuDuration(t);
+		} else if (option == "-break") {
+			int addr = tokens[++i].getInt(interp);
+			if ((addr < 0) || (addr > 0xFFFF)) {
+				throw CommandException("Invalid address: ", addr);
+			}
+			job->stopAddress = addr;
+		} else if (option == "-pattern") {
+			int addr = tokens[++i].getInt(interp);
+			const auto& bytes = tokens[++i];
+			unsigned num = bytes.getListLength(interp);
+			if ((addr < 0) || ((addr + num) > 0x10000) || (num == 0)) {
+				throw CommandException("Invalid memory pattern");
+			}
+			job->patternAddress = addr;
+			for (unsigned j = 0; j < num; ++j) {
+				job->pattern.push_back(
+					bytes.getListIndex(interp, j).getInt(interp));
+			}
+		} else {
+			throw CommandException("Unknown option: ", option);
+		}
+	}
+
+	job->board = reactor.createEmptyMotherBoard();
+	try {
+		job->board->loadMachine(tokens[2].getString().str());
+		if (!job->rom.empty()) {
+			job->board->insertExtension("ROM",
+				HardwareConfig::createRomConfig(
+					*job->board, job->rom, "any", {}));
+		}
+	} catch (MSXException& e) {
+		throw CommandException("Couldn't create batch machine: ",
+		                       e.getMessage());
+	}
+	result.setString(job->board->getMachineID());
+	jobs.push_back(std::move(job));
+}
+
+void BatchRunner::run(array_ref<TclObject> tokens, TclObject& result)
+{
+	unsigned numThreads = std::max(1u, std::thread::hardware_concurrency());
+	switch (tokens.size()) {
+	case 2:
+		break;
+	case 4:
+		if (tokens[2].getString() != "-threads") {
+			throw SyntaxError();
+		}
+		numThreads = std::max(1, tokens[3].getInt(batchCommand.getInterpreter()));
+		break;
+	default:
+		throw SyntaxError();
+	}
+	checkRenderer();
+	// Batch machines run in fast-forward mode, that mode silently skips
+	// breakpoints and conditions. Rather than ignoring them, refuse to run.
+	if (MSXCPUInterface::anyBreakPoints()) {
+		throw CommandException(
+			"Batch machines can't run while there are breakpoints "
+			"or conditions, remove them first.");
+	}
+
+	vector<Job*> todo;
+	for (auto& job : jobs) {
+		if (job->stopReason.empty()) todo.push_back(job.get());
+	}
+	if (todo.empty()) return;
+	for (auto* job : todo) {
+		// Watchpoints would execute Tcl callbacks in the worker threads.
+		if (!job->board->getCPUInterface().getWatchPoints().empty()) {
+			throw CommandException(
+				"Batch machines can't have watchpoints.");
+		}
+	}
+	numThreads = std::min<unsigned>(numThreads, todo.size());
+
+	// Everything that touches global state happens here, in the main thread.
+	for (auto* job : todo) {
+		auto& board = *job->board;
+		board.powerUp();
+		board.getRealTime().disable();
+		board.getMSXMixer().mute();
+		board.getCPU().setStopAddress(job->stopAddress);
+		board.getCPU().setBatchMode(true);
+	}
+	auto deliverPending = [&] {
+		for (auto* job : todo) {
+			checked_cast<MSXCliComm&>(job->board->getMSXCliComm()).deliverPending();
+		}
+	};
+
+	auto start = Timer::getTime();
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::atomic<unsigned> next(0);
+	unsigned finished = 0;
+	vector<std::thread> threads;
+	for (unsigned i = 0; i < numThreads; ++i) {
+		threads.emplace_back([&] {
+			Thread::setEmulationThread();
+			while (true) {
+				unsigned n = next++;
+				if (n >= todo.size()) break;
+				runJob(*todo[n]);
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					++finished;
+				}
+				condition.notify_one();
+			}
+		});
+	}
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (finished != todo.size()) {
+			condition.wait_for(lock, std::chrono::milliseconds(100));
+			lock.unlock();
+			deliverPending();
+			lock.lock();
+		}
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+	deliverPending();
+	auto hostTime = (Timer::getTime() - start) / 1000000.0;
+
+	double emuTime = 0.0;
+	for (auto* job : todo) {
+		auto& board = *job->board;
+		board.getCPU().setBatchMode(false);
+		board.getCPU().setStopAddress(-1);
+		board.getMSXMixer().unmute();
+		board.getRealTime().enable();
+		emuTime += job->emuTime;
+		addResult(*job, result);
+	}
+	reactor.getCliComm().printInfo(
+		"Batch run finished: ", unsigned(todo.size()), " machine(s) on ",
+		numThreads, " thread(s), ", emuTime, "s emulated in ",
+		hostTime, "s.");
+}
+
+void BatchRunner::runJob(Job& job)
+{
+	// Called from a worker thread. Only touch the state of this machine and
+	// no settings: those are Tcl objects, which may only be accessed from
+	// the main thread. The CPU uses the setting values that were copied
+	// when it entered batch mode (see MSXCPU::setBatchMode()). The speed
+	// setting isn't read at all because RealTime is disabled.
+	auto& board = *job.board;
+	auto startHost = Timer::getTime();
+	EmuTime start = board.getCurrentTime();
+	EmuTime end = start + job.duration;
+	try {
+		while (true) {
+			EmuTime now = board.getCurrentTime();
+			if (now >= end) {
+				job.stopReason = "time";
+				break;
+			}
+			EmuTime sliceEnd = now + SLICE;
+			if (!board.runBatch(std::min(sliceEnd, end))) {
+				job.stopReason = "breakpoint";
+				break;
+			}
+			if (patternMatches(job)) {
+				job.stopReason = "pattern";
+				break;
+			}
+		}
+	} catch (MSXException& e) {
+		job.stopReason = "error";
+		job.message = e.getMessage();
+	}
+	job.emuTime = (board.getCurrentTime() - start).toDouble();
+	job.hostTime = (Timer::getTime() - startHost) / 1000000.0;
+}
+
+bool BatchRunner::patternMatches(const Job& job)
+{
+	if (job.patternAddress < 0) return false;
+	auto& board = *job.board;
+	auto& cpuInterface = board.getCPUInterface();
+	EmuTime::param time = board.getCurrentTime();
+	for (unsigned i = 0; i < job.pattern.size(); ++i) {
+		if (cpuInterface.peekMem(job.patternAddress + i, time) !=
+		    job.pattern[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void BatchRunner::addResult(const Job& job, TclObject& result)
+{
+	TclObject r;
+	r.addListElement("machine");
+	r.addListElement(job.board->getMachineID());
+	r.addListElement("rom");
+	r.addListElement(job.rom);
+	r.addListElement("stop");
+	r.addListElement(job.stopReason.empty() ? string_view("pending")
+	                                        : string_view(job.stopReason));
+	r.addListElement("emutime");
+	r.addListElement(job.emuTime);
+	r.addListElement("hosttime");
+	r.addListElement(job.hostTime);
+	if (!job.message.empty()) {
+		r.addListElement("message");
+		r.addListElement(job.message);
+	}
+	result.addListElement(r);
+}
+
+void BatchRunner::status(TclObject& result) const
+{
+	for (auto& job : jobs) {
+		addResult(*job, result);
+	}
+}
+
+void BatchRunner::clear()
+{
+	jobs.clear();
+}
+
+
+// class BatchRunner::Cmd
+
+BatchRunner::Cmd::Cmd(CommandController& commandController_)
+	: Command(commandController_, "batch")
+{
+}
+
+void BatchRunner::Cmd::execute(array_ref<TclObject> tokens, TclObject& result)
+{
+	if (tokens.size() < 2) {
+		throw CommandException("Missing argument");
+	}
+	auto& runner = OUTER(BatchRunner, batchCommand);
+	const string_view subcommand = tokens[1].getString();
+	if (subcommand == "add") {
+		runner.add(tokens, result);
+	} else if (subcommand == "run") {
+		runner.run(tokens, result);
+	} else if (subcommand == "status") {
+		if (tokens.size() != 2) throw SyntaxError();
+		runner.status(result);
+	} else if (subcommand == "clear") {
+		if (tokens.size() != 2) throw SyntaxError();
+		runner.clear();
+	} else {
+		throw SyntaxError();
+	}
+}
+
+string BatchRunner::Cmd::help(const vector<string>& /*tokens*/) const
+{
+	return "Run many MSX machines in parallel (headless), e.g. for regression tests.\n"
+	       "batch add <machine> [options]    Create a batch machine, returns its ID\n"
+	       "  -cart <rom>                    Insert the given ROM image\n"
+	       "  -time <seconds>                Stop after this much emulated time (default 60)\n"
+	       "  -break <address>               Stop when the CPU reaches this address\n"
+	       "  -pattern <address> <bytes>     Stop when memory contains this list of bytes\n"
+	       "batch run [-threads <n>]         Run all not yet finished batch machines, by\n"
+	       "                                 default on as many threads as there are cores\n"
+	       "batch status                     Show the results of all batch machines\n"
+	       "batch clear                      Delete all batch machines\n"
+	       "\n"
+	       "The result of 'batch run' and 'batch status' is a list with for each "
+	       "machine the ROM, the reason why it stopped (time, breakpoint, pattern "
+	       "or error) and the emulated and host time it ran.\n"
+	       "Batch machines only work with 'set renderer none'. They run in "
+	       "fast-forward mode, so 'batch run' refuses to start while there "
+	       "are breakpoints, conditions or watchpoints. Tcl callbacks don't "
+	       "trigger for them and setting changes made while they run only "
+	       "take effect afterwards.";
+}
+
+void BatchRunner::Cmd::tabCompletion(vector<string>& tokens) const
+{
+	if (tokens.size() == 2) {
+		static const char* const cmds[] = {
+			"add", "run", "status", "clear",
+		};
+		completeString(tokens, cmds);
+	} else if ((tokens.size() == 3) && (tokens[1] == "add")) {
+		completeString(tokens, Reactor::getHwConfigs("machines"));
+	} else if ((tokens.size() > 3) && (tokens[1] == "add")) {
+		static const char* const options[] = {
+			"-cart", "-time", "-break", "-pattern",
+		};
+		completeFileName(tokens, userFileContext(), options);
+	}
+}
+
+} // namespace openmsx
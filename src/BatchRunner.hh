@@ -0,0 +1,79 @@
+#ifndef BATCHRUNNER_HH
+#define BATCHRUNNER_HH
+
+#include "Command.hh"
+#include "EmuTime.hh"
+#include "array_ref.hh"
+#include "openmsx.hh"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace openmsx {
+
+class Reactor;
+class MSXMotherBoard;
+class TclObject;
+
+/** Runs many MSX machines in parallel, each on its own worker thread.
+ *
+ * This is meant for headless (regression) testing: machines are created with
+ * 'batch add', each with its own stop conditions, and 'batch run' then
+ * advances all of them (in fast-forward mode) on a pool of worker threads.
+ *
+ * While the worker threads are running, the main thread does nothing else
+ * than waiting for them (so no events, no Tcl, no rendering). A worker thread
+ * only touches the state of its own machine. Global side-effects triggered by
+ * the emulation are deferred to the main thread (CliComm messages, LED
+ * settings) or dropped (Tcl callbacks). Breakpoints, watchpoints and
+ * conditions are ignored, like in fast-forward mode. Batch machines can only
+ * be run with the dummy renderer ('set renderer none') and their sound output
+ * stays muted.
+ */
+class BatchRunner
+{
+public:
+	explicit BatchRunner(Reactor& reactor);
+	~BatchRunner();
+
+private:
+	struct Job {
+		std::unique_ptr<MSXMotherBoard> board;
+		std::string rom;
+		EmuDuration duration; // max emulated time
+		int stopAddress;      // -1 when not used
+		int patternAddress;   // -1 when not used
+		std::vector<byte> pattern;
+
+		// results, only valid when 'stopReason' is not empty
+		std::string stopReason;
+		std::string message;
+		double emuTime;
+		double hostTime;
+	};
+
+	void add   (array_ref<TclObject> tokens, TclObject& result);
+	void run   (array_ref<TclObject> tokens, TclObject& result);
+	void status(TclObject& result) const;
+	void clear();
+
+	void checkRenderer() const;
+	static void runJob(Job& job);
+	static bool patternMatches(const Job& job);
+	static void addResult(const Job& job, TclObject& result);
+
+	Reactor& reactor;
+
+	struct Cmd final : Command {
+		explicit Cmd(CommandController& commandController);
+		void execute(array_ref<TclObject> tokens, TclObject& result) override;
+		std::string help(const std::vector<std::string>& tokens) const override;
+		void tabCompletion(std::vector<std::string>& tokens) const override;
+	} batchCommand;
+
+	std::vector<std::unique_ptr<Job>> jobs;
+};
+
+} // namespace openmsx
+
+#endif
@@ -66,6 +66,7 @@ CommandLineParser::CommandLineParser(Reactor& reactor_)
 	registerOption("-setting",    settingOption, PHASE_BEFORE_SETTINGS);
 	registerOption("-control",    controlOption, PHASE_BEFORE_SETTINGS, 1);
 	registerOption("-script",     scriptOption,  PHASE_BEFORE_SETTINGS, 1); // correct phase?
+	registerOption("-batch",      batchOption,   PHASE_BEFORE_SETTINGS, 1);
 	#if COMPONENT_GL
 	registerOption("-nopbo",      noPBOOption,   PHASE_BEFORE_SETTINGS, 1);
 	#endif
@@ -278,7 +279,8 @@ void CommandLineParser::parse(int argc, char** argv)
 
 bool CommandLineParser::isHiddenStartup() const
 {
-	return (parseStatus == CONTROL) || (parseStatus == TEST);
+	return (parseStatus == CONTROL) || (parseStatus == TEST) ||
+	       (parseStatus == BATCH);
 }
 
 CommandLineParser::ParseStatus CommandLineParser::getParseStatus() const
@@ -292,6 +294,11 @@ const CommandLineParser::Scripts& CommandLineParser::getStartupScripts() const
 	return scriptOption.scripts;
 }
 
+const string& CommandLineParser::getBatchScript() const
+{
+	return batchOption.script;
+}
+
 MSXMotherBoard* CommandLineParser::getMotherBoard() const
 {
 	return reactor.getMotherBoard();
@@ -369,6 +376,22 @@ string_view CommandLineParser::ScriptOption::fileTypeHelp() const
 }
 
 
+// class BatchOption
+
+void CommandLineParser::BatchOption::parseOption(
+	const string& option, array_ref<string>& cmdLine)
+{
+	script = getArgument(option, cmdLine);
+	auto& parser = OUTER(CommandLineParser, batchOption);
+	parser.parseStatus = CommandLineParser::BATCH;
+}
+
+string_view CommandLineParser::BatchOption::optionHelp() const
+{
+	return "Run the given script without a window and exit";
+}
+
+
 // Help option
 
 static string formatSet(const vector<string_view>& inputSet, string::size_type columns)
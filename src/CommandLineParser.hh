@@ -31,7 +31,7 @@ class Interpreter;
 class CommandLineParser
 {
 public:
-	enum ParseStatus { UNPARSED, RUN, CONTROL, TEST, EXIT };
+	enum ParseStatus { UNPARSED, RUN, CONTROL, TEST, BATCH, EXIT };
 	enum ParsePhase {
 		PHASE_BEFORE_INIT,       // --help, --version, -bash
 		PHASE_INIT,              // calls Reactor::init()
@@ -53,6 +53,10 @@ public:
 	using Scripts = std::vector<std::string>;
 	const Scripts& getStartupScripts() const;
 
+	/** Script to run in batch mode (only valid if status is BATCH).
+	  */
+	const std::string& getBatchScript() const;
+
 	MSXMotherBoard* getMotherBoard() const;
 	GlobalCommandController& getGlobalCommandController() const;
 	Interpreter& getInterpreter() const;
@@ -106,6 +110,13 @@ private:
 		CommandLineParser::Scripts scripts;
 	} scriptOption;
 
+	struct BatchOption final : CLIOption {
+		void parseOption(const std::string& option, array_ref<std::string>& cmdLine) override;
+		string_view optionHelp() const override;
+
+		std::string script;
+	} batchOption;
+
 	struct MachineOption final : CLIOption {
 		void parseOption(const std::string& option, array_ref<std::string>& cmdLine) override;
 		string_view optionHelp() const override;
@@ -43,6 +43,19 @@ GlobalSettings::GlobalSettings(GlobalCommandController& commandController_)
 			{"hq",   ResampledSoundDevice::RESAMPLE_HQ},
 			{"fast", ResampledSoundDevice::RESAMPLE_LQ},
 			{"blip", ResampledSoundDevice::RESAMPLE_BLIP}})
+	, reverseMemoryBudgetSetting(commandController, "reverse_memory_budget",
+		"maximum amount of memory (in MB) for the reverse history of a "
+		"machine, older snapshots are moved to a temporary file on disk "
+		"when it's exceeded, 0 means no limit", 0, 0, 1024 * 1024)
+	, reverseIntervalSetting(commandController, "reverse_interval",
+		"time (in seconds) between two reverse snapshots", 1.0, 0.1, 60.0)
+	, reverseDenseHistorySetting(commandController, "reverse_dense_history",
+		"all reverse snapshots of this many recent seconds are kept, "
+		"older snapshots are thinned out", 25, 0, 24 * 60 * 60)
+	, reverseCpuBudgetSetting(commandController, "reverse_cpu_budget",
+		"maximum percentage of the time that may be spent on taking "
+		"reverse snapshots, the interval between snapshots grows when "
+		"it's exceeded, 0 means no limit", 0, 0, 100)
 	, throttleManager(commandController)
 {
 	for (auto i : xrange(SDL_NumJoysticks())) {
@@ -4,6 +4,7 @@
 #include "Observer.hh"
 #include "BooleanSetting.hh"
 #include "EnumSetting.hh"
+#include "FloatSetting.hh"
 #include "IntegerSetting.hh"
 #include "StringSetting.hh"
 #include "ThrottleManager.hh"
@@ -50,6 +51,18 @@ public:
 	EnumSetting<ResampledSoundDevice::ResampleType>& getResampleSetting() {
 		return resampleSetting;
 	}
+	IntegerSetting& getReverseMemoryBudgetSetting() {
+		return reverseMemoryBudgetSetting;
+	}
+	FloatSetting& getReverseIntervalSetting() {
+		return reverseIntervalSetting;
+	}
+	IntegerSetting& getReverseDenseHistorySetting() {
+		return reverseDenseHistorySetting;
+	}
+	IntegerSetting& getReverseCpuBudgetSetting() {
+		return reverseCpuBudgetSetting;
+	}
 	IntegerSetting& getJoyDeadzoneSetting(int i) {
 		return *deadzoneSettings[i];
 	}
@@ -71,6 +84,10 @@ private:
 	StringSetting  umrCallBackSetting;
 	StringSetting  invalidPsgDirectionsSetting;
 	EnumSetting<ResampledSoundDevice::ResampleType> resampleSetting;
+	IntegerSetting reverseMemoryBudgetSetting;
+	FloatSetting   reverseIntervalSetting;
+	IntegerSetting reverseDenseHistorySetting;
+	IntegerSetting reverseCpuBudgetSetting;
 	std::vector<std::unique_ptr<IntegerSetting>> deadzoneSettings;
 	ThrottleManager throttleManager;
 };
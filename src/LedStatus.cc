@@ -2,6 +2,7 @@
 #include "MSXCliComm.hh"
 #include "ReadOnlySetting.hh"
 #include "CommandController.hh"
+#include "Thread.hh"
 #include "Timer.hh"
 #include "memory.hh"
 
@@ -41,6 +42,16 @@ void LedStatus::setLed(Led led, bool status)
 	if (ledValue[led] == status) return;
 	ledValue[led] = status;
 
+	if (!Thread::isMainThread()) {
+		// Called from a BatchRunner worker thread. The setting and the
+		// CliComm update can only be done from the main thread, let
+		// executeRT() pick up the new value.
+		if (!isPendingRT()) {
+			scheduleRT(0);
+		}
+		return;
+	}
+
 	// Some MSX programs generate tons of LED events (e.g. New Era uses
 	// the LEDs as a VU meter while playing samples). Without throttling
 	// all these events overload the host CPU. That's why we limit it to
@@ -406,6 +406,18 @@ void MSXDevice::writeIO(word /*port*/, byte /*value*/, EmuTime::param /*time*/)
 	// write to unmapped IO, do nothing
 }
 
+bool MSXDevice::canWriteIOBurst(word /*port*/) const
+{
+	return false;
+}
+
+unsigned MSXDevice::writeIOBurst(word /*port*/, array_ref<byte> /*values*/,
+                                 EmuTime::param /*time*/,
+                                 EmuDuration::param /*interval*/)
+{
+	return 0;
+}
+
 byte MSXDevice::peekIO(word /*port*/, EmuTime::param /*time*/) const
 {
 	return 0xFF;
@@ -432,13 +444,18 @@ void MSXDevice::writeMem(word /*address*/, byte /*value*/,
 byte MSXDevice::peekMem(word address, EmuTime::param /*time*/) const
 {
 	word base = address & CacheLine::HIGH;
+	word offset = address & CacheLine::LOW;
 	if (const byte* cache = getReadCacheLine(base)) {
-		word offset = address & CacheLine::LOW;
 		return cache[offset];
-	} else {
-		// peek not supported for this device
-		return 0xFF;
 	}
+	unsigned uncacheable;
+	if (const byte* cache = getReadCacheSubLines(base, uncacheable)) {
+		if (!(uncacheable & CacheLine::subLineBit(address))) {
+			return cache[offset];
+		}
+	}
+	// peek not supported for this device (or this address)
+	return 0xFF;
 }
 
 void MSXDevice::globalWrite(word /*address*/, byte /*value*/,
@@ -457,6 +474,18 @@ byte* MSXDevice::getWriteCacheLine(word /*start*/) const
 	return nullptr; // uncacheable
 }
 
+const byte* MSXDevice::getReadCacheSubLines(
+	word /*start*/, unsigned& /*uncacheable*/) const
+{
+	return nullptr; // uncacheable
+}
+
+byte* MSXDevice::getWriteCacheSubLines(
+	word /*start*/, unsigned& /*uncacheable*/) const
+{
+	return nullptr; // uncacheable
+}
+
 void MSXDevice::invalidateMemCache(word start, unsigned size)
 {
 	getCPU().invalidateMemCache(start, size);
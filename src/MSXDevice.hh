@@ -5,6 +5,7 @@
 #include "EmuTime.hh"
 #include "openmsx.hh"
 #include "serialize_meta.hh"
+#include "array_ref.hh"
 #include <string>
 #include <vector>
 #include <utility> // for pair
@@ -119,6 +120,26 @@ public:
 	 */
 	virtual void writeIO(word port, byte value, EmuTime::param time);
 
+	/**
+	 * Can writeIOBurst() be used for the given IO port right now?
+	 * The default implementation returns false.
+	 */
+	virtual bool canWriteIOBurst(word port) const;
+
+	/**
+	 * Write a sequence of bytes to a given IO port. Byte 'i' is written
+	 * at time 'time + i * interval', like a series of writeIO() calls
+	 * (e.g. from an OTIR instruction) would do. The device may stop
+	 * early, for example when the writes would pass a sync point of
+	 * another device. It returns the number of bytes that were written,
+	 * the caller must write the remaining bytes in the normal way.
+	 * Only called when canWriteIOBurst() returned true for this port.
+	 * The default implementation writes nothing (returns 0).
+	 */
+	virtual unsigned writeIOBurst(word port, array_ref<byte> values,
+	                              EmuTime::param time,
+	                              EmuDuration::param interval);
+
 	/**
 	 * Read a byte from a given IO port. Reading via this method has no
 	 * side effects (doesn't change the device status). If save reading
@@ -172,6 +193,26 @@ public:
 	 */
 	virtual byte* getWriteCacheLine(word start) const;
 
+	/**
+	 * Finer grained variant of getReadCacheLine(), for cache lines in
+	 * which only a few addresses have side effects (e.g. a memory mapped
+	 * register at the end of a ROM block). Only called for lines for
+	 * which getReadCacheLine() returned a null pointer.
+	 * Returns a pointer like getReadCacheLine() does, and sets in
+	 * 'uncacheable' the bits of the sub-lines (CacheLine::SUB_SIZE
+	 * bytes, see CacheLine::subLineMask()) that must still be read via
+	 * readMem(). The pointer is never used for those sub-lines.
+	 * The default implementation returns a null pointer (the whole line
+	 * is uncacheable).
+	 */
+	virtual const byte* getReadCacheSubLines(word start, unsigned& uncacheable) const;
+
+	/**
+	 * Like getReadCacheSubLines(), but for writing.
+	 * @see getWriteCacheLine()
+	 */
+	virtual byte* getWriteCacheSubLines(word start, unsigned& uncacheable) const;
+
 	/**
 	 * Read a byte from a given memory location. Reading memory
 	 * via this method has no side effects (doesn't change the
@@ -146,6 +146,7 @@ class FastForwardHelper final : private Schedulable
 public:
 	explicit FastForwardHelper(MSXMotherBoard& msxMotherBoardImpl);
 	void setTarget(EmuTime::param targetTime);
+	void cancel();
 private:
 	void executeUntil(EmuTime::param time) override;
 	MSXMotherBoard& motherBoard;
@@ -518,6 +519,25 @@ void MSXMotherBoard::fastForward(EmuTime::param time, bool fast)
 	msxMixer->unmute();
 }
 
+bool MSXMotherBoard::runBatch(EmuTime::param time)
+{
+	assert(powered);
+	assert(getMachineConfig());
+
+	if (time <= getCurrentTime()) return true;
+
+	ScopedAssign<bool> sa(fastForwarding, true);
+	fastForwardHelper->setTarget(time);
+	while (time > getCurrentTime()) {
+		getCPU().execute(true); // fast-forward mode
+		if (getCPU().isStopAddressReached()) {
+			fastForwardHelper->cancel();
+			return false;
+		}
+	}
+	return true;
+}
+
 void MSXMotherBoard::pause()
 {
 	if (getMachineConfig()) {
@@ -1009,6 +1029,11 @@ void FastForwardHelper::setTarget(EmuTime::param targetTime)
 	setSyncPoint(targetTime);
 }
 
+void FastForwardHelper::cancel()
+{
+	removeSyncPoint();
+}
+
 void FastForwardHelper::executeUntil(EmuTime::param /*time*/)
 {
 	motherBoard.exitCPULoopSync();
@@ -79,6 +79,16 @@ public:
 	 */
 	void fastForward(EmuTime::param time, bool fast);
 
+	/** Run emulation in fast-forward mode until a certain time, or until
+	 * the CPU reaches its stop address (see MSXCPU::setStopAddress()).
+	 * Unlike fastForward() this doesn't touch any state that is shared
+	 * with other machines, so BatchRunner can call it from a worker
+	 * thread. The caller must disable RealTime and mute the MSXMixer
+	 * (both from the main thread) before the first call.
+	 * @return False iff the stop address was reached.
+	 */
+	bool runBatch(EmuTime::param time);
+
 	/** See CPU::exitCPULoopAsync(). */
 	void exitCPULoopAsync();
 	void exitCPULoopSync();
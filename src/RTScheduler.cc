@@ -17,6 +17,7 @@ struct EqualRTSchedulable {
 
 void RTScheduler::add(uint64_t delta, RTSchedulable& schedulable)
 {
+	std::lock_guard<std::mutex> lock(mutex);
 	queue.insert(RTSyncPoint{Timer::getTime() + delta, &schedulable},
 	             [](RTSyncPoint& sp) {
                              sp.time = std::numeric_limits<uint64_t>::max(); },
@@ -26,11 +27,13 @@ void RTScheduler::add(uint64_t delta, RTSchedulable& schedulable)
 
 bool RTScheduler::remove(RTSchedulable& schedulable)
 {
+	std::lock_guard<std::mutex> lock(mutex);
 	return queue.remove(EqualRTSchedulable(schedulable));
 }
 
 bool RTScheduler::isPending(const RTSchedulable& schedulable) const
 {
+	std::lock_guard<std::mutex> lock(mutex);
 	return std::find_if(std::begin(queue), std::end(queue),
 	                    EqualRTSchedulable(schedulable)) != std::end(queue);
 }
@@ -40,12 +43,15 @@ void RTScheduler::scheduleHelper(uint64_t limit)
 	// Process at most this many events to prevent getting stuck in an
 	// infinite loop when a RTSchedulable keeps on rescheduling itself in
 	// the (too) near future.
+	std::unique_lock<std::mutex> lock(mutex);
 	auto count = queue.size();
 	while (true) {
 		auto* schedulable = queue.front().schedulable;
 		queue.remove_front();
 
+		lock.unlock();
 		schedulable->executeRT();
+		lock.lock();
 
 		// It's possible RTSchedulables are canceled in the mean time,
 		// so we can't rely on 'count' to replace this empty check.
@@ -5,6 +5,7 @@
 #include "Timer.hh"
 #include "likely.hh"
 #include <cstdint>
+#include <mutex>
 
 namespace openmsx {
 
@@ -19,7 +20,13 @@ struct RTSyncPoint
 class RTScheduler
 {
 public:
-	/** Execute all expired RTSchedulables. */
+	/** Execute all expired RTSchedulables.
+	  * Must be called from the main thread. RTSchedulables can be
+	  * (un)scheduled from any thread, but this method doesn't take the
+	  * lock on its fast path. That's fine because the only other threads
+	  * that use this class are BatchRunner worker threads, and the main
+	  * thread doesn't call execute() while those are running.
+	  */
 	inline void execute()
 	{
 		auto limit = Timer::getTime();
@@ -39,6 +46,7 @@ private:
 	void scheduleHelper(uint64_t limit);
 
 	SchedulerQueue<RTSyncPoint> queue;
+	mutable std::mutex mutex; // protects 'queue'
 };
 
 } // namespace openmsx
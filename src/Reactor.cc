@@ -23,6 +23,7 @@
 #include "Display.hh"
 #include "Mixer.hh"
 #include "AviRecorder.hh"
+#include "BatchRunner.hh"
 #include "GlobalSettings.hh"
 #include "BooleanSetting.hh"
 #include "EnumSetting.hh"
@@ -33,6 +34,7 @@
 #include "FileContext.hh"
 #include "FileException.hh"
 #include "FileOperations.hh"
+#include "LocalFileReference.hh"
 #include "ReadDir.hh"
 #include "Thread.hh"
 #include "Timer.hh"
@@ -229,6 +231,7 @@ void Reactor::init()
 	restoreMachineCommand = make_unique<RestoreMachineCommand>(
 		*globalCommandController, *this);
 	aviRecordCommand = make_unique<AviRecorder>(*this);
+	batchRunner = make_unique<BatchRunner>(*this);
 	extensionInfo = make_unique<ConfigInfo>(
 		getOpenMSXInfoCommand(), "extensions");
 	machineInfo   = make_unique<ConfigInfo>(
@@ -251,6 +254,7 @@ void Reactor::init()
 Reactor::~Reactor()
 {
 	if (!isInit) return;
+	batchRunner.reset(); // deletes the batch machines
 	deleteBoard(activeBoard);
 
 	eventDistributor->unregisterEventListener(OPENMSX_QUIT_EVENT, *this);
@@ -515,6 +519,19 @@ void Reactor::run(CommandLineParser& parser)
 		}
 	}
 
+	// In batch mode the script does all the work (typically using the
+	// 'batch' command), there's no main loop.
+	if (parser.getParseStatus() == CommandLineParser::BATCH) {
+		try {
+			LocalFileReference file(
+				userFileContext().resolve(parser.getBatchScript()));
+			getInterpreter().executeFile(file.getFilename());
+		} catch (MSXException& e) {
+			throw FatalError("Batch script failed: ", e.getMessage());
+		}
+		return;
+	}
+
 	// At this point openmsx is fully started, it's OK now to start
 	// accepting external commands
 	getGlobalCliComm().setAllowExternalCommands();
@@ -876,39 +893,63 @@ StoreMachineCommand::StoreMachineCommand(
 
 void StoreMachineCommand::execute(array_ref<TclObject> tokens, TclObject& result)
 {
+	// By default savestates use the (fast) binary format, the XML format
+	// can be loaded on any platform.
+	bool xml = false;
+	vector<string_view> arguments;
+	for (size_t i = 1; i < tokens.size(); ++i) {
+		string_view arg = tokens[i].getString();
+		if (arg == "-xml") {
+			xml = true;
+		} else {
+			arguments.push_back(arg);
+		}
+	}
+
 	string filename;
 	string_view machineID;
-	switch (tokens.size()) {
-	case 1:
+	switch (arguments.size()) {
+	case 0:
 		machineID = reactor.getMachineID();
-		filename = FileOperations::getNextNumberedFileName("savestates", "openmsxstate", ".xml.gz");
 		break;
-	case 2:
-		machineID = tokens[1].getString();
-		filename = FileOperations::getNextNumberedFileName("savestates", "openmsxstate", ".xml.gz");
+	case 1:
+		machineID = arguments[0];
 		break;
-	case 3:
-		machineID = tokens[1].getString();
-		filename = tokens[2].getString().str();
+	case 2:
+		machineID = arguments[0];
+		filename = arguments[1].str();
 		break;
 	default:
 		throw SyntaxError();
 	}
+	if (filename.empty()) {
+		filename = FileOperations::getNextNumberedFileName(
+			"savestates", "openmsxstate", xml ? ".xml.gz" : ".oms");
+	}
 
 	auto& board = reactor.getMachine(machineID);
 
-	XmlOutputArchive out(filename);
-	out.serialize("machine", board);
+	if (xml) {
+		XmlOutputArchive out(filename);
+		out.serialize("machine", board);
+	} else {
+		BinOutputArchive out(filename);
+		out.serialize("machine", board);
+		out.close();
+	}
 	result.setString(filename);
 }
 
 string StoreMachineCommand::help(const vector<string>& /*tokens*/) const
 {
 	return
-		"store_machine                       Save state of current machine to file \"openmsxNNNN.xml.gz\"\n"
-		"store_machine machineID             Save state of machine \"machineID\" to file \"openmsxNNNN.xml.gz\"\n"
+		"store_machine                       Save state of current machine to file \"openmsxNNNN.oms\"\n"
+		"store_machine machineID             Save state of machine \"machineID\" to file \"openmsxNNNN.oms\"\n"
                 "store_machine machineID <filename>  Save state of machine \"machineID\" to indicated file\n"
 		"\n"
+		"With the -xml option the state is saved in the (portable) XML format,\n"
+		"by default a (faster) binary format is used.\n"
+		"\n"
 		"This is a low-level command, the 'savestate' script is easier to use.";
 }
 
@@ -966,8 +1007,13 @@ void RestoreMachineCommand::execute(array_ref<TclObject> tokens,
 
 	//std::cerr << "Loading " << filename << std::endl;
 	try {
-		XmlInputArchive in(filename);
-		in.serialize("machine", *newBoard);
+		if (BinInputArchive::isBinArchive(filename)) {
+			BinInputArchive in(filename);
+			in.serialize("machine", *newBoard);
+		} else {
+			XmlInputArchive in(filename);
+			in.serialize("machine", *newBoard);
+		}
 	} catch (XMLException& e) {
 		throw CommandException("Cannot load state, bad file format: ",
 		                       e.getMessage());
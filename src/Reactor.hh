@@ -48,6 +48,7 @@ class ActivateMachineCommand;
 class StoreMachineCommand;
 class RestoreMachineCommand;
 class AviRecorder;
+class BatchRunner;
 class ConfigInfo;
 class RealTimeInfo;
 template <typename T> class EnumSetting;
@@ -164,6 +165,7 @@ private:
 	std::unique_ptr<StoreMachineCommand> storeMachineCommand;
 	std::unique_ptr<RestoreMachineCommand> restoreMachineCommand;
 	std::unique_ptr<AviRecorder> aviRecordCommand;
+	std::unique_ptr<BatchRunner> batchRunner;
 	std::unique_ptr<ConfigInfo> extensionInfo;
 	std::unique_ptr<ConfigInfo> machineInfo;
 	std::unique_ptr<RealTimeInfo> realTimeInfo;
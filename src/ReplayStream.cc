@@ -0,0 +1,367 @@
+#include "ReplayStream.hh"
+#include "FileException.hh"
+#include "MSXException.hh"
+#include "MemBuffer.hh"
+#include "endian.hh"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <zlib.h>
+
+namespace openmsx {
+namespace ReplayStream {
+
+// File header: magic + format version.
+static const char HEADER_MAGIC[12] = {
+	'o', 'p', 'e', 'n', 'M', 'S', 'X', '-', 'r', 'p', 'l', 'y' };
+static const uint32_t FORMAT_VERSION = 1;
+static const size_t HEADER_SIZE = 16;
+
+// Record header: type, reserved, storedSize, rawSize, time, eventCount, num.
+static const size_t RECORD_HEADER_SIZE = 2 * 4 + 5 * 8;
+
+// Upper limit for the uncompressed size of a record, so that a corrupt file
+// can't make us allocate huge amounts of memory. Keyframes are by far the
+// largest records, typically a few MB.
+static const uint64_t MAX_RAW_SIZE = 1024 * 1024 * 1024;
+// zlib never compresses better than this.
+static const uint64_t MAX_COMPRESSION_RATIO = 1032;
+
+// Trailer: position of the INDEX record + magic.
+static const char TRAILER_MAGIC[8] = { 'r', 'p', 'l', 'y', 'I', 'd', 'x', '1' };
+static const size_t TRAILER_SIZE = 16;
+
+static void encodeRecordHeader(const Record& r, uint8_t* p)
+{
+	Endian::write_UA_L32(p +  0, r.type);
+	Endian::write_UA_L32(p +  4, 0);
+	Endian::write_UA_L64(p +  8, r.storedSize);
+	Endian::write_UA_L64(p + 16, r.rawSize);
+	Endian::write_UA_L64(p + 24, r.time);
+	Endian::write_UA_L64(p + 32, r.eventCount);
+	Endian::write_UA_L64(p + 40, r.num);
+}
+
+static Record decodeRecordHeader(const uint8_t* p, uint64_t offset)
+{
+	Record r;
+	r.type       = Endian::read_UA_L32(p +  0);
+	r.offset     = offset;
+	r.storedSize = Endian::read_UA_L64(p +  8);
+	r.rawSize    = Endian::read_UA_L64(p + 16);
+	r.time       = Endian::read_UA_L64(p + 24);
+	r.eventCount = Endian::read_UA_L64(p + 32);
+	r.num        = Endian::read_UA_L64(p + 40);
+	return r;
+}
+
+void Index::add(const Record& record)
+{
+	auto truncateEvents = [&](uint64_t count) {
+		while (!events.empty() && (events.back().eventCount >= count)) {
+			events.pop_back();
+		}
+		if (!events.empty()) {
+			auto& last = events.back();
+			last.num = std::min(last.num, count - last.eventCount);
+		}
+	};
+	switch (record.type) {
+	case KEYFRAME:
+		keyframes.push_back(record);
+		break;
+	case EVENTS:
+		if (record.eventCount > numEvents()) {
+			throw MSXException("Corrupt replay file: missing events");
+		}
+		// A batch that starts before the end replaces the old events
+		// (e.g. the complete event log that's written when the
+		// recording is finished).
+		truncateEvents(record.eventCount);
+		events.push_back(record);
+		break;
+	case TRUNCATE:
+		truncateEvents(record.eventCount);
+		keyframes.erase(std::remove_if(keyframes.begin(), keyframes.end(),
+			[&](const Record& k) {
+				return (k.time > record.time) ||
+				       (k.eventCount > record.eventCount);
+			}), keyframes.end());
+		break;
+	default:
+		// ignore unknown records (and INDEX)
+		break;
+	}
+}
+
+uint64_t Index::numEvents() const
+{
+	if (events.empty()) return 0;
+	return events.back().eventCount + events.back().num;
+}
+
+bool isReplayStream(const std::string& filename)
+{
+	try {
+		File file(filename, "rb");
+		if (file.getSize() < HEADER_SIZE) return false;
+		char magic[sizeof(HEADER_MAGIC)];
+		file.read(magic, sizeof(magic));
+		return memcmp(magic, HEADER_MAGIC, sizeof(magic)) == 0;
+	} catch (FileException&) {
+		return false;
+	}
+}
+
+} // namespace ReplayStream
+
+using namespace ReplayStream;
+
+
+// class ReplayStreamWriter
+
+ReplayStreamWriter::ReplayStreamWriter(const std::string& filename_)
+	: filename(filename_)
+	, file(filename, "wb")
+	, end(HEADER_SIZE)
+	, writer(1)
+{
+	uint8_t header[HEADER_SIZE];
+	memcpy(header, HEADER_MAGIC, sizeof(HEADER_MAGIC));
+	Endian::write_UA_L32(header + 12, FORMAT_VERSION);
+	file.write(header, sizeof(header));
+	file.flush();
+}
+
+Record ReplayStreamWriter::write(Record record, string_view payload)
+{
+	assert(file.is_open());
+	auto dstLen = uLongf(compressBound(uLong(payload.size())));
+	MemBuffer<uint8_t> buf(RECORD_HEADER_SIZE + dstLen);
+	if (compress2(buf.data() + RECORD_HEADER_SIZE, &dstLen,
+	              reinterpret_cast<const Bytef*>(payload.data()),
+	              uLong(payload.size()), 6) != Z_OK) {
+		throw FileException("Error while compressing replay data");
+	}
+	record.offset = end;
+	record.storedSize = dstLen;
+	record.rawSize = payload.size();
+	encodeRecordHeader(record, buf.data());
+
+	// Flush after each record, so that little is lost after a crash.
+	file.write(buf.data(), RECORD_HEADER_SIZE + dstLen);
+	file.flush();
+	end += RECORD_HEADER_SIZE + dstLen;
+	index.add(record);
+	return record;
+}
+
+// Wait till all keyframes are written and rethrow their error (if any).
+void ReplayStreamWriter::wait()
+{
+	writer.wait();
+	if (!error.empty()) {
+		throw FileException(error);
+	}
+}
+
+const Index& ReplayStreamWriter::getIndex()
+{
+	wait();
+	return index;
+}
+
+void ReplayStreamWriter::addKeyframe(
+	EmuTime::param time, uint64_t eventCount, std::string xml)
+{
+	// Records must be written in order, so all methods first wait for
+	// the pending keyframe. That one was started at least one snapshot
+	// interval ago, so normally this doesn't block.
+	wait();
+	Record record{KEYFRAME, 0, 0, 0, toTicks(time), eventCount, 0};
+	auto payload = std::make_shared<std::string>(std::move(xml));
+	writer.add([this, record, payload] {
+		try {
+			write(record, *payload);
+		} catch (MSXException& e) {
+			error = e.getMessage();
+		}
+	});
+}
+
+void ReplayStreamWriter::addEvents(
+	EmuTime::param time, uint64_t first, uint64_t num, string_view xml)
+{
+	wait();
+	write(Record{EVENTS, 0, 0, 0, toTicks(time), first, num}, xml);
+}
+
+void ReplayStreamWriter::truncate(EmuTime::param time, uint64_t eventCount)
+{
+	wait();
+	if (eventCount >= index.numEvents()) {
+		// Only drop keyframes, but those are never in the future.
+		if (index.keyframes.empty() ||
+		    (index.keyframes.back().time <= toTicks(time))) {
+			return;
+		}
+	}
+	write(Record{TRUNCATE, 0, 0, 0, toTicks(time), eventCount, 0}, {});
+}
+
+void ReplayStreamWriter::finish(EmuTime::param currentTime, unsigned reRecordCount)
+{
+	wait();
+	// payload: currentTime, reRecordCount, number of records, records
+	std::vector<const Record*> records;
+	for (auto& r : index.keyframes) records.push_back(&r);
+	for (auto& r : index.events)    records.push_back(&r);
+	const size_t ENTRY_SIZE = 8 + RECORD_HEADER_SIZE;
+	std::string payload(3 * 8 + records.size() * ENTRY_SIZE, '\0');
+	auto* p = reinterpret_cast<uint8_t*>(&payload[0]);
+	Endian::write_UA_L64(p +  0, toTicks(currentTime));
+	Endian::write_UA_L64(p +  8, reRecordCount);
+	Endian::write_UA_L64(p + 16, records.size());
+	p += 3 * 8;
+	for (auto* r : records) {
+		Endian::write_UA_L64(p, r->offset);
+		encodeRecordHeader(*r, p + 8);
+		p += ENTRY_SIZE;
+	}
+	auto indexRecord = write(Record{INDEX, 0, 0, 0, toTicks(currentTime), 0, 0},
+	                         payload);
+
+	uint8_t trailer[TRAILER_SIZE];
+	Endian::write_UA_L64(trailer, indexRecord.offset);
+	memcpy(trailer + 8, TRAILER_MAGIC, sizeof(TRAILER_MAGIC));
+	file.write(trailer, sizeof(trailer));
+	file.close();
+}
+
+
+// class ReplayStreamReader
+
+ReplayStreamReader::ReplayStreamReader(const std::string& filename_)
+	: filename(filename_)
+	, file(filename, "rb")
+	, fileSize(file.getSize())
+	, currentTime(0)
+	, reRecordCount(0)
+	, finished(false)
+{
+	uint8_t header[HEADER_SIZE];
+	if (fileSize < HEADER_SIZE) {
+		throw MSXException("Not a replay file");
+	}
+	file.read(header, sizeof(header));
+	if (memcmp(header, HEADER_MAGIC, sizeof(HEADER_MAGIC)) != 0) {
+		throw MSXException("Not a replay file");
+	}
+	if (Endian::read_UA_L32(header + 12) > FORMAT_VERSION) {
+		throw MSXException("Replay file was made by a newer openMSX version");
+	}
+	if (!readIndex()) {
+		// the recording wasn't finished properly
+		index = Index();
+		scan();
+	}
+}
+
+// Does the record lie completely within the file, and are its sizes sane?
+// These values come from the file, so check for overflow.
+bool ReplayStreamReader::validRecord(const Record& record) const
+{
+	if ((record.offset < HEADER_SIZE) ||
+	    (record.offset > fileSize) ||
+	    ((fileSize - record.offset) < RECORD_HEADER_SIZE)) {
+		return false;
+	}
+	uint64_t remaining = fileSize - record.offset - RECORD_HEADER_SIZE;
+	return (record.storedSize <= remaining) &&
+	       (record.rawSize <= MAX_RAW_SIZE) &&
+	       (record.rawSize <= (record.storedSize * MAX_COMPRESSION_RATIO + 64));
+}
+
+bool ReplayStreamReader::readIndex()
+{
+	uint64_t size = fileSize;
+	if (size < (HEADER_SIZE + RECORD_HEADER_SIZE + TRAILER_SIZE)) return false;
+	uint8_t trailer[TRAILER_SIZE];
+	file.seek(size - TRAILER_SIZE);
+	file.read(trailer, sizeof(trailer));
+	if (memcmp(trailer + 8, TRAILER_MAGIC, sizeof(TRAILER_MAGIC)) != 0) {
+		return false;
+	}
+	uint64_t offset = Endian::read_UA_L64(trailer);
+	if ((offset < HEADER_SIZE) || (offset > (size - TRAILER_SIZE - RECORD_HEADER_SIZE))) {
+		return false;
+	}
+	uint8_t buf[RECORD_HEADER_SIZE];
+	file.seek(offset);
+	file.read(buf, sizeof(buf));
+	auto record = decodeRecordHeader(buf, offset);
+	if ((record.type != INDEX) || !validRecord(record)) return false;
+
+	auto payload = read(record);
+	const size_t ENTRY_SIZE = 8 + RECORD_HEADER_SIZE;
+	if (payload.size() < 3 * 8) return false;
+	auto* p = reinterpret_cast<const uint8_t*>(payload.data());
+	currentTime   = Endian::read_UA_L64(p + 0);
+	reRecordCount = unsigned(Endian::read_UA_L64(p + 8));
+	uint64_t num  = Endian::read_UA_L64(p + 16);
+	if (num != ((payload.size() - 3 * 8) / ENTRY_SIZE)) return false;
+	if (payload.size() != (3 * 8 + num * ENTRY_SIZE)) return false;
+	p += 3 * 8;
+	for (uint64_t i = 0; i < num; ++i) {
+		auto entry = decodeRecordHeader(p + 8, Endian::read_UA_L64(p));
+		if (!validRecord(entry)) return false;
+		index.add(entry);
+		p += ENTRY_SIZE;
+	}
+	finished = true;
+	return true;
+}
+
+void ReplayStreamReader::scan()
+{
+	uint64_t offset = HEADER_SIZE;
+	while ((fileSize - offset) >= RECORD_HEADER_SIZE) {
+		uint8_t buf[RECORD_HEADER_SIZE];
+		file.seek(offset);
+		file.read(buf, sizeof(buf));
+		auto record = decodeRecordHeader(buf, offset);
+		// incomplete (or corrupt) record at the end
+		if (!validRecord(record)) break;
+		index.add(record);
+		offset += RECORD_HEADER_SIZE + record.storedSize;
+	}
+}
+
+bool ReplayStreamReader::getInfo(EmuTime& currentTime_, unsigned& reRecordCount_) const
+{
+	if (!finished) return false;
+	currentTime_ = EmuTime::zero + EmuDuration(currentTime);
+	reRecordCount_ = reRecordCount;
+	return true;
+}
+
+std::string ReplayStreamReader::read(const Record& record)
+{
+	if (!validRecord(record)) {
+		throw MSXException("Corrupt replay file: ", filename);
+	}
+	MemBuffer<uint8_t> buf(record.storedSize);
+	file.seek(record.offset + RECORD_HEADER_SIZE);
+	file.read(buf.data(), record.storedSize);
+
+	std::string result(record.rawSize, '\0');
+	auto dstLen = uLongf(record.rawSize);
+	if ((uncompress(reinterpret_cast<Bytef*>(&result[0]), &dstLen,
+	                buf.data(), uLong(record.storedSize)) != Z_OK) ||
+	    (dstLen != record.rawSize)) {
+		throw MSXException("Corrupt replay file: ", filename);
+	}
+	return result;
+}
+
+} // namespace openmsx
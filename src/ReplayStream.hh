@@ -0,0 +1,148 @@
+#ifndef REPLAYSTREAM_HH
+#define REPLAYSTREAM_HH
+
+#include "File.hh"
+#include "EmuTime.hh"
+#include "ThreadPool.hh"
+#include "string_view.hh"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace openmsx {
+
+/** Container format for replays that are written while they are recorded.
+  *
+  * Unlike the XML replay format (see ReverseManager::saveReplay()) the file
+  * is a sequence of independent records that is only ever appended to:
+  *  - KEYFRAME: a (XML) savestate of the machine
+  *  - EVENTS:   a batch of consecutive recorded events (XML)
+  *  - TRUNCATE: all events and keyframes after a certain point in time are
+  *              no longer valid (the user changed history during a replay)
+  *  - INDEX:    the list of all valid records, written when the recording
+  *              is finished, so that loading doesn't need to scan the file
+  * The payload of each record is zlib compressed. When the recording was
+  * finished properly, the last 16 bytes of the file contain the position of
+  * the INDEX record. Otherwise (e.g. after a crash) the index is rebuilt by
+  * scanning all records. Loading a keyframe only requires a single read.
+  *
+  * All integers are stored in little endian format.
+  */
+namespace ReplayStream {
+
+	enum RecordType : uint32_t {
+		KEYFRAME = 1,
+		EVENTS   = 2,
+		TRUNCATE = 3,
+		INDEX    = 4,
+	};
+
+	struct Record {
+		uint32_t type;
+		uint64_t offset;     // position of the record in the file
+		uint64_t storedSize; // size of the (compressed) payload
+		uint64_t rawSize;    // size of the uncompressed payload
+		uint64_t time;       // EmuTime, in ticks since EmuTime::zero
+		uint64_t eventCount; // KEYFRAME: number of events before it
+		                     // EVENTS:   index of the first event
+		                     // TRUNCATE: number of remaining events
+		uint64_t num;        // EVENTS:   number of events in the batch
+
+		EmuTime getTime() const { return EmuTime::zero + EmuDuration(time); }
+	};
+
+	/** The valid keyframes and event batches, in order. */
+	struct Index {
+		/** Process a new record. */
+		void add(const Record& record);
+		/** Total number of events. */
+		uint64_t numEvents() const;
+
+		std::vector<Record> keyframes;
+		std::vector<Record> events;
+	};
+
+	/** Is the given file in this format? */
+	bool isReplayStream(const std::string& filename);
+
+	/** Convert an EmuTime for use in a Record. */
+	inline uint64_t toTicks(EmuTime::param time)
+	{
+		return (time - EmuTime::zero).length();
+	}
+
+} // namespace ReplayStream
+
+
+class ReplayStreamWriter
+{
+public:
+	/** @throws FileException */
+	explicit ReplayStreamWriter(const std::string& filename);
+
+	const std::string& getFilename() const { return filename; }
+
+	/** All methods below throw FileException on error. Keyframes are
+	  * compressed and written in a background thread, an error while
+	  * doing that is thrown by the next call. */
+	const ReplayStream::Index& getIndex();
+	void addKeyframe(EmuTime::param time, uint64_t eventCount, std::string xml);
+	void addEvents(EmuTime::param time, uint64_t first, uint64_t num,
+	               string_view xml);
+	void truncate(EmuTime::param time, uint64_t eventCount);
+
+	/** Write the index, afterwards no more records can be added. */
+	void finish(EmuTime::param currentTime, unsigned reRecordCount);
+
+private:
+	ReplayStream::Record write(ReplayStream::Record record, string_view payload);
+	void wait();
+
+	std::string filename;
+	File file;
+	ReplayStream::Index index;
+	uint64_t end;
+	std::string error; // of a keyframe written in the background
+
+	// Writes the keyframes. The members above may only be used from the
+	// calling thread after wait(). Must be declared last, so that it's
+	// destroyed first (this finishes the pending writes).
+	ThreadPool writer;
+};
+
+
+class ReplayStreamReader
+{
+public:
+	/** @throws MSXException */
+	explicit ReplayStreamReader(const std::string& filename);
+
+	const ReplayStream::Index& getIndex() const { return index; }
+
+	/** Only known when the recording was finished properly, otherwise
+	  * returns false. */
+	bool getInfo(EmuTime& currentTime, unsigned& reRecordCount) const;
+
+	/** Read the (uncompressed) payload of a record.
+	  * @throws MSXException */
+	std::string read(const ReplayStream::Record& record);
+
+	const std::string& getFilename() const { return filename; }
+
+private:
+	bool validRecord(const ReplayStream::Record& record) const;
+	bool readIndex();
+	void scan();
+
+	std::string filename;
+	File file;
+	uint64_t fileSize;
+	ReplayStream::Index index;
+	uint64_t currentTime;
+	unsigned reRecordCount;
+	bool finished;
+};
+
+} // namespace openmsx
+
+#endif
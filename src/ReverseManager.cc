@@ -8,6 +8,7 @@
 #include "MSXMixer.hh"
 #include "MSXCommandController.hh"
 #include "XMLException.hh"
+#include "XMLLoader.hh"
 #include "TclObject.hh"
 #include "FileOperations.hh"
 #include "FileContext.hh"
@@ -16,15 +17,21 @@
 #include "CliComm.hh"
 #include "Display.hh"
 #include "Reactor.hh"
+#include "GlobalSettings.hh"
 #include "CommandException.hh"
 #include "MemBuffer.hh"
+#include "Math.hh"
 #include "serialize.hh"
 #include "serialize_stl.hh"
+#include "memory.hh"
 #include "xrange.hh"
 #include <cassert>
 #include <cmath>
+#include <cstring>
 #include <functional>
 #include <iomanip>
+#include <iterator>
+#include <unordered_set>
 
 using std::string;
 using std::vector;
@@ -33,8 +40,17 @@ using std::move;
 
 namespace openmsx {
 
-// Time between two snapshots (in seconds)
-static const double SNAPSHOT_PERIOD = 1.0;
+// Resolution of the snapshot sequence numbers (in seconds). Must be smaller
+// than the minimal value of the reverse_interval setting.
+static const double SEQ_NUM_UNIT = 0.01;
+
+// Outside the dense part of the history, the minimal distance between two
+// snapshots is about their age (beyond the dense part) divided by this factor.
+static const double THINNING_FACTOR = 16.0;
+
+// Upper limit for the interval between snapshots when it's adapted to the
+// reverse_cpu_budget setting (in seconds).
+static const double MAX_ADAPTIVE_INTERVAL = 60.0;
 
 // Max number of snapshots in a replay file
 static const unsigned MAX_NOF_SNAPSHOTS = 10;
@@ -45,6 +61,9 @@ static const EmuDuration MIN_PARTITION_LENGTH = EmuDuration(60.0);
 // Max distance of one before last snapshot before the end time in replay file (in seconds)
 static const EmuDuration MAX_DIST_1_BEFORE_LAST_SNAPSHOT = EmuDuration(30.0);
 
+// Min distance between snapshots in a streamed replay file (in seconds)
+static const EmuDuration KEYFRAME_PERIOD = EmuDuration(60.0);
+
 static const char* const REPLAY_DIR = "replays";
 
 // A replay is a struct that contains a vector of motherboards and an MSX event
@@ -105,6 +124,13 @@ void ReverseManager::ReverseHistory::swap(ReverseHistory& other)
 {
 	std::swap(chunks, other.chunks);
 	std::swap(events, other.events);
+	std::swap(spillFile, other.spillFile);
+	std::swap(pendingSpills, other.pendingSpills);
+	std::swap(spillFailed, other.spillFailed);
+	std::swap(replayFile, other.replayFile);
+	std::swap(stream, other.stream);
+	std::swap(streamedEvents, other.streamedEvents);
+	std::swap(lastKeyframe, other.lastKeyframe);
 }
 
 void ReverseManager::ReverseHistory::clear()
@@ -112,6 +138,76 @@ void ReverseManager::ReverseHistory::clear()
 	// clear() and free storage capacity
 	Chunks().swap(chunks);
 	Events().swap(events);
+	pendingSpills.clear();
+	spillFile.reset(); // after the chunks, finishes the pending writes
+	spillFailed = false;
+	replayFile.reset();
+	stream.reset();
+	streamedEvents = 0;
+}
+
+// Memory used by the snapshots that are not spilled. Delta blocks that are
+// shared between snapshots are only counted once.
+size_t ReverseManager::ReverseHistory::getMemoryUsage() const
+{
+	std::unordered_set<const void*> seen;
+	size_t result = 0;
+	for (auto& p : chunks) {
+		auto& chunk = p.second;
+		if (chunk.onDisk()) continue;
+		result += chunk.size;
+		for (auto& block : chunk.deltaBlocks) {
+			result += block->getMemoryUsage(seen);
+		}
+	}
+	return result;
+}
+
+// Move the savestate and the delta blocks of the given snapshot to the spill
+// file. The actual (compressing and) writing is done in the background.
+void ReverseManager::ReverseHistory::spill(ReverseChunk& chunk)
+{
+	assert(!chunk.onDisk());
+	if (!spillFile) {
+		spillFile = make_unique<ReverseSpillFile>();
+	}
+	auto spilled = std::make_shared<ReverseSpillFile::Snapshot>();
+	spilled->savestate = std::move(chunk.savestate);
+	spilled->deltaBlocks.swap(chunk.deltaBlocks);
+	chunk.spilled = spilled;
+	pendingSpills.push_back(spilled);
+	spillFile->spill(spilled, chunk.size);
+}
+
+static XMLElement loadXml(ReplayStreamReader& reader,
+                          const ReplayStream::Record& record)
+{
+	return XMLLoader::loadFromString(reader.read(record), reader.getFilename(),
+	                                 "openmsx-serialize.dtd");
+}
+
+// Restore the machine state of the given snapshot (possibly loading it back
+// from the spill file or from a streamed replay file).
+void ReverseManager::ReverseHistory::restore(
+	const ReverseChunk& chunk, MSXMotherBoard& board)
+{
+	if (chunk.keyframe != -1) {
+		XmlInputArchive in(loadXml(
+			*replayFile, replayFile->getIndex().keyframes[chunk.keyframe]));
+		in.serialize("machine", board);
+		return;
+	}
+	if (!chunk.spilled) {
+		MemInputArchive in(chunk.savestate.data(), chunk.size,
+		                   chunk.deltaBlocks);
+		in.serialize("machine", board);
+		return;
+	}
+	MemBuffer<uint8_t> savestate;
+	vector<shared_ptr<DeltaBlock>> blocks;
+	spillFile->restore(*chunk.spilled, chunk.size, savestate, blocks);
+	MemInputArchive in(savestate.data(), chunk.size, blocks);
+	in.serialize("machine", board);
 }
 
 
@@ -145,6 +241,8 @@ ReverseManager::ReverseManager(MSXMotherBoard& motherBoard_)
 	, collecting(false)
 	, pendingTakeSnapshot(false)
 	, reRecordCount(0)
+	, snapshotCost(0.0)
+	, lastSnapshotTime(EmuTime::zero)
 {
 	eventDistributor.registerEventListener(OPENMSX_TAKE_REVERSE_SNAPSHOT, *this);
 
@@ -180,6 +278,7 @@ void ReverseManager::start()
 void ReverseManager::stop()
 {
 	if (isCollecting()) {
+		finishStream();
 		motherBoard.getStateChangeDistributor().unregisterRecorder(*this);
 		syncNewSnapshot.removeSyncPoint(); // don't schedule new snapshot takings
 		syncInputEvent .removeSyncPoint(); // stop any pending replay actions
@@ -187,6 +286,8 @@ void ReverseManager::stop()
 		replayIndex = 0;
 		collecting = false;
 		pendingTakeSnapshot = false;
+		snapshotCost = 0.0;
+		lastSnapshotTime = EmuTime::zero;
 	}
 	assert(!pendingTakeSnapshot);
 	assert(!isCollecting());
@@ -239,6 +340,34 @@ void ReverseManager::status(TclObject& result) const
 	}
 	result.addListElement(snapshots);
 
+	// Memory used by each snapshot, not counting the data it shares with
+	// older snapshots, and the (host) time it took to create it.
+	result.addListElement("snapshot_sizes");
+	TclObject sizes;
+	std::unordered_set<const void*> seen;
+	for (auto& p : history.chunks) {
+		auto& chunk = p.second;
+		size_t size = 0;
+		if (!chunk.onDisk()) {
+			size = chunk.size;
+			for (auto& block : chunk.deltaBlocks) {
+				size += block->getMemoryUsage(seen);
+			}
+		}
+		sizes.addListElement(double(size));
+	}
+	result.addListElement(sizes);
+
+	result.addListElement("snapshot_costs");
+	TclObject costs;
+	for (auto& p : history.chunks) {
+		costs.addListElement(p.second.cost);
+	}
+	result.addListElement(costs);
+
+	result.addListElement("interval");
+	result.addListElement(getInterval());
+
 	result.addListElement("last_event");
 	auto lastEvent = history.events.rbegin();
 	if (lastEvent != history.events.rend() && dynamic_cast<const EndLogEvent*>(lastEvent->get())) {
@@ -260,10 +389,17 @@ void ReverseManager::debugInfo(TclObject& result) const
 		          (chunk.time - EmuTime::zero).toDouble(), ' ',
 		          ((chunk.time - EmuTime::zero).toDouble() / (getCurrentTime() - EmuTime::zero).toDouble()) * 100, "%"
 		          " (", chunk.size, ")"
-		          " (next event index: ", chunk.eventCount, ")\n");
+		          " (", int(chunk.cost * 1000000.0), "us)"
+		          " (next event index: ", chunk.eventCount, ")",
+		          chunk.onDisk() ? " (on disk)\n" : "\n");
 		totalSize += chunk.size;
 	}
-	strAppend(res, "total size: ", totalSize, '\n');
+	strAppend(res, "total size: ", totalSize, '\n',
+	          "memory usage: ", history.getMemoryUsage(), '\n');
+	if (history.spillFile) {
+		strAppend(res, "spill file usage: ",
+		          history.spillFile->getUsedSize(), '\n');
+	}
 	result.setString(res);
 }
 
@@ -415,10 +551,7 @@ void ReverseManager::goTo(
 			// -- restore old snapshot --
 			newBoard_ = reactor.createEmptyMotherBoard();
 			newBoard = newBoard_.get();
-			MemInputArchive in(chunk.savestate.data(),
-					   chunk.size,
-					   chunk.deltaBlocks);
-			in.serialize("machine", *newBoard);
+			hist.restore(chunk, *newBoard);
 
 			if (eventDelay) {
 				// Handle all events that are scheduled, but not yet
@@ -464,7 +597,7 @@ void ReverseManager::goTo(
 			auto nextSnapshotTarget = std::min(
 				preTarget,
 				lastSnapshotTarget + std::max(
-					EmuDuration(SNAPSHOT_PERIOD),
+					EmuDuration(getInterval()),
 					(preTarget - lastSnapshotTarget) / 2
 					));
 			auto nextTarget = std::min(nextSnapshotTarget, currentTimeNewBoard + EmuDuration::sec(1));
@@ -596,10 +729,7 @@ void ReverseManager::saveReplay(
 
 	// restore first snapshot to be able to serialize it to a file
 	auto initialBoard = reactor.createEmptyMotherBoard();
-	MemInputArchive in(begin(chunks)->second.savestate.data(),
-	                   begin(chunks)->second.size,
-			   begin(chunks)->second.deltaBlocks);
-	in.serialize("machine", *initialBoard);
+	history.restore(begin(chunks)->second, *initialBoard);
 	replay.motherBoards.push_back(move(initialBoard));
 
 	if (maxNofExtraSnapshots > 0) {
@@ -625,10 +755,7 @@ void ReverseManager::saveReplay(
 				if (it != lastAddedIt) {
 					// this is a new one, add it to the list of snapshots
 					Reactor::Board board = reactor.createEmptyMotherBoard();
-					MemInputArchive in2(it->second.savestate.data(),
-							    it->second.size,
-							    it->second.deltaBlocks);
-					in2.serialize("machine", *board);
+					history.restore(it->second, *board);
 					replay.motherBoards.push_back(move(board));
 					lastAddedIt = it;
 				}
@@ -720,9 +847,15 @@ void ReverseManager::loadReplay(
 	Replay replay(reactor);
 	Events events;
 	replay.events = &events;
+	shared_ptr<ReplayStreamReader> stream;
 	try {
-		XmlInputArchive in(filename);
-		in.serialize("replay", replay);
+		if (ReplayStream::isReplayStream(filename)) {
+			stream = std::make_shared<ReplayStreamReader>(filename);
+			loadStreamReplay(*stream, replay);
+		} else {
+			XmlInputArchive in(filename);
+			in.serialize("replay", replay);
+		}
 	} catch (XMLException& e) {
 		throw CommandException("Cannot load replay, bad file format: ",
 		                       e.getMessage());
@@ -786,6 +919,21 @@ void ReverseManager::loadReplay(
 		newHistory.chunks[newHistory.getNextSeqNum(newChunk.time)] =
 			move(newChunk);
 	}
+	if (stream) {
+		// The other snapshots of a streamed replay are only loaded from
+		// the file when they're actually needed.
+		auto& keyframes = stream->getIndex().keyframes;
+		for (size_t i = 1; i < keyframes.size(); ++i) {
+			ReverseChunk newChunk;
+			newChunk.time = keyframes[i].getTime();
+			newChunk.size = 0;
+			newChunk.eventCount = unsigned(keyframes[i].eventCount);
+			newChunk.keyframe = int(i);
+			newHistory.chunks[newHistory.getNextSeqNum(newChunk.time)] =
+				move(newChunk);
+		}
+		newHistory.replayFile = move(stream);
+	}
 
 	// Note: untill this point we didn't make any changes to the current
 	// ReverseManager/MSXMotherBoard yet
@@ -796,6 +944,151 @@ void ReverseManager::loadReplay(
 	result.setString("Loaded replay from " + filename);
 }
 
+// Only the first snapshot and the events are read, see loadReplay().
+void ReverseManager::loadStreamReplay(ReplayStreamReader& reader, Replay& replay)
+{
+	auto& index = reader.getIndex();
+	if (index.keyframes.empty()) {
+		throw MSXException("Replay doesn't contain any snapshots");
+	}
+
+	auto& events = *replay.events;
+	for (auto& record : index.events) {
+		Events batch;
+		XmlInputArchive in(loadXml(reader, record));
+		in.serialize("events", batch);
+		if (batch.size() < record.num) {
+			throw MSXException("Corrupt replay file: missing events");
+		}
+		events.insert(end(events), begin(batch), begin(batch) + record.num);
+	}
+
+	auto board = replay.reactor.createEmptyMotherBoard();
+	XmlInputArchive in(loadXml(reader, index.keyframes[0]));
+	in.serialize("machine", *board);
+	replay.motherBoards.push_back(move(board));
+
+	if (!reader.getInfo(replay.currentTime, replay.reRecordCount)) {
+		// recording wasn't finished properly (e.g. openMSX crashed)
+		replay.currentTime = index.keyframes.back().getTime();
+		if (!events.empty()) {
+			replay.currentTime = std::max(replay.currentTime,
+			                              events.back()->getTime());
+		}
+		replay.reRecordCount = 0;
+	}
+	if (events.empty() ||
+	    !dynamic_cast<const EndLogEvent*>(events.back().get())) {
+		events.push_back(std::make_shared<EndLogEvent>(replay.currentTime));
+	}
+}
+
+void ReverseManager::streamReplay(array_ref<TclObject> tokens, TclObject& result)
+{
+	if ((tokens.size() == 3) && (tokens[2] == "-stop")) {
+		if (!history.stream) {
+			throw CommandException("Not streaming a replay");
+		}
+		string filename = history.stream->getFilename();
+		finishStream();
+		result.setString("Stopped streaming replay to " + filename);
+		return;
+	}
+	if (tokens.size() > 3) throw SyntaxError();
+	if (!isCollecting()) {
+		throw CommandException("Reverse is not enabled");
+	}
+	if (history.stream) {
+		throw CommandException("Already streaming a replay to ",
+		                       history.stream->getFilename());
+	}
+	string filename = FileOperations::parseCommandFileArgument(
+		(tokens.size() == 3) ? tokens[2].getString() : string_view(),
+		REPLAY_DIR, "openmsx", ".omr");
+
+	try {
+		auto stream = make_unique<ReplayStreamWriter>(filename);
+
+		// start with the first snapshot and all events since then
+		const auto& first = begin(history.chunks)->second;
+		auto board = motherBoard.getReactor().createEmptyMotherBoard();
+		history.restore(first, *board);
+		XmlOutputArchive out;
+		out.serialize("machine", *board);
+		stream->addKeyframe(first.time, first.eventCount, out.getXml());
+
+		history.stream = move(stream);
+		history.streamedEvents = 0;
+		history.lastKeyframe = first.time;
+		if (!history.events.empty()) {
+			streamEvents(history.events, 0);
+		}
+	} catch (MSXException& e) {
+		history.stream.reset();
+		throw CommandException("Cannot stream replay: ", e.getMessage());
+	}
+	result.setString("Streaming replay to " + filename);
+}
+
+// Append the events starting at 'first' to the streamed replay.
+void ReverseManager::streamEvents(const Events& events, size_t first)
+{
+	Events batch(begin(events) + first, end(events));
+	XmlOutputArchive out;
+	out.serialize("events", batch);
+	auto time = batch.empty() ? getCurrentTime() : batch.front()->getTime();
+	history.stream->addEvents(time, first, batch.size(), out.getXml());
+	history.streamedEvents = events.size();
+}
+
+// Called after each new snapshot: write the new events and, once in a while,
+// a new keyframe.
+void ReverseManager::streamSnapshot(EmuTime::param time)
+{
+	if (!history.stream) return;
+	try {
+		if (history.events.size() > history.streamedEvents) {
+			streamEvents(history.events, history.streamedEvents);
+		}
+		if (time >= (history.lastKeyframe + KEYFRAME_PERIOD)) {
+			XmlOutputArchive out;
+			out.serialize("machine", motherBoard);
+			history.stream->addKeyframe(time, replayIndex, out.getXml());
+			history.lastKeyframe = time;
+		}
+	} catch (MSXException& e) {
+		stopStream(e);
+	}
+}
+
+// Close the streamed replay: write the complete event log (so that loading
+// doesn't need to merge batches) and the index.
+void ReverseManager::finishStream()
+{
+	if (!history.stream) return;
+	try {
+		Events events = history.events;
+		if (events.empty() ||
+		    !dynamic_cast<const EndLogEvent*>(events.back().get())) {
+			events.push_back(std::make_shared<EndLogEvent>(
+				getCurrentTime()));
+		}
+		streamEvents(events, 0);
+		history.stream->finish(getCurrentTime(), reRecordCount);
+	} catch (MSXException& e) {
+		stopStream(e);
+	}
+	history.stream.reset();
+}
+
+void ReverseManager::stopStream(const MSXException& e)
+{
+	motherBoard.getMSXCliComm().printWarning(
+		"Stopped streaming replay to ", history.stream->getFilename(),
+		": ", e.getMessage());
+	history.stream.reset();
+}
+
 void ReverseManager::transferHistory(ReverseHistory& oldHistory,
                                      unsigned oldEventCount)
 {
@@ -894,30 +1187,112 @@ unsigned ReverseManager::ReverseHistory::getNextSeqNum(EmuTime::param time) cons
 	}
 	const auto& startTime = begin(chunks)->second.time;
 	double duration = (time - startTime).toDouble();
-	return lrint(duration / SNAPSHOT_PERIOD);
+	return lrint(duration / SEQ_NUM_UNIT);
 }
 
 void ReverseManager::takeSnapshot(EmuTime::param time)
 {
-	// (possibly) drop old snapshots
-	// TODO does snapshot pruning still happen correctly (often enough)
-	//      when going back/forward in time?
-	unsigned seqNum = history.getNextSeqNum(time);
-	dropOldSnapshots<25>(seqNum);
+	auto start = Timer::getTime();
 
-	// During replay we might already have a snapshot with the current
-	// sequence number, though this snapshot does not necessarily have the
-	// exact same EmuTime (because we don't (re)start taking snapshots at
-	// the same moment in time).
+	// During replay we might already have a snapshot close to the current
+	// time, though this snapshot does not necessarily have the exact same
+	// EmuTime (because we don't (re)start taking snapshots at the same
+	// moment in time). Replace it, but never replace the very first one or
+	// one that was taken earlier in this session.
+	unsigned seqNum = history.getNextSeqNum(time);
+	if (!history.chunks.empty()) {
+		auto half = unsigned(getInterval() / (2.0 * SEQ_NUM_UNIT));
+		auto it = history.chunks.lower_bound(
+			std::max(1u, (seqNum > half) ? (seqNum - half) : 0u));
+		while ((it != end(history.chunks)) && (it->first <= (seqNum + half))) {
+			if ((it->first != seqNum) &&
+			    (it->second.time > lastSnapshotTime)) {
+				it = history.chunks.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
 
 	// actually create new snapshot
 	ReverseChunk& newChunk = history.chunks[seqNum];
 	newChunk.deltaBlocks.clear();
+	newChunk.spilled.reset();
+	newChunk.keyframe = -1;
 	MemOutputArchive out(history.lastDeltaBlocks, newChunk.deltaBlocks, true);
 	out.serialize("machine", motherBoard);
 	newChunk.time = time;
 	newChunk.savestate = out.releaseBuffer(newChunk.size);
 	newChunk.eventCount = replayIndex;
+	lastSnapshotTime = time;
+
+	// (possibly) drop old snapshots
+	dropOldSnapshots(seqNum);
+	spillSnapshots();
+	streamSnapshot(time);
+
+	newChunk.cost = (Timer::getTime() - start) / 1000000.0;
+	snapshotCost = (snapshotCost == 0.0)
+	             ? newChunk.cost
+	             : 0.75 * snapshotCost + 0.25 * newChunk.cost;
+}
+
+// When the history uses more memory than allowed by the budget setting, move
+// the oldest snapshots to the spill file. They're loaded back when needed.
+void ReverseManager::spillSnapshots()
+{
+	auto spillError = [&](const string& message) {
+		history.spillFailed = true; // don't retry every snapshot
+		motherBoard.getMSXCliComm().printWarning(
+			"Couldn't move old reverse snapshots to disk, "
+			"reverse memory budget is ignored: ", message);
+	};
+	// Check the results of the earlier spills (written in the background).
+	auto& pending = history.pendingSpills;
+	for (auto it = begin(pending); it != end(pending); /**/) {
+		auto& spilled = **it;
+		if (!spilled.done) {
+			++it;
+			continue;
+		}
+		if (!spilled.error.empty() && !history.spillFailed) {
+			spillError(spilled.error);
+		}
+		it = pending.erase(it);
+	}
+
+	auto& setting = motherBoard.getReactor().getGlobalSettings()
+	                           .getReverseMemoryBudgetSetting();
+	uint64_t budget = uint64_t(setting.getInt()) * 1024 * 1024;
+	if ((budget == 0) || history.spillFailed) return;
+
+	// Only calculate the memory usage once (it has to visit all delta
+	// blocks), then subtract what each spilled snapshot frees. Delta blocks
+	// that are shared with other snapshots stay in memory. This is only an
+	// estimate, it gets corrected at the next snapshot.
+	uint64_t usage = history.getMemoryUsage();
+	std::unordered_set<const void*> seen;
+	// Never spill the most recent snapshot, it's the most likely target
+	// of a short 'reverse goback'.
+	auto last = std::prev(end(history.chunks));
+	for (auto it = begin(history.chunks); it != last; ++it) {
+		if (usage <= budget) break;
+		auto& chunk = it->second;
+		if (chunk.onDisk()) continue;
+		uint64_t freed = chunk.size;
+		for (auto& block : chunk.deltaBlocks) {
+			if (block.use_count() == 1) {
+				freed += block->getMemoryUsage(seen);
+			}
+		}
+		try {
+			history.spill(chunk);
+		} catch (MSXException& e) {
+			spillError(e.getMessage());
+			break;
+		}
+		usage -= std::min(usage, freed);
+	}
 }
 
 void ReverseManager::replayNextEvent()
@@ -964,6 +1339,19 @@ void ReverseManager::stopReplay(EmuTime::param time)
 		auto it = find_if(begin(history.chunks), end(history.chunks),
 			[&](Chunks::value_type& p) { return p.second.time > time; });
 		history.chunks.erase(it, end(history.chunks));
+		if (history.stream) {
+			// also mark this in the streamed replay
+			try {
+				history.stream->truncate(time, replayIndex);
+				auto& keyframes = history.stream->getIndex().keyframes;
+				history.lastKeyframe = keyframes.empty()
+					? EmuTime::zero : keyframes.back().getTime();
+				history.streamedEvents = std::min<size_t>(
+					history.streamedEvents, replayIndex);
+			} catch (MSXException& e) {
+				stopStream(e);
+			}
+		}
 		// this also means someone is changing history, record that
 		reRecordCount++;
 	}
@@ -975,31 +1363,71 @@ void ReverseManager::stopReplay(EmuTime::param time)
  * more snapshots of recent history and less of distant history. It has the
  * following properties:
  *  - the very oldest snapshot is never deleted
- *  - it keeps the N or N+1 most recent snapshots (snapshot distance = 1)
- *  - then it keeps N or N+1 with snapshot distance 2
- *  - then N or N+1 with snapshot distance 4
- *  - ... and so on
- * @param count The index of the just added (or about to be added) element.
- *              First element should have index 1.
+ *  - all snapshots of the last 'reverse_dense_history' seconds are kept
+ *  - further back, the sequence numbers are split in aligned blocks of a
+ *    power of two, proportional to the age of the snapshots, and only the
+ *    oldest snapshot of each block is kept. Because the blocks only grow
+ *    (and nest), the remaining snapshots are stable and their number only
+ *    grows logarithmically with the length of the history
+ * @param seqNum The sequence number of the just added snapshot. Snapshots
+ *               after it (when replaying) are not touched.
  */
-template<unsigned N>
-void ReverseManager::dropOldSnapshots(unsigned count)
+void ReverseManager::dropOldSnapshots(unsigned seqNum)
+{
+	double dense = motherBoard.getReactor().getGlobalSettings()
+	                          .getReverseDenseHistorySetting().getInt();
+	auto last = history.chunks.find(seqNum);
+	assert(last != end(history.chunks));
+	std::vector<std::pair<unsigned, EmuTime>> snapshots;
+	for (auto it = begin(history.chunks); it != std::next(last); ++it) {
+		snapshots.emplace_back(it->first, it->second.time);
+	}
+	for (auto s : thinSnapshots(snapshots, dense)) {
+		history.chunks.erase(s);
+	}
+}
+
+std::vector<unsigned> ReverseManager::thinSnapshots(
+	const std::vector<std::pair<unsigned, EmuTime>>& snapshots, double dense)
+{
+	std::vector<unsigned> result;
+	if (snapshots.size() < 2) return result;
+	EmuTime now = snapshots.back().second;
+	unsigned prevKept = snapshots.front().first;
+	for (auto i : xrange(size_t(1), snapshots.size() - 1)) {
+		unsigned seqNum = snapshots[i].first;
+		double age = (now - snapshots[i].second).toDouble();
+		auto distance = unsigned((age - dense) / (THINNING_FACTOR * SEQ_NUM_UNIT));
+		if ((age > dense) && (distance > 1)) {
+			unsigned blockSize = (Math::floodRight(distance) >> 1) + 1;
+			if ((seqNum / blockSize) == (prevKept / blockSize)) {
+				result.push_back(seqNum);
+				continue;
+			}
+		}
+		prevKept = seqNum;
+	}
+	return result;
+}
+
+// Time between two snapshots (in emulated seconds). When a CPU budget is set,
+// the interval grows while taking a snapshot costs (on average) more than
+// that percentage of it. This assumes the emulation runs at normal speed.
+double ReverseManager::getInterval() const
 {
-	unsigned y = (count + N) ^ (count + N + 1);
-	unsigned d = N;
-	unsigned d2 = 2 * N + 1;
-	while (true) {
-		y >>= 1;
-		if ((y == 0) || (count < d)) return;
-		history.chunks.erase(count - d);
-		d += d2;
-		d2 *= 2;
+	auto& settings = motherBoard.getReactor().getGlobalSettings();
+	double interval = settings.getReverseIntervalSetting().getDouble();
+	int budget = settings.getReverseCpuBudgetSetting().getInt();
+	if (budget > 0) {
+		double needed = snapshotCost * 100.0 / budget;
+		interval = std::max(interval, std::min(needed, MAX_ADAPTIVE_INTERVAL));
 	}
+	return interval;
 }
 
 void ReverseManager::schedule(EmuTime::param time)
 {
-	syncNewSnapshot.setSyncPoint(time + EmuDuration(SNAPSHOT_PERIOD));
+	syncNewSnapshot.setSyncPoint(time + EmuDuration(getInterval()));
 }
 
 
@@ -1034,6 +1462,8 @@ void ReverseManager::ReverseCmd::execute(array_ref<TclObject> tokens, TclObject&
 		return manager.saveReplay(interp, tokens, result);
 	} else if (subcommand == "loadreplay") {
 		return manager.loadReplay(interp, tokens, result);
+	} else if (subcommand == "streamreplay") {
+		return manager.streamReplay(tokens, result);
 	} else if (subcommand == "viewonlymode") {
 		auto& distributor = manager.motherBoard.getStateChangeDistributor();
 		switch (tokens.size()) {
@@ -1065,6 +1495,8 @@ string ReverseManager::ReverseCmd::help(const vector<string>& /*tokens*/) const
 	       "viewonlymode <bool> switch viewonly mode on or off\n"
 	       "truncatereplay      stop replaying and remove all 'future' data\n"
 	       "savereplay [<name>] save the first snapshot and all replay data as a 'replay' (with optional name)\n"
+	       "streamreplay [<name>] keep writing the replay data to a file while recording (with optional name)\n"
+	       "streamreplay -stop  stop streaming the replay data\n"
 	       "loadreplay [-goto <begin|end|savetime|<n>>] [-viewonly] <name>   load a replay (snapshot and replay data) with given name and start replaying\n";
 }
 
@@ -1074,14 +1506,17 @@ void ReverseManager::ReverseCmd::tabCompletion(vector<string>& tokens) const
 		static const char* const subCommands[] = {
 			"start", "stop", "status", "goback", "goto",
 			"savereplay", "loadreplay", "viewonlymode",
-			"truncatereplay",
+			"truncatereplay", "streamreplay",
 		};
 		completeString(tokens, subCommands);
 	} else if ((tokens.size() == 3) || (tokens[1] == "loadreplay")) {
-		if (tokens[1] == "loadreplay" || tokens[1] == "savereplay") {
+		if (tokens[1] == "loadreplay" || tokens[1] == "savereplay" ||
+		    tokens[1] == "streamreplay") {
 			std::vector<const char*> cmds;
 			if (tokens[1] == "loadreplay") {
 				cmds = { "-goto", "-viewonly" };
+			} else if (tokens[1] == "streamreplay") {
+				cmds = { "-stop" };
 			}
 			completeFileName(tokens, userDataFileContext(REPLAY_DIR), cmds);
 		} else if (tokens[1] == "viewonlymode") {
@@ -8,11 +8,14 @@
 #include "EmuTime.hh"
 #include "MemBuffer.hh"
 #include "DeltaBlock.hh"
+#include "ReverseSpillFile.hh"
+#include "ReplayStream.hh"
 #include "array_ref.hh"
 #include "outer.hh"
 #include <vector>
 #include <map>
 #include <memory>
+#include <string>
 #include <cstdint>
 
 namespace openmsx {
@@ -23,6 +26,9 @@ class EventDelay;
 class EventDistributor;
 class TclObject;
 class Interpreter;
+class MSXException;
+
+struct Replay;
 
 class ReverseManager final : private EventListener, private StateChangeRecorder
 {
@@ -50,31 +56,74 @@ public:
 		reRecordCount = count;
 	}
 
+	/** The thinning of the reverse history, see dropOldSnapshots().
+	  * Only public for the unittest.
+	  * @param snapshots Sequence number and time of each snapshot, from
+	  *                  the oldest up to the just added snapshot.
+	  * @param dense Length (in seconds) of the dense part of the history.
+	  * @result The sequence numbers of the snapshots to drop.
+	  */
+	static std::vector<unsigned> thinSnapshots(
+		const std::vector<std::pair<unsigned, EmuTime>>& snapshots,
+		double dense);
+
 private:
 	struct ReverseChunk {
-		ReverseChunk() : time(EmuTime::zero) {}
+		ReverseChunk() : time(EmuTime::zero), keyframe(-1), cost(0.0) {}
 
 		EmuTime time;
 		std::vector<std::shared_ptr<DeltaBlock>> deltaBlocks;
 		MemBuffer<uint8_t> savestate;
 		size_t size;
 
+		// When the history exceeds its memory budget, 'savestate' and
+		// 'deltaBlocks' of old snapshots are moved to the spill file.
+		std::shared_ptr<ReverseSpillFile::Snapshot> spilled;
+
+		// Snapshots of a loaded streaming replay are only read from the
+		// replay file when needed. This is the index of the keyframe in
+		// that file, or -1.
+		int keyframe;
+
+		bool onDisk() const { return spilled || (keyframe != -1); }
+
 		// Number of recorded events (or replay index) when this
 		// snapshot was created. So when going back replay should
 		// start at this index.
 		unsigned eventCount;
+
+		// Host time (in seconds) it took to create this snapshot.
+		double cost;
 	};
 	using Chunks = std::map<unsigned, ReverseChunk>;
 	using Events = std::vector<std::shared_ptr<StateChange>>;
 
 	struct ReverseHistory {
+		ReverseHistory()
+			: spillFailed(false), streamedEvents(0)
+			, lastKeyframe(EmuTime::zero) {}
 		void swap(ReverseHistory& other);
 		void clear();
 		unsigned getNextSeqNum(EmuTime::param time) const;
-
+		size_t getMemoryUsage() const;
+		void spill(ReverseChunk& chunk);
+		void restore(const ReverseChunk& chunk, MSXMotherBoard& board);
+
+		// Must be declared before (so destroyed after) 'chunks'.
+		std::unique_ptr<ReverseSpillFile> spillFile;
+		// Spills of which the result wasn't checked yet.
+		std::vector<std::shared_ptr<ReverseSpillFile::Snapshot>> pendingSpills;
+		std::shared_ptr<ReplayStreamReader> replayFile;
 		Chunks chunks;
 		Events events;
 		LastDeltaBlocks lastDeltaBlocks;
+		bool spillFailed;
+
+		// When streaming a replay: the file, the number of events that
+		// are already written to it and the time of the last keyframe.
+		std::unique_ptr<ReplayStreamWriter> stream;
+		size_t streamedEvents;
+		EmuTime lastKeyframe;
 	};
 
 	bool isCollecting() const { return collecting; }
@@ -89,6 +138,12 @@ private:
 	                array_ref<TclObject> tokens, TclObject& result);
 	void loadReplay(Interpreter& interp,
 	                array_ref<TclObject> tokens, TclObject& result);
+	void streamReplay(array_ref<TclObject> tokens, TclObject& result);
+	void loadStreamReplay(ReplayStreamReader& reader, Replay& replay);
+	void streamSnapshot(EmuTime::param time);
+	void streamEvents(const Events& events, size_t first);
+	void finishStream();
+	void stopStream(const MSXException& e);
 
 	void signalStopReplay(EmuTime::param time);
 	EmuTime::param getEndTime(const ReverseHistory& history) const;
@@ -99,9 +154,11 @@ private:
 	                     unsigned oldEventCount);
 	void transferState(MSXMotherBoard& newBoard);
 	void takeSnapshot(EmuTime::param time);
+	void spillSnapshots();
 	void schedule(EmuTime::param time);
+	double getInterval() const;
 	void replayNextEvent();
-	template<unsigned N> void dropOldSnapshots(unsigned count);
+	void dropOldSnapshots(unsigned seqNum);
 
 	// Schedulable
 	struct SyncNewSnapshot : Schedulable {
@@ -152,6 +209,11 @@ private:
 
 	unsigned reRecordCount;
 
+	// Average host time (in seconds) it takes to create a snapshot.
+	double snapshotCost;
+	// Time of the last snapshot that was taken by this object.
+	EmuTime lastSnapshotTime;
+
 	friend struct Replay;
 };
 
@@ -0,0 +1,228 @@
+#include "ReverseSpillFile.hh"
+#include "DeltaBlock.hh"
+#include "FileOperations.hh"
+#include "FileException.hh"
+#include "snappy.hh"
+#include <cassert>
+#include <cstring>
+#include <iterator>
+
+namespace openmsx {
+
+// class ReverseSpillFile::Record
+
+ReverseSpillFile::Record::Record(Record&& other) noexcept
+	: file(other.file)
+	, offset(other.offset)
+	, storedSize(other.storedSize)
+	, rawSize(other.rawSize)
+{
+	other.file = nullptr;
+}
+
+ReverseSpillFile::Record& ReverseSpillFile::Record::operator=(Record&& other) noexcept
+{
+	if (this != &other) {
+		release();
+		file       = other.file;
+		offset     = other.offset;
+		storedSize = other.storedSize;
+		rawSize    = other.rawSize;
+		other.file = nullptr;
+	}
+	return *this;
+}
+
+void ReverseSpillFile::Record::release()
+{
+	if (file) {
+		file->free(offset, storedSize);
+		file = nullptr;
+	}
+}
+
+
+// class ReverseSpillFile
+
+ReverseSpillFile::ReverseSpillFile()
+	: end(0)
+	, usedSize(0)
+	, writer(1)
+{
+	{
+		// only used to create a file with a unique name
+		auto fp = FileOperations::openUniqueFile(
+			FileOperations::getTempDir(), filename);
+		if (!fp) {
+			throw FileException("Couldn't create reverse spill file");
+		}
+	}
+	try {
+		file = File(filename, "rb+");
+	} catch (FileException&) {
+		FileOperations::unlink(filename);
+		throw;
+	}
+}
+
+ReverseSpillFile::~ReverseSpillFile()
+{
+	writer.wait();
+	assert(usedSize == 0); // all records must be released
+	file.close();
+	FileOperations::unlink(filename);
+}
+
+ReverseSpillFile::Record ReverseSpillFile::write(const uint8_t* data, size_t size)
+{
+	size_t dstLen = snappy::maxCompressedLength(size);
+	MemBuffer<uint8_t> buf(dstLen);
+	snappy::compress(reinterpret_cast<const char*>(data), size,
+	                 reinterpret_cast<char*>(buf.data()), dstLen);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	// first fit, otherwise append
+	size_t offset = end;
+	for (auto it = holes.begin(); it != holes.end(); ++it) {
+		if (it->second >= dstLen) {
+			offset = it->first;
+			size_t remaining = it->second - dstLen;
+			holes.erase(it);
+			if (remaining) holes[offset + dstLen] = remaining;
+			break;
+		}
+	}
+	file.seek(offset);
+	file.write(buf.data(), dstLen);
+	if (offset == end) end += dstLen;
+	usedSize += dstLen;
+
+	Record record;
+	record.file = this;
+	record.offset = offset;
+	record.storedSize = dstLen;
+	record.rawSize = size;
+	return record;
+}
+
+void ReverseSpillFile::spill(std::shared_ptr<Snapshot> snapshot, size_t size)
+{
+	writer.add([this, snapshot, size] { write(*snapshot, size); });
+}
+
+// Executed on the writer thread. Format of the record:
+//   number of blocks, size of each block, savestate, content of each block
+void ReverseSpillFile::write(Snapshot& snapshot, size_t size)
+{
+	auto& blocks = snapshot.deltaBlocks;
+	size_t num = blocks.size();
+	size_t total = (num + 1) * sizeof(size_t) + size;
+	for (auto& block : blocks) total += block->getSize();
+
+	MemBuffer<uint8_t> buf(total);
+	uint8_t* p = buf.data();
+	auto put = [&](size_t value) {
+		memcpy(p, &value, sizeof(value));
+		p += sizeof(value);
+	};
+	put(num);
+	for (auto& block : blocks) put(block->getSize());
+	memcpy(p, snapshot.savestate.data(), size);
+	p += size;
+	for (auto& block : blocks) {
+		block->apply(p, block->getSize());
+		p += block->getSize();
+	}
+	assert(p == buf.data() + total);
+
+	try {
+		snapshot.record = write(buf.data(), total);
+		snapshot.savestate.clear();
+		std::vector<std::shared_ptr<DeltaBlock>>().swap(blocks);
+	} catch (MSXException& e) {
+		// keep the data in memory
+		snapshot.error = e.getMessage();
+	}
+	snapshot.done = true;
+}
+
+void ReverseSpillFile::restore(
+	const Snapshot& snapshot, size_t size, MemBuffer<uint8_t>& savestate,
+	std::vector<std::shared_ptr<DeltaBlock>>& deltaBlocks)
+{
+	writer.wait(); // the snapshot may still be being written
+	if (!snapshot.record) {
+		// writing failed, the data is still in memory
+		savestate.resize(size);
+		memcpy(savestate.data(), snapshot.savestate.data(), size);
+		deltaBlocks = snapshot.deltaBlocks;
+		return;
+	}
+	auto buf = read(snapshot.record);
+	const uint8_t* p = buf.data();
+	auto get = [&] {
+		size_t value;
+		memcpy(&value, p, sizeof(value));
+		p += sizeof(value);
+		return value;
+	};
+	std::vector<size_t> sizes(get());
+	for (auto& s : sizes) s = get();
+	savestate.resize(size);
+	memcpy(savestate.data(), p, size);
+	p += size;
+	deltaBlocks.clear();
+	for (auto s : sizes) {
+		deltaBlocks.push_back(std::make_shared<DeltaBlockCopy>(p, s));
+		p += s;
+	}
+}
+
+MemBuffer<uint8_t> ReverseSpillFile::read(const Record& record)
+{
+	assert(record.file == this);
+	MemBuffer<uint8_t> buf(record.storedSize);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		file.seek(record.offset);
+		file.read(buf.data(), record.storedSize);
+	}
+
+	MemBuffer<uint8_t> result(record.rawSize);
+	snappy::uncompress(reinterpret_cast<const char*>(buf.data()), record.storedSize,
+	                   reinterpret_cast<char*>(result.data()), record.rawSize);
+	return result;
+}
+
+size_t ReverseSpillFile::getUsedSize() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return usedSize;
+}
+
+void ReverseSpillFile::free(size_t offset, size_t size)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	usedSize -= size;
+	// merge with the neighbouring holes
+	auto next = holes.lower_bound(offset);
+	if (next != holes.end() && (offset + size) == next->first) {
+		size += next->second;
+		next = holes.erase(next);
+	}
+	if (next != holes.begin()) {
+		auto prev = std::prev(next);
+		if ((prev->first + prev->second) == offset) {
+			offset = prev->first;
+			size += prev->second;
+			holes.erase(prev);
+		}
+	}
+	if ((offset + size) == end) {
+		end = offset; // hole at the end of the file
+	} else {
+		holes[offset] = size;
+	}
+}
+
+} // namespace openmsx
@@ -0,0 +1,110 @@
+#ifndef REVERSESPILLFILE_HH
+#define REVERSESPILLFILE_HH
+
+#include "File.hh"
+#include "MemBuffer.hh"
+#include "ThreadPool.hh"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace openmsx {
+
+class DeltaBlock;
+
+/** Temporary file to which the ReverseManager moves old snapshots when the
+  * reverse history grows beyond its memory budget. Records are stored
+  * compressed and can be read back in any order. The space of a record is
+  * reused once its Record handle is destroyed. The file itself is deleted
+  * when this object is destroyed, so it must outlive all its records.
+  * All methods can be called from any thread. Snapshots are written by a
+  * background thread owned by this object, see spill().
+  */
+class ReverseSpillFile
+{
+public:
+	class Record {
+	public:
+		Record() : file(nullptr) {}
+		Record(Record&& other) noexcept;
+		Record& operator=(Record&& other) noexcept;
+		~Record() { release(); }
+
+		explicit operator bool() const { return file != nullptr; }
+		void release();
+
+	private:
+		friend class ReverseSpillFile;
+		ReverseSpillFile* file;
+		size_t offset;
+		size_t storedSize;
+		size_t rawSize;
+	};
+
+	/** A snapshot (savestate plus delta blocks) that is moved to the file
+	  * with spill(). Until the background write has finished (or when it
+	  * failed) the data stays in 'savestate' and 'deltaBlocks'. Other
+	  * threads may only access those members after 'done' was set.
+	  */
+	struct Snapshot {
+		Snapshot() : done(false) {}
+
+		Record record;
+		MemBuffer<uint8_t> savestate;
+		std::vector<std::shared_ptr<DeltaBlock>> deltaBlocks;
+		std::string error;
+		std::atomic<bool> done;
+	};
+
+	/** @throws FileException */
+	ReverseSpillFile();
+	~ReverseSpillFile();
+
+	/** Write the given snapshot (with a savestate of 'size' bytes) in the
+	  * background. The delta blocks are stored fully expanded, so that the
+	  * snapshot no longer depends on (the reference blocks of) other
+	  * snapshots. A write error is stored in 'snapshot->error'.
+	  */
+	void spill(std::shared_ptr<Snapshot> snapshot, size_t size);
+
+	/** Get the savestate and the delta blocks of a spilled snapshot back.
+	  * When it's still being written, this first waits for that.
+	  * @throws FileException */
+	void restore(const Snapshot& snapshot, size_t size,
+	             MemBuffer<uint8_t>& savestate,
+	             std::vector<std::shared_ptr<DeltaBlock>>& deltaBlocks);
+
+	/** Store a new record.
+	  * @throws FileException */
+	Record write(const uint8_t* data, size_t size);
+
+	/** Read back a record that was written earlier.
+	  * @throws FileException */
+	MemBuffer<uint8_t> read(const Record& record);
+
+	/** Total size of all records in the file. */
+	size_t getUsedSize() const;
+
+private:
+	void write(Snapshot& snapshot, size_t size);
+	void free(size_t offset, size_t size);
+
+	// Protects all members below, except 'writer'.
+	mutable std::mutex mutex;
+	std::string filename;
+	File file;
+	std::map<size_t, size_t> holes; // offset -> size of unused space
+	size_t end; // end of the last record
+	size_t usedSize;
+
+	// Executes the spill() requests, one at a time.
+	ThreadPool writer;
+};
+
+} // namespace openmsx
+
+#endif
@@ -39,7 +39,7 @@ Scheduler::~Scheduler()
 
 void Scheduler::setSyncPoint(EmuTime::param time, Schedulable& device)
 {
-	assert(Thread::isMainThread());
+	assert(Thread::isEmulationThread());
 	assert(time >= scheduleTime);
 
 	// Push sync point into queue.
@@ -66,20 +66,20 @@ Scheduler::SyncPoints Scheduler::getSyncPoints(const Schedulable& device) const
 
 bool Scheduler::removeSyncPoint(Schedulable& device)
 {
-	assert(Thread::isMainThread());
+	assert(Thread::isEmulationThread());
 	return queue.remove(EqualSchedulable(device));
 }
 
 void Scheduler::removeSyncPoints(Schedulable& device)
 {
-	assert(Thread::isMainThread());
+	assert(Thread::isEmulationThread());
 	queue.remove_all(EqualSchedulable(device));
 }
 
 bool Scheduler::pendingSyncPoint(const Schedulable& device,
                                  EmuTime& result) const
 {
-	assert(Thread::isMainThread());
+	assert(Thread::isEmulationThread());
 	auto it = std::find_if(std::begin(queue), std::end(queue),
 	                       EqualSchedulable(device));
 	if (it != std::end(queue)) {
@@ -92,7 +92,7 @@ bool Scheduler::pendingSyncPoint(const Schedulable& device,
 
 EmuTime::param Scheduler::getCurrentTime() const
 {
-	assert(Thread::isMainThread());
+	assert(Thread::isEmulationThread());
 	return scheduleTime;
 }
 
@@ -0,0 +1,52 @@
+#ifndef BENCHMARK_HH
+#define BENCHMARK_HH
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+// Minimal micro-benchmark support for the "benchmark" flavour. Each benchmark
+// is a function registered with BENCHMARK_CASE(). The executable runs all of
+// them, or only those whose name contains the (optional) filter argument:
+//   openmsx [-o <file>] [<filter>]
+// With '-o' the results passed to report() are also written to <file>, one
+// "<benchmark>/<name> <value> <unit>" line per result, so that they can be
+// compared across builds.
+
+namespace benchmark {
+
+using Func = void (*)();
+
+struct Registrar {
+	Registrar(const char* name, Func func);
+};
+
+// Sink for results, prevents the compiler from optimizing the benchmarked
+// code away.
+extern volatile uint64_t sink;
+
+// Print a result and record it for the '-o' output file.
+void report(const std::string& name, double value, const char* unit);
+
+// Run 'f' 'repeat' times and print the fastest run.
+template<typename F> void measure(const char* name, unsigned repeat, F f)
+{
+	using Clock = std::chrono::steady_clock;
+	auto best = Clock::duration::max();
+	for (unsigned i = 0; i < repeat; ++i) {
+		auto start = Clock::now();
+		sink = sink + f();
+		auto duration = Clock::now() - start;
+		if (duration < best) best = duration;
+	}
+	auto us = std::chrono::duration_cast<std::chrono::microseconds>(best);
+	std::cout << "  " << name << ": " << us.count() << "us" << std::endl;
+}
+
+} // namespace benchmark
+
+#define BENCHMARK_CASE(NAME, FUNC) \
+	static benchmark::Registrar FUNC##_registrar(NAME, FUNC)
+
+#endif
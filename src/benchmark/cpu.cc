@@ -0,0 +1,274 @@
+#include "benchmark.hh"
+#include "Reactor.hh"
+#include "MSXMotherBoard.hh"
+#include "MSXCPU.hh"
+#include "MSXCPUInterface.hh"
+#include "CPURegs.hh"
+#include "EmuDuration.hh"
+#include "File.hh"
+#include "FileOperations.hh"
+#include "MSXException.hh"
+#include "Thread.hh"
+#include "strCat.hh"
+#include <algorithm>
+#include <cstring>
+
+// Measures the speed of the Z80 and R800 emulation (CPUCore), including the
+// cost of the memory and I/O accesses they do. Each workload is a small
+// machine code program that runs for a fixed amount of emulated time on a
+// minimal turboR-like machine (only RAM, a VDP and the S1990 to have an
+// R800) without a renderer or sound. The result is expressed as 'emulated
+// MHz': the number of CPU clock cycles that are emulated per host second.
+
+using namespace openmsx;
+
+static const char* const MACHINE_CONFIG =
+	"<?xml version=\"1.0\" ?>\n"
+	"<!DOCTYPE msxconfig SYSTEM 'msxconfig2.dtd'>\n"
+	"<msxconfig>\n"
+	"  <info>\n"
+	"    <manufacturer>openMSX</manufacturer>\n"
+	"    <code>CPU benchmark</code>\n"
+	"    <description>Minimal machine for the CPU benchmark.</description>\n"
+	"    <type>MSXturboR</type>\n"
+	"  </info>\n"
+	"  <devices>\n"
+	"    <primary slot=\"0\">\n"
+	"      <MemoryMapper id=\"Main RAM\">\n"
+	"        <mem base=\"0x0000\" size=\"0x10000\"/>\n"
+	"        <size>64</size>\n"
+	"      </MemoryMapper>\n"
+	"    </primary>\n"
+	"    <VDP id=\"VDP\">\n"
+	"      <io base=\"0x98\" num=\"4\"/>\n"
+	"      <version>V9958</version>\n"
+	"      <vram>128</vram>\n"
+	"    </VDP>\n"
+	"    <S1990 id=\"S1990\">\n"
+	"      <io base=\"0xE4\" num=\"2\"/>\n"
+	"    </S1990>\n"
+	"  </devices>\n"
+	"</msxconfig>\n";
+
+// All programs are loaded at address 0x0100.
+static const byte MIX[] = {
+	0xF3,                   //       di
+	0x31, 0x00, 0xF0,       //       ld   sp,0F000h
+	0xDD, 0x21, 0x00, 0xE0, //       ld   ix,0E000h
+	0x21, 0x00, 0x00,       //       ld   hl,0
+	0x01, 0x00, 0x10,       // loop: ld   bc,1000h
+	0x7E,                   // in:   ld   a,(hl)
+	0x83,                   //       add  a,e
+	0x5F,                   //       ld   e,a
+	0x23,                   //       inc  hl
+	0xAA,                   //       xor  d
+	0x57,                   //       ld   d,a
+	0x07,                   //       rlca
+	0xDD, 0x77, 0x01,       //       ld   (ix+1),a
+	0xC5,                   //       push bc
+	0xC1,                   //       pop  bc
+	0xCB, 0x3F,             //       srl  a
+	0x0B,                   //       dec  bc
+	0x78,                   //       ld   a,b
+	0xB1,                   //       or   c
+	0xC2, 0x0E, 0x01,       //       jp   nz,in
+	0xCD, 0x28, 0x01,       //       call sub
+	0xC3, 0x0B, 0x01,       //       jp   loop
+	0xED, 0x44,             // sub:  neg
+	0x3C,                   //       inc  a
+	0xC9,                   //       ret
+};
+
+static const byte LDIR[] = {
+	0xF3,                   //       di
+	0x31, 0x00, 0xF0,       //       ld   sp,0F000h
+	0x21, 0x00, 0x40,       // loop: ld   hl,4000h
+	0x11, 0x00, 0x80,       //       ld   de,8000h
+	0x01, 0x00, 0x20,       //       ld   bc,2000h
+	0xED, 0xB0,             //       ldir
+	0x21, 0x00, 0x80,       //       ld   hl,8000h
+	0x11, 0x00, 0x40,       //       ld   de,4000h
+	0x01, 0x00, 0x20,       //       ld   bc,2000h
+	0xED, 0xB0,             //       ldir
+	0x18, 0xE8,             //       jr   loop
+};
+
+static const byte VDP_OUT[] = {
+	0xF3,                   //       di
+	0x31, 0x00, 0xF0,       //       ld   sp,0F000h
+	0xAF,                   // loop: xor  a
+	0xD3, 0x99,             //       out  (99h),a
+	0x3E, 0x40,             //       ld   a,40h
+	0xD3, 0x99,             //       out  (99h),a   ; VRAM write address 0
+	0x21, 0x00, 0x40,       //       ld   hl,4000h
+	0x01, 0x98, 0x00,       //       ld   bc,0098h
+	0xED, 0xB3,             //       otir           ; 256 bytes
+	0x06, 0x40,             //       ld   b,40h
+	0x7D,                   // out:  ld   a,l
+	0xD3, 0x98,             //       out  (98h),a
+	0x2C,                   //       inc  l
+	0x10, 0xFA,             //       djnz out
+	0x18, 0xE7,             //       jr   loop
+};
+
+// IN/OUT on a mapped port (VDP status) and on unmapped ports.
+static const byte IO[] = {
+	0xF3,                   //       di
+	0x31, 0x00, 0xF0,       //       ld   sp,0F000h
+	0x06, 0x00,             // loop: ld   b,0
+	0xDB, 0x99,             // io:   in   a,(99h)
+	0xD3, 0xA0,             //       out  (0A0h),a
+	0xDB, 0xA2,             //       in   a,(0A2h)
+	0x10, 0xF8,             //       djnz io
+	0x18, 0xF4,             //       jr   loop
+};
+
+// Line interrupt every 4 lines (plus the vblank interrupt), the main program
+// is a simple counting loop.
+static const byte INTERRUPT[] = {
+	0xF3,                   //       di
+	0x31, 0x00, 0xF0,       //       ld   sp,0F000h
+	0xED, 0x56,             //       im   1
+	0x3E, 0x10,             //       ld   a,10h
+	0xD3, 0x99,             //       out  (99h),a
+	0x3E, 0x80,             //       ld   a,80h
+	0xD3, 0x99,             //       out  (99h),a   ; R#0: line interrupts on
+	0x3E, 0x60,             //       ld   a,60h
+	0xD3, 0x99,             //       out  (99h),a
+	0x3E, 0x81,             //       ld   a,81h
+	0xD3, 0x99,             //       out  (99h),a   ; R#1: vblank interrupt on
+	0xFB,                   //       ei
+	0x01, 0x00, 0x10,       // loop: ld   bc,1000h
+	0x0B,                   // in:   dec  bc
+	0x78,                   //       ld   a,b
+	0xB1,                   //       or   c
+	0x20, 0xFB,             //       jr   nz,in
+	0x18, 0xF6,             //       jr   loop
+};
+// Loaded at address 0x0038.
+static const byte INTERRUPT_HANDLER[] = {
+	0xF5,                   //       push af
+	0x3E, 0x01,             //       ld   a,1
+	0xD3, 0x99,             //       out  (99h),a
+	0x3E, 0x8F,             //       ld   a,8Fh
+	0xD3, 0x99,             //       out  (99h),a   ; R#15: select S#1
+	0xDB, 0x99,             //       in   a,(99h)   ; acknowledge line int
+	0x3A, 0x00, 0xC0,       //       ld   a,(0C000h)
+	0xC6, 0x04,             //       add  a,4
+	0x32, 0x00, 0xC0,       //       ld   (0C000h),a
+	0xD3, 0x99,             //       out  (99h),a
+	0x3E, 0x93,             //       ld   a,93h
+	0xD3, 0x99,             //       out  (99h),a   ; R#19: next line
+	0xAF,                   //       xor  a
+	0xD3, 0x99,             //       out  (99h),a
+	0x3E, 0x8F,             //       ld   a,8Fh
+	0xD3, 0x99,             //       out  (99h),a   ; R#15: select S#0
+	0xDB, 0x99,             //       in   a,(99h)   ; acknowledge vblank
+	0xF1,                   //       pop  af
+	0xFB,                   //       ei
+	0xC9,                   //       ret
+};
+
+struct Workload {
+	const char* name;
+	const byte* program;
+	size_t size;
+	const byte* handler; // can be nullptr
+	size_t handlerSize;
+};
+
+static const Workload workloads[] = {
+	{ "mix",       MIX,       sizeof(MIX),       nullptr, 0 },
+	{ "ldir",      LDIR,      sizeof(LDIR),      nullptr, 0 },
+	{ "vdp_out",   VDP_OUT,   sizeof(VDP_OUT),   nullptr, 0 },
+	{ "io",        IO,        sizeof(IO),        nullptr, 0 },
+	{ "interrupt", INTERRUPT, sizeof(INTERRUPT),
+	  INTERRUPT_HANDLER, sizeof(INTERRUPT_HANDLER) },
+};
+
+static const unsigned EMU_SECONDS = 10; // per run
+static const unsigned REPEAT = 3;       // report the fastest run
+
+static void load(MSXMotherBoard& board, word address, const byte* data, size_t size)
+{
+	auto& interface = board.getCPUInterface();
+	auto time = board.getCurrentTime();
+	for (size_t i = 0; i < size; ++i) {
+		interface.writeMem(address + i, data[i], time);
+	}
+}
+
+// Returns the host time in seconds.
+static double run(MSXMotherBoard& board, MSXCPU::CPUType type,
+                  const Workload& workload)
+{
+	auto& cpu = board.getCPU();
+	cpu.setActiveCPU(type);
+	// the switch only happens when the CPU executes
+	board.fastForward(board.getCurrentTime() + EmuDuration::usec(1), true);
+
+	load(board, 0x0100, workload.program, workload.size);
+	if (workload.handler) {
+		load(board, 0x0038, workload.handler, workload.handlerSize);
+	}
+	auto& regs = cpu.getRegisters();
+	regs.setPC(0x0100);
+	regs.setIFF1(false);
+	regs.setIFF2(false);
+	regs.setHALT(false);
+
+	using Clock = std::chrono::steady_clock;
+	auto start = Clock::now();
+	board.fastForward(board.getCurrentTime() + EmuDuration::sec(EMU_SECONDS), true);
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void cpu()
+{
+	Thread::setMainThread();
+	Reactor reactor;
+	reactor.init();
+
+	// The machine config is loaded from a file, the '.xml' extension is
+	// added by the loader.
+	std::string config = strCat(FileOperations::getTempDir(),
+	                            "/openmsx-cpu-benchmark");
+	try {
+		File file(config + ".xml", File::TRUNCATE);
+		file.write(MACHINE_CONFIG, strlen(MACHINE_CONFIG));
+	} catch (MSXException& e) {
+		std::cerr << "Couldn't write machine config: "
+		          << e.getMessage() << std::endl;
+		return;
+	}
+	try {
+		reactor.switchMachine(config);
+	} catch (MSXException& e) {
+		std::cerr << e.getMessage() << std::endl;
+		FileOperations::unlink(config + ".xml");
+		return;
+	}
+	FileOperations::unlink(config + ".xml");
+	auto& board = *reactor.getMotherBoard();
+	board.powerUp();
+
+	struct {
+		const char* name;
+		MSXCPU::CPUType type;
+		unsigned freq; // default clock frequency
+	} const cpus[] = {
+		{ "z80",  MSXCPU::CPU_Z80,  3579545 },
+		{ "r800", MSXCPU::CPU_R800, 7159090 },
+	};
+	for (auto& c : cpus) {
+		for (auto& w : workloads) {
+			double best = 1e99;
+			for (unsigned i = 0; i < REPEAT; ++i) {
+				best = std::min(best, run(board, c.type, w));
+			}
+			double mhz = double(c.freq) * EMU_SECONDS / best / 1e6;
+			benchmark::report(strCat(c.name, '_', w.name), mhz, "MHz");
+		}
+	}
+}
+BENCHMARK_CASE("cpu", cpu);
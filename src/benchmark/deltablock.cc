@@ -0,0 +1,56 @@
+#include "benchmark.hh"
+#include "DeltaBlock.hh"
+#include <memory>
+#include <vector>
+
+// Measures the calculation and the application of deltas between two
+// snapshots of a 4MB memory block (e.g. a mapper RAM) in which a few thousand
+// bytes changed, like the reverse feature does. Both the AVX2 and the generic
+// code paths are measured (the former only makes a difference on CPUs that
+// support it).
+
+using namespace openmsx;
+
+static const size_t SIZE = 4 * 1024 * 1024;
+static const unsigned REPEAT = 20;
+
+static void deltaBlock()
+{
+	std::vector<uint8_t> oldBuf(SIZE);
+	uint32_t state = 12345;
+	auto next = [&] { state = state * 1664525 + 1013904223; return state >> 8; };
+	for (auto& b : oldBuf) b = next();
+	auto newBuf = oldBuf;
+	for (unsigned i = 0; i < 4000; ++i) {
+		auto pos = next() % SIZE;
+		auto len = std::min<size_t>(next() % 40 + 1, SIZE - pos);
+		for (size_t j = 0; j < len; ++j) newBuf[pos + j] ^= 0x55;
+	}
+	auto prev = std::make_shared<DeltaBlockCopy>(oldBuf.data(), SIZE);
+	std::vector<uint8_t> out(SIZE);
+
+	for (bool avx2 : {false, true}) {
+		auto old = DeltaBlock::setUseAVX2(avx2);
+		std::cout << (avx2 ? " AVX2 (if supported)" : " generic") << std::endl;
+		benchmark::measure("calcDelta", 5, [&] {
+			uint64_t sum = 0;
+			for (unsigned i = 0; i < REPEAT; ++i) {
+				DeltaBlockDiff diff(prev, newBuf.data(), SIZE);
+				sum += diff.calcDelta(SIZE);
+			}
+			return sum;
+		});
+		DeltaBlockDiff diff(prev, newBuf.data(), SIZE);
+		diff.calcDelta(SIZE);
+		benchmark::measure("apply    ", 5, [&] {
+			uint64_t sum = 0;
+			for (unsigned i = 0; i < REPEAT; ++i) {
+				diff.apply(out.data(), SIZE);
+				sum += out[i];
+			}
+			return sum;
+		});
+		DeltaBlock::setUseAVX2(old);
+	}
+}
+BENCHMARK_CASE("deltablock", deltaBlock);
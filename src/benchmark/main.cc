@@ -0,0 +1,61 @@
+#include "benchmark.hh"
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+namespace benchmark {
+
+volatile uint64_t sink = 0;
+
+static std::vector<std::pair<const char*, Func>>& getBenchmarks()
+{
+	static std::vector<std::pair<const char*, Func>> benchmarks;
+	return benchmarks;
+}
+
+Registrar::Registrar(const char* name, Func func)
+{
+	getBenchmarks().emplace_back(name, func);
+}
+
+static const char* currentBenchmark = "";
+static std::ostringstream results;
+
+void report(const std::string& name, double value, const char* unit)
+{
+	std::cout << "  " << name << ": " << value << ' ' << unit << std::endl;
+	results << currentBenchmark << '/' << name << ' '
+	        << value << ' ' << unit << '\n';
+}
+
+} // namespace benchmark
+
+int main(int argc, char** argv)
+{
+	const char* output = nullptr;
+	const char* filter = "";
+	for (int i = 1; i < argc; ++i) {
+		if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc)) {
+			output = argv[++i];
+		} else {
+			filter = argv[i];
+		}
+	}
+	for (auto& b : benchmark::getBenchmarks()) {
+		if (!strstr(b.first, filter)) continue;
+		std::cout << b.first << std::endl;
+		benchmark::currentBenchmark = b.first;
+		b.second();
+	}
+	if (output) {
+		std::ofstream file(output);
+		file << benchmark::results.str();
+		if (!file) {
+			std::cerr << "Couldn't write " << output << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,179 @@
+#include "benchmark.hh"
+#include "LineScalers.hh"
+#include "LineScalersAVX2.hh"
+#include "Scale2xScaler.hh"
+#include "ScalerOutput.hh"
+#include "RawFrame.hh"
+#include "MemBuffer.hh"
+#include "build-info.hh"
+#include <cstring>
+
+// Measures the line scalers (LineScalers.hh) and the Scale2x scaler, which
+// are used to scale the MSX image to the host screen. Each measurement
+// processes a number of frames of 240 lines of 640 (or 320) pixels, in both
+// 16bpp and 32bpp. Both the AVX2 and the SSE2 (or generic) code paths are
+// measured (the former only makes a difference on CPUs that support AVX2).
+
+using namespace openmsx;
+
+static const unsigned WIDTH = 640;
+static const unsigned HEIGHT = 240;
+static const unsigned FRAMES = 50;
+static const unsigned REPEAT = 5;
+
+// Output for Scaler::scaleImage(), a simple memory buffer.
+template<typename Pixel> class BufferOutput final : public ScalerOutput<Pixel>
+{
+public:
+	BufferOutput(unsigned width_, unsigned height_)
+		: width(width_), height(height_), buffer(width_ * height_) {}
+
+	unsigned getWidth()  const override { return width; }
+	unsigned getHeight() const override { return height; }
+	Pixel* acquireLine(unsigned y) override
+	{
+		return buffer.data() + y * width;
+	}
+	void releaseLine(unsigned /*y*/, Pixel* /*buf*/) override {}
+	void fillLine(unsigned y, Pixel color) override
+	{
+		Pixel* line = acquireLine(y);
+		for (unsigned x = 0; x < width; ++x) line[x] = color;
+	}
+
+private:
+	unsigned width, height;
+	MemBuffer<Pixel, 64> buffer;
+};
+
+static SDL_PixelFormat createFormat(unsigned bpp)
+{
+	SDL_PixelFormat format;
+	memset(&format, 0, sizeof(format));
+	format.BitsPerPixel = bpp;
+	format.BytesPerPixel = bpp / 8;
+	if (bpp == 16) {
+		// RGB 565
+		format.Rmask = 0xF800; format.Rshift = 11; format.Rloss = 3;
+		format.Gmask = 0x07E0; format.Gshift =  5; format.Gloss = 2;
+		format.Bmask = 0x001F; format.Bshift =  0; format.Bloss = 3;
+		format.Amask = 0x0000; format.Ashift =  0; format.Aloss = 8;
+	} else {
+		// ARGB 8888
+		format.Rmask = 0x00FF0000; format.Rshift = 16;
+		format.Gmask = 0x0000FF00; format.Gshift =  8;
+		format.Bmask = 0x000000FF; format.Bshift =  0;
+		format.Amask = 0xFF000000; format.Ashift = 24;
+	}
+	return format;
+}
+
+// Apply 'f(line)' to all lines of FRAMES frames.
+template<typename F> static uint64_t allLines(F f)
+{
+	for (unsigned i = 0; i < FRAMES * HEIGHT; ++i) {
+		f(i % HEIGHT);
+	}
+	return FRAMES;
+}
+
+template<typename Pixel> static void scalers(unsigned bpp)
+{
+	SDL_PixelFormat format = createFormat(bpp);
+	PixelOperations<Pixel> pixelOps(format);
+
+	// Input: two frames with random pixels, output: three times as wide.
+	// For 16bpp some pixels of the second frame are made transparent (see
+	// PixelOperations::alphaBlend()), in 32bpp the alpha values are random.
+	MemBuffer<Pixel, 64> in1(WIDTH * HEIGHT);
+	MemBuffer<Pixel, 64> in2(WIDTH * HEIGHT);
+	MemBuffer<Pixel, 64> out(3 * WIDTH * HEIGHT);
+	uint32_t state = 12345;
+	auto next = [&] { state = state * 1664525 + 1013904223; return state >> 8; };
+	for (unsigned i = 0; i < WIDTH * HEIGHT; ++i) {
+		in1[i] = Pixel(next());
+		in2[i] = ((sizeof(Pixel) == 2) && ((i % 3) == 0)) ? Pixel(0x0001)
+		                                                   : Pixel(next());
+	}
+	auto line1 = [&](unsigned y) { return in1.data() + y * WIDTH; };
+	auto line2 = [&](unsigned y) { return in2.data() + y * WIDTH; };
+	auto lineOut = [&](unsigned y) { return out.data() + 3 * y * WIDTH; };
+
+	// Input for Scale2x: a frame with few different colors, so that the
+	// edge rules actually kick in.
+	RawFrame frame(format, WIDTH, HEIGHT);
+	for (unsigned y = 0; y < HEIGHT; ++y) {
+		Pixel* line = frame.getLinePtrDirect<Pixel>(y);
+		for (unsigned x = 0; x < WIDTH; ++x) {
+			line[x] = ((next() % 4) == 0) ? in1[x] : in1[0];
+		}
+		frame.setLineWidth(y, WIDTH / 2);
+	}
+	Scale2xScaler<Pixel> scale2x(pixelOps);
+	BufferOutput<Pixel> dst(WIDTH, 2 * HEIGHT);
+
+	Scale_1on2<Pixel> scale_1on2;
+	Scale_2on1<Pixel> scale_2on1(pixelOps);
+	Scale_1on3<Pixel> scale_1on3;
+	Scale_2on3<Pixel> scale_2on3(pixelOps);
+	BlendLines<Pixel> blendLines(pixelOps);
+	AlphaBlendLines<Pixel> alphaBlendLines(pixelOps);
+
+	for (bool avx2 : {false, true}) {
+		auto old = LineScalersAVX2::setEnabled(avx2);
+		std::cout << ' ' << bpp << "bpp "
+		          << (avx2 ? "AVX2 (if supported)" : "SSE2/generic")
+		          << std::endl;
+		benchmark::measure("1on2       ", REPEAT, [&] {
+			return allLines([&](unsigned y) {
+				scale_1on2(line1(y), lineOut(y), 2 * WIDTH); });
+		});
+		benchmark::measure("2on1       ", REPEAT, [&] {
+			return allLines([&](unsigned y) {
+				scale_2on1(line1(y), lineOut(y), WIDTH / 2); });
+		});
+		benchmark::measure("1on3       ", REPEAT, [&] {
+			return allLines([&](unsigned y) {
+				scale_1on3(line1(y), lineOut(y), 3 * WIDTH); });
+		});
+		benchmark::measure("2on3       ", REPEAT, [&] {
+			return allLines([&](unsigned y) {
+				scale_2on3(line1(y), lineOut(y), 3 * WIDTH / 2); });
+		});
+		benchmark::measure("blend      ", REPEAT, [&] {
+			return allLines([&](unsigned y) {
+				blendLines(line1(y), line2(y), lineOut(y), WIDTH); });
+		});
+		benchmark::measure("alphaBlend ", REPEAT, [&] {
+			return allLines([&](unsigned y) {
+				alphaBlendLines(line2(y), line1(y), lineOut(y), WIDTH); });
+		});
+		if (sizeof(Pixel) == 4) {
+			// The constant color must be partly transparent.
+			Pixel color = Pixel(0x80000000 | next());
+			benchmark::measure("alphaBlendC", REPEAT, [&] {
+				return allLines([&](unsigned y) {
+					alphaBlendLines(color, line1(y), lineOut(y), WIDTH); });
+			});
+		}
+		benchmark::measure("scale2x    ", REPEAT, [&] {
+			for (unsigned i = 0; i < FRAMES; ++i) {
+				scale2x.scaleImage(frame, nullptr, 0, HEIGHT, WIDTH / 2,
+				                   dst, 0, 2 * HEIGHT);
+			}
+			return dst.acquireLine(0)[0];
+		});
+		LineScalersAVX2::setEnabled(old);
+	}
+}
+
+static void scalers()
+{
+#if HAVE_16BPP
+	scalers<uint16_t>(16);
+#endif
+#if HAVE_32BPP
+	scalers<uint32_t>(32);
+#endif
+}
+BENCHMARK_CASE("scalers", scalers);
@@ -431,6 +431,34 @@ void Interpreter::deleteNamespace(const std::string& name)
 	execute("namespace delete " + name);
 }
 
+void Interpreter::watchCommand(const char* name, const char* origin, bool& valid)
+{
+	valid = false;
+	// 'namespace origin' also resolves 'namespace import' aliases. Don't
+	// disturb the result of a possibly ongoing command.
+	Tcl_InterpState state = Tcl_SaveInterpState(interp, TCL_OK);
+	bool match = (Tcl_Eval(interp, strCat("namespace origin ", name).c_str()) == TCL_OK) &&
+	             (string_view(Tcl_GetStringResult(interp)) == origin);
+	Tcl_RestoreInterpState(interp, state);
+	if (!match) return;
+
+	for (auto* n : {name, origin}) {
+		// (re)install, the previous trace may have followed a rename
+		Tcl_UntraceCommand(interp, n, TCL_TRACE_RENAME | TCL_TRACE_DELETE,
+		                   commandTraceProc, &valid);
+		Tcl_TraceCommand  (interp, n, TCL_TRACE_RENAME | TCL_TRACE_DELETE,
+		                   commandTraceProc, &valid);
+	}
+	valid = true;
+}
+
+void Interpreter::commandTraceProc(ClientData clientData, Tcl_Interp* /*interp*/,
+                                   const char* /*oldName*/, const char* /*newName*/,
+                                   int /*flags*/)
+{
+	*static_cast<bool*>(clientData) = false;
+}
+
 void Interpreter::poll()
 {
 	//Tcl_ServiceAll();
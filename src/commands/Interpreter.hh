@@ -48,6 +48,14 @@ public:
 	  */
 	void deleteNamespace(const std::string& name);
 
+	/** Checks whether the command 'name' (e.g. "::reg") is (an imported
+	  * alias of) the command 'origin' (e.g. "::cpuregs::reg"). If so,
+	  * 'valid' is set to true, and it's reset to false as soon as either
+	  * of these commands gets renamed, deleted or redefined. Otherwise
+	  * 'valid' is set to false.
+	  */
+	void watchCommand(const char* name, const char* origin, bool& valid);
+
 	TclParser parse(string_view command);
 
 	void poll();
@@ -59,6 +67,9 @@ private:
 	                       int objc, Tcl_Obj* const objv[]);
 	static char* traceProc(ClientData clientData, Tcl_Interp* interp,
 	                       const char* part1, const char* part2, int flags);
+	static void commandTraceProc(ClientData clientData, Tcl_Interp* interp,
+	                             const char* oldName, const char* newName,
+	                             int flags);
 
 	EventDistributor& eventDistributor;
 
@@ -3,6 +3,7 @@
 #include "CliComm.hh"
 #include "CommandException.hh"
 #include "StringSetting.hh"
+#include "Thread.hh"
 #include "memory.hh"
 #include <iostream>
 
@@ -10,6 +11,13 @@ using std::string;
 
 namespace openmsx {
 
+// The Tcl interpreter can only be used from the main thread. Callbacks
+// triggered from a BatchRunner worker thread are dropped.
+static bool isCallable()
+{
+	return Thread::isMainThread();
+}
+
 TclCallback::TclCallback(
 		CommandController& controller,
 		string_view name,
@@ -39,6 +47,7 @@ TclObject TclCallback::getValue() const
 
 TclObject TclCallback::execute()
 {
+	if (!isCallable()) return TclObject();
 	const auto& callback = getValue();
 	if (callback.empty()) return TclObject();
 
@@ -49,6 +58,7 @@ TclObject TclCallback::execute()
 
 TclObject TclCallback::execute(int arg1)
 {
+	if (!isCallable()) return TclObject();
 	const auto& callback = getValue();
 	if (callback.empty()) return TclObject();
 
@@ -60,6 +70,7 @@ TclObject TclCallback::execute(int arg1)
 
 TclObject TclCallback::execute(int arg1, int arg2)
 {
+	if (!isCallable()) return TclObject();
 	const auto& callback = getValue();
 	if (callback.empty()) return TclObject();
 
@@ -72,6 +83,7 @@ TclObject TclCallback::execute(int arg1, int arg2)
 
 TclObject TclCallback::execute(int arg1, string_view arg2)
 {
+	if (!isCallable()) return TclObject();
 	const auto& callback = getValue();
 	if (callback.empty()) return TclObject();
 
@@ -84,6 +96,7 @@ TclObject TclCallback::execute(int arg1, string_view arg2)
 
 TclObject TclCallback::execute(string_view arg1, string_view arg2)
 {
+	if (!isCallable()) return TclObject();
 	const auto& callback = getValue();
 	if (callback.empty()) return TclObject();
 
@@ -5,6 +5,7 @@
 #include "FileException.hh"
 #include "MemBuffer.hh"
 #include "rapidsax.hh"
+#include <cstring>
 
 namespace openmsx {
 namespace XMLLoader {
@@ -28,6 +29,9 @@ private:
 	string_view systemID;
 };
 
+static XMLElement parse(MemBuffer<char>& buf, string_view filename,
+                        string_view systemID);
+
 XMLElement load(string_view filename, string_view systemID)
 {
 	MemBuffer<char> buf;
@@ -40,7 +44,21 @@ XMLElement load(string_view filename, string_view systemID)
 	} catch (FileException& e) {
 		throw XMLException(filename, ": failed to read: ", e.getMessage());
 	}
+	return parse(buf, filename, systemID);
+}
+
+XMLElement loadFromString(string_view xml, string_view name,
+                          string_view systemID)
+{
+	MemBuffer<char> buf(xml.size() + rapidsax::EXTRA_BUFFER_SPACE);
+	memcpy(buf.data(), xml.data(), xml.size());
+	buf[xml.size()] = 0;
+	return parse(buf, name, systemID);
+}
 
+static XMLElement parse(MemBuffer<char>& buf, string_view filename,
+                        string_view systemID)
+{
 	XMLElementParser handler;
 	try {
 		rapidsax::parse<rapidsax::trimWhitespace>(handler, buf.data());
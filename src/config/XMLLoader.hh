@@ -8,6 +8,11 @@ namespace XMLLoader {
 
 	XMLElement load(string_view filename, string_view systemID);
 
+	/** Like load(), but parse an XML document that's already in memory.
+	  * 'name' is only used in error messages. */
+	XMLElement loadFromString(string_view xml, string_view name,
+	                          string_view systemID);
+
 } // namespace XMLLoader
 } // namespace openmsx
 
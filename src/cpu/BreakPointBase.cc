@@ -1,23 +1,126 @@
 #include "BreakPointBase.hh"
+#include "CompiledCondition.hh"
+#include "MSXMotherBoard.hh"
+#include "MSXCPU.hh"
+#include "MSXCPUInterface.hh"
+#include "Reactor.hh"
+#include "Interpreter.hh"
 #include "CommandException.hh"
 #include "GlobalCliComm.hh"
 #include "ScopedAssign.hh"
+#include <algorithm>
+#include <iterator>
 
 namespace openmsx {
 
+// The Tcl commands a compiled condition may use, together with the command
+// from the standard scripts it replaces. The user can redefine these, then
+// the compiled version is no longer equivalent. There's only one Tcl
+// interpreter, so this table can be shared by all breakpoints.
+struct StandardCommand {
+	const char* name;
+	const char* origin;
+	bool valid; // see Interpreter::watchCommand()
+};
+static StandardCommand standardCommands[] = {
+	{ "::reg",          "::cpuregs::reg",        false },
+	{ "::cpuregs::reg", "::cpuregs::reg",        false },
+	{ "::peek",         "::disasm::peek",        false },
+	{ "::peek8",        "::disasm::peek8",       false },
+	{ "::peek_u8",      "::disasm::peek_u8",     false },
+	{ "::peek_s8",      "::disasm::peek_s8",     false },
+	{ "::peek16",       "::disasm::peek16",      false },
+	{ "::peek16_LE",    "::disasm::peek16_LE",   false },
+	{ "::peek16_BE",    "::disasm::peek16_BE",   false },
+	{ "::peek_u16",     "::disasm::peek_u16",    false },
+	{ "::peek_u16LE",   "::disasm::peek_u16LE",  false },
+	{ "::peek_u16BE",   "::disasm::peek_u16BE",  false },
+	{ "::peek_s16",     "::disasm::peek_s16",    false },
+	{ "::peek_s16LE",   "::disasm::peek_s16LE",  false },
+	{ "::peek_s16BE",   "::disasm::peek_s16BE",  false },
+	{ "::expr",         "::expr",                false },
+};
+
+static std::vector<StandardCommand*> getStandardCommands(
+	const CompiledCondition* compiled)
+{
+	std::vector<StandardCommand*> result;
+	if (!compiled) return result;
+	for (auto& cmd : compiled->getCommands()) {
+		auto it = std::find_if(std::begin(standardCommands), std::end(standardCommands),
+			[&](const StandardCommand& s) { return cmd == (s.name + 2); });
+		if (it == std::end(standardCommands)) return {nullptr};
+		result.push_back(&*it);
+	}
+	return result;
+}
+
+// Gives compiled conditions access to the same state as the 'reg' and 'peek'
+// Tcl procs (only valid for the active machine).
+class MotherBoardConditionContext final : public CompiledCondition::Context
+{
+public:
+	explicit MotherBoardConditionContext(MSXMotherBoard& motherBoard_)
+		: motherBoard(motherBoard_) {}
+
+	const CPURegs& getRegisters() override
+	{
+		return motherBoard.getCPU().getRegisters();
+	}
+	byte peekMem(word address) override
+	{
+		return motherBoard.getCPUInterface().peekMem(
+			address, motherBoard.getCurrentTime());
+	}
+
+private:
+	MSXMotherBoard& motherBoard;
+};
+
+
 BreakPointBase::BreakPointBase(TclObject command_, TclObject condition_)
 	: command(std::move(command_)), condition(std::move(condition_))
+	, compiled(CompiledCondition::compile(condition.getString()))
+	, commands(getStandardCommands(compiled.get()))
 	, executing(false)
 {
 }
 
-bool BreakPointBase::isTrue(GlobalCliComm& cliComm, Interpreter& interp) const
+bool BreakPointBase::canUseCompiled(Interpreter& interp,
+                                    MSXMotherBoard& motherBoard) const
+{
+	if (!compiled) return false;
+	// Breakpoints are global, but 'reg' and 'peek' act on the active machine.
+	if (&motherBoard != motherBoard.getReactor().getMotherBoard()) return false;
+	for (auto* cmd : commands) {
+		if (!cmd) return false;
+		if (!cmd->valid) {
+			// Not yet checked, or redefined by the user since. Note
+			// that the standard procs are loaded lazily, so this can
+			// only succeed after they're used via Tcl for the first time.
+			interp.watchCommand(cmd->name, cmd->origin, cmd->valid);
+			if (!cmd->valid) return false;
+		}
+	}
+	return true;
+}
+
+bool BreakPointBase::isTrue(GlobalCliComm& cliComm, Interpreter& interp,
+                            MSXMotherBoard& motherBoard) const
 {
 	if (condition.getString().empty()) {
 		// unconditional bp
 		return true;
 	}
 	try {
+		if (canUseCompiled(interp, motherBoard)) {
+			try {
+				MotherBoardConditionContext context(motherBoard);
+				return compiled->evaluate(context);
+			} catch (CompiledCondition::Overflow&) {
+				// rare, let Tcl handle it
+			}
+		}
 		return condition.evalBool(interp);
 	} catch (CommandException& e) {
 		cliComm.printWarning(e.getMessage());
@@ -25,14 +128,15 @@ bool BreakPointBase::isTrue(GlobalCliComm& cliComm, Interpreter& interp) const
 	}
 }
 
-void BreakPointBase::checkAndExecute(GlobalCliComm& cliComm, Interpreter& interp)
+void BreakPointBase::checkAndExecute(GlobalCliComm& cliComm, Interpreter& interp,
+                                     MSXMotherBoard& motherBoard)
 {
 	if (executing) {
 		// no recursive execution
 		return;
 	}
 	ScopedAssign<bool> sa(executing, true);
-	if (isTrue(cliComm, interp)) {
+	if (isTrue(cliComm, interp, motherBoard)) {
 		try {
 			command.executeCommand(interp, true); // compile command
 		} catch (CommandException& e) {
@@ -3,11 +3,16 @@
 
 #include "TclObject.hh"
 #include "string_view.hh"
+#include <memory>
+#include <vector>
 
 namespace openmsx {
 
 class Interpreter;
 class GlobalCliComm;
+class MSXMotherBoard;
+class CompiledCondition;
+struct StandardCommand;
 
 /** Base class for CPU break and watch points.
  */
@@ -19,7 +24,8 @@ public:
 	TclObject getConditionObj() const { return condition; }
 	TclObject getCommandObj()   const { return command; }
 
-	void checkAndExecute(GlobalCliComm& cliComm, Interpreter& interp);
+	void checkAndExecute(GlobalCliComm& cliComm, Interpreter& interp,
+	                     MSXMotherBoard& motherBoard);
 
 protected:
 	// Note: we require GlobalCliComm here because breakpoint objects can
@@ -28,10 +34,18 @@ protected:
 	BreakPointBase(TclObject command, TclObject condition);
 
 private:
-	bool isTrue(GlobalCliComm& cliComm, Interpreter& interp) const;
+	bool isTrue(GlobalCliComm& cliComm, Interpreter& interp,
+	            MSXMotherBoard& motherBoard) const;
+	bool canUseCompiled(Interpreter& interp,
+	                    MSXMotherBoard& motherBoard) const;
 
 	TclObject command;
 	TclObject condition;
+	// Native version of the condition, nullptr if it can't be compiled
+	// (then it's evaluated via Tcl).
+	std::shared_ptr<const CompiledCondition> compiled;
+	// The Tcl commands used by 'compiled', nullptr for a non-standard one.
+	std::vector<StandardCommand*> commands;
 	bool executing;
 };
 
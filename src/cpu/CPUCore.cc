@@ -40,6 +40,14 @@
 // from then on this pointer is used for all further accesses to this region,
 // until the cache is invalidated again.
 //
+// Often only a few addresses in a cacheLine have side effects, for example a
+// mapper register at the end of a ROM block, or a watchpoint. So when a region
+// can't be cached as a whole, we try again at the granularity of 16 byte
+// sub-lines: we get a pointer for the whole region plus a bitmask of the
+// sub-lines that must still use the slow way. These regions still go through
+// the (non-inlined) slow path, but for most addresses that only means checking
+// the bitmask instead of executing a virtual method call.
+//
 //
 // INSTRUCTION EMULATION
 // ---------------------
@@ -160,6 +168,8 @@
 
 #include "CPUCore.hh"
 #include "MSXCPUInterface.hh"
+#include "CPUProfiler.hh"
+#include "CPUTraceBuffer.hh"
 #include "Scheduler.hh"
 #include "MSXMotherBoard.hh"
 #include "CliComm.hh"
@@ -198,6 +208,15 @@
 // flag to the compiler. This is for example done in the super-opt flavour.
 // See build/flavour-super-opt.mk
 
+//
+// #define USE_LAZY_FLAGS
+//
+// Selects lazy evaluation of the flags for the 8-bit arithmetic and logical
+// instructions (see CPUCore::LazyOp), instead of calculating F immediately.
+// This is a property of the CPU_POLICY (see Z80TYPE::LAZY_FLAGS), so it's
+// enabled by passing -DUSE_LAZY_FLAGS to the compiler. It's not enabled by
+// default, use 'make benchmark' to compare both strategies on your CPU.
+
 
 using std::string;
 
@@ -285,6 +304,9 @@ static CONSTEXPR Table table = initTables();
 // the (logical) lifetime of this variable cannot overlap between execution
 // of two MSX machines.
 static word start_pc;
+// Opcode bytes at start_pc, read before the instruction is executed (it
+// could modify itself). Only for the trace buffer.
+static byte start_opcode[4];
 
 // conditions
 struct CondC  { bool operator()(byte f) const { return  (f & C_FLAG) != 0; } };
@@ -300,7 +322,8 @@ struct CondTrue { bool operator()(byte) const { return true; } };
 template<class T> CPUCore<T>::CPUCore(
 		MSXMotherBoard& motherboard_, const string& name,
 		const BooleanSetting& traceSetting_,
-		TclCallback& diHaltCallback_, EmuTime::param time)
+		TclCallback& diHaltCallback_, CPUProfiler& profiler_,
+		CPUTraceBuffer& traceBuffer_, EmuTime::param time)
 	: CPURegs(T::isR800())
 	, T(time, motherboard_.getScheduler())
 	, motherboard(motherboard_)
@@ -308,6 +331,8 @@ template<class T> CPUCore<T>::CPUCore(
 	, interface(nullptr)
 	, traceSetting(traceSetting_)
 	, diHaltCallback(diHaltCallback_)
+	, profiler(profiler_)
+	, traceBuffer(traceBuffer_)
 	, IRQStatus(motherboard.getDebugger(), name + ".pendingIRQ",
 	            "Non-zero if there are pending IRQs (thus CPU would enter "
 	            "interrupt routine in EI mode).",
@@ -325,15 +350,19 @@ template<class T> CPUCore<T>::CPUCore(
 		strCat("custom ", name, " frequency (only valid when unlocked)"),
 		T::CLOCK_FREQ, 1000000, 1000000000)
 	, freq(T::CLOCK_FREQ)
+	, settingFreqLocked(true)
+	, settingFreq(T::CLOCK_FREQ)
+	, settingTrace(false)
 	, NMIStatus(0)
+	, stopAddress(-1)
 	, nmiEdge(false)
 	, exitLoop(false)
-	, tracingEnabled(traceSetting.getBoolean())
+	, tracingEnabled(false)
 	, isTurboR(motherboard.isTurboR())
 {
 	static_assert(!std::is_polymorphic<CPUCore<T>>::value,
 		"keep CPUCore non-virtual to keep PC at offset 0");
-	doSetFreq();
+	loadSettings();
 	doReset(time);
 }
 
@@ -356,6 +385,30 @@ template<class T> void CPUCore<T>::invalidateMemCache(unsigned start, unsigned s
 	memset(&writeCacheLine [first], 0, num * sizeof(byte*)); //
 	memset(&readCacheTried [first], 0, num * sizeof(bool));  // FALSE
 	memset(&writeCacheTried[first], 0, num * sizeof(bool));  //
+	memset(&readCacheSubLine [first], 0, num * sizeof(byte*)); // nullptr
+	memset(&writeCacheSubLine[first], 0, num * sizeof(byte*)); //
+}
+
+template<class T> void CPUCore<T>::invalidateWriteCache(const byte* begin, const byte* end)
+{
+	for (unsigned i = 0; i < CacheLine::NUM; ++i) {
+		// the cached pointers are offset by the CPU address of the line
+		unsigned addr = i << CacheLine::BITS;
+		if (writeCacheLine[i]) {
+			const byte* p = writeCacheLine[i] + addr;
+			if ((begin <= p) && (p < end)) {
+				writeCacheLine[i] = nullptr;
+				writeCacheTried[i] = false;
+			}
+		}
+		if (writeCacheSubLine[i]) {
+			const byte* p = writeCacheSubLine[i] + addr;
+			if ((begin <= p) && (p < end)) {
+				writeCacheSubLine[i] = nullptr;
+				writeCacheTried[i] = false;
+			}
+		}
+	}
 }
 
 template<class T> void CPUCore<T>::doReset(EmuTime::param time)
@@ -429,7 +482,7 @@ template<class T> void CPUCore<T>::exitCPULoopAsync()
 }
 template<class T> void CPUCore<T>::exitCPULoopSync()
 {
-	assert(Thread::isMainThread());
+	assert(Thread::isEmulationThread());
 	exitLoop = true;
 	T::disableLimit();
 }
@@ -555,15 +608,27 @@ template<class T> void CPUCore<T>::disasmCommand(
 
 template<class T> void CPUCore<T>::update(const Setting& setting)
 {
-	if (&setting == &freqLocked) {
-		doSetFreq();
-	} else if (&setting == &freqValue) {
-		doSetFreq();
-	} else if (&setting == &traceSetting) {
-		tracingEnabled = traceSetting.getBoolean();
+	if ((&setting == &freqLocked) || (&setting == &freqValue) ||
+	    (&setting == &traceSetting)) {
+		loadSettings();
 	}
 }
 
+template<class T> void CPUCore<T>::loadSettings()
+{
+	assert(Thread::isMainThread());
+	settingFreqLocked = freqLocked.getBoolean();
+	settingFreq = freqValue.getInt();
+	settingTrace = traceSetting.getBoolean();
+	doSetFreq();
+	updateTracing();
+}
+
+template<class T> void CPUCore<T>::updateTracing()
+{
+	tracingEnabled = settingTrace || traceBuffer.isActive();
+}
+
 template<class T> void CPUCore<T>::setFreq(unsigned freq_)
 {
 	freq = freq_;
@@ -572,12 +637,12 @@ template<class T> void CPUCore<T>::setFreq(unsigned freq_)
 
 template<class T> void CPUCore<T>::doSetFreq()
 {
-	if (freqLocked.getBoolean()) {
+	if (settingFreqLocked) {
 		// locked, use value set via setFreq()
 		T::setFreq(freq);
 	} else {
 		// unlocked, use value set by user
-		T::setFreq(freqValue.getInt());
+		T::setFreq(settingFreq);
 	}
 }
 
@@ -614,9 +679,23 @@ NEVER_INLINE byte CPUCore<T>::RDMEMslow(unsigned address, unsigned cc)
 			readCacheLine[high] = line - addrBase;
 			return readCacheLine[high][address];
 		}
+		// maybe (part of) the line can be cached at a finer granularity
+		unsigned uncacheable;
+		if (const byte* line = interface->getReadCacheSubLines(addrBase, uncacheable)) {
+			readCacheSubLine[high] = line - addrBase;
+			readCacheSubMask[high] = uncacheable;
+		}
+		readCacheTried[high] = true;
+	}
+	if (const byte* line = readCacheSubLine[high]) {
+		if (!(readCacheSubMask[high] & CacheLine::subLineBit(address))) {
+			// cached sub-line
+			T::template PRE_MEM<PRE_PB, POST_PB>(address);
+			T::template POST_MEM<       POST_PB>(address);
+			return line[address];
+		}
 	}
 	// uncacheable
-	readCacheTried[high] = true;
 	T::template PRE_MEM<PRE_PB, POST_PB>(address);
 	EmuTime time = T::getTimeFast(cc);
 	scheduler.schedule(time);
@@ -718,9 +797,24 @@ NEVER_INLINE void CPUCore<T>::WRMEMslow(unsigned address, byte value, unsigned c
 			writeCacheLine[high][address] = value;
 			return;
 		}
+		// maybe (part of) the line can be cached at a finer granularity
+		unsigned uncacheable;
+		if (byte* line = interface->getWriteCacheSubLines(addrBase, uncacheable)) {
+			writeCacheSubLine[high] = line - addrBase;
+			writeCacheSubMask[high] = uncacheable;
+		}
+		writeCacheTried[high] = true;
+	}
+	if (byte* line = writeCacheSubLine[high]) {
+		if (!(writeCacheSubMask[high] & CacheLine::subLineBit(address))) {
+			// cached sub-line
+			T::template PRE_MEM<PRE_PB, POST_PB>(address);
+			T::template POST_MEM<       POST_PB>(address);
+			line[address] = value;
+			return;
+		}
 	}
 	// uncacheable
-	writeCacheTried[high] = true;
 	T::template PRE_MEM<PRE_PB, POST_PB>(address);
 	EmuTime time = T::getTimeFast(cc);
 	scheduler.schedule(time);
@@ -863,7 +957,7 @@ template<class T> inline void CPUCore<T>::irq2()
 	T::add(T::CC_IRQ2);
 }
 
-template<class T>
+template<class T> template<bool PROFILE>
 void CPUCore<T>::executeInstructions()
 {
 	checkNoCurrentFlags();
@@ -914,6 +1008,7 @@ void CPUCore<T>::executeInstructions()
 	if (likely(!T::limitReached())) { \
 		incR(1); \
 		unsigned address = getPC(); \
+		if (PROFILE) profiler.count(address); \
 		const byte* line = readCacheLine[address >> CacheLine::BITS]; \
 		if (likely(line != nullptr)) { \
 			T::template PRE_MEM<false, false>(address); \
@@ -976,6 +1071,7 @@ void CPUCore<T>::executeInstructions()
 #ifndef USE_COMPUTED_GOTO
 start:
 #endif
+	if (PROFILE) profiler.count(getPC());
 	unsigned ixy; // for dd_cb/fd_cb
 	byte opcodeMain = RDMEM_OPCODE<0>(T::CC_MAIN);
 	incR(1);
@@ -1205,15 +1301,15 @@ CASE(E6) { II ii = and_byte();   NEXT; }
 CASE(EE) { II ii = xor_byte();   NEXT; }
 CASE(F6) { II ii = or_byte();    NEXT; }
 CASE(FE) { II ii = cp_byte();    NEXT; }
-CASE(C0) { II ii = ret(CondNZ()); NEXT; }
-CASE(C8) { II ii = ret(CondZ ()); NEXT; }
-CASE(D0) { II ii = ret(CondNC()); NEXT; }
-CASE(D8) { II ii = ret(CondC ()); NEXT; }
-CASE(E0) { II ii = ret(CondPO()); NEXT; }
-CASE(E8) { II ii = ret(CondPE()); NEXT; }
-CASE(F0) { II ii = ret(CondP ()); NEXT; }
-CASE(F8) { II ii = ret(CondM ()); NEXT; }
-CASE(C9) { II ii = ret();         NEXT; }
+CASE(C0) { II ii = ret<PROFILE>(CondNZ()); NEXT; }
+CASE(C8) { II ii = ret<PROFILE>(CondZ ()); NEXT; }
+CASE(D0) { II ii = ret<PROFILE>(CondNC()); NEXT; }
+CASE(D8) { II ii = ret<PROFILE>(CondC ()); NEXT; }
+CASE(E0) { II ii = ret<PROFILE>(CondPO()); NEXT; }
+CASE(E8) { II ii = ret<PROFILE>(CondPE()); NEXT; }
+CASE(F0) { II ii = ret<PROFILE>(CondP ()); NEXT; }
+CASE(F8) { II ii = ret<PROFILE>(CondM ()); NEXT; }
+CASE(C9) { II ii = ret<PROFILE>();         NEXT; }
 CASE(C2) { II ii = jp(CondNZ()); NEXT; }
 CASE(CA) { II ii = jp(CondZ ()); NEXT; }
 CASE(D2) { II ii = jp(CondNC()); NEXT; }
@@ -1223,15 +1319,15 @@ CASE(EA) { II ii = jp(CondPE()); NEXT; }
 CASE(F2) { II ii = jp(CondP ()); NEXT; }
 CASE(FA) { II ii = jp(CondM ()); NEXT; }
 CASE(C3) { II ii = jp(CondTrue()); NEXT; }
-CASE(C4) { II ii = call(CondNZ()); NEXT; }
-CASE(CC) { II ii = call(CondZ ()); NEXT; }
-CASE(D4) { II ii = call(CondNC()); NEXT; }
-CASE(DC) { II ii = call(CondC ()); NEXT; }
-CASE(E4) { II ii = call(CondPO()); NEXT; }
-CASE(EC) { II ii = call(CondPE()); NEXT; }
-CASE(F4) { II ii = call(CondP ()); NEXT; }
-CASE(FC) { II ii = call(CondM ()); NEXT; }
-CASE(CD) { II ii = call(CondTrue()); NEXT; }
+CASE(C4) { II ii = call<PROFILE>(CondNZ()); NEXT; }
+CASE(CC) { II ii = call<PROFILE>(CondZ ()); NEXT; }
+CASE(D4) { II ii = call<PROFILE>(CondNC()); NEXT; }
+CASE(DC) { II ii = call<PROFILE>(CondC ()); NEXT; }
+CASE(E4) { II ii = call<PROFILE>(CondPO()); NEXT; }
+CASE(EC) { II ii = call<PROFILE>(CondPE()); NEXT; }
+CASE(F4) { II ii = call<PROFILE>(CondP ()); NEXT; }
+CASE(FC) { II ii = call<PROFILE>(CondM ()); NEXT; }
+CASE(CD) { II ii = call<PROFILE>(CondTrue()); NEXT; }
 CASE(C1) { II ii = pop_SS <BC,0>(); NEXT; }
 CASE(D1) { II ii = pop_SS <DE,0>(); NEXT; }
 CASE(E1) { II ii = pop_SS <HL,0>(); NEXT; }
@@ -1240,14 +1336,14 @@ CASE(C5) { II ii = push_SS<BC,0>(); NEXT; }
 CASE(D5) { II ii = push_SS<DE,0>(); NEXT; }
 CASE(E5) { II ii = push_SS<HL,0>(); NEXT; }
 CASE(F5) { II ii = push_SS<AF,0>(); NEXT; }
-CASE(C7) { II ii = rst<0x00>(); NEXT; }
-CASE(CF) { II ii = rst<0x08>(); NEXT; }
-CASE(D7) { II ii = rst<0x10>(); NEXT; }
-CASE(DF) { II ii = rst<0x18>(); NEXT; }
-CASE(E7) { II ii = rst<0x20>(); NEXT; }
-CASE(EF) { II ii = rst<0x28>(); NEXT; }
-CASE(F7) { II ii = rst<0x30>(); NEXT; }
-CASE(FF) { II ii = rst<0x38>(); NEXT; }
+CASE(C7) { II ii = rst<PROFILE, 0x00>(); NEXT; }
+CASE(CF) { II ii = rst<PROFILE, 0x08>(); NEXT; }
+CASE(D7) { II ii = rst<PROFILE, 0x10>(); NEXT; }
+CASE(DF) { II ii = rst<PROFILE, 0x18>(); NEXT; }
+CASE(E7) { II ii = rst<PROFILE, 0x20>(); NEXT; }
+CASE(EF) { II ii = rst<PROFILE, 0x28>(); NEXT; }
+CASE(F7) { II ii = rst<PROFILE, 0x30>(); NEXT; }
+CASE(FF) { II ii = rst<PROFILE, 0x38>(); NEXT; }
 CASE(CB) {
 	setPC(getPC() + 1); // M1 cycle at this point
 	byte cb_opcode = RDMEM_OPCODE<0>(T::CC_PREFIX);
@@ -1618,7 +1714,7 @@ CASE(ED) {
 
 		case 0x45: case 0x4d: case 0x55: case 0x5d:
 		case 0x65: case 0x6d: case 0x75: case 0x7d:
-		           { II ii = retn(); NEXT_STOP; }
+		           { II ii = retn<PROFILE>(); NEXT_STOP; }
 		case 0x46: case 0x4e: case 0x66: case 0x6e:
 		           { II ii = im_N<0>(); NEXT; }
 		case 0x56: case 0x76:
@@ -2463,6 +2559,17 @@ xx_cb: {
 template<class T> inline void CPUCore<T>::cpuTracePre()
 {
 	start_pc = getPC();
+	if (unlikely(tracingEnabled)) {
+		cpuTracePre_slow();
+	}
+}
+template<class T> void CPUCore<T>::cpuTracePre_slow()
+{
+	if (traceBuffer.isActive()) {
+		for (int i = 0; i < 4; ++i) {
+			start_opcode[i] = interface->peekMem(start_pc + i, T::getTimeFast());
+		}
+	}
 }
 template<class T> inline void CPUCore<T>::cpuTracePost()
 {
@@ -2472,6 +2579,13 @@ template<class T> inline void CPUCore<T>::cpuTracePost()
 }
 template<class T> void CPUCore<T>::cpuTracePost_slow()
 {
+	if (traceBuffer.isActive()) {
+		syncFlags();
+		traceBuffer.record(*this, start_pc, start_opcode, T::getTimeFast(),
+		                   T::isR800());
+	}
+	if (!settingTrace) return;
+
 	byte opbuf[4];
 	string dasmOutput;
 	dasm(*interface, start_pc, opbuf, dasmOutput, T::getTimeFast());
@@ -2487,11 +2601,12 @@ template<class T> void CPUCore<T>::cpuTracePost_slow()
 	     << std::endl << std::dec;
 }
 
-template<class T> void CPUCore<T>::executeSlow()
+template<class T> template<bool PROFILE> void CPUCore<T>::executeSlow()
 {
 	if (unlikely(nmiEdge)) {
 		nmiEdge = false;
 		nmi(); // NMI occured
+		if (PROFILE) profiler.call(getPC(), getSP() + 2, T::getTimeFast());
 	} else if (unlikely(IRQStatus && getIFF1() && !prevWasEI())) {
 		// normal interrupt
 		if (unlikely(prevWasLDAI())) {
@@ -2526,6 +2641,7 @@ template<class T> void CPUCore<T>::executeSlow()
 			default:
 				UNREACHABLE;
 		}
+		if (PROFILE) profiler.call(getPC(), getSP() + 2, T::getTimeFast());
 	} else if (unlikely(getHALT())) {
 		// in halt mode
 		incR(T::advanceHalt(T::haltStates(), scheduler.getNext()));
@@ -2533,7 +2649,7 @@ template<class T> void CPUCore<T>::executeSlow()
 	} else {
 		cpuTracePre();
 		assert(T::limitReached()); // we want only one instruction
-		executeInstructions();
+		executeInstructions<PROFILE>();
 		endInstruction();
 
 		if (T::isR800()) {
@@ -2563,11 +2679,21 @@ template<class T> void CPUCore<T>::execute(bool fastForward)
 	if (fastForward) {
 		interface->setFastForward(true);
 	}
-	execute2(fastForward);
+	// Only check for the profiler once, so that it has no overhead when
+	// it's not active.
+	if (unlikely(profiler.isActive())) {
+		EmuTime start = T::getTime();
+		execute2<true>(fastForward);
+		profiler.flush((T::getTime() - start).length() /
+		                   (MAIN_FREQ32 / T::getFreq()),
+		               T::getFreq());
+	} else {
+		execute2<false>(fastForward);
+	}
 	interface->setFastForward(false);
 }
 
-template<class T> void CPUCore<T>::execute2(bool fastForward)
+template<class T> template<bool PROFILE> void CPUCore<T>::execute2(bool fastForward)
 {
 	// note: Don't use getTimeFast() here, because 'once in a while' we
 	//       need to CPUClock::sync() to avoid overflow.
@@ -2579,7 +2705,7 @@ template<class T> void CPUCore<T>::execute2(bool fastForward)
 	if (!fastForward && (interface->isContinue() || interface->isStep())) {
 		// at least one instruction
 		interface->setContinue(false);
-		executeSlow();
+		executeSlow<PROFILE>();
 		scheduler.schedule(T::getTimeFast());
 		--slowInstructions;
 		if (interface->isStep()) {
@@ -2592,20 +2718,21 @@ template<class T> void CPUCore<T>::execute2(bool fastForward)
 	// Note: we call scheduler _after_ executing the instruction and before
 	// deciding between executeFast() and executeSlow() (because a
 	// SyncPoint could set an IRQ and then we must choose executeSlow())
-	if (fastForward ||
-	    (!interface->anyBreakPoints() && !tracingEnabled)) {
-		// fast path, no breakpoints, no tracing
+	if ((fastForward ||
+	     (!interface->anyBreakPoints() && !tracingEnabled)) &&
+	    (stopAddress < 0)) {
+		// fast path, no breakpoints, no tracing, no stop address
 		while (!needExitCPULoop()) {
 			if (slowInstructions) {
 				--slowInstructions;
-				executeSlow();
+				executeSlow<PROFILE>();
 				scheduler.schedule(T::getTimeFast());
 			} else {
 				while (slowInstructions == 0) {
 					T::enableLimit(); // does CPUClock::sync()
 					if (likely(!T::limitReached())) {
 						// multiple instructions
-						executeInstructions();
+						executeInstructions<PROFILE>();
 						// note: pipeline only shifted one
 						// step for multiple instructions
 						endInstruction();
@@ -2617,19 +2744,24 @@ template<class T> void CPUCore<T>::execute2(bool fastForward)
 		}
 	} else {
 		while (!needExitCPULoop()) {
-			if (interface->checkBreakPoints(getPC(), motherboard)) {
+			if (unlikely(isStopAddressReached())) {
+				break;
+			}
+			// breakpoints don't trigger in fast-forward mode
+			if (!fastForward &&
+			    interface->checkBreakPoints(getPC(), motherboard)) {
 				assert(interface->isBreaked());
 				break;
 			}
 			if (slowInstructions == 0) {
 				cpuTracePre();
 				assert(T::limitReached()); // only one instruction
-				executeInstructions();
+				executeInstructions<PROFILE>();
 				endInstruction();
 				cpuTracePost();
 			} else {
 				--slowInstructions;
-				executeSlow();
+				executeSlow<PROFILE>();
 			}
 			// Don't use getTimeFast() here, we need a call to
 			// CPUClock::sync() 'once in a while'. (During a
@@ -2822,8 +2954,38 @@ template<class T> template<Reg16 REG, int EE> II CPUCore<T>::ld_SS_word() {
 }
 
 
+// Lazy flags
+template<class T> void CPUCore<T>::syncFlags()
+{
+	if (T::LAZY_FLAGS && lazy.isPending()) {
+		CPURegs::setF(lazy.calcF(T::isR800()));
+		lazy.clear();
+	}
+}
+
+template<class T> template<typename COND>
+inline bool CPUCore<T>::checkCond(COND cond) const
+{
+	if (std::is_same<COND, CondTrue>::value) return true;
+	if (T::LAZY_FLAGS && lazy.isPending()) {
+		// the most common conditions don't need the full F register
+		if (std::is_same<COND, CondZ >::value) return  lazy.isZero();
+		if (std::is_same<COND, CondNZ>::value) return !lazy.isZero();
+		if (std::is_same<COND, CondC >::value) return getCarryLazy() != 0;
+		if (std::is_same<COND, CondNC>::value) return getCarryLazy() == 0;
+	}
+	return cond(getF());
+}
+
+
 // ADC A,r
 template<class T> inline void CPUCore<T>::ADC(byte reg) {
+	if (T::LAZY_FLAGS) {
+		unsigned res = getA() + reg + getCarryLazy();
+		setFlagsLazy(LAZY_ADD, getA(), reg, res);
+		setA(res);
+		return;
+	}
 	unsigned res = getA() + reg + ((getF() & C_FLAG) ? 1 : 0);
 	byte f = ((res & 0x100) ? C_FLAG : 0) |
 	         ((getA() ^ res ^ reg) & H_FLAG) |
@@ -2839,6 +3001,9 @@ template<class T> inline void CPUCore<T>::ADC(byte reg) {
 	setA(res);
 }
 template<class T> inline II CPUCore<T>::adc_a_a() {
+	if (T::LAZY_FLAGS) {
+		ADC(getA()); return {1, T::CC_CP_R};
+	}
 	unsigned res = 2 * getA() + ((getF() & C_FLAG) ? 1 : 0);
 	byte f = ((res & 0x100) ? C_FLAG : 0) |
 	         (res & H_FLAG) |
@@ -2874,6 +3039,11 @@ template<class T> template<Reg16 IXY> II CPUCore<T>::adc_a_xix() {
 // ADD A,r
 template<class T> inline void CPUCore<T>::ADD(byte reg) {
 	unsigned res = getA() + reg;
+	if (T::LAZY_FLAGS) {
+		setFlagsLazy(LAZY_ADD, getA(), reg, res);
+		setA(res);
+		return;
+	}
 	byte f = ((res & 0x100) ? C_FLAG : 0) |
 	         ((getA() ^ res ^ reg) & H_FLAG) |
 	         (((getA() ^ res) & (reg ^ res) & 0x80) >> 5) | // V_FLAG
@@ -2888,6 +3058,9 @@ template<class T> inline void CPUCore<T>::ADD(byte reg) {
 	setA(res);
 }
 template<class T> inline II CPUCore<T>::add_a_a() {
+	if (T::LAZY_FLAGS) {
+		ADD(getA()); return {1, T::CC_CP_R};
+	}
 	unsigned res = 2 * getA();
 	byte f = ((res & 0x100) ? C_FLAG : 0) |
 	         (res & H_FLAG) |
@@ -2923,6 +3096,10 @@ template<class T> template<Reg16 IXY> II CPUCore<T>::add_a_xix() {
 // AND r
 template<class T> inline void CPUCore<T>::AND(byte reg) {
 	setA(getA() & reg);
+	if (T::LAZY_FLAGS) {
+		setFlagsLazy(LAZY_AND, 0, 0, getA());
+		return;
+	}
 	byte f = 0;
 	if (T::isR800()) {
 		f |= table.ZSPH[getA()];
@@ -2933,6 +3110,9 @@ template<class T> inline void CPUCore<T>::AND(byte reg) {
 	setF(f);
 }
 template<class T> II CPUCore<T>::and_a() {
+	if (T::LAZY_FLAGS) {
+		AND(getA()); return {1, T::CC_CP_R};
+	}
 	byte f = 0;
 	if (T::isR800()) {
 		f |= table.ZSPH[getA()];
@@ -2963,6 +3143,10 @@ template<class T> template<Reg16 IXY> II CPUCore<T>::and_xix() {
 // CP r
 template<class T> inline void CPUCore<T>::CP(byte reg) {
 	unsigned q = getA() - reg;
+	if (T::LAZY_FLAGS) {
+		setFlagsLazy(LAZY_CP, getA(), reg, q);
+		return;
+	}
 	byte f = table.ZS[q & 0xFF] |
 	         ((q & 0x100) ? C_FLAG : 0) |
 	         N_FLAG |
@@ -2976,6 +3160,9 @@ template<class T> inline void CPUCore<T>::CP(byte reg) {
 	setF(f);
 }
 template<class T> II CPUCore<T>::cp_a() {
+	if (T::LAZY_FLAGS) {
+		CP(getA()); return {1, T::CC_CP_R};
+	}
 	byte f = ZS0 | N_FLAG;
 	if (T::isR800()) {
 		f |= getF() & (X_FLAG | Y_FLAG);
@@ -3005,6 +3192,10 @@ template<class T> template<Reg16 IXY> II CPUCore<T>::cp_xix() {
 // OR r
 template<class T> inline void CPUCore<T>::OR(byte reg) {
 	setA(getA() | reg);
+	if (T::LAZY_FLAGS) {
+		setFlagsLazy(LAZY_OR, 0, 0, getA());
+		return;
+	}
 	byte f = 0;
 	if (T::isR800()) {
 		f |= table.ZSP[getA()];
@@ -3015,6 +3206,9 @@ template<class T> inline void CPUCore<T>::OR(byte reg) {
 	setF(f);
 }
 template<class T> II CPUCore<T>::or_a() {
+	if (T::LAZY_FLAGS) {
+		OR(getA()); return {1, T::CC_CP_R};
+	}
 	byte f = 0;
 	if (T::isR800()) {
 		f |= table.ZSP[getA()];
@@ -3044,6 +3238,12 @@ template<class T> template<Reg16 IXY> II CPUCore<T>::or_xix() {
 
 // SBC A,r
 template<class T> inline void CPUCore<T>::SBC(byte reg) {
+	if (T::LAZY_FLAGS) {
+		unsigned res = getA() - reg - getCarryLazy();
+		setFlagsLazy(LAZY_SUB, getA(), reg, res);
+		setA(res);
+		return;
+	}
 	unsigned res = getA() - reg - ((getF() & C_FLAG) ? 1 : 0);
 	byte f = ((res & 0x100) ? C_FLAG : 0) |
 	         N_FLAG |
@@ -3059,6 +3259,9 @@ template<class T> inline void CPUCore<T>::SBC(byte reg) {
 	setA(res);
 }
 template<class T> II CPUCore<T>::sbc_a_a() {
+	if (T::LAZY_FLAGS) {
+		SBC(getA()); return {1, T::CC_CP_R};
+	}
 	if (T::isR800()) {
 		word t = (getF() & C_FLAG)
 		       ? (255 * 256 | ZS255 | C_FLAG | H_FLAG | N_FLAG)
@@ -3091,6 +3294,11 @@ template<class T> template<Reg16 IXY> II CPUCore<T>::sbc_a_xix() {
 // SUB r
 template<class T> inline void CPUCore<T>::SUB(byte reg) {
 	unsigned res = getA() - reg;
+	if (T::LAZY_FLAGS) {
+		setFlagsLazy(LAZY_SUB, getA(), reg, res);
+		setA(res);
+		return;
+	}
 	byte f = ((res & 0x100) ? C_FLAG : 0) |
 	         N_FLAG |
 	         ((getA() ^ res ^ reg) & H_FLAG) |
@@ -3105,6 +3313,9 @@ template<class T> inline void CPUCore<T>::SUB(byte reg) {
 	setA(res);
 }
 template<class T> II CPUCore<T>::sub_a() {
+	if (T::LAZY_FLAGS) {
+		SUB(getA()); return {1, T::CC_CP_R};
+	}
 	if (T::isR800()) {
 		word t = 0 * 256 | ZS0 | N_FLAG;
 		setAF(t | (getF() & (X_FLAG | Y_FLAG)));
@@ -3133,6 +3344,10 @@ template<class T> template<Reg16 IXY> II CPUCore<T>::sub_xix() {
 // XOR r
 template<class T> inline void CPUCore<T>::XOR(byte reg) {
 	setA(getA() ^ reg);
+	if (T::LAZY_FLAGS) {
+		setFlagsLazy(LAZY_OR, 0, 0, getA());
+		return;
+	}
 	byte f = 0;
 	if (T::isR800()) {
 		f |= table.ZSP[getA()];
@@ -3143,6 +3358,9 @@ template<class T> inline void CPUCore<T>::XOR(byte reg) {
 	setF(f);
 }
 template<class T> II CPUCore<T>::xor_a() {
+	if (T::LAZY_FLAGS) {
+		XOR(getA()); return {1, T::CC_CP_R};
+	}
 	if (T::isR800()) {
 		word t = 0 * 256 + ZSP0;
 		setAF(t | (getF() & (X_FLAG | Y_FLAG)));
@@ -3172,6 +3390,10 @@ template<class T> template<Reg16 IXY> II CPUCore<T>::xor_xix() {
 // DEC r
 template<class T> inline byte CPUCore<T>::DEC(byte reg) {
 	byte res = reg - 1;
+	if (T::LAZY_FLAGS) {
+		setFlagsLazy(LAZY_DEC, 0, reg, res);
+		return res;
+	}
 	byte f = ((reg & ~res & 0x80) >> 5) | // V_FLAG
 	         (((res & 0x0F) + 1) & H_FLAG) |
 	         N_FLAG;
@@ -3207,6 +3429,10 @@ template<class T> template<Reg16 IXY> II CPUCore<T>::dec_xix() {
 // INC r
 template<class T> inline byte CPUCore<T>::INC(byte reg) {
 	reg++;
+	if (T::LAZY_FLAGS) {
+		setFlagsLazy(LAZY_INC, 0, 0, reg);
+		return reg;
+	}
 	byte f = ((reg & -reg & 0x80) >> 5) | // V_FLAG
 	         (((reg & 0x0F) - 1) & H_FLAG) |
 		 0; // N_FLAG
@@ -3860,12 +4086,13 @@ template<class T> template<Reg16 REG, int EE> II CPUCore<T>::pop_SS() {
 
 
 // CALL nn / CALL cc,nn
-template<class T> template<typename COND> II CPUCore<T>::call(COND cond) {
+template<class T> template<bool PROFILE, typename COND> II CPUCore<T>::call(COND cond) {
 	unsigned addr = RD_WORD_PC<1>(T::CC_CALL_1);
 	T::setMemPtr(addr);
-	if (cond(getF())) {
+	if (checkCond(cond)) {
 		PUSH<T::EE_CALL>(getPC() + 3); /**/
 		setPC(addr);
+		if (PROFILE) profiler.call(addr, getSP() + 2, T::getTimeFast());
 		if (T::isR800()) {
 			setCurrentCall();
 			setSlowInstructions();
@@ -3878,10 +4105,11 @@ template<class T> template<typename COND> II CPUCore<T>::call(COND cond) {
 
 
 // RST n
-template<class T> template<unsigned ADDR> II CPUCore<T>::rst() {
+template<class T> template<bool PROFILE, unsigned ADDR> II CPUCore<T>::rst() {
 	PUSH<0>(getPC() + 1); /**/
 	T::setMemPtr(ADDR);
 	setPC(ADDR);
+	if (PROFILE) profiler.call(ADDR, getSP() + 2, T::getTimeFast());
 	if (T::isR800()) {
 		setCurrentCall();
 		setSlowInstructions();
@@ -3891,26 +4119,27 @@ template<class T> template<unsigned ADDR> II CPUCore<T>::rst() {
 
 
 // RET
-template<class T> template<int EE, typename COND> inline II CPUCore<T>::RET(COND cond) {
-	if (cond(getF())) {
+template<class T> template<bool PROFILE, int EE, typename COND> inline II CPUCore<T>::RET(COND cond) {
+	if (checkCond(cond)) {
 		unsigned addr = POP<EE>();
 		T::setMemPtr(addr);
 		setPC(addr);
+		if (PROFILE) profiler.ret(getSP(), T::getTimeFast());
 		return {0/*1*/, T::CC_RET_A + EE};
 	} else {
 		return {1, T::CC_RET_B + EE};
 	}
 }
-template<class T> template<typename COND> II CPUCore<T>::ret(COND cond) {
-	return RET<T::EE_RET_C>(cond);
+template<class T> template<bool PROFILE, typename COND> II CPUCore<T>::ret(COND cond) {
+	return RET<PROFILE, T::EE_RET_C>(cond);
 }
-template<class T> II CPUCore<T>::ret() {
-	return RET<0>(CondTrue());
+template<class T> template<bool PROFILE> II CPUCore<T>::ret() {
+	return RET<PROFILE, 0>(CondTrue());
 }
-template<class T> II CPUCore<T>::retn() { // also reti
+template<class T> template<bool PROFILE> II CPUCore<T>::retn() { // also reti
 	setIFF1(getIFF2());
 	setSlowInstructions();
-	return RET<T::EE_RETN>(CondTrue());
+	return RET<PROFILE, T::EE_RETN>(CondTrue());
 }
 
 
@@ -3923,7 +4152,7 @@ template<class T> template<Reg16 REG, int EE> II CPUCore<T>::jp_SS() {
 template<class T> template<typename COND> II CPUCore<T>::jp(COND cond) {
 	unsigned addr = RD_WORD_PC<1>(T::CC_JP_1);
 	T::setMemPtr(addr);
-	if (cond(getF())) {
+	if (checkCond(cond)) {
 		setPC(addr);
 		T::R800ForcePageBreak();
 		return {0/*3*/, T::CC_JP_A};
@@ -3935,7 +4164,7 @@ template<class T> template<typename COND> II CPUCore<T>::jp(COND cond) {
 // JR e
 template<class T> template<typename COND> II CPUCore<T>::jr(COND cond) {
 	int8_t ofst = RDMEM_OPCODE<1>(T::CC_JR_1);
-	if (cond(getF())) {
+	if (checkCond(cond)) {
 		if (((getPC() + 2) & 0xFF) == 0) { /**/
 			// On R800, when this instruction is located in the
 			// last two byte of a page (a page is a 256-byte
@@ -4149,6 +4378,12 @@ template<class T> II CPUCore<T>::inir() { return BLOCK_IN( 1, true ); }
 
 // block OUT
 template<class T> inline II CPUCore<T>::BLOCK_OUT(int increase, bool repeat) {
+	// Only when executing multiple instructions in one go (no tracing,
+	// breakpoints, pending IRQ, ...).
+	if (!T::isR800() && repeat && !T::limitReached()) {
+		II result;
+		if (BLOCK_OUT_BURST(increase, result)) return result;
+	}
 	// TODO R800 flags
 	byte val = RDMEM(getHL(), T::CC_OUTI_1);
 	setHL(getHL() + increase);
@@ -4169,6 +4404,61 @@ template<class T> inline II CPUCore<T>::BLOCK_OUT(int increase, bool repeat) {
 		return {1, T::CC_OUTI};
 	}
 }
+// Execute multiple iterations of OTIR/OTDR at once by passing all bytes to
+// the I/O device in a single writeIOBurst() call (e.g. for VRAM uploads).
+// Each byte is still written at exactly the same EmuTime as when the
+// instruction is repeated one iteration at a time, and the end result is the
+// same. Only the repeated opcode fetches are skipped, so these (and the
+// source data) must come from cacheable memory, i.e. reading has no side
+// effects. Returns false when nothing was written, then the caller must
+// execute the iteration in the normal way.
+template<class T> bool CPUCore<T>::BLOCK_OUT_BURST(int increase, II& result)
+{
+	unsigned pc = getPC(); // 2nd opcode byte
+	if (!readCacheLine[((pc - 1) & 0xFFFF) >> CacheLine::BITS] ||
+	    !readCacheLine[pc >> CacheLine::BITS]) {
+		return false;
+	}
+	word port = getBC();
+	if (!interface->canWriteIOBurst(port)) return false;
+
+	unsigned total = getB() ? getB() : 256;
+	byte values[256];
+	unsigned num = 0;
+	word addr = getHL();
+	while (num < total) {
+		const byte* line = readCacheLine[addr >> CacheLine::BITS];
+		if (!line) break;
+		values[num++] = line[addr];
+		addr += increase;
+	}
+	if (num < 2) return false; // nothing to gain
+
+	EmuTime time = T::getTimeFast(T::CC_OUTI_2);
+	EmuDuration interval = T::getTimeFast(T::CC_OUTI_2 + T::CC_OTIR) - time;
+	unsigned n = interface->writeIOBurst(
+		port, make_array_ref(values, num), time, interval);
+	if (n == 0) return false;
+
+	// registers after the n-th iteration, see BLOCK_OUT()
+	byte val = values[n - 1];
+	setHL(getHL() + n * increase);
+	setBC(getBC() - 0x100 * n);
+	T::setMemPtr(getBC() + increase);
+	unsigned k = val + getL();
+	byte b = getB();
+	setF(((val & S_FLAG) >> 6) | // N_FLAG
+	       ((k & 0x100) ? (H_FLAG | C_FLAG) : 0) |
+	       table.ZSXY[b] |
+	       (table.ZSPXY[(k & 0x07) ^ b] & P_FLAG));
+	incR(2 * (n - 1)); // skipped opcode fetches
+	if (b) {
+		result = {-1/*1*/, int(n * T::CC_OTIR)};
+	} else {
+		result = {1, int((n - 1) * T::CC_OTIR + T::CC_OUTI)};
+	}
+	return true;
+}
 template<class T> II CPUCore<T>::outd() { return BLOCK_OUT(-1, false); }
 template<class T> II CPUCore<T>::outi() { return BLOCK_OUT( 1, false); }
 template<class T> II CPUCore<T>::otdr() { return BLOCK_OUT(-1, true ); }
@@ -4388,6 +4678,7 @@ template<class T> template<typename Archive>
 void CPUCore<T>::serialize(Archive& ar, unsigned version)
 {
 	T::serialize(ar, version);
+	syncFlags(); // make F in CPURegs up-to-date (or reset lazy state on load)
 	ar.serialize("regs", static_cast<CPURegs&>(*this));
 	if (ar.versionBelow(version, 2)) {
 		unsigned mptr = 0; // dummy value (avoid warning)
@@ -4416,6 +4707,8 @@ void CPUCore<T>::serialize(Archive& ar, unsigned version)
 	//     the IRQHelper deserialization makes sure these get the right value
 	// - slowInstructions, exitLoop:
 	//     serialization happens outside the CPU emulation loop
+	// - stopAddress:
+	//     only set for the duration of a BatchRunner run
 
 	if (T::isR800() && ar.versionBelow(version, 4)) {
 		motherboard.getMSXCliComm().printWarning(
@@ -3,6 +3,7 @@
 
 #include "CPURegs.hh"
 #include "CacheLine.hh"
+#include "LazyFlags.hh"
 #include "Probe.hh"
 #include "EmuTime.hh"
 #include "BooleanSetting.hh"
@@ -20,6 +21,8 @@ class MSXCPUInterface;
 class Scheduler;
 class MSXMotherBoard;
 class TclCallback;
+class CPUProfiler;
+class CPUTraceBuffer;
 class TclObject;
 class Interpreter;
 enum Reg8  : int;
@@ -46,7 +49,8 @@ class CPUCore final : public CPUBase, public CPURegs, public CPU_POLICY
 public:
 	CPUCore(MSXMotherBoard& motherboard, const std::string& name,
 	        const BooleanSetting& traceSetting,
-	        TclCallback& diHaltCallback, EmuTime::param time);
+	        TclCallback& diHaltCallback, CPUProfiler& profiler,
+	        CPUTraceBuffer& traceBuffer, EmuTime::param time);
 
 	void setInterface(MSXCPUInterface* interf) { interface = interf; }
 
@@ -57,8 +61,18 @@ public:
 
 	void execute(bool fastForward);
 
+	/** Re-evaluate whether each instruction must be traced (cputrace
+	  * setting or trace buffer). */
+	void updateTracing();
+
+	/** (Re)read the values of the freq and cputrace settings, see
+	  * 'settingFreqLocked'. Must be called from the main thread.
+	  */
+	void loadSettings();
+
 	/** Request to exit the main CPU emulation loop.
-	  * This method may only be called from the main thread. The CPU loop
+	  * This method may only be called from the thread that is running
+	  * the emulation (normally the main thread). The CPU loop
 	  * will immediately be exited (current instruction will be finished,
 	  * but no new instruction will be executed).
 	  */
@@ -69,12 +83,21 @@ public:
 	  */
 	void exitCPULoopAsync();
 
+	/** Make execute() return right before the instruction at the given
+	  * address gets executed, also in fast-forward mode. Pass -1 to
+	  * disable. Unlike a breakpoint this doesn't involve the Tcl
+	  * interpreter, it's used for the stop conditions of BatchRunner.
+	  */
+	void setStopAddress(int address) { stopAddress = address; }
+	bool isStopAddressReached() const { return int(getPC()) == stopAddress; }
+
 	void warp(EmuTime::param time);
 	EmuTime::param getCurrentTime() const;
 	void wait(EmuTime::param time);
 	EmuTime waitCycles(EmuTime::param time, unsigned cycles);
 	void setNextSyncPoint(EmuTime::param time);
 	void invalidateMemCache(unsigned start, unsigned size);
+	void invalidateWriteCache(const byte* begin, const byte* end);
 	bool isM1Cycle(unsigned address) const;
 
 	void disasmCommand(Interpreter& interp,
@@ -110,11 +133,18 @@ public:
 	 */
 	void setFreq(unsigned freq);
 
+	/** With lazy flag evaluation (CPU_POLICY::LAZY_FLAGS) the F register
+	  * in the CPURegs base class can be out-of-date. This stores the
+	  * actual value in it. Must be called before the registers are
+	  * accessed from outside CPUCore (see MSXCPU::getRegisters()).
+	  */
+	void syncFlags();
+
 	template<typename Archive>
 	void serialize(Archive& ar, unsigned version);
 
 private:
-	void execute2(bool fastForward);
+	template<bool PROFILE> void execute2(bool fastForward);
 	bool needExitCPULoop();
 	void setSlowInstructions();
 	void doSetFreq();
@@ -127,6 +157,11 @@ private:
 	byte* writeCacheLine[CacheLine::NUM];
 	bool readCacheTried [CacheLine::NUM];
 	bool writeCacheTried[CacheLine::NUM];
+	// lines that are only partly cacheable, see getReadCacheSubLines()
+	const byte* readCacheSubLine[CacheLine::NUM];
+	byte* writeCacheSubLine[CacheLine::NUM];
+	unsigned readCacheSubMask [CacheLine::NUM]; // uncacheable sub-lines
+	unsigned writeCacheSubMask[CacheLine::NUM];
 
 	MSXMotherBoard& motherboard;
 	Scheduler& scheduler;
@@ -134,6 +169,8 @@ private:
 
 	const BooleanSetting& traceSetting;
 	TclCallback& diHaltCallback;
+	CPUProfiler& profiler;
+	CPUTraceBuffer& traceBuffer;
 
 	Probe<int> IRQStatus;
 	Probe<void> IRQAccept;
@@ -143,10 +180,22 @@ private:
 	IntegerSetting freqValue;
 	unsigned freq;
 
+	/** Copies of the values of freqLocked, freqValue and traceSetting.
+	  * The emulation only uses these copies: settings (Tcl objects) may
+	  * only be accessed from the main thread, and with BatchRunner the
+	  * emulation runs in a worker thread. See loadSettings().
+	  */
+	bool settingFreqLocked;
+	unsigned settingFreq;
+	bool settingTrace;
+
 	// state machine variables
 	int slowInstructions;
 	int NMIStatus;
 
+	/** See setStopAddress(), -1 when not used. */
+	int stopAddress;
+
 	/**
 	 * Set to true when there was a rising edge on the NMI line
 	 * (rising = non-active -> active).
@@ -156,15 +205,44 @@ private:
 
 	std::atomic<bool> exitLoop;
 
-	/** In sync with traceSetting.getBoolean(). */
+	/** settingTrace || traceBuffer.isActive() */
 	bool tracingEnabled;
 
 	/** 'normal' Z80 and Z80 in a turboR behave slightly different */
 	const bool isTurboR;
 
+	/** Lazy flag evaluation (only when CPU_POLICY::LAZY_FLAGS is set). */
+	LazyFlags lazy;
+
+	// These hide the corresponding methods in CPURegs.
+	byte getF() const {
+		return (CPU_POLICY::LAZY_FLAGS && lazy.isPending())
+		     ? lazy.calcF(CPU_POLICY::isR800()) : CPURegs::getF();
+	}
+	unsigned getAF() const {
+		return CPU_POLICY::LAZY_FLAGS ? ((getA() << 8) | getF())
+		                              : CPURegs::getAF();
+	}
+	void setF(byte x) {
+		if (CPU_POLICY::LAZY_FLAGS) lazy.clear();
+		CPURegs::setF(x);
+	}
+	void setAF(unsigned x) {
+		if (CPU_POLICY::LAZY_FLAGS) lazy.clear();
+		CPURegs::setAF(x);
+	}
+	byte getCarryLazy() const {
+		return lazy.getCarry(CPURegs::getF());
+	}
+	void setFlagsLazy(LazyOp op, byte a, byte b, unsigned res) {
+		lazy.set(op, a, b, res, CPURegs::getF(), CPU_POLICY::isR800());
+	}
+	template<typename COND> inline bool checkCond(COND cond) const;
+
 
 	inline void cpuTracePre();
 	inline void cpuTracePost();
+	void cpuTracePre_slow();
 	void cpuTracePost_slow();
 
 	inline byte READ_PORT(unsigned port, unsigned cc);
@@ -208,12 +286,12 @@ private:
 	template<bool PRE_PB, bool POST_PB>
 	inline void WR_WORD_rev (unsigned address, unsigned value, unsigned cc);
 
-	void executeInstructions();
+	template<bool PROFILE> void executeInstructions();
 	inline void nmi();
 	inline void irq0();
 	inline void irq1();
 	inline void irq2();
-	void executeSlow();
+	template<bool PROFILE> void executeSlow();
 
 	template<Reg8>  inline byte     get8()  const;
 	template<Reg16> inline unsigned get16() const;
@@ -401,13 +479,13 @@ private:
 	template<int EE> inline unsigned POP();
 	template<Reg16 REG, int EE> inline II pop_SS();
 
-	template<typename COND> inline II call(COND cond);
-	template<unsigned ADDR> inline II rst();
+	template<bool PROFILE, typename COND> inline II call(COND cond);
+	template<bool PROFILE, unsigned ADDR> inline II rst();
 
-	template<int EE, typename COND> inline II RET(COND cond);
-	template<typename COND> inline II ret(COND cond);
-	inline II ret();
-	inline II retn();
+	template<bool PROFILE, int EE, typename COND> inline II RET(COND cond);
+	template<bool PROFILE, typename COND> inline II ret(COND cond);
+	template<bool PROFILE> inline II ret();
+	template<bool PROFILE> inline II retn();
 
 	template<Reg16 REG, int EE> inline II jp_SS();
 	template<typename COND> inline II jp(COND cond);
@@ -441,6 +519,7 @@ private:
 	inline II inir();
 
 	inline II BLOCK_OUT(int increase, bool repeat);
+	bool BLOCK_OUT_BURST(int increase, II& result);
 	inline II outd();
 	inline II outi();
 	inline II otdr();
@@ -0,0 +1,344 @@
+#include "CPUProfiler.hh"
+#include "MSXMotherBoard.hh"
+#include "MSXCPU.hh"
+#include "MSXCPUInterface.hh"
+#include "MSXMapperIO.hh"
+#include "CommandException.hh"
+#include "TclObject.hh"
+#include "outer.hh"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+using std::string;
+using std::vector;
+
+namespace openmsx {
+
+// Packed location:
+//   bit  0-15: address
+//   bit 16-17: primary slot
+//   bit 18-19: secondary slot
+//   bit    20: primary slot is expanded
+//   bit    21: page contains a memory mapper
+//   bit 24-31: selected mapper segment
+static const uint32_t EXPANDED = 1 << 20;
+static const uint32_t MAPPER   = 1 << 21;
+static const uint32_t TOP_LEVEL = 0xffffffff; // caller of not-nested calls
+
+static const unsigned MAX_FRAMES = 1024;
+
+CPUProfiler::CPUProfiler(MSXMotherBoard& motherBoard_)
+	: motherBoard(motherBoard_)
+	, interface(nullptr)
+	, profileCmd(motherBoard.getCommandController())
+	, debuggable(motherBoard)
+	, totalCycles(0)
+	, freq(3579545)
+	, active(false)
+{
+	for (unsigned page = 0; page < 4; ++page) {
+		pageCounts[page] = nullptr;
+		pageLocation[page] = 0;
+	}
+}
+
+CPUProfiler::~CPUProfiler() = default;
+
+void CPUProfiler::start()
+{
+	if (active) return;
+	active = true;
+	for (unsigned page = 0; page < 4; ++page) {
+		invalidatePage(page);
+	}
+	// switch to CPUCore::execute2<true>()
+	motherBoard.getCPU().exitCPULoopSync();
+}
+
+void CPUProfiler::stop()
+{
+	if (!active) return;
+	active = false;
+	// end all calls that are still in progress
+	popFrames(0x10000, motherBoard.getCurrentTime());
+	motherBoard.getCPU().exitCPULoopSync();
+}
+
+void CPUProfiler::clear()
+{
+	// Keep the banks, CPUCore may still point to them.
+	for (auto& p : banks) {
+		std::fill(p.second.begin(), p.second.end(), 0);
+	}
+	edges.clear();
+	frames.clear();
+	totalCycles = 0;
+}
+
+uint32_t CPUProfiler::locatePage(unsigned page)
+{
+	unsigned ps = interface->getPrimarySlot(page);
+	uint32_t result = (page << 14) | (ps << 16);
+	if (interface->isExpanded(ps)) {
+		result |= (interface->getSecondarySlot(page) << 18) | EXPANDED;
+	}
+	if (auto* mapper = dynamic_cast<MSXMemoryMapperInterface*>(
+			interface->getVisibleMSXDevice(page))) {
+		result |= MAPPER | (uint32_t(mapper->getSelectedSegment(page)) << 24);
+	}
+	return result;
+}
+
+void CPUProfiler::invalidatePage(unsigned page)
+{
+	if (!active) return;
+	pageLocation[page] = locatePage(page);
+	auto& bank = banks[pageLocation[page]];
+	if (bank.empty()) bank.assign(0x4000, 0);
+	pageCounts[page] = bank.data();
+}
+
+// Same as EmuDuration::getTicksAt(), but without overflow for long durations.
+static uint64_t toCycles(EmuDuration::param duration, unsigned freq)
+{
+	return duration.length() / (MAIN_FREQ32 / freq);
+}
+
+void CPUProfiler::flush(uint64_t cycles, unsigned freq_)
+{
+	totalCycles += cycles;
+	freq = freq_;
+	processEvents();
+}
+
+void CPUProfiler::processEvents()
+{
+	for (auto& event : events) {
+		if (event.isCall) {
+			// Frames whose return address was dropped.
+			popFrames(event.sp, event.time);
+			if (frames.size() == MAX_FRAMES) {
+				// Probably code that switches stacks without ever
+				// returning. Forget about the outermost call.
+				frames.erase(frames.begin());
+			}
+			uint32_t caller = frames.empty() ? TOP_LEVEL : frames.back().function;
+			++edges[(uint64_t(caller) << 32) | event.location].count;
+			frames.push_back(Frame{event.location, event.sp, event.time});
+		} else {
+			popFrames(event.sp, event.time);
+		}
+	}
+	events.clear();
+}
+
+void CPUProfiler::popFrames(unsigned sp, EmuTime::param time)
+{
+	// Note: this doesn't handle the stack pointer wrapping around at
+	// 0x0000/0xFFFF, MSX software doesn't do that.
+	while (!frames.empty() && (sp >= frames.back().returnSP)) {
+		auto& frame = frames.back();
+		uint32_t caller = (frames.size() == 1)
+		                ? TOP_LEVEL : frames[frames.size() - 2].function;
+		edges[(uint64_t(caller) << 32) | frame.function].cycles +=
+			toCycles(time - frame.start, freq);
+		frames.pop_back();
+	}
+}
+
+static string formatLocation(uint32_t location)
+{
+	if (location == TOP_LEVEL) return "-";
+	std::ostringstream sstr;
+	sstr << ((location >> 16) & 3);
+	if (location & EXPANDED) {
+		sstr << '-' << ((location >> 18) & 3);
+	}
+	if (location & MAPPER) {
+		sstr << ':' << (location >> 24);
+	}
+	sstr << ":0x" << std::hex << std::uppercase << std::setw(4)
+	     << std::setfill('0') << (location & 0xffff);
+	return sstr.str();
+}
+
+// Keeps the 'num' elements with the highest 'key', sorted on that key.
+template<typename T, typename Key>
+static void keepHighest(vector<T>& v, unsigned num, Key key)
+{
+	auto cmp = [&](const T& x, const T& y) { return key(x) > key(y); };
+	if (num < v.size()) {
+		std::partial_sort(v.begin(), v.begin() + num, v.end(), cmp);
+		v.resize(num);
+	} else {
+		std::sort(v.begin(), v.end(), cmp);
+	}
+}
+
+static double percentage(uint64_t cycles, uint64_t total)
+{
+	return total ? (100.0 * cycles / total) : 0.0;
+}
+
+// Execution count per location, only for the executed locations.
+vector<std::pair<uint32_t, uint64_t>> CPUProfiler::getLocationCounts() const
+{
+	vector<std::pair<uint32_t, uint64_t>> result;
+	for (auto& p : banks) {
+		for (unsigned i = 0; i < 0x4000; ++i) {
+			if (auto count = p.second[i]) {
+				result.emplace_back(p.first | i, count);
+			}
+		}
+	}
+	return result;
+}
+
+void CPUProfiler::flatReport(TclObject& result, unsigned num) const
+{
+	auto counts = getLocationCounts();
+	uint64_t total = 0;
+	for (auto& p : counts) total += p.second;
+	keepHighest(counts, num,
+		[](const std::pair<uint32_t, uint64_t>& p) { return p.second; });
+
+	std::ostringstream sstr;
+	sstr << "       count       %  location\n";
+	for (auto& p : counts) {
+		sstr << std::setw(12) << p.second << ' '
+		     << std::setw(7) << std::fixed << std::setprecision(2)
+		     << percentage(p.second, total) << "  "
+		     << formatLocation(p.first) << '\n';
+	}
+	result.setString(sstr.str());
+}
+
+void CPUProfiler::callGraphReport(TclObject& result, unsigned num) const
+{
+	using Edge = hash_map<uint64_t, Counters>::value_type;
+	vector<const Edge*> sorted;
+	sorted.reserve(edges.size());
+	for (auto& p : edges) sorted.push_back(&p);
+	keepHighest(sorted, num, [](const Edge* p) { return p->second.cycles; });
+
+	std::ostringstream sstr;
+	sstr << " incl.cycles       %        calls  caller -> callee\n";
+	for (auto* p : sorted) {
+		sstr << std::setw(12) << p->second.cycles << ' '
+		     << std::setw(7) << std::fixed << std::setprecision(2)
+		     << percentage(p->second.cycles, totalCycles) << ' '
+		     << std::setw(12) << p->second.count << "  "
+		     << formatLocation(p->first >> 32) << " -> "
+		     << formatLocation(p->first & 0xffffffff) << '\n';
+	}
+	result.setString(sstr.str());
+}
+
+
+// class ProfileCmd
+
+CPUProfiler::ProfileCmd::ProfileCmd(CommandController& controller)
+	: Command(controller, "profile")
+{
+}
+
+void CPUProfiler::ProfileCmd::execute(array_ref<TclObject> tokens, TclObject& result)
+{
+	if (tokens.size() < 2) {
+		throw CommandException("Missing subcommand");
+	}
+	auto& profiler = OUTER(CPUProfiler, profileCmd);
+	string_view subcommand = tokens[1].getString();
+	if        (subcommand == "start") {
+		profiler.start();
+	} else if (subcommand == "stop") {
+		profiler.stop();
+	} else if (subcommand == "clear") {
+		profiler.clear();
+	} else if (subcommand == "status") {
+		result.addListElement("active");
+		result.addListElement(profiler.active ? "true" : "false");
+		result.addListElement("cycles");
+		result.addListElement(double(profiler.totalCycles));
+		result.addListElement("locations");
+		result.addListElement(int(profiler.getLocationCounts().size()));
+	} else if (subcommand == "dump") {
+		bool callGraph = false;
+		unsigned num = 20;
+		for (unsigned i = 2; i < tokens.size(); ++i) {
+			if (tokens[i].getString() == "-callgraph") {
+				callGraph = true;
+			} else {
+				int n = tokens[i].getInt(getInterpreter());
+				if (n <= 0) {
+					throw CommandException(
+						"Number of lines must be positive");
+				}
+				num = n;
+			}
+		}
+		if (callGraph) {
+			profiler.callGraphReport(result, num);
+		} else {
+			profiler.flatReport(result, num);
+		}
+	} else {
+		throw CommandException("Invalid subcommand: ", subcommand);
+	}
+}
+
+string CPUProfiler::ProfileCmd::help(const vector<string>& /*tokens*/) const
+{
+	return "start                      start collecting profile data\n"
+	       "stop                       stop collecting\n"
+	       "clear                      throw away the collected data\n"
+	       "status                     show whether the profiler is active and how much data it collected\n"
+	       "dump [-callgraph] [<num>]  show the <num> (default 20) most executed locations, or with\n"
+	       "                           -callgraph the caller/callee pairs with the most inclusive cycles\n"
+	       "Locations are shown as <primary slot>[-<secondary slot>][:<mapper segment>]:<address>.\n";
+}
+
+void CPUProfiler::ProfileCmd::tabCompletion(vector<string>& tokens) const
+{
+	if (tokens.size() == 2) {
+		static const char* const subCommands[] = {
+			"start", "stop", "clear", "status", "dump",
+		};
+		completeString(tokens, subCommands);
+	} else if ((tokens.size() == 3) && (tokens[1] == "dump")) {
+		static const char* const options[] = { "-callgraph" };
+		completeString(tokens, options);
+	}
+}
+
+
+// class Debuggable
+
+static const char* const PROFILE_COUNTS_DESC =
+	"Number of executed instructions per CPU address, summed over all "
+	"slots and mapper segments. Each address takes 4 bytes (little "
+	"endian), the count saturates at 0xFFFFFFFF. Use the 'profile' "
+	"command to start or stop collecting.";
+
+CPUProfiler::Debuggable::Debuggable(MSXMotherBoard& motherBoard_)
+	: SimpleDebuggable(motherBoard_, "profile counts", PROFILE_COUNTS_DESC,
+	                   0x10000 * 4)
+{
+}
+
+byte CPUProfiler::Debuggable::read(unsigned address)
+{
+	auto& profiler = OUTER(CPUProfiler, debuggable);
+	unsigned pc = address / 4;
+	uint64_t count = 0;
+	for (auto& p : profiler.banks) {
+		if (((p.first >> 14) & 3) == (pc >> 14)) {
+			count += p.second[pc & 0x3fff];
+		}
+	}
+	count = std::min<uint64_t>(count, 0xffffffff);
+	return count >> (8 * (address % 4));
+}
+
+} // namespace openmsx
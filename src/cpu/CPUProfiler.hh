@@ -0,0 +1,154 @@
+#ifndef CPUPROFILER_HH
+#define CPUPROFILER_HH
+
+#include "Command.hh"
+#include "SimpleDebuggable.hh"
+#include "EmuTime.hh"
+#include "hash_map.hh"
+#include "openmsx.hh"
+#include <vector>
+#include <cstdint>
+
+namespace openmsx {
+
+class MSXMotherBoard;
+class MSXCPUInterface;
+struct MSXMemoryMapperInterface;
+
+/** Execution profiler for the Z80 and R800.
+  *
+  * While active, CPUCore uses a separate instantiation of its main loop
+  * (see CPUCore::execute2<true>) that calls count() before each instruction.
+  * That only increments a counter in a flat per-address array. There's one
+  * such array (a bank) per combination of page, primary/secondary slot and
+  * selected memory mapper segment, the arrays for the currently visible
+  * banks are looked up when the memory layout changes, not per instruction.
+  * So code that runs from different slots or mapper segments at the same
+  * address is counted separately.
+  *
+  * Only the CALL, RST and RET instructions (and accepted interrupts) are
+  * reported separately. Those are appended to a list and only turned into
+  * a call graph when the CPU leaves its main loop. A call frame ends as soon
+  * as the stack pointer rises above the position of its return address
+  * again (normally via a RET, but this also handles code that drops its
+  * return address). This gives the number of calls and the inclusive number
+  * of cycles per caller/callee pair.
+  *
+  * When the profiler is not active, CPUCore uses its normal code paths, so
+  * there is no overhead.
+  */
+class CPUProfiler
+{
+public:
+	explicit CPUProfiler(MSXMotherBoard& motherBoard);
+	~CPUProfiler();
+
+	void setInterface(MSXCPUInterface* interf) { interface = interf; }
+
+	bool isActive() const { return active; }
+
+	/** Called by CPUCore (only when active) before each instruction. */
+	void count(word pc)
+	{
+		++pageCounts[pc >> 14][pc & 0x3fff];
+	}
+
+	/** Called by CPUCore (only when active) after each executed CALL or
+	  * RST instruction and after each accepted interrupt.
+	  * @param pc Value of the PC register after the call (the callee).
+	  * @param sp Value of the SP register before the call.
+	  */
+	void call(word pc, word sp, EmuTime::param time)
+	{
+		addEvent(Event{pageLocation[pc >> 14] | pc, sp, true, time});
+	}
+
+	/** Called by CPUCore (only when active) after each executed RET,
+	  * RETI or RETN instruction.
+	  * @param sp Value of the SP register after the return.
+	  */
+	void ret(word sp, EmuTime::param time)
+	{
+		addEvent(Event{0, sp, false, time});
+	}
+
+	/** Called by CPUCore (only when active) when it leaves its main loop.
+	  * Processes the calls and returns reported since the previous flush.
+	  * @param cycles Number of cycles emulated since the previous flush.
+	  * @param freq Current CPU frequency.
+	  */
+	void flush(uint64_t cycles, unsigned freq);
+
+	/** Called when the memory layout of the given page changed (a
+	  * different slot or mapper segment became visible). */
+	void invalidatePage(unsigned page);
+
+private:
+	struct Event {
+		uint32_t location; // callee (only for calls)
+		word sp;
+		bool isCall;
+		EmuTime time;
+	};
+	struct Counters {
+		Counters() : count(0), cycles(0) {}
+		uint64_t count; // number of calls
+		uint64_t cycles;
+	};
+	struct Frame {
+		uint32_t function; // location of the called routine
+		word returnSP;     // SP value right before the call
+		EmuTime start;
+	};
+
+	void addEvent(const Event& event)
+	{
+		events.push_back(event);
+		// CPUCore can stay a long time in its main loop (e.g. when
+		// fast-forwarding), limit the memory usage.
+		if (events.size() == 0x10000) processEvents();
+	}
+	void processEvents();
+
+	void start();
+	void stop();
+	void clear();
+	uint32_t locatePage(unsigned page);
+	void popFrames(unsigned sp, EmuTime::param time);
+	std::vector<std::pair<uint32_t, uint64_t>> getLocationCounts() const;
+	void flatReport(TclObject& result, unsigned num) const;
+	void callGraphReport(TclObject& result, unsigned num) const;
+
+	MSXMotherBoard& motherBoard;
+	MSXCPUInterface* interface;
+
+	struct ProfileCmd final : Command {
+		explicit ProfileCmd(CommandController& controller);
+		void execute(array_ref<TclObject> tokens, TclObject& result) override;
+		std::string help(const std::vector<std::string>& tokens) const override;
+		void tabCompletion(std::vector<std::string>& tokens) const override;
+	} profileCmd;
+
+	struct Debuggable final : SimpleDebuggable {
+		explicit Debuggable(MSXMotherBoard& motherBoard);
+		byte read(unsigned address) override;
+	} debuggable;
+
+	// Execution counts, 0x4000 entries per bank. The key is the location
+	// (see locatePage()) of the start of the page.
+	hash_map<uint32_t, std::vector<uint64_t>> banks;
+	uint64_t* pageCounts[4];  // currently visible bank per page
+	uint32_t pageLocation[4]; // slot and mapper info per page
+
+	std::vector<Event> events; // not yet processed calls and returns
+	hash_map<uint64_t, Counters> edges; // per (caller, callee) pair
+	std::vector<Frame> frames;
+	uint64_t totalCycles;
+	unsigned freq; // CPU frequency of the last flush
+
+	bool active;
+};
+
+} // namespace openmsx
+
+#endif
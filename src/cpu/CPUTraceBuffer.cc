@@ -0,0 +1,354 @@
+#include "CPUTraceBuffer.hh"
+#include "MSXMotherBoard.hh"
+#include "MSXCPU.hh"
+#include "CPURegs.hh"
+#include "Dasm.hh"
+#include "File.hh"
+#include "FileContext.hh"
+#include "FileException.hh"
+#include "CommandException.hh"
+#include "TclObject.hh"
+#include "Math.hh"
+#include "memory.hh"
+#include "outer.hh"
+#include "strCat.hh"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+using std::string;
+using std::vector;
+
+namespace openmsx {
+
+static const char HEADER[16] = {
+	'o','p','e','n','M','S','X',' ','t','r','a','c','e',' ','1','\n'
+};
+
+static const unsigned DEFAULT_SIZE = 1024 * 1024; // number of entries
+static const unsigned MAX_SIZE = 64 * 1024 * 1024;
+
+CPUTraceBuffer::CPUTraceBuffer(MSXMotherBoard& motherBoard_)
+	: motherBoard(motherBoard_)
+	, traceBufferCmd(motherBoard.getCommandController())
+	, head(0)
+	, active(false)
+	, streamExit(false)
+	, streamFailed(false)
+{
+}
+
+CPUTraceBuffer::~CPUTraceBuffer()
+{
+	stopStream();
+}
+
+void CPUTraceBuffer::start(unsigned size)
+{
+	if (active) {
+		throw CommandException("Trace buffer is already active");
+	}
+	ring.assign(Math::powerOfTwo(size), Entry());
+	head = 0;
+	active = true;
+	// switch CPUCore to the tracing execution path
+	motherBoard.getCPU().updateTracing();
+}
+
+void CPUTraceBuffer::stop()
+{
+	if (!active) return;
+	stopStream();
+	active = false;
+	motherBoard.getCPU().updateTracing();
+	// keep the ring, so that it can still be saved
+}
+
+void CPUTraceBuffer::record(const CPURegs& regs, word pc, const byte opcode[4],
+                            EmuTime::param time, bool r800)
+{
+	uint64_t n = head.load(std::memory_order_relaxed);
+	auto& entry = ring[n & (ring.size() - 1)];
+	uint64_t t = (time - EmuTime::zero).length();
+	entry.timeLo = uint32_t(t);
+	entry.timeHi = uint32_t(t >> 32);
+	entry.pc = pc;
+	entry.af = regs.getAF();
+	entry.bc = regs.getBC();
+	entry.de = regs.getDE();
+	entry.hl = regs.getHL();
+	entry.ix = regs.getIX();
+	entry.iy = regs.getIY();
+	entry.sp = regs.getSP();
+	memcpy(entry.opcode, opcode, 4);
+	entry.i = regs.getI();
+	entry.r = regs.getR();
+	entry.flags = (regs.getIM() & Entry::IM_MASK) |
+	              (regs.getIFF1() ? Entry::IFF1 : 0) |
+	              (regs.getIFF2() ? Entry::IFF2 : 0) |
+	              (r800 ? Entry::R800 : 0);
+	entry.reserved = 0;
+	// publish the entry to the stream thread
+	head.store(n + 1, std::memory_order_release);
+}
+
+// Copy the entries in the range [from, to) and advance 'from' to 'to'.
+// Returns false when some of the entries in that range were already
+// overwritten (those are not copied).
+bool CPUTraceBuffer::copyEntries(uint64_t& from, uint64_t to,
+                                 vector<Entry>& out) const
+{
+	uint64_t size = ring.size();
+	bool complete = true;
+	if ((to - from) > size) {
+		from = to - size;
+		complete = false;
+	}
+	out.clear();
+	for (uint64_t n = from; n != to; ++n) {
+		out.push_back(ring[n & (size - 1)]);
+	}
+	// The CPU may have overwritten some of the entries while they were
+	// being copied, drop those. With 'head' equal to 'h' the CPU may
+	// already be writing entry 'h', that's the slot of entry 'h - size'.
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint64_t h = head.load(std::memory_order_relaxed);
+	if ((h + 1 - from) > size) {
+		uint64_t overwritten = std::min<uint64_t>(h + 1 - size - from, out.size());
+		out.erase(out.begin(), out.begin() + overwritten);
+		complete = false;
+	}
+	from = to;
+	return complete;
+}
+
+void CPUTraceBuffer::writeHeader(File& file)
+{
+	file.write(HEADER, sizeof(HEADER));
+}
+
+void CPUTraceBuffer::save(const string& filename)
+{
+	if (ring.empty()) {
+		throw CommandException("Trace buffer was never started");
+	}
+	uint64_t from = 0;
+	vector<Entry> entries;
+	copyEntries(from, head.load(std::memory_order_acquire), entries);
+	try {
+		File file(filename, File::TRUNCATE);
+		writeHeader(file);
+		file.write(entries.data(), entries.size() * sizeof(Entry));
+	} catch (FileException& e) {
+		throw CommandException("Couldn't save trace: ", e.getMessage());
+	}
+}
+
+void CPUTraceBuffer::startStream(const string& filename)
+{
+	stopStream();
+	if (!active) {
+		start(DEFAULT_SIZE);
+	}
+	try {
+		streamFile = make_unique<File>(filename, File::TRUNCATE);
+		writeHeader(*streamFile);
+	} catch (FileException& e) {
+		streamFile.reset();
+		throw CommandException("Couldn't stream trace: ", e.getMessage());
+	}
+	streamName = filename;
+	streamExit = false;
+	streamFailed = false;
+	streamThread = std::thread([this]() { streamLoop(); });
+}
+
+void CPUTraceBuffer::stopStream()
+{
+	if (!streamThread.joinable()) return;
+	streamExit = true;
+	streamThread.join();
+	streamFile.reset();
+}
+
+void CPUTraceBuffer::streamLoop()
+{
+	// Only write entries recorded from now on.
+	uint64_t tail = head.load(std::memory_order_acquire);
+	vector<Entry> chunk;
+	while (true) {
+		bool exit = streamExit;
+		bool complete = copyEntries(
+			tail, head.load(std::memory_order_acquire), chunk);
+		if (!complete && !chunk.empty()) {
+			chunk.front().flags |= Entry::LOST;
+		}
+		try {
+			streamFile->write(chunk.data(), chunk.size() * sizeof(Entry));
+		} catch (FileException& e) {
+			streamError = e.getMessage();
+			streamFailed = true;
+			return;
+		}
+		if (exit) return;
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+}
+
+vector<CPUTraceBuffer::Entry> CPUTraceBuffer::load(const string& filename)
+{
+	try {
+		File file(filename);
+		size_t size = file.getSize();
+		char header[sizeof(HEADER)];
+		if (size < sizeof(HEADER)) {
+			throw CommandException("Not a trace file: ", filename);
+		}
+		file.read(header, sizeof(header));
+		if (memcmp(header, HEADER, sizeof(HEADER)) != 0) {
+			throw CommandException("Not a trace file: ", filename);
+		}
+		// ignore a partially written entry at the end (e.g. after a crash)
+		vector<Entry> entries((size - sizeof(HEADER)) / sizeof(Entry));
+		file.read(entries.data(), entries.size() * sizeof(Entry));
+		return entries;
+	} catch (FileException& e) {
+		throw CommandException("Couldn't read trace: ", e.getMessage());
+	}
+}
+
+string CPUTraceBuffer::decode(const vector<Entry>& entries)
+{
+	string result;
+	for (auto& e : entries) {
+		if (e.flags & Entry::LOST) {
+			result += "... (entries lost)\n";
+		}
+		string dasmOutput;
+		dasm(e.opcode, e.pc, dasmOutput);
+		uint64_t t = (uint64_t(e.timeHi) << 32) | e.timeLo;
+		char time[32];
+		snprintf(time, sizeof(time), "%.9f", double(t) / MAIN_FREQ);
+		strAppend(result, time, ' ',
+		          (e.flags & Entry::R800) ? "r800 " : "z80  ",
+		          hex_string<4>(uint16_t(e.pc)), " : ", dasmOutput,
+		          " AF=", hex_string<4>(uint16_t(e.af)),
+		          " BC=", hex_string<4>(uint16_t(e.bc)),
+		          " DE=", hex_string<4>(uint16_t(e.de)),
+		          " HL=", hex_string<4>(uint16_t(e.hl)),
+		          " IX=", hex_string<4>(uint16_t(e.ix)),
+		          " IY=", hex_string<4>(uint16_t(e.iy)),
+		          " SP=", hex_string<4>(uint16_t(e.sp)),
+		          " I=", hex_string<2>(e.i),
+		          " R=", hex_string<2>(e.r),
+		          " IM", int(e.flags & Entry::IM_MASK),
+		          (e.flags & Entry::IFF1) ? " EI\n" : " DI\n");
+	}
+	return result;
+}
+
+
+// class TraceBufferCmd
+
+CPUTraceBuffer::TraceBufferCmd::TraceBufferCmd(CommandController& controller)
+	: Command(controller, "cputrace_buffer")
+{
+}
+
+void CPUTraceBuffer::TraceBufferCmd::execute(
+	array_ref<TclObject> tokens, TclObject& result)
+{
+	if (tokens.size() < 2) {
+		throw CommandException("Missing subcommand");
+	}
+	auto& buffer = OUTER(CPUTraceBuffer, traceBufferCmd);
+	auto& interp = getInterpreter();
+	string_view subcommand = tokens[1].getString();
+	if        (subcommand == "start") {
+		unsigned size = DEFAULT_SIZE;
+		if (tokens.size() == 3) {
+			int s = tokens[2].getInt(interp);
+			if ((s <= 0) || (unsigned(s) > MAX_SIZE)) {
+				throw CommandException(
+					"Size must be between 1 and ", MAX_SIZE);
+			}
+			size = s;
+		} else if (tokens.size() != 2) {
+			throw SyntaxError();
+		}
+		buffer.start(size);
+	} else if (subcommand == "stop") {
+		buffer.stop();
+	} else if (subcommand == "status") {
+		result.addListElement("active");
+		result.addListElement(buffer.active ? "true" : "false");
+		result.addListElement("size");
+		result.addListElement(int(buffer.ring.size()));
+		result.addListElement("recorded");
+		result.addListElement(double(buffer.head.load()));
+		result.addListElement("stream");
+		result.addListElement(buffer.streamThread.joinable()
+			? string_view(buffer.streamName) : string_view());
+		if (buffer.streamFailed) {
+			result.addListElement("stream_error");
+			result.addListElement(buffer.streamError);
+		}
+	} else if (subcommand == "save") {
+		if (tokens.size() != 3) throw SyntaxError();
+		buffer.save(tokens[2].getString().str());
+	} else if (subcommand == "stream") {
+		if (tokens.size() != 3) throw SyntaxError();
+		if (tokens[2].getString() == "-stop") {
+			buffer.stopStream();
+		} else {
+			buffer.startStream(tokens[2].getString().str());
+		}
+	} else if (subcommand == "decode") {
+		if ((tokens.size() != 3) && (tokens.size() != 4)) {
+			throw SyntaxError();
+		}
+		string text = decode(load(tokens[2].getString().str()));
+		if (tokens.size() == 4) {
+			try {
+				File file(tokens[3].getString(), File::TRUNCATE);
+				file.write(text.data(), text.size());
+			} catch (FileException& e) {
+				throw CommandException(
+					"Couldn't write decoded trace: ", e.getMessage());
+			}
+		} else {
+			result.setString(text);
+		}
+	} else {
+		throw CommandException("Invalid subcommand: ", subcommand);
+	}
+}
+
+string CPUTraceBuffer::TraceBufferCmd::help(const vector<string>& /*tokens*/) const
+{
+	return "start [<size>]                 start recording the last <size> (default 1048576) executed instructions\n"
+	       "stop                           stop recording (also stops streaming)\n"
+	       "status                         show info about the trace buffer\n"
+	       "save <file>                    save the content of the trace buffer to a binary file\n"
+	       "stream <file>                  keep writing all executed instructions to a binary file (starts recording if needed)\n"
+	       "stream -stop                   stop streaming\n"
+	       "decode <file> [<textfile>]     disassemble a binary trace file, return the result or write it to <textfile>\n";
+}
+
+void CPUTraceBuffer::TraceBufferCmd::tabCompletion(vector<string>& tokens) const
+{
+	if (tokens.size() == 2) {
+		static const char* const subCommands[] = {
+			"start", "stop", "status", "save", "stream", "decode",
+		};
+		completeString(tokens, subCommands);
+	} else if ((tokens.size() >= 3) &&
+	           ((tokens[1] == "save") || (tokens[1] == "stream") ||
+	            (tokens[1] == "decode"))) {
+		std::vector<const char*> cmds;
+		if (tokens[1] == "stream") cmds = { "-stop" };
+		completeFileName(tokens, currentDirFileContext(), cmds);
+	}
+}
+
+} // namespace openmsx
@@ -0,0 +1,103 @@
+#ifndef CPUTRACEBUFFER_HH
+#define CPUTRACEBUFFER_HH
+
+#include "Command.hh"
+#include "EmuTime.hh"
+#include "endian.hh"
+#include "openmsx.hh"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+namespace openmsx {
+
+class MSXMotherBoard;
+class CPURegs;
+class File;
+
+/** Records the most recently executed CPU instructions.
+  *
+  * Each executed instruction is stored as a fixed size entry (address,
+  * opcode bytes, registers and EmuTime) in a ring buffer, so the buffer
+  * always holds the last N instructions. The buffer can be saved to a
+  * compact binary file, or it can be streamed to such a file by a
+  * background thread while the emulation continues. For the latter the
+  * buffer is a lock-free single-producer (the CPU) / single-consumer (the
+  * stream thread) queue. When the consumer can't keep up, the oldest
+  * entries are overwritten and the next written entry is marked.
+  *
+  * While the buffer is active, CPUCore takes the same (slow) execution path
+  * as for the 'cputrace' setting. When it's not active there's no overhead.
+  */
+class CPUTraceBuffer
+{
+public:
+	/** One executed instruction, in the format of the binary file. */
+	struct Entry {
+		Endian::L32 timeLo, timeHi; // EmuTime after the instruction
+		Endian::L16 pc; // address of the instruction
+		Endian::L16 af, bc, de, hl, ix, iy, sp; // after the instruction
+		byte opcode[4]; // (up to) 4 bytes at 'pc', read before execution
+		byte i, r;
+		byte flags;
+		byte reserved;
+
+		static const byte IM_MASK = 0x03;
+		static const byte IFF1    = 0x04;
+		static const byte IFF2    = 0x08;
+		static const byte R800    = 0x40;
+		static const byte LOST    = 0x80; // entries were dropped before this one
+	};
+	static_assert(sizeof(Entry) == 32, "no padding in the file format");
+
+	explicit CPUTraceBuffer(MSXMotherBoard& motherBoard);
+	~CPUTraceBuffer();
+
+	bool isActive() const { return active; }
+
+	/** Called by CPUCore (only when active) after each instruction. */
+	void record(const CPURegs& regs, word pc, const byte opcode[4],
+	            EmuTime::param time, bool r800);
+
+	/** Render the entries of a binary trace file as text. */
+	static std::string decode(const std::vector<Entry>& entries);
+
+private:
+	void start(unsigned size);
+	void stop();
+	void save(const std::string& filename);
+	void startStream(const std::string& filename);
+	void stopStream();
+	void streamLoop();
+	bool copyEntries(uint64_t& from, uint64_t to, std::vector<Entry>& out) const;
+	static void writeHeader(File& file);
+	static std::vector<Entry> load(const std::string& filename);
+
+	MSXMotherBoard& motherBoard;
+
+	struct TraceBufferCmd final : Command {
+		explicit TraceBufferCmd(CommandController& controller);
+		void execute(array_ref<TclObject> tokens, TclObject& result) override;
+		std::string help(const std::vector<std::string>& tokens) const override;
+		void tabCompletion(std::vector<std::string>& tokens) const override;
+	} traceBufferCmd;
+
+	std::vector<Entry> ring; // size is a power of 2
+	std::atomic<uint64_t> head; // total number of recorded entries
+	bool active;
+
+	// streaming
+	std::unique_ptr<File> streamFile;
+	std::thread streamThread;
+	std::atomic<bool> streamExit;
+	std::atomic<bool> streamFailed;
+	std::string streamError; // only valid when streamFailed is set
+	std::string streamName;
+};
+
+} // namespace openmsx
+
+#endif
@@ -10,6 +10,28 @@ static const unsigned NUM  = 0x10000 / SIZE;
 static const unsigned LOW  = SIZE - 1;
 static const unsigned HIGH = 0xFFFF - LOW;
 
+// A cache line that can't be cached as a whole can still be partly cached at
+// the granularity of sub-lines (see MSXDevice::getReadCacheSubLines()). Which
+// sub-lines of a line are uncacheable is stored in a bitmask, bit N stands for
+// the N-th sub-line of the line.
+static const unsigned SUB_BITS = 4; // 16 bytes
+static const unsigned SUB_SIZE = 1 << SUB_BITS;
+static const unsigned SUB_NUM  = SIZE / SUB_SIZE;
+static_assert(SUB_NUM <= 32, "sub-line mask must fit in 'unsigned'");
+
+/** The bit in a sub-line mask for the sub-line containing 'address'. */
+inline unsigned subLineBit(unsigned address)
+{
+	return 1u << ((address & LOW) >> SUB_BITS);
+}
+
+/** The sub-line mask for all sub-lines that contain an address in the range
+  * [first, last]. Both addresses must be in the same cache line. */
+inline unsigned subLineMask(unsigned first, unsigned last)
+{
+	return (subLineBit(last) << 1) - subLineBit(first);
+}
+
 } // namespace CacheLine
 } // namespace openmsx
 
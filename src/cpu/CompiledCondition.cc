@@ -0,0 +1,627 @@
+#include "CompiledCondition.hh"
+#include "CPURegs.hh"
+#include "CommandException.hh"
+#include "unreachable.hh"
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+
+namespace openmsx {
+
+// Same names and values as the 'reg' Tcl proc (see _cpuregs.tcl).
+struct RegInfo {
+	const char* name;
+	unsigned (*get)(const CPURegs& regs);
+};
+static const RegInfo registers[] = {
+	{ "A",   [](const CPURegs& r) -> unsigned { return r.getA(); } },
+	{ "F",   [](const CPURegs& r) -> unsigned { return r.getF(); } },
+	{ "B",   [](const CPURegs& r) -> unsigned { return r.getB(); } },
+	{ "C",   [](const CPURegs& r) -> unsigned { return r.getC(); } },
+	{ "D",   [](const CPURegs& r) -> unsigned { return r.getD(); } },
+	{ "E",   [](const CPURegs& r) -> unsigned { return r.getE(); } },
+	{ "H",   [](const CPURegs& r) -> unsigned { return r.getH(); } },
+	{ "L",   [](const CPURegs& r) -> unsigned { return r.getL(); } },
+	{ "A2",  [](const CPURegs& r) -> unsigned { return r.getA2(); } },
+	{ "F2",  [](const CPURegs& r) -> unsigned { return r.getF2(); } },
+	{ "B2",  [](const CPURegs& r) -> unsigned { return r.getB2(); } },
+	{ "C2",  [](const CPURegs& r) -> unsigned { return r.getC2(); } },
+	{ "D2",  [](const CPURegs& r) -> unsigned { return r.getD2(); } },
+	{ "E2",  [](const CPURegs& r) -> unsigned { return r.getE2(); } },
+	{ "H2",  [](const CPURegs& r) -> unsigned { return r.getH2(); } },
+	{ "L2",  [](const CPURegs& r) -> unsigned { return r.getL2(); } },
+	{ "IXH", [](const CPURegs& r) -> unsigned { return r.getIXh(); } },
+	{ "IXL", [](const CPURegs& r) -> unsigned { return r.getIXl(); } },
+	{ "IYH", [](const CPURegs& r) -> unsigned { return r.getIYh(); } },
+	{ "IYL", [](const CPURegs& r) -> unsigned { return r.getIYl(); } },
+	{ "PCH", [](const CPURegs& r) -> unsigned { return r.getPCh(); } },
+	{ "PCL", [](const CPURegs& r) -> unsigned { return r.getPCl(); } },
+	{ "SPH", [](const CPURegs& r) -> unsigned { return r.getSPh(); } },
+	{ "SPL", [](const CPURegs& r) -> unsigned { return r.getSPl(); } },
+	{ "I",   [](const CPURegs& r) -> unsigned { return r.getI(); } },
+	{ "R",   [](const CPURegs& r) -> unsigned { return r.getR(); } },
+	{ "IM",  [](const CPURegs& r) -> unsigned { return r.getIM(); } },
+	{ "IFF", [](const CPURegs& r) -> unsigned {
+		// same as the "CPU regs" debuggable
+		return 1 *  r.getIFF1() +
+		       2 *  r.getIFF2() +
+		       4 * (r.getIFF1() && !r.prevWasEI()); } },
+	{ "AF",  [](const CPURegs& r) -> unsigned { return r.getAF(); } },
+	{ "BC",  [](const CPURegs& r) -> unsigned { return r.getBC(); } },
+	{ "DE",  [](const CPURegs& r) -> unsigned { return r.getDE(); } },
+	{ "HL",  [](const CPURegs& r) -> unsigned { return r.getHL(); } },
+	{ "AF2", [](const CPURegs& r) -> unsigned { return r.getAF2(); } },
+	{ "BC2", [](const CPURegs& r) -> unsigned { return r.getBC2(); } },
+	{ "DE2", [](const CPURegs& r) -> unsigned { return r.getDE2(); } },
+	{ "HL2", [](const CPURegs& r) -> unsigned { return r.getHL2(); } },
+	{ "IX",  [](const CPURegs& r) -> unsigned { return r.getIX(); } },
+	{ "IY",  [](const CPURegs& r) -> unsigned { return r.getIY(); } },
+	{ "PC",  [](const CPURegs& r) -> unsigned { return r.getPC(); } },
+	{ "SP",  [](const CPURegs& r) -> unsigned { return r.getSP(); } },
+};
+
+// Thrown when (a part of) the expression is not supported.
+struct ConditionNotSupported {};
+
+// Recursive descent parser for (a subset of) the Tcl expr syntax, directly
+// generates bytecode.
+class ConditionParser
+{
+public:
+	explicit ConditionParser(string_view input_)
+		: input(input_), pos(0), depth(0), maxDepth(0) {}
+
+	std::vector<CompiledCondition::Instr> parse()
+	{
+		parseTernary();
+		skipSpace();
+		if (pos != input.size()) throw ConditionNotSupported();
+		assert(depth == 1);
+		return std::move(code);
+	}
+
+	std::vector<std::string> getCommands() const { return commands; }
+
+private:
+	using Op = CompiledCondition::Op;
+
+	void emit(Op op, int64_t arg, int stackDelta)
+	{
+		code.push_back({op, arg});
+		depth += stackDelta;
+		maxDepth = std::max(maxDepth, depth);
+		if (maxDepth > int(CompiledCondition::MAX_STACK)) throw ConditionNotSupported();
+	}
+	size_t emitJump(Op op, int stackDelta)
+	{
+		emit(op, 0, stackDelta);
+		return code.size() - 1;
+	}
+	void patchJump(size_t jump)
+	{
+		code[jump].arg = code.size();
+	}
+
+	void addCommand(string_view cmd)
+	{
+		if (std::find(commands.begin(), commands.end(), cmd) == commands.end()) {
+			commands.push_back(cmd.str());
+		}
+	}
+
+	static bool isSpace(char c) { return isspace(static_cast<unsigned char>(c)) != 0; }
+	static bool isDigit(char c) { return isdigit(static_cast<unsigned char>(c)) != 0; }
+	static bool isAlnum(char c) { return isalnum(static_cast<unsigned char>(c)) != 0; }
+
+	void skipSpace()
+	{
+		while ((pos < input.size()) && isSpace(input[pos])) ++pos;
+	}
+	char peekChar()
+	{
+		skipSpace();
+		return (pos < input.size()) ? input[pos] : '\0';
+	}
+	// Match the given operator, but not when it's the start of a longer
+	// operator (e.g. "<" should not match "<<" or "<=").
+	bool match(string_view op, string_view notFollowedBy = {})
+	{
+		skipSpace();
+		if (!input.substr(pos).starts_with(op)) return false;
+		size_t next = pos + op.size();
+		if ((next < input.size()) &&
+		    (notFollowedBy.find(input[next]) != string_view::npos)) {
+			return false;
+		}
+		pos = next;
+		return true;
+	}
+
+	void parseTernary()
+	{
+		parseLogicalOr();
+		if (match("?")) {
+			auto toElse = emitJump(Op::JUMP_IF_FALSE, -1);
+			parseTernary();
+			auto toEnd = emitJump(Op::JUMP, 0);
+			if (!match(":")) throw ConditionNotSupported();
+			patchJump(toElse);
+			depth -= 1; // only one of both branches is executed
+			parseTernary();
+			patchJump(toEnd);
+		}
+	}
+	void parseLogicalOr()
+	{
+		parseLogicalAnd();
+		while (match("||")) {
+			auto jump = emitJump(Op::OR_JUMP, -1);
+			parseLogicalAnd();
+			emit(Op::TO_BOOL, 0, 0);
+			patchJump(jump);
+		}
+	}
+	void parseLogicalAnd()
+	{
+		parseBitOr();
+		while (match("&&")) {
+			auto jump = emitJump(Op::AND_JUMP, -1);
+			parseBitOr();
+			emit(Op::TO_BOOL, 0, 0);
+			patchJump(jump);
+		}
+	}
+	void parseBitOr()
+	{
+		parseBitXor();
+		while (match("|", "|")) {
+			parseBitXor();
+			emit(Op::BITOR, 0, -1);
+		}
+	}
+	void parseBitXor()
+	{
+		parseBitAnd();
+		while (match("^")) {
+			parseBitAnd();
+			emit(Op::BITXOR, 0, -1);
+		}
+	}
+	void parseBitAnd()
+	{
+		parseEquality();
+		while (match("&", "&")) {
+			parseEquality();
+			emit(Op::BITAND, 0, -1);
+		}
+	}
+	void parseEquality()
+	{
+		parseRelational();
+		while (true) {
+			Op op;
+			if      (match("==")) op = Op::EQ;
+			else if (match("!=")) op = Op::NE;
+			else return;
+			parseRelational();
+			emit(op, 0, -1);
+		}
+	}
+	void parseRelational()
+	{
+		parseShift();
+		while (true) {
+			Op op;
+			if      (match("<="))      op = Op::LE;
+			else if (match(">="))      op = Op::GE;
+			else if (match("<", "<"))  op = Op::LT;
+			else if (match(">", ">"))  op = Op::GT;
+			else return;
+			parseShift();
+			emit(op, 0, -1);
+		}
+	}
+	void parseShift()
+	{
+		parseAdditive();
+		while (true) {
+			Op op;
+			if      (match("<<")) op = Op::SHL;
+			else if (match(">>")) op = Op::SHR;
+			else return;
+			parseAdditive();
+			emit(op, 0, -1);
+		}
+	}
+	void parseAdditive()
+	{
+		parseMultiplicative();
+		while (true) {
+			Op op;
+			if      (match("+")) op = Op::ADD;
+			else if (match("-")) op = Op::SUB;
+			else return;
+			parseMultiplicative();
+			emit(op, 0, -1);
+		}
+	}
+	void parseMultiplicative()
+	{
+		parseUnary();
+		while (true) {
+			Op op;
+			if      (match("*", "*")) op = Op::MUL; // '**' not supported
+			else if (match("/"))      op = Op::DIV;
+			else if (match("%"))      op = Op::MOD;
+			else return;
+			parseUnary();
+			emit(op, 0, -1);
+		}
+	}
+	void parseUnary()
+	{
+		if (match("-")) {
+			parseUnary();
+			emit(Op::NEG, 0, 0);
+		} else if (match("+")) {
+			parseUnary();
+		} else if (match("!", "=")) {
+			parseUnary();
+			emit(Op::NOT, 0, 0);
+		} else if (match("~")) {
+			parseUnary();
+			emit(Op::BITNOT, 0, 0);
+		} else {
+			parsePrimary();
+		}
+	}
+	void parsePrimary()
+	{
+		char c = peekChar();
+		if (c == '(') {
+			++pos;
+			parseTernary();
+			if (!match(")")) throw ConditionNotSupported();
+		} else if (c == '[') {
+			++pos;
+			parseCommand();
+		} else if (isDigit(c)) {
+			emit(Op::PUSH_CONST, parseNumber(), 1);
+		} else {
+			throw ConditionNotSupported();
+		}
+	}
+
+	// Parses a Tcl word (the part after the command name in [...]):
+	// either a plain word or a word in braces.
+	string_view parseWord()
+	{
+		skipSpace();
+		if ((pos < input.size()) && (input[pos] == '{')) {
+			// no nested braces or backslashes
+			auto rest = input.substr(pos + 1);
+			auto end = rest.find_first_of("{}\\");
+			if ((end == string_view::npos) || (rest[end] != '}')) {
+				throw ConditionNotSupported();
+			}
+			pos += end + 2;
+			return rest.substr(0, end);
+		}
+		auto start = pos;
+		while ((pos < input.size()) && !isSpace(input[pos]) &&
+		       (string_view("[]{}\"$\\;").find(input[pos]) == string_view::npos)) {
+			++pos;
+		}
+		if (pos == start) throw ConditionNotSupported();
+		return input.substr(start, pos - start);
+	}
+
+	// Parses the argument of e.g. peek: a number or a nested command.
+	void parseArgument()
+	{
+		char c = peekChar();
+		if (c == '[') {
+			++pos;
+			parseCommand();
+		} else {
+			ConditionParser sub(parseWord());
+			emit(Op::PUSH_CONST, sub.parseOnlyNumber(), 1);
+		}
+	}
+
+	// Parses the part after '[' up to and including the matching ']'.
+	void parseCommand()
+	{
+		auto cmd = parseWord();
+		if (cmd.starts_with("::")) cmd = cmd.substr(2);
+		addCommand(cmd);
+		if ((cmd == "reg") || (cmd == "cpuregs::reg")) {
+			std::string name = parseWord().str();
+			for (auto& c : name) c = char(toupper(static_cast<unsigned char>(c)));
+			auto it = std::find_if(std::begin(registers), std::end(registers),
+				[&](const RegInfo& r) { return name == r.name; });
+			if (it == std::end(registers)) throw ConditionNotSupported();
+			emit(Op::PUSH_REG, it - std::begin(registers), 1);
+		} else if ((cmd == "peek") || (cmd == "peek8") || (cmd == "peek_u8")) {
+			parseArgument();
+			emit(Op::PEEK, 0, 0);
+		} else if (cmd == "peek_s8") {
+			parseArgument();
+			emit(Op::PEEK, 0, 0);
+			emit(Op::SEXT8, 0, 0);
+		} else if ((cmd == "peek16") || (cmd == "peek16_LE") ||
+		           (cmd == "peek_u16") || (cmd == "peek_u16LE")) {
+			parseArgument();
+			emit(Op::PEEK16, 0, 0);
+		} else if ((cmd == "peek16_BE") || (cmd == "peek_u16BE")) {
+			parseArgument();
+			emit(Op::PEEK16BE, 0, 0);
+		} else if ((cmd == "peek_s16") || (cmd == "peek_s16LE")) {
+			parseArgument();
+			emit(Op::PEEK16, 0, 0);
+			emit(Op::SEXT16, 0, 0);
+		} else if (cmd == "peek_s16BE") {
+			parseArgument();
+			emit(Op::PEEK16BE, 0, 0);
+			emit(Op::SEXT16, 0, 0);
+		} else if (cmd == "expr") {
+			skipSpace();
+			if ((pos >= input.size()) || (input[pos] != '{')) {
+				throw ConditionNotSupported();
+			}
+			// Compile the braced expression in place.
+			auto body = parseWord();
+			ConditionParser sub(body);
+			sub.depth = depth;
+			sub.maxDepth = maxDepth;
+			sub.parseTernary();
+			sub.skipSpace();
+			if (sub.pos != body.size()) throw ConditionNotSupported();
+			auto offset = code.size();
+			for (auto& instr : sub.code) {
+				if ((instr.op == Op::AND_JUMP) || (instr.op == Op::OR_JUMP) ||
+				    (instr.op == Op::JUMP_IF_FALSE) || (instr.op == Op::JUMP)) {
+					instr.arg += offset;
+				}
+				code.push_back(instr);
+			}
+			depth = sub.depth;
+			maxDepth = sub.maxDepth;
+			for (auto& c : sub.commands) addCommand(c);
+		} else {
+			throw ConditionNotSupported();
+		}
+		if (!match("]")) throw ConditionNotSupported(); // e.g. extra arguments
+	}
+
+	int64_t parseOnlyNumber()
+	{
+		skipSpace();
+		auto result = parseNumber();
+		skipSpace();
+		if (pos != input.size()) throw ConditionNotSupported();
+		return result;
+	}
+
+	// Integer literals, like Tcl 8.5/8.6: a leading zero means octal.
+	int64_t parseNumber()
+	{
+		skipSpace();
+		unsigned base = 10;
+		if ((pos + 1 < input.size()) && (input[pos] == '0')) {
+			char p = input[pos + 1];
+			if      ((p == 'x') || (p == 'X')) { base = 16; pos += 2; }
+			else if ((p == 'b') || (p == 'B')) { base =  2; pos += 2; }
+			else if ((p == 'o') || (p == 'O')) { base =  8; pos += 2; }
+			else if (isDigit(p))     { base =  8; pos += 1; }
+		}
+		uint64_t result = 0;
+		auto start = pos;
+		while (pos < input.size()) {
+			char c = input[pos];
+			unsigned digit;
+			if      (('0' <= c) && (c <= '9')) digit = c - '0';
+			else if (('a' <= c) && (c <= 'f')) digit = c - 'a' + 10;
+			else if (('A' <= c) && (c <= 'F')) digit = c - 'A' + 10;
+			else break;
+			if (digit >= base) throw ConditionNotSupported(); // e.g. 09, 1e3
+			if (result > (uint64_t(INT64_MAX) - digit) / base) {
+				throw ConditionNotSupported(); // Tcl would use a bignum
+			}
+			result = result * base + digit;
+			++pos;
+		}
+		if (pos == start) throw ConditionNotSupported();
+		if ((pos < input.size()) &&
+		    (isAlnum(input[pos]) || (input[pos] == '.') ||
+		     (input[pos] == '_'))) {
+			throw ConditionNotSupported(); // floating point or garbage
+		}
+		return int64_t(result);
+	}
+
+	string_view input;
+	size_t pos;
+	int depth;
+	int maxDepth;
+	std::vector<CompiledCondition::Instr> code;
+	std::vector<std::string> commands;
+};
+
+
+CompiledCondition::CompiledCondition(std::vector<Instr> code_,
+                                     std::vector<std::string> commands_)
+	: code(std::move(code_)), commands(std::move(commands_))
+{
+}
+
+std::unique_ptr<CompiledCondition> CompiledCondition::compile(string_view condition)
+{
+	try {
+		ConditionParser parser(condition);
+		auto code = parser.parse();
+		return std::unique_ptr<CompiledCondition>(new CompiledCondition(
+			std::move(code), parser.getCommands()));
+	} catch (ConditionNotSupported&) {
+		return nullptr;
+	}
+}
+
+static word checkAddress(int64_t address)
+{
+	// same check (and message) as 'debug read memory <address>'
+	if ((address < 0) || (address > 0xFFFF)) {
+		throw CommandException("Invalid address");
+	}
+	return word(address);
+}
+
+// Tcl switches to big integers when a result doesn't fit in 64 bits.
+static int64_t checked(bool overflow, uint64_t x)
+{
+	if (overflow) throw CompiledCondition::Overflow();
+	return int64_t(x);
+}
+
+bool CompiledCondition::evaluate(Context& context) const
+{
+	int64_t stack[MAX_STACK];
+	int sp = -1; // index of the top element
+	size_t pc = 0;
+	while (pc < code.size()) {
+		const auto& instr = code[pc++];
+		switch (instr.op) {
+		case PUSH_CONST:
+			stack[++sp] = instr.arg;
+			break;
+		case PUSH_REG:
+			stack[++sp] = registers[instr.arg].get(context.getRegisters());
+			break;
+		case PEEK:
+			stack[sp] = context.peekMem(checkAddress(stack[sp]));
+			break;
+		case PEEK16: {
+			auto address = stack[sp];
+			checkAddress(address + 1);
+			stack[sp] = context.peekMem(checkAddress(address)) +
+			      256 * context.peekMem(checkAddress(address + 1));
+			break;
+		}
+		case PEEK16BE: {
+			auto address = stack[sp];
+			checkAddress(address + 1);
+			stack[sp] = 256 * context.peekMem(checkAddress(address)) +
+			                  context.peekMem(checkAddress(address + 1));
+			break;
+		}
+		case SEXT8:
+			stack[sp] = int8_t(stack[sp]);
+			break;
+		case SEXT16:
+			stack[sp] = int16_t(stack[sp]);
+			break;
+		case NEG:
+			stack[sp] = checked(stack[sp] == INT64_MIN, -uint64_t(stack[sp]));
+			break;
+		case NOT:
+			stack[sp] = stack[sp] == 0;
+			break;
+		case BITNOT:
+			stack[sp] = ~stack[sp];
+			break;
+		case TO_BOOL:
+			stack[sp] = stack[sp] != 0;
+			break;
+		case AND_JUMP:
+			if (stack[sp] == 0) {
+				pc = instr.arg;
+			} else {
+				--sp;
+			}
+			break;
+		case OR_JUMP:
+			if (stack[sp] != 0) {
+				stack[sp] = 1;
+				pc = instr.arg;
+			} else {
+				--sp;
+			}
+			break;
+		case JUMP_IF_FALSE:
+			if (stack[sp--] == 0) pc = instr.arg;
+			break;
+		case JUMP:
+			pc = instr.arg;
+			break;
+		default: {
+			// binary operators
+			int64_t b = stack[sp--];
+			int64_t a = stack[sp];
+			int64_t r;
+			switch (instr.op) {
+			case MUL:
+				r = int64_t(uint64_t(a) * uint64_t(b));
+				checked((a != 0) && (((r / a) != b) ||
+				                     ((a == -1) && (b == INT64_MIN))), 0);
+				break;
+			case ADD:
+				r = int64_t(uint64_t(a) + uint64_t(b));
+				checked(((a ^ r) & (b ^ r)) < 0, 0);
+				break;
+			case SUB:
+				r = int64_t(uint64_t(a) - uint64_t(b));
+				checked(((a ^ b) & (a ^ r)) < 0, 0);
+				break;
+			case DIV:
+			case MOD:
+				if (b == 0) {
+					throw CommandException("divide by zero");
+				}
+				if (b == -1) {
+					// avoid overflow for INT64_MIN / -1
+					r = (instr.op == DIV)
+					  ? checked(a == INT64_MIN, -uint64_t(a))
+					  : 0;
+				} else if (instr.op == DIV) {
+					// Tcl rounds towards negative infinity
+					r = a / b;
+					if (((a % b) != 0) && ((a < 0) != (b < 0))) --r;
+				} else {
+					// and the remainder has the sign of the divisor
+					r = a % b;
+					if ((r != 0) && ((r < 0) != (b < 0))) r += b;
+				}
+				break;
+			case SHL:
+			case SHR:
+				if (b < 0) {
+					throw CommandException("negative shift argument");
+				}
+				if (instr.op == SHL) {
+					r = (b < 63) ? int64_t(uint64_t(a) << b) : 0;
+					checked((b >= 63) ? (a != 0) : ((r >> b) != a), 0);
+				} else {
+					r = a >> std::min<int64_t>(b, 63);
+				}
+				break;
+			case LT:     r = a <  b; break;
+			case LE:     r = a <= b; break;
+			case GT:     r = a >  b; break;
+			case GE:     r = a >= b; break;
+			case EQ:     r = a == b; break;
+			case NE:     r = a != b; break;
+			case BITAND: r = a & b; break;
+			case BITXOR: r = a ^ b; break;
+			case BITOR:  r = a | b; break;
+			default: UNREACHABLE; r = 0;
+			}
+			stack[sp] = r;
+			break;
+		}
+		}
+	}
+	assert(sp == 0);
+	return stack[0] != 0;
+}
+
+} // namespace openmsx
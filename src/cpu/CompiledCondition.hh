@@ -0,0 +1,91 @@
+#ifndef COMPILEDCONDITION_HH
+#define COMPILEDCONDITION_HH
+
+#include "string_view.hh"
+#include "openmsx.hh"
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace openmsx {
+
+class CPURegs;
+
+/** Native version of a breakpoint (or debug) condition.
+  *
+  * Conditions are Tcl expressions. Evaluating them via the Tcl interpreter
+  * on each breakpoint hit (or for debug conditions: before each instruction)
+  * is slow. Most conditions only compare CPU registers and memory with some
+  * constants, e.g.
+  *     [reg A] == 0x3f && [peek 0xf3ae] != 0
+  * This class recognizes that subset and translates it to a small bytecode
+  * program. Supported are:
+  *  - integer constants (decimal, hex, octal and binary)
+  *  - the commands reg, peek, peek16 (and their variants) and expr {...}
+  *  - the integer operators of expr: unary - + ! ~, * / %, + -, << >>,
+  *    < <= > >=, == !=, &, ^, |, &&, || and ?:
+  * Everything else (variables, functions, strings, ...) is not compiled,
+  * such conditions are still evaluated via Tcl.
+  */
+class CompiledCondition
+{
+public:
+	/** The machine state a condition can read. */
+	class Context
+	{
+	public:
+		virtual const CPURegs& getRegisters() = 0;
+		virtual byte peekMem(word address) = 0;
+	protected:
+		~Context() = default;
+	};
+
+	/** Returns nullptr when the condition can't be compiled. */
+	static std::unique_ptr<CompiledCondition> compile(string_view condition);
+
+	/** Thrown by evaluate() when an intermediate result doesn't fit in 64
+	  * bits. Tcl uses big integers for those, so the caller should fall
+	  * back to evaluating the condition via Tcl. */
+	struct Overflow {};
+
+	/** Same result as evaluating the original expression via Tcl.
+	  * @throws CommandException (e.g. on division by zero).
+	  * @throws Overflow */
+	bool evaluate(Context& context) const;
+
+	/** The Tcl commands used in the condition (without leading '::').
+	  * The bytecode implements the standard definition of these commands,
+	  * so it's only equivalent to the Tcl expression as long as they are
+	  * not redefined. */
+	const std::vector<std::string>& getCommands() const { return commands; }
+
+	// Only public for the implementation.
+	enum Op : uint8_t {
+		PUSH_CONST, PUSH_REG, PEEK, PEEK16, PEEK16BE, SEXT8, SEXT16,
+		NEG, NOT, BITNOT,
+		MUL, DIV, MOD, ADD, SUB, SHL, SHR,
+		LT, LE, GT, GE, EQ, NE, BITAND, BITXOR, BITOR,
+		AND_JUMP,      // if top is false: jump, else pop
+		OR_JUMP,       // if top is true: make it 1 and jump, else pop
+		TO_BOOL,       // convert top to 0 or 1
+		JUMP_IF_FALSE, // pop, jump if false
+		JUMP,
+	};
+	struct Instr {
+		Op op;
+		int64_t arg; // constant, register index or jump target
+	};
+	static const unsigned MAX_STACK = 32;
+
+private:
+	CompiledCondition(std::vector<Instr> code,
+	                  std::vector<std::string> commands);
+
+	std::vector<Instr> code;
+	std::vector<std::string> commands;
+};
+
+} // namespace openmsx
+
+#endif
@@ -21,6 +21,14 @@ class MSXCPUInterface;
 unsigned dasm(const MSXCPUInterface& interf, word pc, byte buf[4],
               std::string& dest, EmuTime::param time);
 
+/** Disassemble the given opcode bytes, e.g. stored in a trace.
+  * @param opcode The (max 4) bytes of the instruction.
+  * @param pc Address of the instruction (needed for relative jumps).
+  * @param dest String representation of the disassembled opcode
+  * @return Length of the disassembled opcode in bytes
+  */
+unsigned dasm(const byte opcode[4], word pc, std::string& dest);
+
 } // namespace openmsx
 
 #endif
@@ -0,0 +1,149 @@
+#ifndef LAZYFLAGS_HH
+#define LAZYFLAGS_HH
+
+#include "openmsx.hh"
+#include "unreachable.hh"
+
+namespace openmsx {
+
+enum LazyOp : byte {
+	LAZY_NONE, // F is up-to-date
+	LAZY_ADD, LAZY_SUB, LAZY_CP, // also ADC, SBC
+	LAZY_AND, LAZY_OR, // also XOR
+	LAZY_INC, LAZY_DEC,
+};
+
+/** Lazy evaluation of the F register, used by CPUCore when
+  * CPU_POLICY::LAZY_FLAGS is set.
+  *
+  * The 8-bit arithmetic and logical instructions don't calculate F,
+  * instead they store their operands and result in here. F is only
+  * calculated when it's actually read, most of the time it gets overwritten
+  * by the next arithmetic instruction before that happens.
+  *
+  * Methods that need the F value from before the last lazy instruction
+  * take it as a parameter, it's stored in CPURegs.
+  */
+class LazyFlags
+{
+public:
+	LazyFlags() : res(0), op(LAZY_NONE), a(0), b(0), keep(0) {}
+
+	/** Is there a lazy result, or is the F value in CPURegs valid? */
+	bool isPending() const { return op != LAZY_NONE; }
+	void clear() { op = LAZY_NONE; }
+
+	/** Store the result of an instruction.
+	  * @param op_ The kind of instruction.
+	  * @param a_ First operand (ADD, SUB, CP).
+	  * @param b_ Second operand (ADD, SUB, CP), or the original value (DEC).
+	  * @param res_ 8-bit result, bit 8 is the carry for ADD, SUB and CP.
+	  * @param f The (valid) F value in CPURegs.
+	  * @param r800 The R800 keeps the X and Y flags.
+	  */
+	void set(LazyOp op_, byte a_, byte b_, unsigned res_, byte f, bool r800)
+	{
+		byte k = 0;
+		if ((op_ == LAZY_INC) || (op_ == LAZY_DEC)) k |= getCarry(f);
+		if (r800) k |= (isPending() ? keep : f) & (X_FLAG | Y_FLAG);
+		keep = k;
+		op = op_;
+		a = a_;
+		b = b_;
+		res = res_;
+	}
+
+	/** Returns C_FLAG or 0, without calculating the full F register. */
+	byte getCarry(byte f) const
+	{
+		switch (op) {
+		case LAZY_NONE:
+			return f & C_FLAG;
+		case LAZY_ADD: case LAZY_SUB: case LAZY_CP:
+			return (res >> 8) & C_FLAG;
+		case LAZY_AND: case LAZY_OR:
+			return 0;
+		default: // INC, DEC
+			return keep & C_FLAG;
+		}
+	}
+
+	/** Is the Z flag set? Only valid when isPending(). */
+	bool isZero() const { return (res & 0xFF) == 0; }
+
+	/** Calculate the F register. Only valid when isPending(). */
+	byte calcF(bool r800) const
+	{
+		byte r = res;
+		byte f = keep;
+		switch (op) {
+		case LAZY_ADD:
+			f |= ((res & 0x100) ? C_FLAG : 0) |
+			     ((a ^ r ^ b) & H_FLAG) |
+			     (((a ^ r) & (b ^ r) & 0x80) >> 5); // V_FLAG
+			break;
+		case LAZY_SUB:
+			f |= ((res & 0x100) ? C_FLAG : 0) |
+			     N_FLAG |
+			     ((a ^ r ^ b) & H_FLAG) |
+			     (((b ^ a) & (a ^ r) & 0x80) >> 5); // V_FLAG
+			break;
+		case LAZY_CP:
+			f |= zs(r) |
+			     ((res & 0x100) ? C_FLAG : 0) |
+			     N_FLAG |
+			     ((a ^ r ^ b) & H_FLAG) |
+			     (((b ^ a) & (a ^ r) & 0x80) >> 5); // V_FLAG
+			if (!r800) {
+				f |= b & (X_FLAG | Y_FLAG); // XY from operand
+			}
+			return f;
+		case LAZY_AND:
+			return f | zs(r) | parity(r) | H_FLAG | (r800 ? 0 : xy(r));
+		case LAZY_OR:
+			return f | zs(r) | parity(r) | (r800 ? 0 : xy(r));
+		case LAZY_INC:
+			f |= ((r & -r & 0x80) >> 5) | // V_FLAG
+			     (((r & 0x0F) - 1) & H_FLAG);
+			break;
+		case LAZY_DEC:
+			f |= ((b & ~r & 0x80) >> 5) | // V_FLAG
+			     (((r & 0x0F) + 1) & H_FLAG) |
+			     N_FLAG;
+			break;
+		default:
+			UNREACHABLE;
+		}
+		return f | zs(r) | (r800 ? 0 : xy(r));
+	}
+
+	// flag positions
+	static const byte S_FLAG = 0x80;
+	static const byte Z_FLAG = 0x40;
+	static const byte Y_FLAG = 0x20;
+	static const byte H_FLAG = 0x10;
+	static const byte X_FLAG = 0x08;
+	static const byte V_FLAG = 0x04;
+	static const byte N_FLAG = 0x02;
+	static const byte C_FLAG = 0x01;
+
+private:
+	static byte zs(byte r) { return (r ? 0 : Z_FLAG) | (r & S_FLAG); }
+	static byte xy(byte r) { return r & (X_FLAG | Y_FLAG); }
+	static byte parity(byte r)
+	{
+		r ^= r >> 4;
+		r ^= r >> 2;
+		r ^= r >> 1;
+		return (r & 1) ? 0 : V_FLAG;
+	}
+
+	unsigned res; // 8-bit result, bit 8 is the carry for ADD/SUB/CP
+	byte op;      // LazyOp
+	byte a, b;    // operands
+	byte keep;    // flags that are copied from the previous F value
+};
+
+} // namespace openmsx
+
+#endif
@@ -23,16 +23,20 @@ MSXCPU::MSXCPU(MSXMotherBoard& motherboard_)
 	, traceSetting(
 		motherboard.getCommandController(), "cputrace",
 		"CPU tracing on/off", false, Setting::DONT_SAVE)
+	, batchMode(false)
+	, settingsChanged(false)
 	, diHaltCallback(
 		motherboard.getCommandController(), "di_halt_callback",
 		"Tcl proc called when the CPU executed a DI/HALT sequence")
+	, profiler(motherboard)
+	, traceBuffer(motherboard)
 	, z80(make_unique<CPUCore<Z80TYPE>>(
 		motherboard, "z80", traceSetting,
-		diHaltCallback, EmuTime::zero))
+		diHaltCallback, profiler, traceBuffer, EmuTime::zero))
 	, r800(motherboard.isTurboR()
 		? make_unique<CPUCore<R800TYPE>>(
 			motherboard, "r800", traceSetting,
-			diHaltCallback, EmuTime::zero)
+			diHaltCallback, profiler, traceBuffer, EmuTime::zero)
 		: nullptr)
 	, timeInfo(motherboard.getMachineInfoCommand())
 	, z80FreqInfo(motherboard.getMachineInfoCommand(), "z80_freq", *z80)
@@ -75,6 +79,7 @@ void MSXCPU::setInterface(MSXCPUInterface* interface)
 {
 	          z80 ->setInterface(interface);
 	if (r800) r800->setInterface(interface);
+	profiler.setInterface(interface);
 }
 
 void MSXCPU::doReset(EmuTime::param time)
@@ -115,6 +120,13 @@ void MSXCPU::execute(bool fastForward)
 	          : r800->execute(fastForward);
 }
 
+void MSXCPU::updateTracing()
+{
+	          z80 ->updateTracing();
+	if (r800) r800->updateTracing();
+	exitCPULoopSync();
+}
+
 void MSXCPU::exitCPULoopSync()
 {
 	z80Active ? z80 ->exitCPULoopSync()
@@ -126,6 +138,30 @@ void MSXCPU::exitCPULoopAsync()
 	          : r800->exitCPULoopAsync();
 }
 
+void MSXCPU::setStopAddress(int address)
+{
+	z80->setStopAddress(address);
+	if (r800) r800->setStopAddress(address);
+}
+void MSXCPU::setBatchMode(bool batch)
+{
+	assert(batch != batchMode);
+	batchMode = batch;
+	if (!batch && settingsChanged) {
+		// apply the changes that were postponed during batch mode
+		          z80 ->loadSettings();
+		if (r800) r800->loadSettings();
+		settingsChanged = false;
+		exitCPULoopSync();
+	}
+}
+
+bool MSXCPU::isStopAddressReached() const
+{
+	return z80Active ? z80 ->isStopAddressReached()
+	                 : r800->isStopAddressReached();
+}
+
 EmuTime::param MSXCPU::getCurrentTime() const
 {
 	return z80Active ? z80 ->getCurrentTime()
@@ -148,6 +184,18 @@ void MSXCPU::invalidateMemCache(word start, unsigned size)
 {
 	z80Active ? z80 ->invalidateMemCache(start, size)
 	          : r800->invalidateMemCache(start, size);
+	// Also called on a slot or memory mapper segment switch.
+	if (profiler.isActive() && size) {
+		for (unsigned page = start >> 14; page <= ((start + size - 1) >> 14); ++page) {
+			profiler.invalidatePage(page);
+		}
+	}
+}
+
+void MSXCPU::invalidateWriteCache(const byte* begin, const byte* end)
+{
+	          z80 ->invalidateWriteCache(begin, end);
+	if (r800) r800->invalidateWriteCache(begin, end);
 }
 
 void MSXCPU::raiseIRQ()
@@ -203,14 +251,21 @@ EmuTime MSXCPU::waitCyclesR800(EmuTime::param time, unsigned cycles)
 CPURegs& MSXCPU::getRegisters()
 {
 	if (z80Active) {
+		z80->syncFlags();
 		return *z80;
 	} else {
+		r800->syncFlags();
 		return *r800;
 	}
 }
 
 void MSXCPU::update(const Setting& setting)
 {
+	if (batchMode) {
+		// the CPU is running in another thread, see setBatchMode()
+		settingsChanged = true;
+		return;
+	}
 	          z80 ->update(setting);
 	if (r800) r800->update(setting);
 	exitCPULoopSync();
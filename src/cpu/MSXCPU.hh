@@ -2,6 +2,8 @@
 #define MSXCPU_HH
 
 #include "InfoTopic.hh"
+#include "CPUProfiler.hh"
+#include "CPUTraceBuffer.hh"
 #include "SimpleDebuggable.hh"
 #include "Observer.hh"
 #include "BooleanSetting.hh"
@@ -53,6 +55,10 @@ public:
 	  * method when a 'memory switch' occurs. */
 	void invalidateMemCache(word start, unsigned size);
 
+	/** Drop the cached write pointers (of both CPUs) that point into the
+	  * host memory range [begin, end). Read pointers are kept. */
+	void invalidateWriteCache(const byte* begin, const byte* end);
+
 	/** This method raises a maskable interrupt. A device may call this
 	  * method more than once. If the device wants to lower the
 	  * interrupt again it must call the lowerIRQ() method exactly as
@@ -86,11 +92,26 @@ public:
 	  */
 	bool isM1Cycle(unsigned address) const;
 
+	/** See CPUCore::updateTracing() */
+	void updateTracing();
+
 	/** See CPUCore::exitCPULoopsync() */
 	void exitCPULoopSync();
 	/** See CPUCore::exitCPULoopAsync() */
 	void exitCPULoopAsync();
 
+	/** See CPUCore::setStopAddress() */
+	void setStopAddress(int address);
+	/** See CPUCore::isStopAddressReached() */
+	bool isStopAddressReached() const;
+
+	/** Used by BatchRunner: while 'batch' is set the CPU runs in a worker
+	  * thread. It then only uses the setting values that were copied
+	  * when batch mode was entered, changes made meanwhile (in the main
+	  * thread) only take effect when batch mode is left again.
+	  */
+	void setBatchMode(bool batch);
+
 	/** Is the R800 currently active? */
 	bool isR800Active() const { return !z80Active; }
 
@@ -135,7 +156,11 @@ private:
 
 	MSXMotherBoard& motherboard;
 	BooleanSetting traceSetting;
+	bool batchMode;
+	bool settingsChanged; // during batch mode
 	TclCallback diHaltCallback;
+	CPUProfiler profiler;
+	CPUTraceBuffer traceBuffer;
 	const std::unique_ptr<CPUCore<Z80TYPE>> z80;
 	const std::unique_ptr<CPUCore<R800TYPE>> r800; // can be nullptr
 
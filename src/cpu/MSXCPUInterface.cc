@@ -20,7 +20,6 @@
 #include "DeviceFactory.hh"
 #include "ReadOnlySetting.hh"
 #include "serialize.hh"
-#include "checked_cast.hh"
 #include "memory.hh"
 #include "outer.hh"
 #include "stl.hh"
@@ -111,6 +110,9 @@ MSXCPUInterface::MSXCPUInterface(MSXMotherBoard& motherBoard_)
 			IO_Out[port] = delayDevice.get();
 		}
 	}
+	for (int port = 0; port < 256; ++port) {
+		updateIODispatch(port);
+	}
 
 	if (breakedSettingCount++ == 0) {
 		assert(!breakedSetting);
@@ -189,7 +191,7 @@ byte MSXCPUInterface::readMemSlow(word address, EmuTime::param time)
 		// execute read watches before actual read
 		if (readWatchSet[address >> CacheLine::BITS]
 		                [address &  CacheLine::LOW]) {
-			executeMemWatch(WatchPoint::READ_MEM, address);
+			executeWatch(WatchPoint::READ_MEM, address);
 		}
 	}
 	if (unlikely((address == 0xFFFF) && isExpanded(primarySlotState[3]))) {
@@ -222,11 +224,61 @@ void MSXCPUInterface::writeMemSlow(word address, byte value, EmuTime::param time
 		// execute write watches after actual write
 		if (writeWatchSet[address >> CacheLine::BITS]
 		                 [address &  CacheLine::LOW]) {
-			executeMemWatch(WatchPoint::WRITE_MEM, address, value);
+			executeWatch(WatchPoint::WRITE_MEM, address, value);
 		}
 	}
 }
 
+// The sub-lines of the given cache line that must not be cached because of
+// something in this class (so not counting the device itself).
+unsigned MSXCPUInterface::uncacheableSubLines(word start, bool isRead) const
+{
+	unsigned line = start >> CacheLine::BITS;
+	byte disallow = isRead ? disallowReadCache[line] : disallowWriteCache[line];
+	unsigned result = 0;
+	if (disallow & SECONDARY_SLOT_BIT) {
+		result |= CacheLine::subLineBit(0xFFFF);
+	}
+	if (disallow & MEMORY_WATCH_BIT) {
+		auto& watchSet = isRead ? readWatchSet[line] : writeWatchSet[line];
+		for (unsigned i = 0; i < CacheLine::SIZE; ++i) {
+			if (watchSet[i]) result |= CacheLine::subLineBit(i);
+		}
+	}
+	if (disallow & GLOBAL_RW_BIT) {
+		for (auto& g : isRead ? globalReads : globalWrites) {
+			if ((g.addr >> CacheLine::BITS) == line) {
+				result |= CacheLine::subLineBit(g.addr);
+			}
+		}
+	}
+	return result;
+}
+
+const byte* MSXCPUInterface::getReadCacheSubLines(
+	word start, unsigned& uncacheable) const
+{
+	auto* device = visibleDevices[start >> 14];
+	unsigned deviceMask = 0;
+	const byte* line = device->getReadCacheLine(start);
+	if (!line) line = device->getReadCacheSubLines(start, deviceMask);
+	if (!line) return nullptr;
+	uncacheable = deviceMask | uncacheableSubLines(start, true);
+	return line;
+}
+
+byte* MSXCPUInterface::getWriteCacheSubLines(
+	word start, unsigned& uncacheable) const
+{
+	auto* device = visibleDevices[start >> 14];
+	unsigned deviceMask = 0;
+	byte* line = device->getWriteCacheLine(start);
+	if (!line) line = device->getWriteCacheSubLines(start, deviceMask);
+	if (!line) return nullptr;
+	uncacheable = deviceMask | uncacheableSubLines(start, false);
+	return line;
+}
+
 void MSXCPUInterface::setExpanded(int ps)
 {
 	if (expanded[ps] == 0) {
@@ -320,28 +372,47 @@ MSXDevice*& MSXCPUInterface::getDevicePtr(byte port, bool isIn)
 	return *devicePtr;
 }
 
+void MSXCPUInterface::updateIODispatch(byte port)
+{
+	auto flatten = [&](MSXDevice* device, std::vector<MSXDevice*>& result) {
+		if (device == dummyDevice.get()) {
+			result.clear();
+		} else if (auto multi = dynamic_cast<MSXMultiIODevice*>(device)) {
+			result = multi->getDevices();
+		} else {
+			result.assign(1, device);
+		}
+	};
+	flatten(IO_In [port], ioInDevices [port]);
+	flatten(IO_Out[port], ioOutDevices[port]);
+}
+
 void MSXCPUInterface::register_IO_In(byte port, MSXDevice* device)
 {
 	MSXDevice*& devicePtr = getDevicePtr(port, true); // in
 	register_IO(port, true, devicePtr, device); // in
+	updateIODispatch(port);
 }
 
 void MSXCPUInterface::unregister_IO_In(byte port, MSXDevice* device)
 {
 	MSXDevice*& devicePtr = getDevicePtr(port, true); // in
 	unregister_IO(devicePtr, device);
+	updateIODispatch(port);
 }
 
 void MSXCPUInterface::register_IO_Out(byte port, MSXDevice* device)
 {
 	MSXDevice*& devicePtr = getDevicePtr(port, false); // out
 	register_IO(port, false, devicePtr, device); // out
+	updateIODispatch(port);
 }
 
 void MSXCPUInterface::unregister_IO_Out(byte port, MSXDevice* device)
 {
 	MSXDevice*& devicePtr = getDevicePtr(port, false); // out
 	unregister_IO(devicePtr, device);
+	updateIODispatch(port);
 }
 
 void MSXCPUInterface::register_IO(int port, bool isIn,
@@ -398,6 +469,7 @@ bool MSXCPUInterface::replace_IO_In(
 		return false;
 	}
 	devicePtr = newDevice;
+	updateIODispatch(port);
 	return true;
 }
 bool MSXCPUInterface::replace_IO_Out(
@@ -409,6 +481,7 @@ bool MSXCPUInterface::replace_IO_Out(
 		return false;
 	}
 	devicePtr = newDevice;
+	updateIODispatch(port);
 	return true;
 }
 
@@ -758,11 +831,11 @@ void MSXCPUInterface::checkBreakPoints(
 	auto& globalCliComm = motherBoard.getReactor().getGlobalCliComm();
 	auto& interp        = motherBoard.getReactor().getInterpreter();
 	for (auto& p : bpCopy) {
-		p.checkAndExecute(globalCliComm, interp);
+		p.checkAndExecute(globalCliComm, interp, motherBoard);
 	}
 	auto condCopy = conditions;
 	for (auto& c : condCopy) {
-		c.checkAndExecute(globalCliComm, interp);
+		c.checkAndExecute(globalCliComm, interp, motherBoard);
 	}
 }
 
@@ -771,16 +844,15 @@ void MSXCPUInterface::setWatchPoint(const shared_ptr<WatchPoint>& watchPoint)
 {
 	watchPoints.push_back(watchPoint);
 	WatchPoint::Type type = watchPoint->getType();
+	watchIndex[type].insert(watchPoint);
 	switch (type) {
 	case WatchPoint::READ_IO:
-		registerIOWatch(*watchPoint, IO_In);
-		break;
 	case WatchPoint::WRITE_IO:
-		registerIOWatch(*watchPoint, IO_Out);
+		updateIOWatch(*watchPoint);
 		break;
 	case WatchPoint::READ_MEM:
 	case WatchPoint::WRITE_MEM:
-		updateMemWatch(type);
+		updateMemWatch(*watchPoint);
 		break;
 	default:
 		UNREACHABLE; break;
@@ -794,19 +866,18 @@ void MSXCPUInterface::removeWatchPoint(shared_ptr<WatchPoint> watchPoint)
 	// from the watchPoints collection.
 	for (auto it = begin(watchPoints); it != end(watchPoints); ++it) {
 		if (*it == watchPoint) {
-			// remove before calling updateMemWatch()
+			// remove before calling update{IO,Mem}Watch()
 			watchPoints.erase(it);
 			WatchPoint::Type type = watchPoint->getType();
+			watchIndex[type].remove(*watchPoint);
 			switch (type) {
 			case WatchPoint::READ_IO:
-				unregisterIOWatch(*watchPoint, IO_In);
-				break;
 			case WatchPoint::WRITE_IO:
-				unregisterIOWatch(*watchPoint, IO_Out);
+				updateIOWatch(*watchPoint);
 				break;
 			case WatchPoint::READ_MEM:
 			case WatchPoint::WRITE_MEM:
-				updateMemWatch(type);
+				updateMemWatch(*watchPoint);
 				break;
 			default:
 				UNREACHABLE; break;
@@ -827,80 +898,86 @@ void MSXCPUInterface::removeCondition(const DebugCondition& cond)
 		[&](DebugCondition& e) { return &e == &cond; }));
 }
 
-void MSXCPUInterface::registerIOWatch(WatchPoint& watchPoint, MSXDevice** devices)
-{
-	assert(dynamic_cast<WatchIO*>(&watchPoint));
-	auto& ioWatch = static_cast<WatchIO&>(watchPoint);
-	unsigned beginPort = ioWatch.getBeginAddress();
-	unsigned endPort   = ioWatch.getEndAddress();
-	assert(beginPort <= endPort);
-	assert(endPort < 0x100);
-	for (unsigned port = beginPort; port <= endPort; ++port) {
-		ioWatch.getDevice(port).getDevicePtr() = devices[port];
-		devices[port] = &ioWatch.getDevice(port);
-	}
-}
-
-void MSXCPUInterface::unregisterIOWatch(WatchPoint& watchPoint, MSXDevice** devices)
+// Insert or remove the MSXWatchIODevices for the ports covered by the given
+// (just added or removed) watchpoint.
+void MSXCPUInterface::updateIOWatch(const WatchPoint& watchPoint)
 {
-	assert(dynamic_cast<WatchIO*>(&watchPoint));
-	auto& ioWatch = static_cast<WatchIO&>(watchPoint);
-	unsigned beginPort = ioWatch.getBeginAddress();
-	unsigned endPort   = ioWatch.getEndAddress();
+	WatchPoint::Type type = watchPoint.getType();
+	bool isIn = type == WatchPoint::READ_IO;
+	MSXDevice** devices = isIn ? IO_In : IO_Out;
+	auto& watchDevices = ioWatchDevices[isIn ? 0 : 1];
+	unsigned beginPort = watchPoint.getBeginAddress();
+	unsigned endPort   = watchPoint.getEndAddress();
 	assert(beginPort <= endPort);
 	assert(endPort < 0x100);
-
 	for (unsigned port = beginPort; port <= endPort; ++port) {
-		// find pointer to watchpoint
-		MSXDevice** prev = &devices[port];
-		while (*prev != &ioWatch.getDevice(port)) {
-			prev = &checked_cast<MSXWatchIODevice*>(*prev)->getDevicePtr();
+		bool needed = !watchIndex[type].find(port).empty();
+		auto& watch = watchDevices[port];
+		if (needed && !watch) {
+			watch = make_unique<MSXWatchIODevice>(
+				*motherBoard.getMachineConfig(), type);
+			watch->getDevicePtr() = devices[port];
+			devices[port] = watch.get();
+		} else if (!needed && watch) {
+			assert(devices[port] == watch.get());
+			devices[port] = watch->getDevicePtr();
+			watch.reset();
 		}
-		// remove watchpoint from chain
-		*prev = checked_cast<MSXWatchIODevice*>(*prev)->getDevicePtr();
+		updateIODispatch(port);
 	}
 }
 
-void MSXCPUInterface::updateMemWatch(WatchPoint::Type type)
+// Update the watch bitsets and the cache of only those cache lines that are
+// covered by the given (just added or removed) watchpoint.
+void MSXCPUInterface::updateMemWatch(const WatchPoint& watchPoint)
 {
+	WatchPoint::Type type = watchPoint.getType();
+	bool isRead = type == WatchPoint::READ_MEM;
 	std::bitset<CacheLine::SIZE>* watchSet =
-		(type == WatchPoint::READ_MEM) ? readWatchSet : writeWatchSet;
-	for (unsigned i = 0; i < CacheLine::NUM; ++i) {
+		isRead ? readWatchSet : writeWatchSet;
+	byte* disallowCache = isRead ? disallowReadCache : disallowWriteCache;
+	assert(watchPoint.getBeginAddress() <= watchPoint.getEndAddress());
+	assert(watchPoint.getEndAddress() < 0x10000);
+	unsigned firstLine = watchPoint.getBeginAddress() >> CacheLine::BITS;
+	unsigned lastLine  = watchPoint.getEndAddress()   >> CacheLine::BITS;
+	unsigned beginAddr = firstLine << CacheLine::BITS;
+	unsigned endAddr   = (lastLine << CacheLine::BITS) | CacheLine::LOW;
+
+	for (unsigned i = firstLine; i <= lastLine; ++i) {
 		watchSet[i].reset();
 	}
-	for (auto& w : watchPoints) {
-		if (w->getType() == type) {
-			unsigned beginAddr = w->getBeginAddress();
-			unsigned endAddr   = w->getEndAddress();
-			assert(beginAddr <= endAddr);
-			assert(endAddr < 0x10000);
-			for (unsigned addr = beginAddr; addr <= endAddr; ++addr) {
-				watchSet[addr >> CacheLine::BITS].set(
-				         addr  & CacheLine::LOW);
-			}
+	for (auto& w : watchIndex[type].getAll()) {
+		unsigned first = std::max(w->getBeginAddress(), beginAddr);
+		unsigned last  = std::min(w->getEndAddress(),   endAddr);
+		for (unsigned addr = first; addr <= last; ++addr) {
+			watchSet[addr >> CacheLine::BITS].set(
+			         addr  & CacheLine::LOW);
 		}
 	}
-	for (unsigned i = 0; i < CacheLine::NUM; ++i) {
-		if (readWatchSet [i].any()) {
-			disallowReadCache [i] |=  MEMORY_WATCH_BIT;
+	for (unsigned i = firstLine; i <= lastLine; ++i) {
+		if (watchSet[i].any()) {
+			disallowCache[i] |=  MEMORY_WATCH_BIT;
 		} else {
-			disallowReadCache [i] &= ~MEMORY_WATCH_BIT;
-		}
-		if (writeWatchSet[i].any()) {
-			disallowWriteCache[i] |=  MEMORY_WATCH_BIT;
-		} else {
-			disallowWriteCache[i] &= ~MEMORY_WATCH_BIT;
+			disallowCache[i] &= ~MEMORY_WATCH_BIT;
 		}
 	}
-	msxcpu.invalidateMemCache(0x0000, 0x10000);
+	msxcpu.invalidateMemCache(beginAddr, endAddr - beginAddr + 1);
 }
 
-void MSXCPUInterface::executeMemWatch(WatchPoint::Type type,
-                                      unsigned address, unsigned value)
+void MSXCPUInterface::executeWatch(WatchPoint::Type type,
+                                   unsigned address, unsigned value)
 {
-	assert(!watchPoints.empty());
 	if (isFastForward()) return;
 
+	// Copy the list: it's invalidated when a watchpoint gets added or
+	// removed, and this also keeps the watchpoints alive for the case
+	// they delete themselves in checkAndExecute().
+	// I/O watchpoints are on the low 8 bits of the port, but (like
+	// before) 'wp_last_address' gets the full 16-bit port number.
+	bool io = (type == WatchPoint::READ_IO) || (type == WatchPoint::WRITE_IO);
+	auto matching = watchIndex[type].find(io ? (address & 0xFF) : address);
+	if (matching.empty()) return;
+
 	auto& globalCliComm = motherBoard.getReactor().getGlobalCliComm();
 	auto& interp        = motherBoard.getReactor().getInterpreter();
 	interp.setVariable(TclObject("wp_last_address"),
@@ -910,13 +987,8 @@ void MSXCPUInterface::executeMemWatch(WatchPoint::Type type,
 		                   TclObject(int(value)));
 	}
 
-	auto wpCopy = watchPoints;
-	for (auto& w : wpCopy) {
-		if ((w->getBeginAddress() <= address) &&
-		    (w->getEndAddress()   >= address) &&
-		    (w->getType()         == type)) {
-			w->checkAndExecute(globalCliComm, interp);
-		}
+	for (auto& w : matching) {
+		w->checkAndExecute(globalCliComm, interp, motherBoard);
 	}
 
 	interp.unsetVariable("wp_last_address");
@@ -7,6 +7,7 @@
 #include "MSXDevice.hh"
 #include "BreakPoint.hh"
 #include "WatchPoint.hh"
+#include "WatchPointIndex.hh"
 #include "openmsx.hh"
 #include "likely.hh"
 #include <algorithm>
@@ -17,6 +18,7 @@
 namespace openmsx {
 
 class VDPIODelay;
+class MSXWatchIODevice;
 class DummyDevice;
 class MSXMotherBoard;
 class MSXCPU;
@@ -134,7 +136,20 @@ public:
 	 * @see MSXDevice::readIO()
 	 */
 	inline byte readIO(word port, EmuTime::param time) {
-		return IO_In[port & 0xFF]->readIO(port, time);
+		auto& devices = ioInDevices[port & 0xFF];
+		if (likely(devices.size() == 1)) {
+			return devices.front()->readIO(port, time);
+		}
+		// unmapped or conflict, see MSXMultiIODevice::readIO()
+		byte result = 0xFF;
+		if (devices.empty()) return result;
+		// Iterate over a copy: a device (e.g. via a watchpoint callback)
+		// can change the registered devices, that rebuilds 'devices'.
+		auto copy = devices;
+		for (auto& dev : copy) {
+			result &= dev->readIO(port, time);
+		}
+		return result;
 	}
 
 	/**
@@ -142,7 +157,36 @@ public:
 	 * @see MSXDevice::writeIO()
 	 */
 	inline void writeIO(word port, byte value, EmuTime::param time) {
-		IO_Out[port & 0xFF]->writeIO(port, value, time);
+		auto& devices = ioOutDevices[port & 0xFF];
+		if (likely(devices.size() == 1)) {
+			devices.front()->writeIO(port, value, time);
+			return;
+		}
+		// unmapped or conflict, iterate over a copy, see readIO()
+		if (devices.empty()) return;
+		auto copy = devices;
+		for (auto& dev : copy) {
+			dev->writeIO(port, value, time);
+		}
+	}
+
+	/**
+	 * Can a sequence of bytes be written to the given IO-port in one go?
+	 * @see MSXDevice::canWriteIOBurst()
+	 */
+	inline bool canWriteIOBurst(word port) const {
+		return IO_Out[port & 0xFF]->canWriteIOBurst(port);
+	}
+
+	/**
+	 * This writes a sequence of bytes to the given IO-port
+	 * @see MSXDevice::writeIOBurst()
+	 */
+	inline unsigned writeIOBurst(word port, array_ref<byte> values,
+	                             EmuTime::param time,
+	                             EmuDuration::param interval) {
+		return IO_Out[port & 0xFF]->writeIOBurst(
+			port, values, time, interval);
 	}
 
 	/**
@@ -183,6 +227,21 @@ public:
 		return visibleDevices[start >> 14]->getWriteCacheLine(start);
 	}
 
+	/**
+	 * Only called when getReadCacheLine() returned a null pointer. Tries
+	 * to cache the line at the granularity of sub-lines instead, see
+	 * MSXDevice::getReadCacheSubLines(). Next to the sub-lines that are
+	 * uncacheable for the device itself, also the sub-lines containing
+	 * a watchpoint, a global read or the secondary slot register are
+	 * marked as uncacheable.
+	 */
+	const byte* getReadCacheSubLines(word start, unsigned& uncacheable) const;
+
+	/**
+	 * Like getReadCacheSubLines(), but for writing.
+	 */
+	byte* getWriteCacheSubLines(word start, unsigned& uncacheable) const;
+
 	/**
 	 * CPU uses this method to read 'extra' data from the databus
 	 * used in interrupt routines. In MSX this returns always 255.
@@ -211,6 +270,12 @@ public:
 	inline bool isExpanded(int ps) const { return expanded[ps] != 0; }
 	void changeExpanded(bool isExpanded);
 
+	/** Currently selected primary/secondary slot and the device that is
+	  * visible in the given page. */
+	byte getPrimarySlot  (int page) const { return primarySlotState[page]; }
+	byte getSecondarySlot(int page) const { return secondarySlotState[page]; }
+	MSXDevice* getVisibleMSXDevice(int page) const { return visibleDevices[page]; }
+
 	DummyDevice& getDummyDevice() { return *dummyDevice; }
 
 	static void insertBreakPoint(const BreakPoint& bp);
@@ -220,10 +285,16 @@ public:
 
 	void setWatchPoint(const std::shared_ptr<WatchPoint>& watchPoint);
 	void removeWatchPoint(std::shared_ptr<WatchPoint> watchPoint);
-	// note: must be shared_ptr (not unique_ptr), see WatchIO::doReadCallback()
+	// note: must be shared_ptr (not unique_ptr), see executeWatch()
 	using WatchPoints = std::vector<std::shared_ptr<WatchPoint>>;
 	const WatchPoints& getWatchPoints() const { return watchPoints; }
 
+	/** Execute the watchpoints of the given type that contain the given
+	  * address (or I/O port). Should only be used by MSXWatchIODevice
+	  * and the slow memory access path. */
+	void executeWatch(WatchPoint::Type type, unsigned address,
+	                  unsigned value = ~0u);
+
 	static void setCondition(const DebugCondition& cond);
 	static void removeCondition(const DebugCondition& cond);
 	using Conditions = std::vector<DebugCondition>;
@@ -272,8 +343,10 @@ public:
 private:
 	byte readMemSlow(word address, EmuTime::param time);
 	void writeMemSlow(word address, byte value, EmuTime::param time);
+	unsigned uncacheableSubLines(word start, bool isRead) const;
 
 	MSXDevice*& getDevicePtr(byte port, bool isIn);
+	void updateIODispatch(byte port);
 
 	void register_IO  (int port, bool isIn,
 	                   MSXDevice*& devicePtr, MSXDevice* device);
@@ -291,11 +364,8 @@ private:
 	                             MSXMotherBoard& motherBoard);
 
 	void removeAllWatchPoints();
-	void registerIOWatch  (WatchPoint& watchPoint, MSXDevice** devices);
-	void unregisterIOWatch(WatchPoint& watchPoint, MSXDevice** devices);
-	void updateMemWatch(WatchPoint::Type type);
-	void executeMemWatch(WatchPoint::Type type, unsigned address,
-	                     unsigned value = ~0u);
+	void updateIOWatch (const WatchPoint& watchPoint);
+	void updateMemWatch(const WatchPoint& watchPoint);
 
 	void doContinue2();
 
@@ -378,6 +448,8 @@ private:
 	byte disallowWriteCache[CacheLine::NUM];
 	std::bitset<CacheLine::SIZE> readWatchSet [CacheLine::NUM];
 	std::bitset<CacheLine::SIZE> writeWatchSet[CacheLine::NUM];
+	WatchPointIndex watchIndex[4]; // indexed by WatchPoint::Type
+	std::unique_ptr<MSXWatchIODevice> ioWatchDevices[2][256]; // [in/out][port]
 
 	struct GlobalRwInfo {
 		MSXDevice* device;
@@ -392,6 +464,12 @@ private:
 
 	MSXDevice* IO_In [256];
 	MSXDevice* IO_Out[256];
+	// Flattened version of IO_In/IO_Out, used by readIO()/writeIO(): the
+	// devices that must be called for an access to each port, without the
+	// DummyDevice (empty list) or MSXMultiIODevice (its devices are listed
+	// directly) layer. Kept up-to-date by updateIODispatch().
+	std::vector<MSXDevice*> ioInDevices [256];
+	std::vector<MSXDevice*> ioOutDevices[256];
 	MSXDevice* slotLayout[4][4][4];
 	MSXDevice* visibleDevices[4];
 	byte subSlotRegister[4];
@@ -150,4 +150,26 @@ byte* MSXMultiMemDevice::getWriteCacheLine(word start) const
 	return searchDevice(start)->getWriteCacheLine(start);
 }
 
+const byte* MSXMultiMemDevice::getReadCacheSubLines(
+	word start, unsigned& uncacheable) const
+{
+	assert((start & CacheLine::HIGH) == start);
+	const auto& range = searchRange(start);
+	if (unlikely(((range.base + range.size) & CacheLine::HIGH) == start)) {
+		return nullptr;
+	}
+	return range.device->getReadCacheSubLines(start, uncacheable);
+}
+
+byte* MSXMultiMemDevice::getWriteCacheSubLines(
+	word start, unsigned& uncacheable) const
+{
+	assert((start & CacheLine::HIGH) == start);
+	const auto& range = searchRange(start);
+	if (unlikely(((range.base + range.size) & CacheLine::HIGH) == start)) {
+		return nullptr;
+	}
+	return range.device->getWriteCacheSubLines(start, uncacheable);
+}
+
 } // namespace openmsx
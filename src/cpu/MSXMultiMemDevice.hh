@@ -26,6 +26,8 @@ public:
 	void writeMem(word address, byte value, EmuTime::param time) override;
 	const byte* getReadCacheLine(word start) const override;
 	byte* getWriteCacheLine(word start) const override;
+	const byte* getReadCacheSubLines(word start, unsigned& uncacheable) const override;
+	byte* getWriteCacheSubLines(word start, unsigned& uncacheable) const override;
 
 private:
 	struct Range {
@@ -3,38 +3,18 @@
 
 #include "MSXMultiDevice.hh"
 #include "WatchPoint.hh"
-#include <memory>
 
 namespace openmsx {
 
-class MSXWatchIODevice;
-
-class WatchIO final : public WatchPoint
-                    , public std::enable_shared_from_this<WatchIO>
-{
-public:
-	WatchIO(MSXMotherBoard& motherboard,
-	        WatchPoint::Type type,
-	        unsigned beginAddr, unsigned endAddr,
-	        TclObject command, TclObject condition,
-	        unsigned newId = -1);
-
-	MSXWatchIODevice& getDevice(byte port);
-
-private:
-	void doReadCallback(unsigned port);
-	void doWriteCallback(unsigned port, unsigned value);
-
-	MSXMotherBoard& motherboard;
-	std::vector<std::unique_ptr<MSXWatchIODevice>> ios;
-
-	friend class MSXWatchIODevice;
-};
-
+/** Inserted (by MSXCPUInterface) in front of the device of an I/O port on
+  * which one or more I/O watchpoints are set. There's at most one such
+  * device per port and direction, independent of the number of watchpoints.
+  * MSXCPUInterface finds the matching watchpoints via its WatchPointIndex.
+  */
 class MSXWatchIODevice final : public MSXMultiDevice
 {
 public:
-	MSXWatchIODevice(const HardwareConfig& hwConf, WatchIO& watchIO);
+	MSXWatchIODevice(const HardwareConfig& hwConf, WatchPoint::Type type);
 
 	MSXDevice*& getDevicePtr() { return device; }
 
@@ -45,7 +25,7 @@ private:
 	byte peekIO(word port, EmuTime::param time) const override;
 	void writeIO(word port, byte value, EmuTime::param time) override;
 
-	WatchIO& watchIO;
+	const WatchPoint::Type type;
 	MSXDevice* device;
 };
 
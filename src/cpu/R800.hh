@@ -31,6 +31,11 @@ protected:
 	template<bool B> struct Normalize { static const bool value = B; };
 
 	static const int CLOCK_FREQ = 7159090;
+#ifdef USE_LAZY_FLAGS
+	static const bool LAZY_FLAGS = true;
+#else
+	static const bool LAZY_FLAGS = false;
+#endif
 
 	ALWAYS_INLINE unsigned haltStates() const { return 1; } // TODO check this
 	ALWAYS_INLINE bool isR800() const { return true; }
@@ -0,0 +1,52 @@
+#include "WatchPointIndex.hh"
+#include "WatchPoint.hh"
+#include "stl.hh"
+#include <algorithm>
+
+namespace openmsx {
+
+void WatchPointIndex::insert(const std::shared_ptr<WatchPoint>& watchPoint)
+{
+	watchPoints.push_back(watchPoint);
+	rebuild();
+}
+
+void WatchPointIndex::remove(const WatchPoint& watchPoint)
+{
+	watchPoints.erase(rfind_if_unguarded(watchPoints,
+		[&](const std::shared_ptr<WatchPoint>& w) {
+			return w.get() == &watchPoint; }));
+	rebuild();
+}
+
+const WatchPointIndex::WatchPoints& WatchPointIndex::find(unsigned address) const
+{
+	static const WatchPoints none;
+	auto it = std::upper_bound(bounds.begin(), bounds.end(), address);
+	if (it == bounds.begin()) return none;
+	return segments[(it - bounds.begin()) - 1];
+}
+
+void WatchPointIndex::rebuild()
+{
+	bounds.clear();
+	for (auto& w : watchPoints) {
+		bounds.push_back(w->getBeginAddress());
+		bounds.push_back(w->getEndAddress() + 1);
+	}
+	std::sort(bounds.begin(), bounds.end());
+	bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+	segments.assign(bounds.size(), WatchPoints());
+	for (auto& w : watchPoints) {
+		auto first = std::lower_bound(bounds.begin(), bounds.end(),
+		                              w->getBeginAddress());
+		auto last  = std::lower_bound(first, bounds.end(),
+		                              w->getEndAddress() + 1);
+		for (auto it = first; it != last; ++it) {
+			segments[it - bounds.begin()].push_back(w);
+		}
+	}
+}
+
+} // namespace openmsx
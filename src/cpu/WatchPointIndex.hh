@@ -0,0 +1,47 @@
+#ifndef WATCHPOINTINDEX_HH
+#define WATCHPOINTINDEX_HH
+
+#include <memory>
+#include <vector>
+
+namespace openmsx {
+
+class WatchPoint;
+
+/** Sorted index on the address ranges of a set of watchpoints.
+  *
+  * The address space is split in segments at each begin and (end + 1)
+  * address of the watchpoints, so that within one segment the set of
+  * matching watchpoints is constant. Looking up the watchpoints for an
+  * address is then a binary search on the segment boundaries. The index is
+  * rebuilt when a watchpoint is added or removed, that's rare compared to
+  * the number of lookups.
+  */
+class WatchPointIndex
+{
+public:
+	using WatchPoints = std::vector<std::shared_ptr<WatchPoint>>;
+
+	void insert(const std::shared_ptr<WatchPoint>& watchPoint);
+	void remove(const WatchPoint& watchPoint);
+
+	bool empty() const { return watchPoints.empty(); }
+
+	/** All watchpoints in this index, in insertion order. */
+	const WatchPoints& getAll() const { return watchPoints; }
+
+	/** The watchpoints whose range contains the given address, in
+	  * insertion order. The result is invalidated by insert()/remove(). */
+	const WatchPoints& find(unsigned address) const;
+
+private:
+	void rebuild();
+
+	WatchPoints watchPoints;
+	std::vector<unsigned> bounds;  // sorted start addresses of the segments
+	std::vector<WatchPoints> segments; // same size as 'bounds'
+};
+
+} // namespace openmsx
+
+#endif
@@ -16,6 +16,11 @@ protected:
 
 	static const int CLOCK_FREQ = 3579545;
 	static const int WAIT_CYCLES = 1;
+#ifdef USE_LAZY_FLAGS
+	static const bool LAZY_FLAGS = true;
+#else
+	static const bool LAZY_FLAGS = false;
+#endif
 
 	Z80TYPE(EmuTime::param time, Scheduler& scheduler_)
 		: CPUClock(time, scheduler_)
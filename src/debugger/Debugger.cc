@@ -7,7 +7,6 @@
 #include "MSXCPUInterface.hh"
 #include "BreakPoint.hh"
 #include "DebugCondition.hh"
-#include "MSXWatchIODevice.hh"
 #include "TclObject.hh"
 #include "CommandException.hh"
 #include "MemBuffer.hh"
@@ -18,7 +17,6 @@
 #include <cassert>
 #include <stdexcept>
 
-using std::shared_ptr;
 using std::make_shared;
 using std::string;
 using std::vector;
@@ -149,15 +147,8 @@ unsigned Debugger::setWatchPoint(TclObject command, TclObject condition,
                                  unsigned beginAddr, unsigned endAddr,
                                  unsigned newId /*= -1*/)
 {
-	shared_ptr<WatchPoint> wp;
-	if ((type == WatchPoint::READ_IO) || (type == WatchPoint::WRITE_IO)) {
-		wp = make_shared<WatchIO>(
-			motherBoard, type, beginAddr, endAddr,
-			command, condition, newId);
-	} else {
-		wp = make_shared<WatchPoint>(
-			command, condition, type, beginAddr, endAddr, newId);
-	}
+	auto wp = make_shared<WatchPoint>(
+		command, condition, type, beginAddr, endAddr, newId);
 	motherBoard.getCPUInterface().setWatchPoint(wp);
 	return wp->getId();
 }
@@ -33,7 +33,7 @@ void ProbeBreakPoint::update(const ProbeBase& /*subject*/)
 	auto& reactor = debugger.getMotherBoard().getReactor();
 	auto& cliComm = reactor.getGlobalCliComm();
 	auto& interp  = reactor.getInterpreter();
-	checkAndExecute(cliComm, interp);
+	checkAndExecute(cliComm, interp, debugger.getMotherBoard());
 }
 
 void ProbeBreakPoint::subjectDeleted(const ProbeBase& /*subject*/)
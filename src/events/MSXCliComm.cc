@@ -1,6 +1,7 @@
 #include "MSXCliComm.hh"
 #include "GlobalCliComm.hh"
 #include "MSXMotherBoard.hh"
+#include "Thread.hh"
 
 namespace openmsx {
 
@@ -12,6 +13,11 @@ MSXCliComm::MSXCliComm(MSXMotherBoard& motherBoard_, GlobalCliComm& cliComm_)
 
 void MSXCliComm::log(LogLevel level, string_view message)
 {
+	if (!Thread::isMainThread()) {
+		std::lock_guard<std::mutex> lock(mutex);
+		pendingLogs.emplace_back(level, message.str());
+		return;
+	}
 	cliComm.log(level, message);
 }
 
@@ -27,7 +33,31 @@ void MSXCliComm::update(UpdateType type, string_view name, string_view value)
 	} else {
 		prevValues[type].emplace_noDuplicateCheck(name.str(), value.str());
 	}
+	if (!Thread::isMainThread()) {
+		std::lock_guard<std::mutex> lock(mutex);
+		pendingUpdates.push_back(PendingUpdate{type, name.str(), value.str()});
+		return;
+	}
 	cliComm.updateHelper(type, motherBoard.getMachineID(), name, value);
 }
 
+void MSXCliComm::deliverPending()
+{
+	assert(Thread::isMainThread());
+	std::vector<std::pair<LogLevel, std::string>> logs;
+	std::vector<PendingUpdate> updates;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		swap(logs, pendingLogs);
+		swap(updates, pendingUpdates);
+	}
+	for (auto& l : logs) {
+		cliComm.log(l.first, l.second);
+	}
+	for (auto& u : updates) {
+		cliComm.updateHelper(u.type, motherBoard.getMachineID(),
+		                     u.name, u.value);
+	}
+}
+
 } // namespace openmsx
@@ -4,6 +4,10 @@
 #include "CliComm.hh"
 #include "hash_map.hh"
 #include "xxhash.hh"
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace openmsx {
 
@@ -19,10 +23,26 @@ public:
 	void update(UpdateType type, string_view name,
 	            string_view value) override;
 
+	/** Messages generated from a non-main thread (a BatchRunner worker
+	  * thread) are queued. This method, called from the main thread,
+	  * passes them on to the GlobalCliComm.
+	  */
+	void deliverPending();
+
 private:
+	struct PendingUpdate {
+		UpdateType type;
+		std::string name;
+		std::string value;
+	};
+
 	MSXMotherBoard& motherBoard;
 	GlobalCliComm& cliComm;
 	hash_map<std::string, std::string, XXHasher> prevValues[NUM_UPDATES];
+
+	std::mutex mutex; // protects the two vectors below
+	std::vector<std::pair<LogLevel, std::string>> pendingLogs;
+	std::vector<PendingUpdate> pendingUpdates;
 };
 
 } // namespace openmsx
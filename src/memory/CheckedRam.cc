@@ -52,8 +52,10 @@ const byte* CheckedRam::getReadCacheLine(unsigned addr) const
 
 byte* CheckedRam::getWriteCacheLine(unsigned addr) const
 {
+	// The CPU may write via this pointer, so mark the line dirty now.
 	return (completely_initialized_cacheline[addr >> CacheLine::BITS])
-	     ? const_cast<byte*>(&ram[addr]) : nullptr;
+	     ? const_cast<TrackedRam&>(ram).getWriteBackdoor(addr, CacheLine::SIZE)
+	     : nullptr;
 }
 
 void CheckedRam::write(unsigned addr, const byte value)
@@ -67,7 +69,7 @@ void CheckedRam::write(unsigned addr, const byte value)
 			                          CacheLine::SIZE);
 		}
 	}
-	ram[addr] = value;
+	ram.write(addr, value);
 }
 
 void CheckedRam::clear()
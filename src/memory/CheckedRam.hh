@@ -1,7 +1,7 @@
 #ifndef CHECKEDRAM_HH
 #define CHECKEDRAM_HH
 
-#include "Ram.hh"
+#include "TrackedRam.hh"
 #include "TclCallback.hh"
 #include "CacheLine.hh"
 #include "Observer.hh"
@@ -47,7 +47,7 @@ public:
 	 * consistently, so that the initialized-administration will be always
 	 * up to date!
 	 */
-	Ram& getUncheckedRam() { return ram; }
+	TrackedRam& getUncheckedRam() { return ram; }
 
 	// TODO
 	//template<typename Archive>
@@ -61,7 +61,7 @@ private:
 
 	std::vector<bool> completely_initialized_cacheline;
 	std::vector<std::bitset<CacheLine::SIZE>> uninitialized;
-	Ram ram;
+	TrackedRam ram;
 	MSXCPU& msxcpu;
 	TclCallback umrCallback;
 };
@@ -9,7 +9,7 @@ PanasonicRam::PanasonicRam(const DeviceConfig& config)
 	: MSXMemoryMapper(config)
 	, panasonicMemory(getMotherBoard().getPanasonicMemory())
 {
-	panasonicMemory.registerRam(checkedRam.getUncheckedRam());
+	panasonicMemory.registerRam(checkedRam.getUncheckedRam().getUntrackedRam());
 }
 
 void PanasonicRam::writeMem(word address, byte value, EmuTime::param /*time*/)
@@ -87,6 +87,17 @@ const byte* RomPanasonic::getReadCacheLine(word address) const
 	}
 }
 
+const byte* RomPanasonic::getReadCacheSubLines(
+	word address, unsigned& uncacheable) const
+{
+	if ((0x7FF0 & CacheLine::HIGH) == address) {
+		// only the mapper registers are special
+		uncacheable = CacheLine::subLineMask(0x7FF0, 0x7FF9);
+		return Rom8kBBlocks::getReadCacheLine(address);
+	}
+	return nullptr;
+}
+
 void RomPanasonic::writeMem(word address, byte value, EmuTime::param /*time*/)
 {
 	if ((0x6000 <= address) && (address < 0x7FF0)) {
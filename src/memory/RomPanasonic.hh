@@ -18,6 +18,7 @@ public:
 	const byte* getReadCacheLine(word address) const override;
 	void writeMem(word address, byte value, EmuTime::param time) override;
 	byte* getWriteCacheLine(word address) const override;
+	const byte* getReadCacheSubLines(word address, unsigned& uncacheable) const override;
 
 	template<typename Archive>
 	void serialize(Archive& ar, unsigned version);
@@ -1,18 +1,126 @@
 #include "TrackedRam.hh"
+#include "DeviceConfig.hh"
+#include "MSXMotherBoard.hh"
+#include "MSXCPU.hh"
+#include "SimpleDebuggable.hh"
 #include "serialize.hh"
+#include "memory.hh"
+#include <algorithm>
+#include <cassert>
 
 namespace openmsx {
 
+// Like the debuggable in Ram, but writes go via TrackedRam::write() so that
+// they're seen by the dirty tracking.
+class TrackedRamDebuggable final : public SimpleDebuggable
+{
+public:
+	TrackedRamDebuggable(MSXMotherBoard& motherBoard_, const std::string& name_,
+	                     const std::string& description_, TrackedRam& ram_)
+		: SimpleDebuggable(motherBoard_, name_, description_, ram_.getSize())
+		, ram(ram_)
+	{
+	}
+
+	byte read(unsigned address) override
+	{
+		return ram.read(address);
+	}
+
+	void write(unsigned address, byte value) override
+	{
+		ram.write(address, value);
+	}
+
+private:
+	TrackedRam& ram;
+};
+
+
+TrackedRam::TrackedRam(const DeviceConfig& config, const std::string& name,
+                       const std::string& description, unsigned size)
+	: ram(*config.getXML(), size)
+	, dirty((size + PAGE_SIZE - 1) >> PAGE_BITS, true)
+	, cpu(&config.getMotherBoard().getCPU())
+	, backdoorBegin(size)
+	, backdoorEnd(0)
+	, tracking(true)
+	, debuggable(make_unique<TrackedRamDebuggable>(
+		config.getMotherBoard(), name, description, *this))
+{
+}
+
+TrackedRam::TrackedRam(const XMLElement& xml, unsigned size)
+	: ram(xml, size)
+	, dirty((size + PAGE_SIZE - 1) >> PAGE_BITS, true)
+	, cpu(nullptr)
+	, backdoorBegin(size)
+	, backdoorEnd(0)
+	, tracking(true)
+{
+}
+
+TrackedRam::~TrackedRam() = default;
+
+const std::string& TrackedRam::getName() const
+{
+	return debuggable->getName();
+}
+
+// The dirty flags were just cleared, but the CPU may still write via cache
+// lines it got from getWriteBackdoor(addr, size). Drop those (only those, the
+// rest of the CPU cache stays valid).
+void TrackedRam::revokeBackdoors()
+{
+	if (backdoorBegin >= backdoorEnd) return;
+	if (cpu) {
+		cpu->invalidateWriteCache(&ram[0] + backdoorBegin,
+		                          &ram[0] + backdoorEnd);
+	}
+	backdoorBegin = getSize();
+	backdoorEnd = 0;
+}
+
 template<typename Archive>
 void TrackedRam::serialize(Archive& ar, unsigned /*version*/)
 {
 	// Note: This is the exact same serialization format as the Ram class.
 	//  This allows to change from Ram to TrackedRam without having to
 	//  increase the class serialization version (of the user).
-	bool diff = writeSinceLastReverseSnapshot || !ar.isReverseSnapshot();
-	ar.serialize_blob("ram", &ram[0], getSize(), diff);
-	if (ar.isReverseSnapshot()) writeSinceLastReverseSnapshot = false;
+	serializeBlob(ar, "ram", getSize());
 }
 INSTANTIATE_SERIALIZE_METHODS(TrackedRam);
 
+template<typename Archive>
+void TrackedRam::serializeBlob(Archive& ar, const char* tag, unsigned size)
+{
+	assert(size <= getSize());
+	if (ar.needVersion()) {
+		// Savestates on disk: a single blob, same format as before.
+		ar.serialize_blob(tag, &ram[0], size);
+	} else {
+		// In-memory (reverse) snapshots: one blob per page, so that
+		// clean pages can share the data of the previous snapshot.
+		bool snapshot = ar.isReverseSnapshot();
+		for (unsigned addr = 0; addr < size; addr += PAGE_SIZE) {
+			bool diff = dirty[addr >> PAGE_BITS] || !tracking || !snapshot;
+			ar.serialize_blob(tag, &ram[addr],
+			                  std::min(size - addr, unsigned(PAGE_SIZE)), diff);
+		}
+		if (snapshot && tracking) {
+			dirty.assign(dirty.size(), false);
+			revokeBackdoors();
+		}
+	}
+	if (ar.isLoader()) {
+		setAllDirty();
+	}
+}
+template void TrackedRam::serializeBlob(MemInputArchive&,  const char*, unsigned);
+template void TrackedRam::serializeBlob(MemOutputArchive&, const char*, unsigned);
+template void TrackedRam::serializeBlob(XmlInputArchive&,  const char*, unsigned);
+template void TrackedRam::serializeBlob(XmlOutputArchive&, const char*, unsigned);
+template void TrackedRam::serializeBlob(BinInputArchive&,  const char*, unsigned);
+template void TrackedRam::serializeBlob(BinOutputArchive&, const char*, unsigned);
+
 } // namespace openmsx
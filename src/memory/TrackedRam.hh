@@ -2,28 +2,39 @@
 #define TRACKED_RAM_HH
 
 #include "Ram.hh"
+#include <algorithm>
+#include <memory>
+#include <vector>
 
 namespace openmsx {
 
+class TrackedRamDebuggable;
+class MSXCPU;
+
 // Ram with dirty tracking
+//
+// The ram is divided in pages of PAGE_SIZE bytes. A page is marked dirty when
+// it's (possibly) written. Reverse snapshots store each page as a separate
+// blob. Pages that were not written since the previous reverse snapshot are
+// stored as a reference to that previous snapshot, without copying or
+// comparing their content again.
 class TrackedRam
 {
 public:
+	static const unsigned PAGE_BITS = 12;
+	static const unsigned PAGE_SIZE = 1 << PAGE_BITS;
+
 	// Most methods simply delegate to the internal 'ram' object.
 	TrackedRam(const DeviceConfig& config, const std::string& name,
-	           const std::string& description, unsigned size)
-		: ram(config, name, description, size) {}
-
-	TrackedRam(const XMLElement& xml, unsigned size)
-		: ram(xml, size) {}
+	           const std::string& description, unsigned size);
+	TrackedRam(const XMLElement& xml, unsigned size);
+	~TrackedRam();
 
 	unsigned getSize() const {
 		return ram.getSize();
 	}
 
-	const std::string& getName() const {
-		return ram.getName();
-	}
+	const std::string& getName() const;
 
 	// Allow read via an explicit read() method or via backdoor access.
 	byte read(unsigned addr) const {
@@ -36,12 +47,12 @@ public:
 
 	// Only allow write/clear via an explicit method.
 	void write(unsigned addr, byte value) {
-		writeSinceLastReverseSnapshot = true;
+		dirty[addr >> PAGE_BITS] = true;
 		ram[addr] = value;
 	}
 
 	void clear(byte c = 0xff) {
-		writeSinceLastReverseSnapshot = true;
+		setAllDirty();
 		ram.clear(c);
 	}
 
@@ -50,16 +61,59 @@ public:
 	// invocation, so the resulting pointer (although the same each time)
 	// should not be reused for multiple (distinct) bulk write operations.
 	byte* getWriteBackdoor() {
-		writeSinceLastReverseSnapshot = true;
+		setAllDirty();
 		return &ram[0];
 	}
 
+	// Like above, but only the range [addr, addr + size) is marked dirty
+	// and may be written via the resulting pointer. The pointer may be
+	// kept in a CPU write cache line. When a reverse snapshot is taken,
+	// the CPU write cache lines that point into the handed out ranges are
+	// dropped, so that they're requested (and marked dirty) again. Other
+	// users must not keep the pointer. (Rams created without a
+	// DeviceConfig don't know the CPU, so for those this only works for
+	// short-lived pointers.)
+	byte* getWriteBackdoor(unsigned addr, unsigned size) {
+		unsigned last = (addr + size - 1) >> PAGE_BITS;
+		for (unsigned page = addr >> PAGE_BITS; page <= last; ++page) {
+			dirty[page] = true;
+		}
+		backdoorBegin = std::min(backdoorBegin, addr);
+		backdoorEnd   = std::max(backdoorEnd,   addr + size);
+		return &ram[addr];
+	}
+
+	// Give up dirty tracking: the returned Ram can be written without
+	// notifying this object, so from now on all pages are always
+	// considered dirty.
+	Ram& getUntrackedRam() {
+		tracking = false;
+		return ram;
+	}
+
 	template<typename Archive>
 	void serialize(Archive& ar, unsigned version);
 
+	// Serialize only the first 'size' bytes of the ram, as a blob with the
+	// given tag (for users that historically didn't store the full ram).
+	template<typename Archive>
+	void serializeBlob(Archive& ar, const char* tag, unsigned size);
+
 private:
+	void setAllDirty() {
+		dirty.assign(dirty.size(), true);
+	}
+	void revokeBackdoors();
+
 	Ram ram;
-	bool writeSinceLastReverseSnapshot = true;
+	std::vector<bool> dirty; // one flag per page
+	MSXCPU* cpu; // can be nullptr
+	// Range handed out by getWriteBackdoor(addr, size) since the last
+	// reverse snapshot. Empty when 'backdoorBegin >= backdoorEnd'.
+	unsigned backdoorBegin;
+	unsigned backdoorEnd;
+	bool tracking;
+	const std::unique_ptr<TrackedRamDebuggable> debuggable; // can be nullptr
 };
 
 } // namespace openmsx
@@ -10,6 +10,8 @@
 #include "FileOperations.hh"
 #include "Version.hh"
 #include "Date.hh"
+#include "MSXException.hh"
+#include "endian.hh"
 #include "cstdiop.hh" // for dup()
 #include <cstring>
 #include <limits>
@@ -26,6 +28,7 @@ void ArchiveBase<Derived>::attribute(const char* name, const char* value)
 }
 template class ArchiveBase<MemOutputArchive>;
 template class ArchiveBase<XmlOutputArchive>;
+template class ArchiveBase<BinOutputArchive>;
 
 ////
 
@@ -109,6 +112,7 @@ void OutputArchiveBase<Derived>::serialize_blob(
 
 template class OutputArchiveBase<MemOutputArchive>;
 template class OutputArchiveBase<XmlOutputArchive>;
+template class OutputArchiveBase<BinOutputArchive>;
 
 ////
 
@@ -168,6 +172,7 @@ void InputArchiveBase<Derived>::serialize_blob(
 
 template class InputArchiveBase<MemInputArchive>;
 template class InputArchiveBase<XmlInputArchive>;
+template class InputArchiveBase<BinInputArchive>;
 
 ////
 
@@ -279,16 +284,31 @@ error:
 	throw XMLException("Could not open compressed file \"", filename, "\"");
 }
 
+XmlOutputArchive::XmlOutputArchive()
+	: file(nullptr)
+	, root("serial")
+{
+	root.addAttribute("openmsx_version", Version::full());
+	root.addAttribute("date_time", Date::toString(time(nullptr)));
+	root.addAttribute("platform", TARGET_PLATFORM);
+	current.push_back(&root);
+}
+
 XmlOutputArchive::~XmlOutputArchive()
+{
+	if (!file) return;
+	string xml = getXml();
+	gzwrite(file, const_cast<char*>(xml.data()), unsigned(xml.size()));
+	gzclose(file);
+}
+
+string XmlOutputArchive::getXml() const
 {
 	assert(current.back() == &root);
-	const char* header =
+	return strCat(
 	    "<?xml version=\"1.0\" ?>\n"
-	    "<!DOCTYPE openmsx-serialize SYSTEM 'openmsx-serialize.dtd'>\n";
-	gzwrite(file, const_cast<char*>(header), unsigned(strlen(header)));
-	string dump = root.dump();
-	gzwrite(file, const_cast<char*>(dump.data()), unsigned(dump.size()));
-	gzclose(file);
+	    "<!DOCTYPE openmsx-serialize SYSTEM 'openmsx-serialize.dtd'>\n",
+	    root.dump());
 }
 
 void XmlOutputArchive::saveChar(char c)
@@ -368,6 +388,12 @@ XmlInputArchive::XmlInputArchive(const string& filename)
 	elems.emplace_back(&rootElem, 0);
 }
 
+XmlInputArchive::XmlInputArchive(XMLElement root)
+	: rootElem(std::move(root))
+{
+	elems.emplace_back(&rootElem, 0);
+}
+
 string_view XmlInputArchive::loadStr()
 {
 	if (!elems.back().first->getChildren().empty()) {
@@ -540,4 +566,141 @@ int XmlInputArchive::countChildren() const
 	return int(elems.back().first->getChildren().size());
 }
 
+////
+
+// Layout of the header of a binary archive:
+//    0: magic
+//   12: format version (little endian)
+//   16: byte order marker (native endian)
+//   20: sizeof(size_t) (native endian)
+//   24: size of the stream (native endian)
+// The stream itself starts right after the header. Blobs bigger than
+// SMALL_SIZE are aligned on BIN_ALIGNMENT bytes relative to the start of the
+// stream, and thus also relative to the start of the file.
+static const char BIN_MAGIC[12] = {
+	'o', 'p', 'e', 'n', 'M', 'S', 'X', '-', 's', 't', 'a', 't' };
+static const uint32_t BIN_VERSION = 1;
+static const uint32_t BIN_BYTE_ORDER = 0x01020304;
+static const size_t BIN_ALIGNMENT = 64;
+static const size_t BIN_HEADER_SIZE = 64;
+
+static size_t blobPadding(size_t pos)
+{
+	return (BIN_ALIGNMENT - (pos % BIN_ALIGNMENT)) % BIN_ALIGNMENT;
+}
+
+BinOutputArchive::BinOutputArchive(const string& filename)
+	: file(filename, File::TRUNCATE)
+{
+}
+
+void BinOutputArchive::save(const std::string& s)
+{
+	auto size = s.size();
+	byte* buf = buffer.allocate(sizeof(size) + size);
+	memcpy(buf, &size, sizeof(size));
+	memcpy(buf + sizeof(size), s.data(), size);
+}
+
+void BinOutputArchive::serialize_blob(const char*, const void* data, size_t len,
+                                      bool /*diff*/)
+{
+	size_t padding = (len > SMALL_SIZE) ? blobPadding(buffer.getPosition()) : 0;
+	byte* buf = buffer.allocate(padding + len);
+	memset(buf, 0, padding);
+	memcpy(buf + padding, data, len);
+}
+
+void BinOutputArchive::close()
+{
+	assert(openSections.empty());
+	size_t size;
+	auto data = buffer.release(size);
+
+	byte header[BIN_HEADER_SIZE] = {};
+	memcpy(header, BIN_MAGIC, sizeof(BIN_MAGIC));
+	Endian::write_UA_L32(header + 12, BIN_VERSION);
+	uint32_t sizeofSizeT = sizeof(size_t);
+	uint64_t streamSize = size;
+	memcpy(header + 16, &BIN_BYTE_ORDER, sizeof(BIN_BYTE_ORDER));
+	memcpy(header + 20, &sizeofSizeT, sizeof(sizeofSizeT));
+	memcpy(header + 24, &streamSize, sizeof(streamSize));
+
+	file.write(header, sizeof(header));
+	file.write(data.data(), size);
+	file.close();
+}
+
+////
+
+BinInputArchive::BinInputArchive(const string& filename)
+	: file(filename)
+{
+	size_t size;
+	const byte* data = file.mmap(size);
+	if ((size < BIN_HEADER_SIZE) ||
+	    (memcmp(data, BIN_MAGIC, sizeof(BIN_MAGIC)) != 0)) {
+		throw MSXException("Not a binary savestate: ", filename);
+	}
+	if (Endian::read_UA_L32(data + 12) > BIN_VERSION) {
+		throw MSXException("Savestate was made by a newer openMSX version");
+	}
+	uint32_t byteOrder, sizeofSizeT;
+	uint64_t streamSize;
+	memcpy(&byteOrder,   data + 16, sizeof(byteOrder));
+	memcpy(&sizeofSizeT, data + 20, sizeof(sizeofSizeT));
+	memcpy(&streamSize,  data + 24, sizeof(streamSize));
+	if ((byteOrder != BIN_BYTE_ORDER) || (sizeofSizeT != sizeof(size_t))) {
+		throw MSXException(
+			"Savestate was made on a different type of platform, "
+			"use a savestate in XML format instead");
+	}
+	if (streamSize > (size - BIN_HEADER_SIZE)) truncated();
+	start = pos = data + BIN_HEADER_SIZE;
+	finish = start + streamSize;
+}
+
+bool BinInputArchive::isBinArchive(const string& filename)
+{
+	try {
+		File file(filename);
+		if (file.getSize() < BIN_HEADER_SIZE) return false;
+		char magic[sizeof(BIN_MAGIC)];
+		file.read(magic, sizeof(magic));
+		return memcmp(magic, BIN_MAGIC, sizeof(magic)) == 0;
+	} catch (MSXException&) {
+		return false;
+	}
+}
+
+void BinInputArchive::truncated()
+{
+	throw MSXException("Savestate file is truncated or corrupt");
+}
+
+void BinInputArchive::load(std::string& s)
+{
+	size_t length;
+	load(length);
+	const byte* p = consume(length);
+	s.assign(reinterpret_cast<const char*>(p), length);
+}
+
+string_view BinInputArchive::loadStr()
+{
+	size_t length;
+	load(length);
+	const byte* p = consume(length);
+	return string_view(reinterpret_cast<const char*>(p), length);
+}
+
+void BinInputArchive::serialize_blob(const char*, void* data, size_t len,
+                                     bool /*diff*/)
+{
+	if (len > SMALL_SIZE) {
+		consume(blobPadding(size_t(pos - start)));
+	}
+	memcpy(data, consume(len), len);
+}
+
 } // namespace openmsx
@@ -5,7 +5,9 @@
 #include "SerializeBuffer.hh"
 #include "XMLElement.hh"
 #include "MemBuffer.hh"
+#include "File.hh"
 #include "inline.hh"
+#include "likely.hh"
 #include "strCat.hh"
 #include "unreachable.hh"
 #include <zlib.h>
@@ -49,6 +51,15 @@ template<typename T> struct SerializeClassVersion;
 //      is not a design goal (e.g. simply changing a value will probably work,
 //      but swapping the position of two tag or adding or removing tags can
 //      easily break the stream).
+//   - Bin
+//      Stores the stream in a binary file. Like XML it contains version
+//      information, but like Mem it is not platform independent (files
+//      can only be loaded on a platform with the same endianess and word
+//      size). Large blobs (e.g. RAM or VRAM content) are stored as raw,
+//      aligned data, so that on load they can be copied directly from the
+//      memory mapped file. The main use case is regular savestates: these
+//      are much faster to create and to load than XML. XML remains the
+//      format to exchange savestates between platforms.
 //   - Text
 //      This stores to stream in a flat ascii file (one item per line). This
 //      format is only written as a proof-of-concept to test the design. It's
@@ -720,8 +731,13 @@ class XmlOutputArchive final : public OutputArchiveBase<XmlOutputArchive>
 {
 public:
 	explicit XmlOutputArchive(const std::string& filename);
+	/** Create an archive that is not written to a file, instead the
+	  * result can be retrieved with getXml(). */
+	XmlOutputArchive();
 	~XmlOutputArchive();
 
+	std::string getXml() const;
+
 	template <typename T> void saveImpl(const T& t)
 	{
 		// TODO make sure floating point is printed with enough digits
@@ -775,6 +791,7 @@ class XmlInputArchive final : public InputArchiveBase<XmlInputArchive>
 {
 public:
 	explicit XmlInputArchive(const std::string& filename);
+	explicit XmlInputArchive(XMLElement root);
 
 	inline bool versionAtLeast(unsigned actual, unsigned required) const
 	{
@@ -837,11 +854,131 @@ private:
 	std::vector<std::pair<const XMLElement*, size_t>> elems;
 };
 
+////
+
+class BinOutputArchive final : public OutputArchiveBase<BinOutputArchive>
+{
+public:
+	/** The file is already created here, but only written by close().
+	  * @throws FileException */
+	explicit BinOutputArchive(const std::string& filename);
+
+	template <typename T> void save(const T& t)
+	{
+		buffer.insert(&t, sizeof(t));
+	}
+	inline void saveChar(char c)
+	{
+		save(c);
+	}
+	void save(bool b)
+	{
+		save(byte(b)); // always one byte, see BinInputArchive::load()
+	}
+	void save(const std::string& s);
+	void serialize_blob(const char*, const void* data, size_t len,
+	                    bool diff = true);
+
+	void beginSection()
+	{
+		size_t skip = 0; // filled in later
+		save(skip);
+		openSections.push_back(buffer.getPosition());
+	}
+	void endSection()
+	{
+		assert(!openSections.empty());
+		size_t beginPos = openSections.back();
+		openSections.pop_back();
+		size_t skip = buffer.getPosition() - beginPos;
+		buffer.insertAt(beginPos - sizeof(skip), &skip, sizeof(skip));
+	}
+
+	/** Write the stream to the file.
+	  * @throws FileException */
+	void close();
+
+private:
+	File file;
+	OutputBuffer buffer;
+	std::vector<size_t> openSections;
+};
+
+class BinInputArchive final : public InputArchiveBase<BinInputArchive>
+{
+public:
+	/** @throws MSXException */
+	explicit BinInputArchive(const std::string& filename);
+
+	/** Quick check on the file header, doesn't throw. */
+	static bool isBinArchive(const std::string& filename);
+
+	inline bool versionAtLeast(unsigned actual, unsigned required) const
+	{
+		return actual >= required;
+	}
+	inline bool versionBelow(unsigned actual, unsigned required) const
+	{
+		return actual < required;
+	}
+
+	template<typename T> void load(T& t)
+	{
+		get(&t, sizeof(t));
+	}
+	inline void loadChar(char& c)
+	{
+		load(c);
+	}
+	void load(bool& b)
+	{
+		// Don't memcpy into the bool, (corrupt) values other than 0
+		// and 1 would give undefined behaviour.
+		byte v;
+		load(v);
+		b = v != 0;
+	}
+	void load(std::string& s);
+	string_view loadStr();
+	void serialize_blob(const char*, void* data, size_t len,
+	                    bool diff = true);
+
+	void skipSection(bool skip)
+	{
+		size_t num;
+		load(num);
+		if (skip) {
+			consume(num);
+		}
+	}
+
+private:
+	const byte* consume(size_t len)
+	{
+		if (unlikely(len > size_t(finish - pos))) truncated();
+		const byte* result = pos;
+		pos += len;
+		return result;
+	}
+	void get(void* data, size_t len)
+	{
+		memcpy(data, consume(len), len);
+	}
+	NEVER_INLINE static void truncated();
+
+	File file;
+	const byte* start; // begin of the stream (after the file header)
+	const byte* pos;
+	const byte* finish;
+};
+
 #define INSTANTIATE_SERIALIZE_METHODS(CLASS) \
 template void CLASS::serialize(MemInputArchive&,   unsigned); \
 template void CLASS::serialize(MemOutputArchive&,  unsigned); \
 template void CLASS::serialize(XmlInputArchive&,   unsigned); \
-template void CLASS::serialize(XmlOutputArchive&,  unsigned);
+template void CLASS::serialize(XmlOutputArchive&,  unsigned); \
+template void CLASS::serialize(BinInputArchive&,   unsigned); \
+template void CLASS::serialize(BinOutputArchive&,  unsigned);
 
 } // namespace openmsx
 
@@ -137,6 +137,30 @@ byte* MSXFmPac::getWriteCacheLine(word address) const
 	}
 }
 
+const byte* MSXFmPac::getReadCacheSubLines(word address, unsigned& uncacheable) const
+{
+	address &= 0x3FFF;
+	if (address == (0x3FF6 & CacheLine::HIGH)) {
+		uncacheable = CacheLine::subLineMask(0x3FF6, 0x3FF7);
+		return sramEnabled ? unmappedRead : &rom[bank * 0x4000 + address];
+	}
+	if (sramEnabled && (address == (0x1FFE & CacheLine::HIGH))) {
+		uncacheable = CacheLine::subLineMask(0x1FFE, 0x1FFF);
+		return &sram[address];
+	}
+	return nullptr;
+}
+
+byte* MSXFmPac::getWriteCacheSubLines(word address, unsigned& uncacheable) const
+{
+	address &= 0x3FFF;
+	if (address == (0x3FF4 & CacheLine::HIGH)) {
+		uncacheable = CacheLine::subLineMask(0x3FF4, 0x3FF7);
+		return unmappedWrite;
+	}
+	return nullptr;
+}
+
 void MSXFmPac::checkSramEnable()
 {
 	bool newEnabled = (r1ffe == 0x4D) && (r1fff == 0x69);
@@ -19,6 +19,8 @@ public:
 	void writeMem(word address, byte value, EmuTime::param time) override;
 	const byte* getReadCacheLine(word address) const override;
 	byte* getWriteCacheLine(word address) const override;
+	const byte* getReadCacheSubLines(word address, unsigned& uncacheable) const override;
+	byte* getWriteCacheSubLines(word address, unsigned& uncacheable) const override;
 
 	template<typename Archive>
 	void serialize(Archive& ar, unsigned version);
@@ -171,6 +171,27 @@ byte* MSXMusicWX::getWriteCacheLine(word start) const
 	}
 }
 
+const byte* MSXMusicWX::getReadCacheSubLines(
+	word start, unsigned& uncacheable) const
+{
+	if ((0x7FF0 & CacheLine::HIGH) == start) {
+		// only the control register (0x7FF0-0x7FFF) is special
+		uncacheable = CacheLine::subLineMask(0x7FF0, 0x7FFF);
+		return ((control & 1) == 0) ? MSXMusicBase::getReadCacheLine(start)
+		                            : unmappedRead;
+	}
+	return nullptr;
+}
+
+byte* MSXMusicWX::getWriteCacheSubLines(word start, unsigned& uncacheable) const
+{
+	if ((0x7FF0 & CacheLine::HIGH) == start) {
+		uncacheable = CacheLine::subLineMask(0x7FF0, 0x7FFF);
+		return unmappedWrite;
+	}
+	return nullptr;
+}
+
 template<typename Archive>
 void MSXMusicWX::serialize(Archive& ar, unsigned version)
 {
@@ -59,6 +59,8 @@ public:
 	const byte* getReadCacheLine(word start) const override;
 	void writeMem(word address, byte value, EmuTime::param time) override;
 	byte* getWriteCacheLine(word start) const override;
+	const byte* getReadCacheSubLines(word start, unsigned& uncacheable) const override;
+	byte* getWriteCacheSubLines(word start, unsigned& uncacheable) const override;
 
 	template<typename Archive>
 	void serialize(Archive& ar, unsigned version);
@@ -193,6 +193,18 @@ byte* MSXSCCPlusCart::getWriteCacheLine(word start) const
 	return unmappedWrite;
 }
 
+byte* MSXSCCPlusCart::getWriteCacheSubLines(word start, unsigned& uncacheable) const
+{
+	if (start == (0xBFFF & CacheLine::HIGH)) {
+		// only the mode register (0xBFFE-0xBFFF) is special
+		if (isRamSegment[3] && isMapped[3]) {
+			uncacheable = CacheLine::subLineMask(0xBFFE, 0xBFFF);
+			return &internalMemoryBank[3][start & 0x1FFF];
+		}
+	}
+	return nullptr;
+}
+
 
 void MSXSCCPlusCart::setMapper(int regio, byte value)
 {
@@ -23,6 +23,7 @@ public:
 	void writeMem(word address, byte value, EmuTime::param time) override;
 	const byte* getReadCacheLine(word start) const override;
 	byte* getWriteCacheLine(word start) const override;
+	byte* getWriteCacheSubLines(word start, unsigned& uncacheable) const override;
 
 	template<typename Archive>
 	void serialize(Archive& ar, unsigned version);
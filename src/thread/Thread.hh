@@ -14,6 +14,20 @@ namespace Thread {
 	  */
 	bool isMainThread();
 
+	/** Mark the calling thread as an emulation thread. Such a thread
+	  * has exclusive ownership of one or more MSX machines (see
+	  * BatchRunner). Should be called once at the start of that thread.
+	  */
+	void setEmulationThread();
+
+	/** Returns true when called from the main thread or from a thread
+	  * marked with setEmulationThread(). Code that only touches the state
+	  * of a single MSX machine (e.g. the Scheduler) may run on such a
+	  * thread, code that touches global state (e.g. the Tcl interpreter)
+	  * still requires isMainThread().
+	  */
+	bool isEmulationThread();
+
 } // namespace Thread
 } // namespace openmsx
 
@@ -0,0 +1,77 @@
+#include "ThreadPool.hh"
+#include <cassert>
+#include <utility>
+
+namespace openmsx {
+
+ThreadPool::ThreadPool(unsigned numThreads_)
+	: numThreads(numThreads_)
+	, busy(0)
+	, stop(false)
+{
+	assert(numThreads > 0);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	jobAdded.notify_all();
+	for (auto& t : threads) {
+		t.join();
+	}
+	assert(jobs.empty());
+}
+
+void ThreadPool::add(Job job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		assert(!stop);
+		if (threads.empty()) {
+			for (unsigned i = 0; i < numThreads; ++i) {
+				threads.emplace_back([this]() { run(); });
+			}
+		}
+		jobs.push_back(std::move(job));
+	}
+	jobAdded.notify_one();
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	jobDone.wait(lock, [&] { return jobs.empty() && (busy == 0); });
+}
+
+unsigned ThreadPool::defaultNumThreads()
+{
+	unsigned cores = std::thread::hardware_concurrency();
+	return (cores > 1) ? (cores - 1) : 1;
+}
+
+void ThreadPool::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		jobAdded.wait(lock, [&] { return stop || !jobs.empty(); });
+		if (jobs.empty()) return; // 'stop' and no more work
+
+		{
+			// Destroy the job (and what it captured) before
+			// wait() can return.
+			Job job = std::move(jobs.front());
+			jobs.pop_front();
+			++busy;
+			lock.unlock();
+			job();
+		}
+		lock.lock();
+		--busy;
+		jobDone.notify_all();
+	}
+}
+
+} // namespace openmsx
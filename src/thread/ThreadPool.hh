@@ -0,0 +1,59 @@
+#ifndef THREADPOOL_HH
+#define THREADPOOL_HH
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace openmsx {
+
+/** A fixed set of worker threads that execute jobs in the background.
+  * Jobs are started in the order they were added, but (with more than one
+  * worker thread) they may finish in a different order.
+  */
+class ThreadPool
+{
+public:
+	using Job = std::function<void()>;
+
+	/** Create a pool with the given number of worker threads. The
+	  * threads are only started when the first job is added.
+	  */
+	explicit ThreadPool(unsigned numThreads);
+
+	/** Finishes all pending jobs, then stops the worker threads. */
+	~ThreadPool();
+
+	/** Add a job, it will be executed on one of the worker threads. */
+	void add(Job job);
+
+	/** Block until all jobs that were added so far have finished. */
+	void wait();
+
+	/** The number of worker threads in this pool. */
+	unsigned getNumThreads() const { return numThreads; }
+
+	/** Number of worker threads a pool should use when it wants to use
+	  * all cores but one (the one running the emulation). At least 1.
+	  */
+	static unsigned defaultNumThreads();
+
+private:
+	void run();
+
+	std::vector<std::thread> threads;
+	std::deque<Job> jobs;
+	std::mutex mutex;
+	std::condition_variable jobAdded;
+	std::condition_variable jobDone;
+	const unsigned numThreads;
+	unsigned busy; // number of jobs being executed right now
+	bool stop;
+};
+
+} // namespace openmsx
+
+#endif
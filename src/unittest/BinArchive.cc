@@ -0,0 +1,196 @@
+#include "catch.hpp"
+#include "serialize.hh"
+#include "serialize_stl.hh"
+#include "File.hh"
+#include "FileOperations.hh"
+#include "MSXException.hh"
+#include "strCat.hh"
+#include "xrange.hh"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace openmsx;
+
+namespace {
+
+struct Inner
+{
+	bool flag = false;
+	std::string name;
+	unsigned version = 0;
+
+	template<typename Archive>
+	void serialize(Archive& ar, unsigned version_)
+	{
+		version = version_;
+		ar.serialize("flag", flag);
+		ar.serialize("name", name);
+	}
+};
+
+struct Outer
+{
+	int i = 0;
+	bool b1 = false;
+	bool b2 = false;
+	std::string s;
+	Inner inner;
+	std::vector<Inner> inners;
+	byte small[10] = {};
+	byte large[1000] = {};
+	unsigned version = 0;
+
+	template<typename Archive>
+	void serialize(Archive& ar, unsigned version_)
+	{
+		version = version_;
+		ar.serialize("i", i);
+		ar.serialize("b1", b1);
+		ar.serialize_blob("small", small, sizeof(small));
+		ar.serialize("s", s);
+		ar.serialize("inner", inner);
+		ar.serialize_blob("large", large, sizeof(large));
+		ar.serialize("b2", b2);
+		ar.serialize("inners", inners);
+	}
+};
+
+// Same layout as 'Inner', but with a byte instead of a bool.
+struct InnerByte
+{
+	byte flag = 0;
+	std::string name;
+
+	template<typename Archive>
+	void serialize(Archive& ar, unsigned /*version*/)
+	{
+		ar.serialize("flag", flag);
+		ar.serialize("name", name);
+	}
+};
+
+} // namespace
+
+namespace openmsx {
+SERIALIZE_CLASS_VERSION(Inner, 3);
+SERIALIZE_CLASS_VERSION(Outer, 7);
+}
+
+static std::string tempFile()
+{
+	return strCat(FileOperations::getTempDir(), "/openmsx-binarchive-test");
+}
+
+static std::vector<byte> readFile(const std::string& filename)
+{
+	File file(filename);
+	std::vector<byte> result(file.getSize());
+	file.read(result.data(), result.size());
+	return result;
+}
+
+TEST_CASE("BinArchive")
+{
+	auto filename = tempFile();
+
+	Outer out;
+	out.i = -12345;
+	out.b1 = true;
+	out.b2 = false;
+	out.s = "hello world";
+	out.inner.flag = true;
+	out.inner.name = "inner";
+	out.inners.resize(2);
+	out.inners[1].flag = true;
+	out.inners[1].name = std::string(300, 'x');
+	for (auto j : xrange(sizeof(out.small))) out.small[j] = byte(j + 1);
+	for (auto j : xrange(sizeof(out.large))) out.large[j] = byte(j * 7 + 3);
+	{
+		BinOutputArchive ar(filename);
+		ar.serialize("outer", out);
+		ar.close();
+	}
+	REQUIRE(BinInputArchive::isBinArchive(filename));
+
+	SECTION("round trip") {
+		Outer in;
+		{
+			BinInputArchive ar(filename);
+			ar.serialize("outer", in);
+		}
+		CHECK(in.version == 7);
+		CHECK(in.i == out.i);
+		CHECK(in.b1 == true);
+		CHECK(in.b2 == false);
+		CHECK(in.s == out.s);
+		CHECK(in.inner.version == 3);
+		CHECK(in.inner.flag == true);
+		CHECK(in.inner.name == "inner");
+		REQUIRE(in.inners.size() == 2);
+		CHECK(in.inners[0].flag == false);
+		CHECK(in.inners[0].name.empty());
+		CHECK(in.inners[1].version == 3);
+		CHECK(in.inners[1].flag == true);
+		CHECK(in.inners[1].name == out.inners[1].name);
+		CHECK(memcmp(in.small, out.small, sizeof(out.small)) == 0);
+		CHECK(memcmp(in.large, out.large, sizeof(out.large)) == 0);
+	}
+	SECTION("large blobs are aligned") {
+		auto data = readFile(filename);
+		auto it = std::search(data.begin(), data.end(),
+		                      std::begin(out.large), std::end(out.large));
+		REQUIRE(it != data.end());
+		CHECK(((it - data.begin()) % 64) == 0);
+	}
+	SECTION("truncated") {
+		auto size = readFile(filename).size();
+		for (auto newSize : {size - 1, size - 500, size_t(70), size_t(10)}) {
+			{
+				File file(filename);
+				file.truncate(newSize);
+			}
+			CHECK_THROWS_AS([&] {
+				BinInputArchive ar(filename);
+				Outer in;
+				ar.serialize("outer", in);
+			}(), MSXException);
+		}
+	}
+	SECTION("corrupt string length") {
+		auto data = readFile(filename);
+		auto it = std::search(data.begin(), data.end(),
+		                      out.s.begin(), out.s.end());
+		REQUIRE((it - data.begin()) >= ptrdiff_t(sizeof(size_t)));
+		size_t length = size_t(-100);
+		memcpy(&*(it - sizeof(size_t)), &length, sizeof(length));
+		{
+			File file(filename, File::TRUNCATE);
+			file.write(data.data(), data.size());
+		}
+		CHECK_THROWS_AS([&] {
+			BinInputArchive ar(filename);
+			Outer in;
+			ar.serialize("outer", in);
+		}(), MSXException);
+	}
+	SECTION("bool other than 0 or 1") {
+		InnerByte ib;
+		ib.flag = 0x42;
+		ib.name = "byte";
+		{
+			BinOutputArchive ar(filename);
+			ar.serialize("inner", ib);
+			ar.close();
+		}
+		Inner in;
+		{
+			BinInputArchive ar(filename);
+			ar.serialize("inner", in);
+		}
+		CHECK(in.flag == true);
+		CHECK(in.name == "byte");
+	}
+
+	FileOperations::unlink(filename);
+}
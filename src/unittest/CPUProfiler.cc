@@ -0,0 +1,111 @@
+#include "catch.hpp"
+#include "Reactor.hh"
+#include "MSXMotherBoard.hh"
+#include "MSXCPU.hh"
+#include "MSXCPUInterface.hh"
+#include "CPURegs.hh"
+#include "Interpreter.hh"
+#include "EmuDuration.hh"
+#include "File.hh"
+#include "FileOperations.hh"
+#include "StringOp.hh"
+#include "Thread.hh"
+#include "strCat.hh"
+#include <cstring>
+
+using namespace openmsx;
+
+static const char* const MACHINE_CONFIG =
+	"<?xml version=\"1.0\" ?>\n"
+	"<!DOCTYPE msxconfig SYSTEM 'msxconfig2.dtd'>\n"
+	"<msxconfig>\n"
+	"  <info>\n"
+	"    <manufacturer>openMSX</manufacturer>\n"
+	"    <code>CPUProfiler test</code>\n"
+	"    <description>Machine with only RAM.</description>\n"
+	"    <type>MSX2</type>\n"
+	"  </info>\n"
+	"  <devices>\n"
+	"    <primary slot=\"0\">\n"
+	"      <MemoryMapper id=\"Main RAM\">\n"
+	"        <mem base=\"0x0000\" size=\"0x10000\"/>\n"
+	"        <size>64</size>\n"
+	"      </MemoryMapper>\n"
+	"    </primary>\n"
+	"  </devices>\n"
+	"</msxconfig>\n";
+
+// Loaded at address 0x0100.
+static const byte PROGRAM[] = {
+	0xF3,                   //       di
+	0x31, 0x00, 0xF0,       //       ld   sp,0F000h
+	0x06, 0x0A,             //       ld   b,10
+	0xCD, 0x0D, 0x01,       // loop: call sub
+	0x10, 0xFB,             //       djnz loop
+	0x18, 0xFE,             // end:  jr   end
+	0x00,                   // sub:  nop
+	0xC9,                   //       ret
+};
+
+static unsigned getCount(Interpreter& interp, unsigned pc)
+{
+	unsigned result = 0;
+	for (int i = 3; i >= 0; --i) {
+		auto value = interp.execute(strCat(
+			"debug read {profile counts} ", 4 * pc + i));
+		result = (result << 8) | value.getInt(interp);
+	}
+	return result;
+}
+
+TEST_CASE("CPUProfiler")
+{
+	Thread::setMainThread();
+	Reactor reactor;
+	reactor.init();
+
+	std::string config = strCat(FileOperations::getTempDir(),
+	                            "/openmsx-profiler-test");
+	{
+		File file(config + ".xml", File::TRUNCATE);
+		file.write(MACHINE_CONFIG, strlen(MACHINE_CONFIG));
+	}
+	reactor.switchMachine(config);
+	FileOperations::unlink(config + ".xml");
+	auto& board = *reactor.getMotherBoard();
+	board.powerUp();
+
+	auto& interface = board.getCPUInterface();
+	for (unsigned i = 0; i < sizeof(PROGRAM); ++i) {
+		interface.writeMem(0x0100 + i, PROGRAM[i], board.getCurrentTime());
+	}
+	auto& regs = board.getCPU().getRegisters();
+	regs.setPC(0x0100);
+	regs.setIFF1(false);
+	regs.setIFF2(false);
+	regs.setHALT(false);
+
+	auto& interp = reactor.getInterpreter();
+	interp.execute("profile start");
+	board.fastForward(board.getCurrentTime() + EmuDuration::msec(1), true);
+	interp.execute("profile stop");
+
+	CHECK(getCount(interp, 0x0100) ==  1); // di
+	CHECK(getCount(interp, 0x0101) ==  1); // ld sp,0F000h
+	CHECK(getCount(interp, 0x0102) ==  0); // not an instruction
+	CHECK(getCount(interp, 0x0104) ==  1); // ld b,10
+	CHECK(getCount(interp, 0x0106) == 10); // call sub
+	CHECK(getCount(interp, 0x0109) == 10); // djnz loop
+	CHECK(getCount(interp, 0x010B) >   1); // jr end
+	CHECK(getCount(interp, 0x010D) == 10); // nop
+	CHECK(getCount(interp, 0x010E) == 10); // ret
+
+	// Something like
+	//   " incl.cycles       %        calls  caller -> callee"
+	//   "         150    4.19           10  - -> 0:3:0x010D"
+	auto lines = StringOp::split(
+		interp.execute("profile dump -callgraph").getString(), '\n');
+	REQUIRE(lines.size() == 2);
+	CHECK(lines[1].find(" 10  - -> ") != string_view::npos);
+	CHECK(lines[1].ends_with(":0x010D"));
+}
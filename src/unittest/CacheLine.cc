@@ -0,0 +1,155 @@
+#include "catch.hpp"
+#include "Reactor.hh"
+#include "MSXMotherBoard.hh"
+#include "MSXCPU.hh"
+#include "MSXCPUInterface.hh"
+#include "CPURegs.hh"
+#include "Interpreter.hh"
+#include "EmuDuration.hh"
+#include "File.hh"
+#include "FileOperations.hh"
+#include "Thread.hh"
+#include "strCat.hh"
+#include <cstring>
+
+using namespace openmsx;
+
+// Two RAMs in the (expanded) primary slot 0.
+static const char* const MACHINE_CONFIG =
+	"<?xml version=\"1.0\" ?>\n"
+	"<!DOCTYPE msxconfig SYSTEM 'msxconfig2.dtd'>\n"
+	"<msxconfig>\n"
+	"  <info>\n"
+	"    <manufacturer>openMSX</manufacturer>\n"
+	"    <code>CacheLine test</code>\n"
+	"    <description>Machine with only RAM.</description>\n"
+	"    <type>MSX2</type>\n"
+	"  </info>\n"
+	"  <devices>\n"
+	"    <primary slot=\"0\">\n"
+	"      <secondary slot=\"0\">\n"
+	"        <MemoryMapper id=\"RAM 0\">\n"
+	"          <mem base=\"0x0000\" size=\"0x10000\"/>\n"
+	"          <size>64</size>\n"
+	"        </MemoryMapper>\n"
+	"      </secondary>\n"
+	"      <secondary slot=\"1\">\n"
+	"        <MemoryMapper id=\"RAM 1\">\n"
+	"          <mem base=\"0x0000\" size=\"0x10000\"/>\n"
+	"          <size>64</size>\n"
+	"        </MemoryMapper>\n"
+	"      </secondary>\n"
+	"    </primary>\n"
+	"  </devices>\n"
+	"</msxconfig>\n";
+
+static MSXMotherBoard& createMachine(Reactor& reactor)
+{
+	std::string config = strCat(FileOperations::getTempDir(),
+	                            "/openmsx-cacheline-test");
+	{
+		File file(config + ".xml", File::TRUNCATE);
+		file.write(MACHINE_CONFIG, strlen(MACHINE_CONFIG));
+	}
+	reactor.switchMachine(config);
+	FileOperations::unlink(config + ".xml");
+	auto& board = *reactor.getMotherBoard();
+	board.powerUp();
+	return board;
+}
+
+// Load the program at address 0x0100 and start it.
+static void run(MSXMotherBoard& board, const byte* program, size_t size)
+{
+	auto& interface = board.getCPUInterface();
+	for (unsigned i = 0; i < size; ++i) {
+		interface.writeMem(0x0100 + i, program[i], board.getCurrentTime());
+	}
+	auto& regs = board.getCPU().getRegisters();
+	regs.setPC(0x0100);
+	regs.setIFF1(false);
+	regs.setIFF2(false);
+	regs.setHALT(false);
+	board.fastForward(board.getCurrentTime() + EmuDuration::usec(500), true);
+}
+
+static byte peek(MSXMotherBoard& board, unsigned subSlot, unsigned address)
+{
+	return board.getCPUInterface().peekSlottedMem(
+		(subSlot << 16) | address, board.getCurrentTime());
+}
+
+TEST_CASE("CacheLine: secondary slot register")
+{
+	// The line 0xFF00-0xFFFF is cached, except for the sub-line with the
+	// secondary slot register. Writing that register selects another RAM
+	// in page 3, after that the cached line of the old RAM may not be
+	// used anymore, both for the cacheable and the uncacheable sub-lines.
+	static const byte PROGRAM[] = {
+		0xF3,                   //       di
+		0x3E, 0x11,             //       ld   a,11h
+		0x32, 0x00, 0xFF,       //       ld   (0FF00h),a
+		0x32, 0xF0, 0xFF,       //       ld   (0FFF0h),a
+		0x3E, 0x40,             //       ld   a,40h  ; page 3: sub-slot 1
+		0x32, 0xFF, 0xFF,       //       ld   (0FFFFh),a
+		0x3E, 0x22,             //       ld   a,22h
+		0x32, 0x00, 0xFF,       //       ld   (0FF00h),a
+		0x32, 0xF0, 0xFF,       //       ld   (0FFF0h),a
+		0x3A, 0x00, 0xFF,       //       ld   a,(0FF00h)
+		0x32, 0x00, 0x80,       //       ld   (8000h),a
+		0x18, 0xFE,             // end:  jr   end
+	};
+
+	Thread::setMainThread();
+	Reactor reactor;
+	reactor.init();
+	auto& board = createMachine(reactor);
+	run(board, PROGRAM, sizeof(PROGRAM));
+
+	CHECK(peek(board, 0, 0xFF00) == 0x11);
+	CHECK(peek(board, 0, 0xFFF0) == 0x11);
+	CHECK(peek(board, 1, 0xFF00) == 0x22);
+	CHECK(peek(board, 1, 0xFFF0) == 0x22);
+	CHECK(peek(board, 0, 0x8000) == 0x22);
+	CHECK(peek(board, 0, 0xFFFF) == byte(~0x40));
+}
+
+TEST_CASE("CacheLine: watchpoint")
+{
+	// A write watchpoint that's set while the line is cached only makes
+	// its own sub-line uncacheable. Writes to that sub-line must reach
+	// the watchpoint, the other writes (also in the same line) must still
+	// end up in RAM.
+	static const byte PROGRAM[] = {
+		0xF3,                   //       di
+		0x21, 0x05, 0xC0,       //       ld   hl,0C005h
+		0x34,                   // loop: inc  (hl)
+		0x7E,                   //       ld   a,(hl)
+		0x32, 0x0A, 0xC0,       //       ld   (0C00Ah),a
+		0x32, 0x20, 0xC0,       //       ld   (0C020h),a
+		0x18, 0xF6,             //       jr   loop
+	};
+
+	Thread::setMainThread();
+	Reactor reactor;
+	reactor.init();
+	auto& board = createMachine(reactor);
+	run(board, PROGRAM, sizeof(PROGRAM));
+	byte before = peek(board, 0, 0xC005);
+	CHECK(before != 0);
+	CHECK(peek(board, 0, 0xC00A) == before);
+
+	auto& interp = reactor.getInterpreter();
+	interp.execute("set ::hits 0");
+	interp.execute("debug set_watchpoint write_mem 0xC005 {} {incr ::hits}");
+	board.fastForward(board.getCurrentTime() + EmuDuration::usec(500), true);
+
+	byte after = peek(board, 0, 0xC005);
+	int hits = interp.execute("set ::hits").getInt(interp);
+	CHECK(hits > 0);
+	CHECK(byte(before + hits) == after);
+	// the loop may be interrupted right after the 'inc (hl)'
+	CHECK(((peek(board, 0, 0xC00A) == after) ||
+	       (peek(board, 0, 0xC00A) == byte(after - 1))));
+	CHECK(peek(board, 0, 0xC020) == peek(board, 0, 0xC00A));
+}
@@ -0,0 +1,83 @@
+#include "catch.hpp"
+#include "CompiledCondition.hh"
+#include "CPURegs.hh"
+#include "CommandException.hh"
+
+using namespace openmsx;
+
+struct TestContext final : CompiledCondition::Context
+{
+	TestContext() : regs(false) {
+		for (unsigned i = 0; i < 0x10000; ++i) mem[i] = byte(i ^ (i >> 8));
+	}
+	const CPURegs& getRegisters() override { return regs; }
+	byte peekMem(word address) override { return mem[address]; }
+
+	CPURegs regs;
+	byte mem[0x10000];
+};
+
+static bool eval(const char* expr, TestContext& context)
+{
+	auto c = CompiledCondition::compile(expr);
+	REQUIRE(c);
+	return c->evaluate(context);
+}
+
+TEST_CASE("CompiledCondition: not supported")
+{
+	for (auto* expr : {"$a == 1", "[reg A] eq 1", "1.5 > 1", "2 ** 3",
+	                   "[peek 0x10 {slot 0}] == 0", "[reg Q] == 0",
+	                   "[debug read memory 0] == 0", "abs(-1)", "09 == 9",
+	                   "[reg A] == ", "(1 == 1", "[reg A", "1 == 1 1"}) {
+		INFO(expr);
+		CHECK(!CompiledCondition::compile(expr));
+	}
+}
+
+TEST_CASE("CompiledCondition: evaluate")
+{
+	TestContext context;
+	context.regs.setA(0x3f);
+	context.regs.setHL(0x1234);
+
+	CHECK( eval("[reg A] == 0x3f", context));
+	CHECK( eval("[reg a]==63", context));
+	CHECK(!eval("[reg A] != 0x3f", context));
+	CHECK( eval("[reg H] == 0x12 && [reg l] == 0x34", context));
+	CHECK( eval("[reg HL] == 0x1234", context));
+	CHECK( eval("[peek 0x1234] == (0x34 ^ 0x12)", context));
+	CHECK( eval("[peek [reg HL]] == 0x26", context));
+	CHECK( eval("[peek16 0x0102] == 0x0203", context));
+	CHECK( eval("[peek16_BE 0x0102] == 0x0302", context));
+	CHECK( eval("[peek_s8 0x80] == -128", context));
+	CHECK( eval("[peek [expr {[reg HL] + 1}]] == 0x27", context));
+	CHECK( eval("[reg A] == 0x3f && [peek 0xf3ae] != 0", context));
+
+	// operators and precedence, same results as Tcl's expr
+	CHECK( eval("1 + 2 * 3 == 7", context));
+	CHECK( eval("(1 + 2) * 3 == 9", context));
+	CHECK( eval("-7 / 2 == -4", context));
+	CHECK( eval("-7 % 2 == 1", context));
+	CHECK( eval("7 % -2 == -1", context));
+	CHECK( eval("1 << 4 == 16 && 256 >> 4 == 16", context));
+	CHECK( eval("(5 & 3) == 1 && (5 | 3) == 7 && (5 ^ 3) == 6", context));
+	CHECK( eval("~0 == -1 && !5 == 0 && !0 == 1", context));
+	CHECK( eval("010 == 8 && 0b101 == 5 && 0o17 == 15", context));
+	CHECK( eval("(3 > 2) + (2 >= 2) + (1 < 2) + (2 <= 1) == 3", context));
+	CHECK( eval("(0 || 5) == 1 && (2 && 3) == 1", context));
+	CHECK( eval("([reg A] == 0x3f ? 10 : 20) == 10", context));
+	CHECK(!eval("0 && [peek 0x10000]", context)); // short circuit
+
+	CHECK_THROWS_AS(eval("1 / 0", context), CommandException);
+	CHECK_THROWS_AS(eval("[peek 0x10000]", context), CommandException);
+	CHECK_THROWS_AS(eval("[peek16 0xffff]", context), CommandException);
+}
+
+TEST_CASE("CompiledCondition: used commands")
+{
+	auto c = CompiledCondition::compile(
+		"[::reg A] == 1 && [peek [expr {[reg HL] + 1}]] == [peek 0]");
+	REQUIRE(c);
+	CHECK(c->getCommands() == (std::vector<std::string>{"reg", "peek", "expr"}));
+}
@@ -0,0 +1,95 @@
+#include "catch.hpp"
+#include "DeltaBlock.hh"
+#include "xrange.hh"
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+using namespace openmsx;
+
+// Make a delta against 'oldBuf', apply it and compare with 'newBuf'.
+static void roundTrip(const std::vector<uint8_t>& oldBuf,
+                      const std::vector<uint8_t>& newBuf)
+{
+	auto size = oldBuf.size();
+	auto prev = std::make_shared<DeltaBlockCopy>(oldBuf.data(), size);
+	DeltaBlockDiff diff(prev, newBuf.data(), size);
+	diff.calcDelta(size);
+	std::vector<uint8_t> out(size);
+	diff.apply(out.data(), size);
+	CHECK(out == newBuf);
+}
+
+static void test(bool avx2)
+{
+	auto old = DeltaBlock::setUseAVX2(avx2);
+
+	uint32_t random = 1;
+	auto next = [&](unsigned n) {
+		random = random * 1103515245 + 12345;
+		return (random >> 16) % n;
+	};
+
+	// Sizes around the word sizes used by the various code paths.
+	for (size_t size : {1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 1000, 4096}) {
+		std::vector<uint8_t> oldBuf(size);
+		for (auto& b : oldBuf) b = next(256);
+		for (auto i : xrange(50)) {
+			auto newBuf = oldBuf;
+			// Runs of changed bytes of all lengths, also at the
+			// start and the end of the buffer.
+			unsigned numRuns = (i == 0) ? 0 : next(5) + 1;
+			for (auto j : xrange(numRuns)) {
+				(void)j;
+				size_t start = next(unsigned(size));
+				size_t len = std::min<size_t>(next(70) + 1, size - start);
+				for (auto k : xrange(len)) newBuf[start + k] ^= next(255) + 1;
+			}
+			roundTrip(oldBuf, newBuf);
+		}
+	}
+
+	DeltaBlock::setUseAVX2(old);
+}
+
+TEST_CASE("DeltaBlock")
+{
+	SECTION("default") { test(true); }
+	SECTION("no AVX2") { test(false); }
+}
+
+TEST_CASE("DeltaBlock chunk sharing")
+{
+	static const size_t SIZE = 64 * 1024;
+	// First half a pattern, second half zeros (so those chunks are all
+	// identical). Both blocks below get this same data.
+	std::vector<uint8_t> data(SIZE, 0);
+	for (auto i : xrange(SIZE / 2)) data[i] = uint8_t(i * 7 + (i >> 8));
+
+	auto before = DeltaBlock::getChunkStats();
+	{
+		DeltaBlockCopy b1(data.data(), SIZE);
+		DeltaBlockCopy b2(data.data(), SIZE);
+		b1.compress(SIZE);
+		auto stats1 = DeltaBlock::getChunkStats();
+		b2.compress(SIZE);
+		auto stats2 = DeltaBlock::getChunkStats();
+		// the 2nd block doesn't store any new chunks
+		CHECK(stats2.numChunks  == stats1.numChunks);
+		CHECK(stats2.storedSize == stats1.storedSize);
+		CHECK(stats2.sharedRefs > stats1.sharedRefs);
+
+		std::vector<uint8_t> out(SIZE);
+		b2.apply(out.data(), SIZE);
+		CHECK(out == data);
+
+		// shared chunks are only counted once
+		std::unordered_set<const void*> seen;
+		CHECK(b1.getMemoryUsage(seen) == (stats1.storedSize - before.storedSize));
+		CHECK(b2.getMemoryUsage(seen) == 0);
+	}
+	// chunks are released together with the last block
+	auto after = DeltaBlock::getChunkStats();
+	CHECK(after.numChunks  == before.numChunks);
+	CHECK(after.storedSize == before.storedSize);
+}
@@ -0,0 +1,193 @@
+#include "catch.hpp"
+#include "Reactor.hh"
+#include "MSXMotherBoard.hh"
+#include "MSXCPU.hh"
+#include "MSXCPUInterface.hh"
+#include "CPURegs.hh"
+#include "Interpreter.hh"
+#include "EmuDuration.hh"
+#include "File.hh"
+#include "FileOperations.hh"
+#include "Thread.hh"
+#include "strCat.hh"
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace openmsx;
+
+static const char* const MACHINE_CONFIG =
+	"<?xml version=\"1.0\" ?>\n"
+	"<!DOCTYPE msxconfig SYSTEM 'msxconfig2.dtd'>\n"
+	"<msxconfig>\n"
+	"  <info>\n"
+	"    <manufacturer>openMSX</manufacturer>\n"
+	"    <code>FBPostProcessor test</code>\n"
+	"    <description>Machine with only RAM and a VDP.</description>\n"
+	"    <type>MSX2</type>\n"
+	"  </info>\n"
+	"  <devices>\n"
+	"    <VDP id=\"VDP\">\n"
+	"      <version>V9938</version>\n"
+	"      <vram>128</vram>\n"
+	"      <io base=\"0x98\" num=\"4\"/>\n"
+	"    </VDP>\n"
+	"    <primary slot=\"0\">\n"
+	"      <MemoryMapper id=\"Main RAM\">\n"
+	"        <mem base=\"0x0000\" size=\"0x10000\"/>\n"
+	"        <size>64</size>\n"
+	"      </MemoryMapper>\n"
+	"    </primary>\n"
+	"  </devices>\n"
+	"</msxconfig>\n";
+
+// Loaded at address 0x0100. Switches to G4 (screen 5) and waits.
+static const byte PROGRAM[] = {
+	0xF3,                   //       di
+	0x3E, 0x06,             //       ld   a,06h   ; R#0: G4
+	0xD3, 0x99,             //       out  (99h),a
+	0x3E, 0x80,             //       ld   a,80h
+	0xD3, 0x99,             //       out  (99h),a
+	0x3E, 0x40,             //       ld   a,40h   ; R#1: display on
+	0xD3, 0x99,             //       out  (99h),a
+	0x3E, 0x81,             //       ld   a,81h
+	0xD3, 0x99,             //       out  (99h),a
+	0x18, 0xFE,             // end:  jr   end
+};
+
+static std::string tempFile()
+{
+	return strCat(FileOperations::getTempDir(),
+	              "/openmsx-fbpostprocessor-test");
+}
+
+static MSXMotherBoard& createMachine(Reactor& reactor)
+{
+	auto& interp = reactor.getInterpreter();
+	for (auto* cmd : {"set renderer SDL",
+	                  "set scale_algorithm hq",
+	                  "set scale_factor 2",
+	                  "set minframeskip 0",
+	                  "set maxframeskip 0",
+	                  "set noise 0",
+	                  "set parallel_render off",
+	                  "set scale_threads 1"}) {
+		interp.execute(cmd);
+	}
+	auto config = tempFile();
+	{
+		File file(config + ".xml", File::TRUNCATE);
+		file.write(MACHINE_CONFIG, strlen(MACHINE_CONFIG));
+	}
+	reactor.switchMachine(config);
+	FileOperations::unlink(config + ".xml");
+	auto& board = *reactor.getMotherBoard();
+	board.powerUp();
+
+	auto& interface = board.getCPUInterface();
+	for (unsigned i = 0; i < sizeof(PROGRAM); ++i) {
+		interface.writeMem(0x0100 + i, PROGRAM[i], board.getCurrentTime());
+	}
+	auto& regs = board.getCPU().getRegisters();
+	regs.setPC(0x0100);
+	regs.setIFF1(false);
+	regs.setIFF2(false);
+	regs.setHALT(false);
+	return board;
+}
+
+// Fill (part of) the 212 visible lines with a pattern, then emulate a few
+// frames (all of them are rendered).
+static void draw(MSXMotherBoard& board, Interpreter& interp,
+                 unsigned startY, unsigned endY, unsigned seed)
+{
+	for (unsigned y = startY; y < endY; ++y) {
+		for (unsigned x = 0; x < 128; ++x) {
+			unsigned v = ((x / 3) ^ (y / 5)) * 17 + seed;
+			if (((x + y) % 7) == 0) v = 0x11 * (seed & 15);
+			interp.execute(strCat("debug write VRAM ",
+			                      y * 128 + x, ' ', v & 0xFF));
+		}
+	}
+	board.fastForward(board.getCurrentTime() + EmuDuration::msec(50), true);
+}
+
+static std::vector<byte> screenShot(Interpreter& interp, const char* options)
+{
+	auto filename = tempFile() + ".png";
+	interp.execute(strCat("screenshot ", options, ' ', filename));
+	std::vector<byte> result;
+	{
+		File file(filename);
+		result.resize(file.getSize());
+		file.read(result.data(), result.size());
+	}
+	FileOperations::unlink(filename);
+	return result;
+}
+
+// Paint the current frame with the given number of threads. When 'full' is
+// set, the whole image is scaled, otherwise only the lines that changed
+// since the previous paint.
+static std::vector<byte> paint(Interpreter& interp, unsigned threads, bool full)
+{
+	if (full) {
+		// a different scaler starts from scratch
+		interp.execute("set scale_algorithm simple");
+		screenShot(interp, "");
+		interp.execute("set scale_algorithm hq");
+	}
+	interp.execute(strCat("set scale_threads ", threads));
+	return screenShot(interp, "");
+}
+
+static double unchangedLines(Interpreter& interp)
+{
+	return interp.execute("machine_info MSX_unchanged_lines").getDouble(interp);
+}
+
+TEST_CASE("FBPostProcessor: scale threads and unchanged lines")
+{
+	// Uses the SDL renderer, so this needs a video driver. Headless (the
+	// screenshots are painted on an off-screen surface anyway), run it with
+	// SDL_VIDEODRIVER=dummy.
+	Thread::setMainThread();
+	Reactor reactor;
+	reactor.init();
+	auto& interp = reactor.getInterpreter();
+	auto& board = createMachine(reactor);
+
+	draw(board, interp, 0, 212, 0);
+	auto raw = screenShot(interp, "-raw");
+
+	// Drawing the frame in bands gives the same frame.
+	interp.execute("set parallel_render on");
+	draw(board, interp, 0, 0, 0);
+	CHECK(screenShot(interp, "-raw") == raw);
+
+	// Scaling in stripes gives the same image.
+	auto full = paint(interp, 1, true);
+	CHECK(paint(interp, 4, true) == full);
+	CHECK(paint(interp, 3, true) == full);
+
+	// Only a few lines changed: copying the unchanged lines from the
+	// previous output gives the same image as scaling everything (with
+	// one thread and with multiple threads).
+	draw(board, interp, 50, 60, 1);
+	auto skip = paint(interp, 1, false);
+	CHECK(unchangedLines(interp) > 0.8);
+	CHECK(unchangedLines(interp) < 1.0);
+	CHECK(skip != full);
+	CHECK(paint(interp, 4, true) == skip);
+
+	draw(board, interp, 100, 110, 2);
+	skip = paint(interp, 4, false);
+	CHECK(unchangedLines(interp) > 0.8);
+	CHECK(paint(interp, 1, true) == skip);
+
+	// The first and the last line, their neighbours are clipped.
+	draw(board, interp, 0, 1, 3);
+	draw(board, interp, 211, 212, 3);
+	skip = paint(interp, 4, false);
+	CHECK(paint(interp, 1, true) == skip);
+}
@@ -0,0 +1,199 @@
+#include "catch.hpp"
+#include "LazyFlags.hh"
+#include "xrange.hh"
+#include <random>
+
+using namespace openmsx;
+
+static const byte S_FLAG = LazyFlags::S_FLAG;
+static const byte Z_FLAG = LazyFlags::Z_FLAG;
+static const byte Y_FLAG = LazyFlags::Y_FLAG;
+static const byte H_FLAG = LazyFlags::H_FLAG;
+static const byte X_FLAG = LazyFlags::X_FLAG;
+static const byte V_FLAG = LazyFlags::V_FLAG;
+static const byte N_FLAG = LazyFlags::N_FLAG;
+static const byte C_FLAG = LazyFlags::C_FLAG;
+
+enum Op { ADD, ADC, SUB, SBC, CP, AND, OR, XOR, INC, DEC, NUM_OPS };
+
+static byte ZS(byte r) { return (r ? 0 : Z_FLAG) | (r & S_FLAG); }
+static byte XY(byte r) { return r & (X_FLAG | Y_FLAG); }
+static byte P(byte r)
+{
+	byte v = V_FLAG;
+	for (int b = 128; b != 0; b >>= 1) {
+		if (r & b) v ^= V_FLAG;
+	}
+	return v;
+}
+
+// The flags as calculated by the (eager) instruction implementations in
+// CPUCore. Returns the new F value, 'a' and 'reg' are updated with the
+// result.
+static byte eager(Op op, byte& a, byte& reg, byte f, bool r800)
+{
+	byte keepXY = r800 ? (f & (X_FLAG | Y_FLAG)) : 0;
+	switch (op) {
+	case ADD: case ADC: {
+		unsigned res = a + reg + ((op == ADC) && (f & C_FLAG) ? 1 : 0);
+		byte nf = ((res & 0x100) ? C_FLAG : 0) |
+		          ((a ^ res ^ reg) & H_FLAG) |
+		          (((a ^ res) & (reg ^ res) & 0x80) >> 5) |
+		          ZS(res) | (r800 ? keepXY : XY(res));
+		a = res;
+		return nf;
+	}
+	case SUB: case SBC: case CP: {
+		unsigned res = a - reg - ((op == SBC) && (f & C_FLAG) ? 1 : 0);
+		byte nf = ((res & 0x100) ? C_FLAG : 0) |
+		          N_FLAG |
+		          ((a ^ res ^ reg) & H_FLAG) |
+		          (((reg ^ a) & (a ^ res) & 0x80) >> 5) |
+		          ZS(res);
+		if (r800) {
+			nf |= keepXY;
+		} else {
+			nf |= XY((op == CP) ? reg : byte(res));
+		}
+		if (op != CP) a = res;
+		return nf;
+	}
+	case AND:
+		a &= reg;
+		return ZS(a) | P(a) | H_FLAG | (r800 ? keepXY : XY(a));
+	case OR: case XOR:
+		a = (op == OR) ? (a | reg) : (a ^ reg);
+		return ZS(a) | P(a) | (r800 ? keepXY : XY(a));
+	case INC: {
+		byte res = reg + 1;
+		byte nf = ((res & -res & 0x80) >> 5) |
+		          (((res & 0x0F) - 1) & H_FLAG) |
+		          (f & C_FLAG) | ZS(res) | (r800 ? keepXY : XY(res));
+		reg = res;
+		return nf;
+	}
+	case DEC: {
+		byte res = reg - 1;
+		byte nf = ((reg & ~res & 0x80) >> 5) |
+		          (((res & 0x0F) + 1) & H_FLAG) |
+		          N_FLAG |
+		          (f & C_FLAG) | ZS(res) | (r800 ? keepXY : XY(res));
+		reg = res;
+		return nf;
+	}
+	default:
+		UNREACHABLE; return 0;
+	}
+}
+
+// The same instruction, like CPUCore executes it with lazy flags.
+// 'f' is the F value in CPURegs (only valid when !lazy.isPending()).
+static void lazyOp(Op op, byte& a, byte& reg, byte f, bool r800, LazyFlags& lazy)
+{
+	switch (op) {
+	case ADD: case ADC: {
+		unsigned res = a + reg + ((op == ADC) ? lazy.getCarry(f) : 0);
+		lazy.set(LAZY_ADD, a, reg, res, f, r800);
+		a = res;
+		break;
+	}
+	case SUB: case SBC: {
+		unsigned res = a - reg - ((op == SBC) ? lazy.getCarry(f) : 0);
+		lazy.set(LAZY_SUB, a, reg, res, f, r800);
+		a = res;
+		break;
+	}
+	case CP:
+		lazy.set(LAZY_CP, a, reg, a - reg, f, r800);
+		break;
+	case AND:
+		a &= reg;
+		lazy.set(LAZY_AND, 0, 0, a, f, r800);
+		break;
+	case OR: case XOR:
+		a = (op == OR) ? (a | reg) : (a ^ reg);
+		lazy.set(LAZY_OR, 0, 0, a, f, r800);
+		break;
+	case INC:
+		++reg;
+		lazy.set(LAZY_INC, 0, 0, reg, f, r800);
+		break;
+	case DEC: {
+		byte res = reg - 1;
+		lazy.set(LAZY_DEC, 0, reg, res, f, r800);
+		reg = res;
+		break;
+	}
+	default:
+		UNREACHABLE;
+	}
+}
+
+static byte getF(const LazyFlags& lazy, byte f, bool r800)
+{
+	return lazy.isPending() ? lazy.calcF(r800) : f;
+}
+
+TEST_CASE("LazyFlags: single instruction")
+{
+	// all operands, all previous flag values (including X and Y)
+	for (bool r800 : {false, true}) {
+		for (auto op : xrange(int(NUM_OPS))) {
+			for (auto a0 : xrange(256)) {
+				for (auto reg0 : xrange(256)) {
+					for (byte f : {0x00, 0x01, 0x28, 0xFF, 0xD6}) {
+						byte a1 = a0, reg1 = reg0;
+						byte ef = eager(Op(op), a1, reg1, f, r800);
+						byte a2 = a0, reg2 = reg0;
+						LazyFlags lazy;
+						lazyOp(Op(op), a2, reg2, f, r800, lazy);
+						REQUIRE(a1 == a2);
+						REQUIRE(reg1 == reg2);
+						REQUIRE(lazy.calcF(r800) == ef);
+						REQUIRE(lazy.getCarry(f) == (ef & C_FLAG));
+						REQUIRE(lazy.isZero() == ((ef & Z_FLAG) != 0));
+					}
+				}
+			}
+		}
+	}
+}
+
+TEST_CASE("LazyFlags: instruction sequences")
+{
+	// Random sequences, compare F after every instruction. ADC/SBC/INC/DEC
+	// depend on the lazy carry of the previous instruction, on R800 the
+	// X and Y flags are kept over any number of instructions.
+	std::mt19937 gen(1234);
+	for (bool r800 : {false, true}) {
+		byte eA = 0, eF = 0;
+		byte lA = 0, lF = 0; // lF is the F value in CPURegs
+		LazyFlags lazy;
+		for (auto i : xrange(1000000)) {
+			(void)i;
+			auto r = gen();
+			auto op = Op(r % NUM_OPS);
+			byte reg = r >> 8;
+			if ((r >> 16) % 4 == 0) reg = eA; // e.g. ADD A,A
+			switch ((r >> 20) % 16) {
+			case 0: // e.g. POP AF
+				eF = lF = byte(r >> 24);
+				lazy.clear();
+				break;
+			case 1: // e.g. PUSH AF, or an external read of the registers
+				lF = getF(lazy, lF, r800);
+				lazy.clear();
+				break;
+			default: {
+				byte eReg = reg, lReg = reg;
+				eF = eager(op, eA, eReg, eF, r800);
+				lazyOp(op, lA, lReg, lF, r800, lazy);
+				REQUIRE(eReg == lReg);
+			}
+			}
+			INFO("op " << int(op) << " r800 " << r800);
+			REQUIRE(eA == lA);
+			REQUIRE(getF(lazy, lF, r800) == eF);
+		}
+	}
+}
@@ -0,0 +1,157 @@
+#include "catch.hpp"
+#include "ReplayStream.hh"
+#include "File.hh"
+#include "FileOperations.hh"
+#include "MSXException.hh"
+#include "endian.hh"
+#include "strCat.hh"
+#include <vector>
+
+using namespace openmsx;
+using namespace ReplayStream;
+
+static EmuTime T(uint64_t ticks)
+{
+	return EmuTime::zero + EmuDuration(ticks);
+}
+
+static std::vector<uint8_t> readFile(const std::string& filename)
+{
+	File file(filename);
+	std::vector<uint8_t> result(file.getSize());
+	file.read(result.data(), result.size());
+	return result;
+}
+
+static void writeFile(const std::string& filename, const std::vector<uint8_t>& data)
+{
+	File file(filename, File::TRUNCATE);
+	file.write(data.data(), data.size());
+}
+
+// Creates a finished recording with 2 (valid) keyframes and 5 events.
+static void createStream(const std::string& filename)
+{
+	ReplayStreamWriter w(filename);
+	w.addKeyframe(T(0), 0, "<k0/>");
+	w.addEvents(T(5), 0, 3, "<e0/>");
+	w.addKeyframe(T(100), 3, "<k1/>");
+	w.addEvents(T(150), 3, 2, "<e1/>");
+	w.addKeyframe(T(200), 5, "<k2/>");
+	// history changed at T(120): drops the last keyframe and an event
+	w.truncate(T(120), 4);
+	w.addEvents(T(130), 4, 1, "<e2/>");
+	CHECK(w.getIndex().keyframes.size() == 2);
+	CHECK(w.getIndex().numEvents() == 5);
+	w.addEvents(T(0), 0, 5, "<all/>");
+	w.finish(T(300), 7);
+}
+
+// Read all records in the index, this may not crash or throw.
+static void readAll(ReplayStreamReader& reader)
+{
+	auto& index = reader.getIndex();
+	for (auto& r : index.keyframes) {
+		auto xml = reader.read(r);
+		CHECK(xml.substr(0, 2) == "<k");
+	}
+	for (auto& r : index.events) {
+		auto xml = reader.read(r);
+		CHECK(!xml.empty());
+	}
+}
+
+TEST_CASE("ReplayStream")
+{
+	auto filename = strCat(FileOperations::getTempDir(),
+	                       "/openmsx-replaystream-test");
+	createStream(filename);
+	REQUIRE(isReplayStream(filename));
+	auto data = readFile(filename);
+	// First record, right after the file header.
+	static const size_t FIRST = 16;
+	REQUIRE(Endian::read_UA_L32(&data[FIRST]) == KEYFRAME);
+
+	SECTION("finished") {
+		ReplayStreamReader r(filename);
+		EmuTime time = EmuTime::zero;
+		unsigned reRecordCount = 0;
+		REQUIRE(r.getInfo(time, reRecordCount));
+		CHECK(time == T(300));
+		CHECK(reRecordCount == 7);
+		auto& index = r.getIndex();
+		REQUIRE(index.keyframes.size() == 2);
+		REQUIRE(index.events.size() == 1);
+		CHECK(index.numEvents() == 5);
+		CHECK(r.read(index.keyframes[0]) == "<k0/>");
+		CHECK(r.read(index.keyframes[1]) == "<k1/>");
+		CHECK(r.read(index.events[0]) == "<all/>");
+	}
+	SECTION("truncated") {
+		// Without the trailer the index is rebuilt by scanning the
+		// records, an incomplete record at the end is ignored.
+		for (size_t size = FIRST; size < data.size(); ++size) {
+			writeFile(filename, std::vector<uint8_t>(
+				data.begin(), data.begin() + size));
+			ReplayStreamReader r(filename);
+			EmuTime time = EmuTime::zero;
+			unsigned reRecordCount = 0;
+			CHECK(!r.getInfo(time, reRecordCount));
+			CHECK(r.getIndex().keyframes.size() <= 3);
+			readAll(r);
+		}
+		// too short for a file header
+		writeFile(filename, std::vector<uint8_t>(data.begin(), data.begin() + 10));
+		CHECK_THROWS_AS(ReplayStreamReader(filename), MSXException);
+	}
+	SECTION("corrupt record size") {
+		// A huge size in the first record: nothing can be loaded, but
+		// it also doesn't try to allocate that much memory.
+		for (uint64_t size : {uint64_t(-1), uint64_t(-100), uint64_t(1) << 40,
+		                      uint64_t(data.size())}) {
+			auto copy = data;
+			Endian::write_UA_L64(&copy[FIRST + 8], size); // storedSize
+			// also invalidate the trailer, so that it has to scan
+			copy.back() ^= 0xFF;
+			writeFile(filename, copy);
+			ReplayStreamReader r(filename);
+			CHECK(r.getIndex().keyframes.empty());
+			CHECK(r.getIndex().events.empty());
+		}
+		auto copy = data;
+		Endian::write_UA_L64(&copy[FIRST + 16], uint64_t(-1)); // rawSize
+		copy.back() ^= 0xFF;
+		writeFile(filename, copy);
+		ReplayStreamReader r(filename);
+		CHECK(r.getIndex().keyframes.empty());
+	}
+	SECTION("invalid record") {
+		// E.g. from a corrupt index.
+		ReplayStreamReader r1(filename);
+		auto valid = r1.getIndex().keyframes[1];
+		auto bad = valid;
+		bad.offset = data.size() - 10;
+		CHECK_THROWS_AS(r1.read(bad), MSXException);
+		bad = valid;
+		bad.storedSize = uint64_t(-1) - 40;
+		CHECK_THROWS_AS(r1.read(bad), MSXException);
+		bad = valid;
+		bad.rawSize = 1000000; // more than zlib can produce from it
+		CHECK_THROWS_AS(r1.read(bad), MSXException);
+	}
+	SECTION("corrupt payload") {
+		ReplayStreamReader r1(filename);
+		auto record = r1.getIndex().keyframes[1];
+		auto copy = data;
+		for (size_t i = 0; i < record.storedSize; ++i) {
+			copy[record.offset + 48 + i] ^= 0x5A;
+		}
+		writeFile(filename, copy);
+		ReplayStreamReader r2(filename);
+		REQUIRE(r2.getIndex().keyframes.size() == 2);
+		CHECK(r2.read(r2.getIndex().keyframes[0]) == "<k0/>");
+		CHECK_THROWS_AS(r2.read(r2.getIndex().keyframes[1]), MSXException);
+	}
+
+	FileOperations::unlink(filename);
+}
@@ -0,0 +1,74 @@
+#include "catch.hpp"
+#include "ReverseManager.hh"
+#include "xrange.hh"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace openmsx;
+
+using Snapshots = std::vector<std::pair<unsigned, EmuTime>>;
+
+// Take a snapshot every 'interval' seconds (like ReverseManager, with
+// sequence numbers in units of 10ms), and thin the history after each one.
+static Snapshots simulate(double interval, double dense, unsigned num)
+{
+	Snapshots snapshots;
+	for (unsigned i = 0; i < num; ++i) {
+		double t = i * interval;
+		snapshots.emplace_back(unsigned(std::round(t * 100.0)),
+		                       EmuTime::zero + EmuDuration(t));
+		auto drop = ReverseManager::thinSnapshots(snapshots, dense);
+		for (auto seqNum : drop) {
+			auto it = std::find_if(snapshots.begin(), snapshots.end(),
+				[&](const std::pair<unsigned, EmuTime>& s) {
+					return s.first == seqNum; });
+			REQUIRE(it != snapshots.end());
+			// never drop a snapshot of the dense part
+			CHECK((EmuTime::zero + EmuDuration(t) - it->second).toDouble() > dense);
+			snapshots.erase(it);
+		}
+	}
+	return snapshots;
+}
+
+static double age(const Snapshots& snapshots, size_t i)
+{
+	return (snapshots.back().second - snapshots[i].second).toDouble();
+}
+
+TEST_CASE("ReverseManager: thinning")
+{
+	for (double interval : {0.2, 1.0, 5.0}) {
+		for (double dense : {0.0, 10.0, 25.0}) {
+			INFO("interval " << interval << " dense " << dense);
+			unsigned num = unsigned(3600 / interval); // one hour
+			auto snapshots = simulate(interval, dense, num);
+
+			// the oldest and the newest snapshot are kept
+			CHECK(snapshots.front().first == 0);
+			CHECK(snapshots.back().second ==
+			      EmuTime::zero + EmuDuration((num - 1) * interval));
+
+			// the newest N snapshots (the dense part) are all kept
+			auto n = size_t(dense / interval) + 1;
+			REQUIRE(snapshots.size() >= n);
+			for (auto i : xrange(snapshots.size() - n, snapshots.size())) {
+				auto j = num - snapshots.size() + i;
+				CHECK(snapshots[i].second ==
+				      EmuTime::zero + EmuDuration(j * interval));
+			}
+
+			// the older part is thinned: the number of snapshots only
+			// grows logarithmically with the length of the history
+			CHECK(snapshots.size() < (n + 200));
+			auto longer = simulate(interval, dense, 4 * num);
+			CHECK(longer.size() < (snapshots.size() + 40));
+			// while the distance between them grows with their age
+			for (auto i : xrange(size_t(1), snapshots.size() - n)) {
+				double gap = (snapshots[i].second - snapshots[i - 1].second).toDouble();
+				CHECK(gap <= ((age(snapshots, i) - dense) / 4.0 + 2 * interval));
+			}
+		}
+	}
+}
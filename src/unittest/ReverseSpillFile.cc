@@ -0,0 +1,151 @@
+#include "catch.hpp"
+#include "ReverseSpillFile.hh"
+#include "DeltaBlock.hh"
+#include "xrange.hh"
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace openmsx;
+
+using Data = std::vector<uint8_t>;
+
+static Data randomData(std::mt19937& gen, size_t size)
+{
+	Data result(size);
+	// only a few different values, so that it's compressible
+	for (auto& b : result) b = uint8_t(gen() % 4);
+	return result;
+}
+
+static Data expand(const DeltaBlock& block)
+{
+	Data result(block.getSize());
+	block.apply(result.data(), result.size());
+	return result;
+}
+
+TEST_CASE("ReverseSpillFile: records")
+{
+	ReverseSpillFile file;
+	std::mt19937 gen(3);
+	std::vector<std::pair<Data, ReverseSpillFile::Record>> records;
+	for (auto i : xrange(1000)) {
+		(void)i;
+		if (!records.empty() && ((gen() % 3) == 0)) {
+			// release a record, its space gets reused
+			records.erase(records.begin() + gen() % records.size());
+		} else {
+			auto data = randomData(gen, gen() % 20000 + 1);
+			auto record = file.write(data.data(), data.size());
+			records.emplace_back(std::move(data), std::move(record));
+		}
+		auto& r = records[gen() % records.size()];
+		auto buf = file.read(r.second);
+		CHECK(memcmp(buf.data(), r.first.data(), r.first.size()) == 0);
+	}
+	records.clear();
+	CHECK(file.getUsedSize() == 0);
+}
+
+// Keeps the writer thread of the spill file busy until 'gate' is opened.
+class BlockingBlock final : public DeltaBlock
+{
+public:
+	BlockingBlock(std::shared_future<void> gate_, size_t size)
+		: DeltaBlock(size), gate(std::move(gate_)) {}
+
+	void apply(uint8_t* dst, size_t size) const override
+	{
+		gate.wait();
+		memset(dst, 0x55, size);
+	}
+	size_t getMemoryUsage(
+		std::unordered_set<const void*>& /*seen*/) const override
+	{
+		return 0;
+	}
+
+private:
+	std::shared_future<void> gate;
+};
+
+TEST_CASE("ReverseSpillFile: snapshots")
+{
+	std::mt19937 gen(5);
+	static const size_t SIZE = 256 * 1024;
+	static const size_t STATE_SIZE = 3000;
+	Data ram1 = randomData(gen, SIZE);
+	Data ram2 = randomData(gen, SIZE / 2);
+
+	// A reference block and a diff against it (of which the delta is
+	// calculated in the background), plus a block of another region.
+	LastDeltaBlocks lastBlocks;
+	auto ref = lastBlocks.createNew(&ram1, ram1.data(), SIZE);
+	Data ram1b = ram1;
+	for (auto i : xrange(100)) { (void)i; ram1b[gen() % SIZE] ^= 0x80; }
+	auto diff = lastBlocks.createNew(&ram1, ram1b.data(), SIZE);
+	auto other = lastBlocks.createNew(&ram2, ram2.data(), SIZE / 2);
+
+	std::promise<void> open;
+	std::shared_future<void> gate = open.get_future().share();
+
+	ReverseSpillFile file;
+	auto s1 = std::make_shared<ReverseSpillFile::Snapshot>();
+	Data state1 = randomData(gen, STATE_SIZE);
+	s1->savestate.resize(STATE_SIZE);
+	memcpy(s1->savestate.data(), state1.data(), STATE_SIZE);
+	s1->deltaBlocks = {ref, std::make_shared<BlockingBlock>(gate, 100)};
+	file.spill(s1, STATE_SIZE);
+
+	auto s2 = std::make_shared<ReverseSpillFile::Snapshot>();
+	Data state2 = randomData(gen, STATE_SIZE / 2);
+	s2->savestate.resize(STATE_SIZE / 2);
+	memcpy(s2->savestate.data(), state2.data(), STATE_SIZE / 2);
+	s2->deltaBlocks = {diff, other};
+	file.spill(s2, STATE_SIZE / 2);
+
+	// The writer is still busy with the first snapshot.
+	CHECK(!s1->done);
+	CHECK(!s2->done);
+
+	// Restore the second snapshot, this has to wait for the writer.
+	std::thread opener([&] {
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		open.set_value();
+	});
+	MemBuffer<uint8_t> state;
+	std::vector<std::shared_ptr<DeltaBlock>> blocks;
+	file.restore(*s2, STATE_SIZE / 2, state, blocks);
+	opener.join();
+	CHECK(s2->done);
+	CHECK(s2->error.empty());
+	CHECK(s2->deltaBlocks.empty()); // only on disk now
+	CHECK(memcmp(state.data(), state2.data(), STATE_SIZE / 2) == 0);
+	REQUIRE(blocks.size() == 2);
+	CHECK(expand(*blocks[0]) == ram1b);
+	CHECK(expand(*blocks[1]) == ram2);
+
+	file.restore(*s1, STATE_SIZE, state, blocks);
+	CHECK(memcmp(state.data(), state1.data(), STATE_SIZE) == 0);
+	REQUIRE(blocks.size() == 2);
+	CHECK(expand(*blocks[0]) == ram1);
+	CHECK(expand(*blocks[1]) == Data(100, 0x55));
+
+	// the spilled snapshots don't depend on the original blocks anymore
+	blocks.clear();
+	ref.reset();
+	diff.reset();
+	other.reset();
+	lastBlocks.clear();
+	file.restore(*s2, STATE_SIZE / 2, state, blocks);
+	CHECK(expand(*blocks[0]) == ram1b);
+
+	blocks.clear();
+	s1.reset();
+	s2.reset();
+	CHECK(file.getUsedSize() == 0);
+}
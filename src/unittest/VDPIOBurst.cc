@@ -0,0 +1,176 @@
+#include "catch.hpp"
+#include "Reactor.hh"
+#include "MSXMotherBoard.hh"
+#include "MSXCPU.hh"
+#include "MSXCPUInterface.hh"
+#include "CPURegs.hh"
+#include "Interpreter.hh"
+#include "EmuDuration.hh"
+#include "File.hh"
+#include "FileOperations.hh"
+#include "Thread.hh"
+#include "strCat.hh"
+#include <cstring>
+#include <string>
+
+using namespace openmsx;
+
+static const char* const MACHINE_CONFIG =
+	"<?xml version=\"1.0\" ?>\n"
+	"<!DOCTYPE msxconfig SYSTEM 'msxconfig2.dtd'>\n"
+	"<msxconfig>\n"
+	"  <info>\n"
+	"    <manufacturer>openMSX</manufacturer>\n"
+	"    <code>VDP I/O burst test</code>\n"
+	"    <description>Machine with only RAM and a VDP.</description>\n"
+	"    <type>MSX2</type>\n"
+	"  </info>\n"
+	"  <devices>\n"
+	"    <VDP id=\"VDP\">\n"
+	"      <version>V9938</version>\n"
+	"      <vram>128</vram>\n"
+	"      <io base=\"0x98\" num=\"4\"/>\n"
+	"    </VDP>\n"
+	"    <primary slot=\"0\">\n"
+	"      <MemoryMapper id=\"Main RAM\">\n"
+	"        <mem base=\"0x0000\" size=\"0x10000\"/>\n"
+	"        <size>64</size>\n"
+	"      </MemoryMapper>\n"
+	"    </primary>\n"
+	"  </devices>\n"
+	"</msxconfig>\n";
+
+// Loaded at address 0x0100. Starts a VDP command (LMMV) and while that's
+// executing uploads 16 times 256 bytes to VRAM with OTIR. The command ends
+// during one of the bursts, and the VDP status changes (vertical blanking)
+// several times. Then waits for the command to end.
+static const byte PROGRAM[] = {
+	0xF3,                   //       di
+	0x3E, 0x06,             //       ld   a,06h   ; R#0: G4 (screen 5)
+	0xD3, 0x99,             //       out  (99h),a
+	0x3E, 0x80,             //       ld   a,80h
+	0xD3, 0x99,             //       out  (99h),a
+	0x3E, 0x40,             //       ld   a,40h   ; R#1: display on
+	0xD3, 0x99,             //       out  (99h),a
+	0x3E, 0x81,             //       ld   a,81h
+	0xD3, 0x99,             //       out  (99h),a
+	0x3E, 0x24,             //       ld   a,36    ; R#17: 36, auto-incr
+	0xD3, 0x99,             //       out  (99h),a
+	0x3E, 0x91,             //       ld   a,91h
+	0xD3, 0x99,             //       out  (99h),a
+	0x21, 0x00, 0x02,       //       ld   hl,0200h
+	0x01, 0x9B, 0x0B,       //       ld   bc,0B9Bh
+	0xED, 0xB3,             //       otir         ; R#36-46, start LMMV
+	0xAF,                   //       xor  a       ; VRAM write address 0
+	0xD3, 0x99,             //       out  (99h),a
+	0x3E, 0x40,             //       ld   a,40h
+	0xD3, 0x99,             //       out  (99h),a
+	0x16, 0x10,             //       ld   d,16
+	0x21, 0x00, 0x40,       // loop: ld   hl,4000h
+	0x01, 0x98, 0x00,       //       ld   bc,0098h
+	0xED, 0xB3,             //       otir
+	0x15,                   //       dec  d
+	0x20, 0xF5,             //       jr   nz,loop
+	0x3E, 0x02,             //       ld   a,2     ; select S#2
+	0xD3, 0x99,             //       out  (99h),a
+	0x3E, 0x8F,             //       ld   a,8Fh
+	0xD3, 0x99,             //       out  (99h),a
+	0x11, 0x00, 0x00,       //       ld   de,0
+	0x13,                   // wait: inc  de
+	0xDB, 0x99,             //       in   a,(99h)
+	0x0F,                   //       rrca         ; CE
+	0x38, 0xFA,             //       jr   c,wait
+	0xED, 0x53, 0x00, 0x03, //       ld   (0300h),de
+	0xED, 0x5F,             //       ld   a,r
+	0x32, 0x02, 0x03,       //       ld   (0302h),a
+	0xAF,                   //       xor  a       ; select S#0
+	0xD3, 0x99,             //       out  (99h),a
+	0x3E, 0x8F,             //       ld   a,8Fh
+	0xD3, 0x99,             //       out  (99h),a
+	0x18, 0xFE,             // end:  jr   end
+};
+
+// LMMV (256 x 8 pixels at (0, 256), color 10), loaded at address 0x0200.
+static const byte COMMAND[] = {
+	0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x08, 0x00, 0x0A, 0x00, 0x80,
+};
+
+struct Result {
+	std::string vram;
+	std::string ram; // 0x0300-0x0302
+	unsigned pc;
+};
+
+static Result run(Reactor& reactor, bool burst)
+{
+	std::string config = strCat(FileOperations::getTempDir(),
+	                            "/openmsx-vdpioburst-test");
+	{
+		File file(config + ".xml", File::TRUNCATE);
+		file.write(MACHINE_CONFIG, strlen(MACHINE_CONFIG));
+	}
+	reactor.switchMachine(config);
+	FileOperations::unlink(config + ".xml");
+	auto& board = *reactor.getMotherBoard();
+	board.powerUp();
+
+	auto& interface = board.getCPUInterface();
+	auto time = board.getCurrentTime();
+	for (unsigned i = 0; i < sizeof(PROGRAM); ++i) {
+		interface.writeMem(0x0100 + i, PROGRAM[i], time);
+	}
+	for (unsigned i = 0; i < sizeof(COMMAND); ++i) {
+		interface.writeMem(0x0200 + i, COMMAND[i], time);
+	}
+	for (unsigned i = 0; i < 256; ++i) {
+		interface.writeMem(0x4000 + i, byte(i * 7 + 3), time);
+	}
+	auto& cpu = board.getCPU();
+	auto& regs = cpu.getRegisters();
+	regs.setPC(0x0100);
+	regs.setIFF1(false);
+	regs.setIFF2(false);
+	regs.setHALT(false);
+	// With a stop address the CPU executes one instruction at a time,
+	// then OTIR doesn't use the burst path.
+	if (!burst) cpu.setStopAddress(0xFFFF);
+	board.fastForward(time + EmuDuration::msec(60), true);
+
+	Result result;
+	auto& interp = reactor.getInterpreter();
+	auto vram = interp.execute("debug read_block VRAM 0 0x20000");
+	unsigned length;
+	auto* data = vram.getBinary(length);
+	result.vram.assign(reinterpret_cast<const char*>(data), length);
+	for (unsigned i = 0x0300; i < 0x0303; ++i) {
+		result.ram += char(interface.peekMem(i, board.getCurrentTime()));
+	}
+	result.pc = regs.getPC();
+	return result;
+}
+
+TEST_CASE("VDP I/O burst")
+{
+	Thread::setMainThread();
+	Reactor reactor;
+	reactor.init();
+	reactor.getInterpreter().execute("set renderer none");
+
+	auto slow = run(reactor, false);
+	auto fast = run(reactor, true);
+
+	REQUIRE(slow.vram.size() == 0x20000);
+	for (unsigned i = 0; i < 0x1000; ++i) {
+		CHECK(byte(slow.vram[i]) == byte((i & 0xFF) * 7 + 3));
+	}
+	for (unsigned i = 0x8000; i < 0x8400; ++i) {
+		CHECK(byte(slow.vram[i]) == 0xAA);
+	}
+	CHECK(slow.pc == 0x0156); // jr end
+
+	// Same VRAM, same timing (the number of status reads and the
+	// R register depend on it).
+	CHECK(fast.vram == slow.vram);
+	CHECK(fast.ram == slow.ram);
+	CHECK(fast.pc == slow.pc);
+}
@@ -0,0 +1,59 @@
+#include "catch.hpp"
+#include "WatchPointIndex.hh"
+#include "WatchPoint.hh"
+#include "TclObject.hh"
+#include <tcl.h>
+
+using namespace openmsx;
+
+static std::shared_ptr<WatchPoint> create(unsigned begin, unsigned end)
+{
+	return std::make_shared<WatchPoint>(
+		TclObject(), TclObject(), WatchPoint::WRITE_MEM, begin, end);
+}
+
+static std::vector<WatchPoint*> find(const WatchPointIndex& index, unsigned address)
+{
+	std::vector<WatchPoint*> result;
+	for (auto& w : index.find(address)) result.push_back(w.get());
+	return result;
+}
+
+TEST_CASE("WatchPointIndex")
+{
+	// WatchPoint holds TclObjects, normally Interpreter initializes Tcl
+	Tcl_FindExecutable(nullptr);
+
+	WatchPointIndex index;
+	CHECK(index.empty());
+	CHECK(find(index, 0x1234).empty());
+
+	auto a = create(0x100, 0x1FF);
+	auto b = create(0x180, 0x180);
+	auto c = create(0x150, 0x300);
+	index.insert(a);
+	index.insert(b);
+	index.insert(c);
+	CHECK(!index.empty());
+
+	using V = std::vector<WatchPoint*>;
+	CHECK(find(index, 0x0FF) == V{});
+	CHECK(find(index, 0x100) == (V{a.get()}));
+	CHECK(find(index, 0x150) == (V{a.get(), c.get()}));
+	CHECK(find(index, 0x17F) == (V{a.get(), c.get()}));
+	CHECK(find(index, 0x180) == (V{a.get(), b.get(), c.get()})); // insertion order
+	CHECK(find(index, 0x181) == (V{a.get(), c.get()}));
+	CHECK(find(index, 0x1FF) == (V{a.get(), c.get()}));
+	CHECK(find(index, 0x200) == (V{c.get()}));
+	CHECK(find(index, 0x300) == (V{c.get()}));
+	CHECK(find(index, 0x301) == V{});
+	CHECK(find(index, 0xFFFF) == V{});
+
+	index.remove(*a);
+	CHECK(find(index, 0x100) == V{});
+	CHECK(find(index, 0x180) == (V{b.get(), c.get()}));
+	index.remove(*b);
+	index.remove(*c);
+	CHECK(index.empty());
+	CHECK(find(index, 0x180) == V{});
+}
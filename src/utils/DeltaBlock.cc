@@ -1,10 +1,13 @@
 #include "DeltaBlock.hh"
+#include "ThreadPool.hh"
 #include "snappy.hh"
+#include "xxhash.hh"
 #include "likely.hh"
 #include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <tuple>
+#include <unordered_map>
 #include <utility>
 #if STATISTICS
 #include <iostream>
@@ -12,11 +15,40 @@
 #ifdef __SSE2__
 #include <emmintrin.h>
 #endif
+#if defined(__x86_64__) && defined(__GNUC__)
+// AVX2 versions of the hot loops. Not all x86_64 CPUs support AVX2 (all do
+// support SSE2), so these are compiled with a function-specific target
+// attribute and only used after a run-time check.
+#define DELTA_BLOCK_AVX2
+#include <immintrin.h>
+#endif
 
 namespace openmsx {
 
 using std::vector;
 
+// --- Run-time CPU detection ---
+
+#ifdef DELTA_BLOCK_AVX2
+static bool detectAVX2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+static const bool cpuHasAVX2 = detectAVX2();
+static std::atomic<bool> useAVX2(cpuHasAVX2);
+#endif
+
+bool DeltaBlock::setUseAVX2(bool enable)
+{
+#ifdef DELTA_BLOCK_AVX2
+	return useAVX2.exchange(enable && cpuHasAVX2);
+#else
+	(void)enable;
+	return false;
+#endif
+}
+
 // --- Compressed integers ---
 
 // See https://en.wikipedia.org/wiki/LEB128 for a description of the
@@ -73,6 +105,25 @@ template<> bool comp<16>(const uint8_t* p, const uint8_t* q)
 }
 #endif
 
+#ifdef DELTA_BLOCK_AVX2
+// Compare 32-bytes-at-a-time until a difference is found (there must be one,
+// see the sentinel in scan_mismatch()). Returns the position of the first
+// different byte. Loads don't need to be aligned.
+__attribute__((target("avx2")))
+static const uint8_t* mismatch32(const uint8_t* p, const uint8_t* q)
+{
+	while (true) {
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q));
+		unsigned eq = _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+		if (eq != 0xffffffff) {
+			return p + __builtin_ctz(~eq);
+		}
+		p += 32; q += 32;
+	}
+}
+#endif
+
 
 // --- Optimized mismatch function ---
 
@@ -90,9 +141,8 @@ static std::pair<const uint8_t*, const uint8_t*> scan_mismatch(
 	assert((p_end - p) == (q_end - q));
 
 	// When SSE is available, work with 16-byte words, otherwise 4 or 8
-	// bytes. This routine also benefits from AVX2 instructions. Though not
-	// all x86_64 CPUs have AVX2 (all have SSE2), so using them requires
-	// extra run-time checks and that's not worth it at this point.
+	// bytes. When the CPU supports AVX2 the fast path below uses 32-byte
+	// words (for that alignment to 16 bytes is good enough).
 	static const int WORD_SIZE =
 #ifdef __SSE2__
 		sizeof(__m128i);
@@ -116,6 +166,22 @@ static std::pair<const uint8_t*, const uint8_t*> scan_mismatch(
 		} while (reinterpret_cast<uintptr_t>(p) & (WORD_SIZE - 1));
 	}
 
+#ifdef DELTA_BLOCK_AVX2
+	if (useAVX2.load(std::memory_order_relaxed) && ((p_end - p) >= 64)) {
+		// Same as below, but the sentinel must be 32 bytes before the
+		// end, so that the last 32-byte load stays within the buffer.
+		auto* sentinel = &const_cast<uint8_t*>(p_end)[-32];
+		auto save = *sentinel;
+		*sentinel = ~q_end[-32];
+
+		auto* p2 = mismatch32(p, q);
+		q += p2 - p; p = p2;
+
+		*sentinel = save;
+		goto end;
+	}
+#endif
+
 	// Fast path. Compare words-at-a-time.
 	{
 		// Place a sentinel in the last full word. This ensures we'll
@@ -182,36 +248,38 @@ static std::pair<const uint8_t*, const uint8_t*> scan_match(
 //   n2 number of bytes are different, and here are the bytes
 //   n3 number of bytes are equal
 //   ...
-static vector<uint8_t> calcDelta(const uint8_t* oldBuf, const uint8_t* newBuf, size_t size)
+// The scan functions above temporarily place sentinels in 'newBuf'. 'oldBuf'
+// is only read, so other threads can read it at the same time.
+static vector<uint8_t> calcDelta(const uint8_t* oldBuf, uint8_t* newBuf, size_t size)
 {
 	vector<uint8_t> result;
 
-	auto* p = oldBuf;
-	auto* q = newBuf;
+	const uint8_t* p = newBuf;
+	const uint8_t* q = oldBuf;
 	auto* p_end = p + size;
 	auto* q_end = q + size;
 
 	// scan equal bytes (possibly zero)
-	auto* q1 = q;
+	auto* p1 = p;
 	std::tie(p, q) = scan_mismatch(p, p_end, q, q_end);
-	auto n1 = q - q1;
+	auto n1 = p - p1;
 	storeUleb(result, n1);
 
-	while (q != q_end) {
+	while (p != p_end) {
 		assert(*p != *q);
 
-		auto* q2 = q;
+		auto* p2 = p;
 	different:
 		std::tie(p, q) = scan_match(p + 1, p_end, q + 1, q_end);
-		auto n2 = q - q2;
+		auto n2 = p - p2;
 
-		auto* q3 = q;
+		auto* p3 = p;
 		std::tie(p, q) = scan_mismatch(p, p_end, q, q_end);
-		auto n3 = q - q3;
-		if ((q != q_end) && (n3 <= 2)) goto different;
+		auto n3 = p - p3;
+		if ((p != p_end) && (n3 <= 2)) goto different;
 
 		storeUleb(result, n2);
-		result.insert(result.end(), q2, q3);
+		result.insert(result.end(), p2, p3);
 
 		if (n3 != 0) storeUleb(result, n3);
 	}
@@ -221,7 +289,7 @@ static vector<uint8_t> calcDelta(const uint8_t* oldBuf, const uint8_t* newBuf, s
 }
 
 // Apply a previously calculated 'delta' to 'oldBuf' to get 'newbuf'.
-static void applyDeltaInPlace(uint8_t* buf, size_t size, const uint8_t* delta)
+static void applyDeltaInPlaceScalar(uint8_t* buf, size_t size, const uint8_t* delta)
 {
 	auto* end = buf + size;
 
@@ -237,11 +305,271 @@ static void applyDeltaInPlace(uint8_t* buf, size_t size, const uint8_t* delta)
 	}
 }
 
+#ifdef DELTA_BLOCK_AVX2
+// Most runs of different bytes in a delta are short. For those the overhead of
+// calling memcpy() dominates. This copies them inline, using (possibly
+// overlapping) 32-byte (or smaller) loads and stores that all stay within the
+// run.
+__attribute__((target("avx2")))
+static inline void copyRun(uint8_t* dst, const uint8_t* src, size_t n)
+{
+	if (n >= 32) {
+		auto* dstLast = dst + n - 32;
+		auto* srcLast = src + n - 32;
+		while (dst < dstLast) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst),
+				_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)));
+			dst += 32; src += 32;
+		}
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dstLast),
+			_mm256_loadu_si256(reinterpret_cast<const __m256i*>(srcLast)));
+	} else if (n >= 16) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n - 16));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), a);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n - 16), b);
+	} else if (n >= 8) {
+		uint64_t a, b;
+		memcpy(&a, src, 8); memcpy(&b, src + n - 8, 8);
+		memcpy(dst, &a, 8); memcpy(dst + n - 8, &b, 8);
+	} else if (n >= 4) {
+		uint32_t a, b;
+		memcpy(&a, src, 4); memcpy(&b, src + n - 4, 4);
+		memcpy(dst, &a, 4); memcpy(dst + n - 4, &b, 4);
+	} else {
+		for (size_t i = 0; i < n; ++i) dst[i] = src[i];
+	}
+}
+
+__attribute__((target("avx2")))
+static void applyDeltaInPlaceAVX2(uint8_t* buf, size_t size, const uint8_t* delta)
+{
+	auto* end = buf + size;
+
+	while (buf != end) {
+		auto n1 = loadUleb(delta);
+		buf += n1;
+		if (buf == end) break;
+
+		auto n2 = loadUleb(delta);
+		copyRun(buf, delta, n2);
+		buf   += n2;
+		delta += n2;
+	}
+}
+#endif
+
+static void applyDeltaInPlace(uint8_t* buf, size_t size, const uint8_t* delta)
+{
+#ifdef DELTA_BLOCK_AVX2
+	if (useAVX2.load(std::memory_order_relaxed)) {
+		applyDeltaInPlaceAVX2(buf, size, delta);
+		return;
+	}
+#endif
+	applyDeltaInPlaceScalar(buf, size, delta);
+}
+
+
+// --- Background work ---
+
+// Calculating deltas and compressing blocks is done by a pool of worker
+// threads, so that taking a snapshot on the emulation thread only costs a
+// memcpy. When the workers fall behind (e.g. on a slow host, or with a very
+// short snapshot interval) the amount of memory waiting to be processed could
+// grow without bound. So above this limit the work is done right away on the
+// calling thread instead (like before there were worker threads).
+static const size_t MAX_PENDING_BYTES = 64 * 1024 * 1024;
+static std::atomic<size_t> pendingBytes(0);
+
+static ThreadPool& getWorkers()
+{
+	static ThreadPool workers(ThreadPool::defaultNumThreads());
+	return workers;
+}
+
+// 'bytes' is the amount of memory that 'job' will process.
+template<typename Job> static void runInBackground(size_t bytes, Job job)
+{
+	// Check and reserve in one atomic step, the workers concurrently
+	// subtract from 'pendingBytes'.
+	size_t pending = pendingBytes;
+	do {
+		if ((pending + bytes) > MAX_PENDING_BYTES) {
+			job();
+			return;
+		}
+	} while (!pendingBytes.compare_exchange_weak(pending, pending + bytes));
+	getWorkers().add([bytes, job]() {
+		job();
+		pendingBytes -= bytes;
+	});
+}
+
+
+// --- Content-addressed chunk store ---
+
+// The compressed data of all DeltaBlockCopy objects is split in chunks of this
+// size. Large parts of the emulated memory are often identical (zero-filled
+// mapper pages, RAM that mirrors ROM, repeated VRAM tables, ...), both between
+// consecutive reference blocks and between different machines. Each distinct
+// chunk is only stored once.
+static const size_t CHUNK_SIZE = 4096;
+
+struct DeltaBlockCopy::Chunk
+{
+	Chunk(const uint8_t* data, size_t size, uint32_t hash_);
+	~Chunk();
+	bool equals(const uint8_t* data, size_t size) const;
+	void uncompress(uint8_t* dst) const;
+
+	MemBuffer<uint8_t> buf;
+	size_t storedSize; // when equal to 'rawSize' the data is not compressed
+	size_t rawSize;
+	uint32_t hash;
+};
+
+namespace {
+// All chunks, indexed on the hash of their (uncompressed) content. The store
+// doesn't own the chunks, the DeltaBlockCopy objects do. The last owner
+// removes a chunk from the store. Chunks are created and destroyed on
+// several threads, hence the mutex.
+class ChunkStore
+{
+public:
+	using Chunk = DeltaBlockCopy::Chunk;
+
+	std::shared_ptr<const Chunk> get(const uint8_t* data, size_t size);
+	void remove(const Chunk& chunk);
+	DeltaBlock::ChunkStats getStats();
+
+private:
+	struct Entry {
+		std::weak_ptr<const Chunk> weak;
+		const Chunk* chunk;
+	};
+	std::mutex mutex;
+	std::unordered_multimap<uint32_t, Entry> chunks;
+	size_t storedSize = 0;
+	std::atomic<size_t> sharedRefs{0};
+};
+}
+
+static ChunkStore& getChunkStore()
+{
+	// Intentionally never destroyed: chunks can still be released by the
+	// worker threads (or by other static objects) during program exit.
+	static ChunkStore& store = *new ChunkStore();
+	return store;
+}
+
+DeltaBlockCopy::Chunk::Chunk(const uint8_t* data, size_t size, uint32_t hash_)
+	: rawSize(size), hash(hash_)
+{
+	size_t dstLen = snappy::maxCompressedLength(size);
+	MemBuffer<uint8_t> tmp(dstLen);
+	snappy::compress(reinterpret_cast<const char*>(data), size,
+	                 reinterpret_cast<char*>(tmp.data()), dstLen);
+	if (dstLen < size) {
+		storedSize = dstLen;
+		buf.swap(tmp);
+		buf.resize(storedSize); // shrink to fit
+	} else {
+		// compression isn't beneficial
+		storedSize = size;
+		buf.resize(size);
+		memcpy(buf.data(), data, size);
+	}
+}
+
+DeltaBlockCopy::Chunk::~Chunk()
+{
+	getChunkStore().remove(*this);
+}
+
+void DeltaBlockCopy::Chunk::uncompress(uint8_t* dst) const
+{
+	if (storedSize == rawSize) {
+		memcpy(dst, buf.data(), rawSize);
+	} else {
+		snappy::uncompress(
+			reinterpret_cast<const char*>(buf.data()), storedSize,
+			reinterpret_cast<char*>(dst), rawSize);
+	}
+}
+
+bool DeltaBlockCopy::Chunk::equals(const uint8_t* data, size_t size) const
+{
+	// The hash only selects candidates, the content must be compared.
+	if (size != rawSize) return false;
+	uint8_t tmp[CHUNK_SIZE];
+	uncompress(tmp);
+	return memcmp(tmp, data, size) == 0;
+}
+
+std::shared_ptr<const DeltaBlockCopy::Chunk> ChunkStore::get(
+	const uint8_t* data, size_t size)
+{
+	auto hash = xxhash(string_view(reinterpret_cast<const char*>(data), size));
+	// Note: the candidates must be released after 'mutex' is unlocked,
+	// because releasing the last reference to a chunk locks 'mutex'.
+	std::vector<std::shared_ptr<const Chunk>> candidates;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto range = chunks.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it) {
+			// lock() fails for a chunk that is being destroyed
+			if (auto chunk = it->second.weak.lock()) {
+				candidates.push_back(std::move(chunk));
+			}
+		}
+	}
+	for (auto& chunk : candidates) {
+		if (chunk->equals(data, size)) {
+			++sharedRefs;
+			return chunk;
+		}
+	}
+	// Compress without holding the lock. Another thread may store the same
+	// content in the meantime, then it's (harmlessly) stored twice.
+	auto chunk = std::make_shared<const Chunk>(data, size, hash);
+	std::lock_guard<std::mutex> lock(mutex);
+	chunks.emplace(hash, Entry{chunk, chunk.get()});
+	storedSize += chunk->storedSize;
+	return chunk;
+}
+
+void ChunkStore::remove(const Chunk& chunk)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto range = chunks.equal_range(chunk.hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second.chunk == &chunk) {
+			chunks.erase(it);
+			storedSize -= chunk.storedSize;
+			return;
+		}
+	}
+	assert(false);
+}
+
+DeltaBlock::ChunkStats ChunkStore::getStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return {chunks.size(), storedSize, sharedRefs};
+}
+
+DeltaBlock::ChunkStats DeltaBlock::getChunkStats()
+{
+	return getChunkStore().getStats();
+}
+
+
 #if STATISTICS
 
 // class DeltaBlock
 
-size_t DeltaBlock::globalAllocSize = 0;
+std::atomic<size_t> DeltaBlock::globalAllocSize(0);
 
 DeltaBlock::~DeltaBlock()
 {
@@ -255,13 +583,15 @@ DeltaBlock::~DeltaBlock()
 // class DeltaBlockCopy
 
 DeltaBlockCopy::DeltaBlockCopy(const uint8_t* data, size_t size)
-	: block(size)
-	, compressedSize(0)
+	: DeltaBlock(size)
+	, compressing(false)
 {
 #ifdef DEBUG
 	sha1 = SHA1::calc(data, size);
 #endif
-	memcpy(block.data(), data, size);
+	auto buf = std::make_shared<MemBuffer<uint8_t>>(size);
+	memcpy(buf->data(), data, size);
+	block = std::move(buf);
 	assert(!compressed());
 #if STATISTICS
 	allocSize = size;
@@ -271,54 +601,110 @@ DeltaBlockCopy::DeltaBlockCopy(const uint8_t* data, size_t size)
 #endif
 }
 
+void DeltaBlockCopy::getData(Block& data, Chunks& chunks_) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	data = block;
+	chunks_ = chunks;
+}
+
 void DeltaBlockCopy::apply(uint8_t* dst, size_t size) const
 {
-	if (compressed()) {
-		snappy::uncompress(
-			reinterpret_cast<const char*>(block.data()), compressedSize,
-			reinterpret_cast<char*>(dst), size);
+	Block data;
+	Chunks chunks_;
+	getData(data, chunks_);
+	if (data) {
+		memcpy(dst, data->data(), size);
 	} else {
-		memcpy(dst, block.data(), size);
+		uncompress(chunks_, dst, size);
 	}
 #ifdef DEBUG
 	assert(SHA1::calc(dst, size) == sha1);
 #endif
 }
 
+size_t DeltaBlockCopy::getMemoryUsage(
+	std::unordered_set<const void*>& seen) const
+{
+	if (!seen.insert(this).second) return 0;
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!compressed()) return getSize();
+	// Chunks that are shared with other blocks are only counted once.
+	size_t result = 0;
+	for (auto& chunk : chunks) {
+		if (seen.insert(chunk.get()).second) {
+			result += chunk->storedSize;
+		}
+	}
+	return result;
+}
+
+void DeltaBlockCopy::uncompress(const Chunks& chunks_, uint8_t* dst, size_t size)
+{
+	(void)size;
+	assert(chunks_.size() == (size + CHUNK_SIZE - 1) / CHUNK_SIZE);
+	for (auto& chunk : chunks_) {
+		chunk->uncompress(dst);
+		dst += chunk->rawSize;
+	}
+}
+
 void DeltaBlockCopy::compress(size_t size)
 {
-	if (compressed()) return;
+	Block old;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (compressed() || compressing) return;
+		compressing = true;
+		old = block;
+	}
 
-	size_t dstLen = snappy::maxCompressedLength(size);
-	MemBuffer<uint8_t> buf2(dstLen);
-	snappy::compress(reinterpret_cast<const char*>(block.data()), size,
-	                 reinterpret_cast<char*>(buf2.data()), dstLen);
-	if (dstLen >= size) {
-		// compression isn't beneficial
-		return;
+	auto& store = getChunkStore();
+	Chunks newChunks;
+	newChunks.reserve((size + CHUNK_SIZE - 1) / CHUNK_SIZE);
+	for (size_t pos = 0; pos < size; pos += CHUNK_SIZE) {
+		newChunks.push_back(store.get(
+			old->data() + pos, std::min(CHUNK_SIZE, size - pos)));
 	}
-	compressedSize = dstLen;
-	block.swap(buf2);
-	block.resize(compressedSize); // shrink to fit
+
+	// Note: 'old' (and so possibly the data) is released after the lock.
+	std::lock_guard<std::mutex> lock(mutex);
+	compressing = false;
+	chunks.swap(newChunks);
+	block.reset();
 	assert(compressed());
 #ifdef DEBUG
 	MemBuffer<uint8_t> buf3(size);
-	apply(buf3.data(), size);
-	assert(memcmp(buf3.data(), buf2.data(), size) == 0);
+	uncompress(chunks, buf3.data(), size);
+	assert(memcmp(buf3.data(), old->data(), size) == 0);
 #endif
 #if STATISTICS
-	int delta = compressedSize - allocSize;
-	allocSize = compressedSize;
+	// This counts shared chunks in each block that refers to them.
+	size_t newSize = 0;
+	for (auto& chunk : chunks) newSize += chunk->storedSize;
+	int delta = int(newSize) - int(allocSize);
+	allocSize = newSize;
 	globalAllocSize += delta;
 	std::cout << "stat: compress " << globalAllocSize
 	          << " (" << delta << ')' << std::endl;
 #endif
 }
 
-const uint8_t* DeltaBlockCopy::getData()
+vector<uint8_t> DeltaBlockCopy::calcDelta(uint8_t* data, size_t size) const
 {
-	assert(!compressed());
-	return block.data();
+	// Only hold the lock to get (and keep alive) the data, several deltas
+	// against this block can then be calculated at the same time.
+	Block ref;
+	Chunks chunks_;
+	getData(ref, chunks_);
+	if (likely(ref != nullptr)) {
+		return openmsx::calcDelta(ref->data(), data, size);
+	}
+	// The worker threads may have compressed this block before all
+	// deltas against it were calculated. This is rare.
+	MemBuffer<uint8_t> buf(size);
+	uncompress(chunks_, buf.data(), size);
+	return openmsx::calcDelta(buf.data(), data, size);
 }
 
 
@@ -327,26 +713,55 @@ const uint8_t* DeltaBlockCopy::getData()
 DeltaBlockDiff::DeltaBlockDiff(
 		std::shared_ptr<DeltaBlockCopy> prev_,
 		const uint8_t* data, size_t size)
-	: prev(std::move(prev_))
-	, delta(calcDelta(prev->getData(), data, size))
+	: DeltaBlock(size)
+	, prev(std::move(prev_))
+	, copy(size)
 {
+	memcpy(copy.data(), data, size);
 #ifdef DEBUG
 	sha1 = SHA1::calc(data, size);
-
-	MemBuffer<uint8_t> buf(size);
-	apply(buf.data(), size);
-	assert(memcmp(buf.data(), data, size) == 0);
 #endif
 #if STATISTICS
-	allocSize = delta.size();
+	allocSize = size;
 	globalAllocSize += allocSize;
 	std::cout << "stat: DeltaBlockDiff " << globalAllocSize
 	          << " (+" << allocSize << ')' << std::endl;
 #endif
 }
 
+size_t DeltaBlockDiff::calcDelta(size_t size)
+{
+	// calcDelta() temporarily modifies 'copy', so keep 'mutex' locked.
+	std::lock_guard<std::mutex> lock(mutex);
+	if (copy.empty()) return delta.size(); // already calculated
+	delta = prev->calcDelta(copy.data(), size);
+	copy.clear();
+#ifdef DEBUG
+	MemBuffer<uint8_t> buf(size);
+	prev->apply(buf.data(), size);
+	applyDeltaInPlace(buf.data(), size, delta.data());
+	assert(SHA1::calc(buf.data(), size) == sha1);
+#endif
+#if STATISTICS
+	int diff = int(delta.size()) - int(allocSize);
+	allocSize = delta.size();
+	globalAllocSize += diff;
+	std::cout << "stat: calcDelta " << globalAllocSize
+	          << " (" << diff << ')' << std::endl;
+#endif
+	return delta.size();
+}
+
 void DeltaBlockDiff::apply(uint8_t* dst, size_t size) const
 {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!copy.empty()) {
+			// delta not yet calculated
+			memcpy(dst, copy.data(), size);
+			return;
+		}
+	}
 	prev->apply(dst, size);
 	applyDeltaInPlace(dst, size, delta.data());
 #ifdef DEBUG
@@ -354,9 +769,13 @@ void DeltaBlockDiff::apply(uint8_t* dst, size_t size) const
 #endif
 }
 
-size_t DeltaBlockDiff::getDeltaSize() const
+size_t DeltaBlockDiff::getMemoryUsage(
+	std::unordered_set<const void*>& seen) const
 {
-	return delta.size();
+	if (!seen.insert(this).second) return 0;
+	size_t result = prev->getMemoryUsage(seen);
+	std::lock_guard<std::mutex> lock(mutex);
+	return result + (copy.empty() ? delta.capacity() : getSize());
 }
 
 
@@ -376,11 +795,19 @@ std::shared_ptr<DeltaBlock> LastDeltaBlocks::createNew(
 	assert(it->size == size);
 
 	auto ref = it->ref.lock();
+	if (auto diff = it->lastDiff.lock()) {
+		// Normally a worker thread calculated this delta long ago,
+		// otherwise we wait for it (or calculate it right here). This
+		// way 'accSize' doesn't depend on the timing of the workers
+		// and the emulation stays deterministic.
+		it->accSize += diff->calcDelta(size);
+	}
+	it->lastDiff.reset();
 	if (it->accSize >= size || !ref) {
 		if (ref) {
 			// We will switch to a new DeltaBlockCopy object. So
 			// now is a good time to compress the old one.
-			ref->compress(size);
+			runInBackground(size, [ref, size]() { ref->compress(size); });
 		}
 		// Heuristic: create a new block when too many small
 		// differences have accumulated.
@@ -394,7 +821,8 @@ std::shared_ptr<DeltaBlock> LastDeltaBlocks::createNew(
 		// Reference remains unchanged.
 		auto b = std::make_shared<DeltaBlockDiff>(ref, data, size);
 		it->last = b;
-		it->accSize += b->getDeltaSize();
+		it->lastDiff = b;
+		runInBackground(size, [b, size]() { b->calcDelta(size); });
 		return b;
 	}
 }
@@ -416,6 +844,7 @@ std::shared_ptr<DeltaBlock> LastDeltaBlocks::createNullDiff(
 		auto b = std::make_shared<DeltaBlockCopy>(data, size);
 		it->ref = b;
 		it->last = b;
+		it->lastDiff.reset();
 		it->accSize = 0;
 		return b;
 	} else {
@@ -430,7 +859,8 @@ void LastDeltaBlocks::clear()
 {
 	for (const Info& info : infos) {
 		if (auto ref = info.ref.lock()) {
-			ref->compress(info.size);
+			auto size = info.size;
+			runInBackground(size, [ref, size]() { ref->compress(size); });
 		}
 	}
 	infos.clear();
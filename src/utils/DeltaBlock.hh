@@ -4,8 +4,11 @@
 #define STATISTICS 0
 
 #include "MemBuffer.hh"
+#include <atomic>
 #include <cstdint>
 #include <memory>
+#include <mutex>
+#include <unordered_set>
 #include <vector>
 #ifdef DEBUG
 #include "sha1.hh"
@@ -23,8 +26,40 @@ public:
 #endif
 	virtual void apply(uint8_t* dst, size_t size) const = 0;
 
+	/** The size of the data in this block (this is the size that must be
+	  * passed to apply()). */
+	size_t getSize() const { return blockSize; }
+
+	/** Approximate amount of memory used by this block and by the blocks
+	  * it depends on. Blocks and (shared) chunks that are already in
+	  * 'seen' are not counted (again), the counted ones are added to
+	  * 'seen'.
+	  */
+	virtual size_t getMemoryUsage(
+		std::unordered_set<const void*>& seen) const = 0;
+
+	/** Enable or disable the AVX2 code paths (they're only used when the
+	  * CPU supports AVX2, by default they are enabled). Only meant for
+	  * testing and benchmarking. Returns the previous setting.
+	  */
+	static bool setUseAVX2(bool enable);
+
+	/** The (compressed) data of reference blocks is split in fixed-size
+	  * chunks. Chunks with identical content are only stored once, also
+	  * when they belong to different blocks or different machines.
+	  */
+	struct ChunkStats {
+		size_t numChunks;  // number of distinct chunks
+		size_t storedSize; // total size of all distinct chunks
+		size_t sharedRefs; // references to chunks that were already stored
+	};
+	static ChunkStats getChunkStats();
+
 protected:
-	DeltaBlock() = default;
+	explicit DeltaBlock(size_t size) : blockSize(size) {}
+
+private:
+	const size_t blockSize;
 
 #ifdef DEBUG
 public:
@@ -33,25 +68,57 @@ public:
 
 #if STATISTICS
 protected:
-	static size_t globalAllocSize;
+	static std::atomic<size_t> globalAllocSize;
 	size_t allocSize;
 #endif
 };
 
 
+// Snapshots are taken on the emulation thread, but the expensive parts (the
+// calculation of the delta and the compression) are done in the background by
+// a pool of worker threads (see DeltaBlock.cc). Until that work is finished a
+// block keeps a plain copy of the data. All public methods of the classes
+// below can be used while the background work is still in progress.
+
 class DeltaBlockCopy final : public DeltaBlock
 {
 public:
 	DeltaBlockCopy(const uint8_t* data, size_t size);
 	void apply(uint8_t* dst, size_t size) const override;
+	size_t getMemoryUsage(
+		std::unordered_set<const void*>& seen) const override;
+
+	/** Compress this block, may be called from a worker thread. The
+	  * compressed data is split in chunks that are shared with all other
+	  * blocks (see ChunkStats above).
+	  */
 	void compress(size_t size);
-	const uint8_t* getData();
 
-private:
-	bool compressed() const { return compressedSize != 0; }
+	/** Calculate the delta between this block and 'data'. Note that the
+	  * content of 'data' is temporarily modified by this function.
+	  */
+	std::vector<uint8_t> calcDelta(uint8_t* data, size_t size) const;
+
+	struct Chunk;
 
-	MemBuffer<uint8_t> block;
-	size_t compressedSize;
+private:
+	using Block = std::shared_ptr<const MemBuffer<uint8_t>>;
+	using Chunks = std::vector<std::shared_ptr<const Chunk>>;
+
+	bool compressed() const { return !chunks.empty(); }
+	void getData(Block& data, Chunks& chunks_) const;
+	static void uncompress(const Chunks& chunks_, uint8_t* dst, size_t size);
+
+	// Only 'compress()' modifies 'block' and 'chunks', and only while
+	// holding 'mutex'. Before compression 'block' contains the data,
+	// afterwards 'block' is null and the data is in 'chunks'. The content
+	// itself never changes, so other threads only hold 'mutex' to copy
+	// these (shared) pointers, see getData(). They can then use the data
+	// without holding the lock.
+	mutable std::mutex mutex;
+	Block block;
+	Chunks chunks;
+	bool compressing;
 };
 
 
@@ -61,11 +128,23 @@ public:
 	DeltaBlockDiff(std::shared_ptr<DeltaBlockCopy> prev_,
 	               const uint8_t* data, size_t size);
 	void apply(uint8_t* dst, size_t size) const override;
-	size_t getDeltaSize() const;
+	size_t getMemoryUsage(
+		std::unordered_set<const void*>& seen) const override;
+
+	/** Replace the copy of the data with the delta against 'prev'.
+	  * Normally executed on a worker thread. Does nothing when the delta
+	  * was already calculated. Returns the size of the delta.
+	  */
+	size_t calcDelta(size_t size);
 
 private:
 	const std::shared_ptr<DeltaBlockCopy> prev;
-	const std::vector<uint8_t> delta; // TODO could be tweaked to use OutputBuffer
+
+	// Until calcDelta() has finished 'delta' is empty and 'copy'
+	// contains the data. Afterwards 'copy' is empty.
+	mutable std::mutex mutex;
+	MemBuffer<uint8_t> copy;
+	std::vector<uint8_t> delta; // TODO could be tweaked to use OutputBuffer
 };
 
 
@@ -87,6 +166,10 @@ private:
 		size_t size;
 		std::weak_ptr<DeltaBlockCopy> ref;
 		std::weak_ptr<DeltaBlock> last;
+		// The most recent diff against 'ref'. Its delta size is only
+		// added to 'accSize' when the next block is created.
+		std::weak_ptr<DeltaBlockDiff> lastDiff;
+		// Total size of the deltas against 'ref', except 'lastDiff'.
 		size_t accSize;
 	};
 
@@ -73,6 +73,15 @@ public:
 		dPaletteValid = false;
 	}
 
+	/** Calculate the data that convertLine() otherwise calculates lazily.
+	  * After this (and until the next palette16Changed()) convertLine()
+	  * can be called from several threads at the same time.
+	  */
+	inline void prepareConcurrentUse()
+	{
+		if (!dPaletteValid) calcDPalette();
+	}
+
 private:
 	void calcDPalette();
 
@@ -5,7 +5,10 @@
 #include "RenderSettings.hh"
 #include "Scaler.hh"
 #include "ScalerFactory.hh"
+#include "ThreadPool.hh"
 #include "OutputSurface.hh"
+#include "MSXMotherBoard.hh"
+#include "TclObject.hh"
 #include "IntegerSetting.hh"
 #include "FloatSetting.hh"
 #include "BooleanSetting.hh"
@@ -13,6 +16,8 @@
 #include "Math.hh"
 #include "aligned.hh"
 #include "random.hh"
+#include "strCat.hh"
+#include "vla.hh"
 #include "xrange.hh"
 #include <algorithm>
 #include <cassert>
@@ -239,6 +244,16 @@ FBPostProcessor<Pixel>::FBPostProcessor(MSXMotherBoard& motherBoard_,
 	: PostProcessor(
 		motherBoard_, display_, screen_, videoSource, maxWidth_, height_,
 		canDoInterlace_)
+	, srcPitch(maxWidth_)
+	, prevSrcHeight(0)
+	, prevOutputWidth(0)
+	, prevOutputHeight(0)
+	, prevInWidth(0)
+	, prevValid(false)
+	, paintedLines(0)
+	, unchangedLines(0)
+	, unchangedLinesInfo(*this, motherBoard_.getMachineInfoCommand(),
+	                     videoSource)
 	, noiseShift(screen.getHeight())
 	, pixelOps(screen.getSDLFormat())
 {
@@ -257,6 +272,128 @@ FBPostProcessor<Pixel>::~FBPostProcessor()
 	renderSettings.getNoiseSetting().detach(*this);
 }
 
+template <class Pixel>
+void FBPostProcessor<Pixel>::scaleStripe(
+	OutputSurface& output, unsigned inWidth, unsigned srcStep,
+	unsigned dstStep, unsigned stripeStartY, unsigned stripeEndY)
+{
+	for (auto& r : regions) {
+		unsigned dstStartY = std::max(r.dstStartY, stripeStartY);
+		unsigned dstEndY   = std::min(r.dstEndY,   stripeEndY);
+		if (dstStartY >= dstEndY) continue;
+		unsigned srcStartY =
+			r.srcStartY + (dstStartY - r.dstStartY) / dstStep * srcStep;
+		unsigned srcEndY =
+			r.srcStartY + (dstEndY   - r.dstStartY) / dstStep * srcStep;
+
+		if (!prevValid) {
+			// Not comparing with the previous frame, scale everything.
+			//fprintf(stderr, "post processing lines %d-%d: %d\n",
+			//	srcStartY, srcEndY, r.lineWidth );
+			std::unique_ptr<ScalerOutput<Pixel>> dst(
+				StretchScalerOutputFactory<Pixel>::create(
+					output, pixelOps, inWidth));
+			currScaler->scaleImage(
+				*paintFrame, superImposeVideoFrame,
+				srcStartY, srcEndY, r.lineWidth, // source
+				*dst, dstStartY, dstEndY); // dest
+			continue;
+		}
+
+		// Only scale the runs of changed units, copy the others.
+		unsigned y = dstStartY;
+		while (y < dstEndY) {
+			bool changed = changedUnits[y / dstStep];
+			unsigned runEndY = y + dstStep;
+			while ((runEndY < dstEndY) &&
+			       (changedUnits[runEndY / dstStep] == changed)) {
+				runEndY += dstStep;
+			}
+			if (changed) {
+				unsigned sy0 = srcStartY + (y       - dstStartY) / dstStep * srcStep;
+				unsigned sy1 = srcStartY + (runEndY - dstStartY) / dstStep * srcStep;
+				std::unique_ptr<ScalerOutput<Pixel>> dst(
+					StretchScalerOutputFactory<Pixel>::create(
+						output, pixelOps, inWidth));
+				currScaler->scaleImage(
+					*paintFrame, superImposeVideoFrame,
+					sy0, sy1, r.lineWidth, // source
+					*dst, y, runEndY); // dest
+				dst.reset(); // flush output
+				saveOutput(output, y, runEndY);
+			} else {
+				restoreOutput(output, y, runEndY);
+			}
+			y = runEndY;
+		}
+	}
+}
+
+template <class Pixel>
+unsigned FBPostProcessor<Pixel>::findChangedUnits(
+	unsigned srcHeight, unsigned srcStep, unsigned numUnits)
+{
+	// Compare (and update) the copy of the source lines.
+	std::vector<bool> changedLines(srcHeight);
+	VLA_SSE_ALIGNED(Pixel, buf, srcPitch);
+	for (unsigned y = 0; y < srcHeight; ++y) {
+		unsigned width = paintFrame->getLineWidth(y);
+		if (width > srcPitch) {
+			// Can't keep a copy, treat as always changed.
+			prevSrcWidths[y] = 0;
+			changedLines[y] = true;
+			continue;
+		}
+		auto* line = paintFrame->getLinePtr(y, width, buf);
+		Pixel* prev = &prevSrcLines[y * srcPitch];
+		bool same = prevValid && (prevSrcWidths[y] == width) &&
+		            (memcmp(line, prev, width * sizeof(Pixel)) == 0);
+		if (!same) {
+			memcpy(prev, line, width * sizeof(Pixel));
+			prevSrcWidths[y] = width;
+		}
+		changedLines[y] = !same;
+	}
+
+	// A unit must be scaled again when one of its source lines or the
+	// lines directly above or below changed.
+	unsigned unchanged = 0;
+	for (unsigned u = 0; u < numUnits; ++u) {
+		unsigned first = u * srcStep;
+		unsigned last = std::min(first + srcStep, srcHeight - 1);
+		if (first != 0) --first;
+		bool changed = false;
+		for (unsigned y = first; y <= last; ++y) {
+			changed |= changedLines[y];
+		}
+		changedUnits[u] = changed;
+		if (!changed) ++unchanged;
+	}
+	return unchanged;
+}
+
+template <class Pixel>
+void FBPostProcessor<Pixel>::saveOutput(
+	OutputSurface& output, unsigned startY, unsigned endY)
+{
+	for (unsigned y = startY; y < endY; ++y) {
+		memcpy(&prevOutput[y * prevOutputWidth],
+		       output.getLinePtrDirect<Pixel>(y),
+		       prevOutputWidth * sizeof(Pixel));
+	}
+}
+
+template <class Pixel>
+void FBPostProcessor<Pixel>::restoreOutput(
+	OutputSurface& output, unsigned startY, unsigned endY)
+{
+	for (unsigned y = startY; y < endY; ++y) {
+		memcpy(output.getLinePtrDirect<Pixel>(y),
+		       &prevOutput[y * prevOutputWidth],
+		       prevOutputWidth * sizeof(Pixel));
+	}
+}
+
 template <class Pixel>
 void FBPostProcessor<Pixel>::paint(OutputSurface& output)
 {
@@ -279,6 +416,7 @@ void FBPostProcessor<Pixel>::paint(OutputSurface& output)
 		currScaler = ScalerFactory<Pixel>::createScaler(
 			PixelOperations<Pixel>(output.getSDLFormat()),
 			renderSettings);
+		prevValid = false;
 	}
 
 	// Scale image.
@@ -291,6 +429,7 @@ void FBPostProcessor<Pixel>::paint(OutputSurface& output)
 
 	// TODO: Store all MSX lines in RawFrame and only scale the ones that fit
 	//       on the PC screen, as a preparation for resizable output window.
+	regions.clear();
 	unsigned srcStartY = 0;
 	unsigned dstStartY = 0;
 	while (dstStartY < dstHeight) {
@@ -307,26 +446,78 @@ void FBPostProcessor<Pixel>::paint(OutputSurface& output)
 			srcEndY += srcStep;
 			dstEndY += dstStep;
 		}
-
-		// fill region
-		//fprintf(stderr, "post processing lines %d-%d: %d\n",
-		//	srcStartY, srcEndY, lineWidth );
-		output.lock();
-		float horStretch = renderSettings.getHorizontalStretch();
-		unsigned inWidth = lrintf(horStretch);
-		std::unique_ptr<ScalerOutput<Pixel>> dst(
-			StretchScalerOutputFactory<Pixel>::create(
-				output, pixelOps, inWidth));
-		currScaler->scaleImage(
-			*paintFrame, superImposeVideoFrame,
-			srcStartY, srcEndY, lineWidth, // source
-			*dst, dstStartY, dstEndY); // dest
+		regions.push_back({srcStartY, srcEndY, dstStartY, dstEndY, lineWidth});
 
 		// next region
 		srcStartY = srcEndY;
 		dstStartY = dstEndY;
 	}
 
+	// Fill the regions. When the scaler allows it, the output is split in
+	// horizontal stripes (at multiples of 'dstStep' output lines) that are
+	// scaled in parallel. The scalers read the neighbour lines they need
+	// directly from the source frame, so the result is the same as when
+	// scaling the whole image at once.
+	output.lock();
+	unsigned inWidth = lrintf(renderSettings.getHorizontalStretch());
+	unsigned numUnits = dstHeight / dstStep;
+
+	// Lines that didn't change since the previous frame are copied from
+	// the previous output (which is kept separately, the output surface
+	// itself can't be used because e.g. the OSD is drawn on top of it).
+	// The superimposed video (laserdisc) is not compared, so in that case
+	// all lines are scaled.
+	unsigned dstWidth = output.getWidth();
+	if (currScaler->isStripeSafe() && !superImposeVideoFrame) {
+		if ((prevSrcHeight    != srcHeight) ||
+		    (prevOutputWidth  != dstWidth)  ||
+		    (prevOutputHeight != dstHeight) ||
+		    (prevInWidth      != inWidth)) {
+			prevSrcHeight    = srcHeight;
+			prevOutputWidth  = dstWidth;
+			prevOutputHeight = dstHeight;
+			prevInWidth      = inWidth;
+			prevSrcLines.resize(srcHeight * srcPitch);
+			prevSrcWidths.assign(srcHeight, 0);
+			prevOutput.resize(dstHeight * dstWidth);
+			changedUnits.assign(numUnits, true);
+			prevValid = false;
+		}
+		unchangedLines = findChangedUnits(srcHeight, srcStep, numUnits)
+		               * dstStep;
+		// 'prevSrcLines' is now up-to-date, 'prevOutput' will be after
+		// scaling below.
+		prevValid = true;
+	} else {
+		prevValid = false;
+		unchangedLines = 0;
+	}
+	paintedLines = dstHeight;
+
+	unsigned numStripes = currScaler->isStripeSafe()
+		? std::min<unsigned>(renderSettings.getScaleThreads(), numUnits)
+		: 1;
+	if (numStripes <= 1) {
+		scaleStripe(output, inWidth, srcStep, dstStep, 0, dstHeight);
+	} else {
+		if (!scaleThreads ||
+		    (scaleThreads->getNumThreads() != (numStripes - 1))) {
+			scaleThreads = make_unique<ThreadPool>(numStripes - 1);
+		}
+		auto stripeY = [&](unsigned stripe) {
+			return (numUnits * stripe / numStripes) * dstStep;
+		};
+		for (unsigned stripe = 1; stripe < numStripes; ++stripe) {
+			unsigned y0 = stripeY(stripe);
+			unsigned y1 = stripeY(stripe + 1);
+			scaleThreads->add([this, &output, inWidth, srcStep, dstStep, y0, y1] {
+				scaleStripe(output, inWidth, srcStep, dstStep, y0, y1);
+			});
+		}
+		scaleStripe(output, inWidth, srcStep, dstStep, 0, stripeY(1));
+		scaleThreads->wait();
+	}
+
 	drawNoise(output);
 
 	output.flushFrameBuffer(); // for SDLGL-FBxx
@@ -346,6 +537,39 @@ std::unique_ptr<RawFrame> FBPostProcessor<Pixel>::rotateFrames(
 }
 
 
+
+// class UnchangedLinesInfo
+
+template <class Pixel>
+FBPostProcessor<Pixel>::UnchangedLinesInfo::UnchangedLinesInfo(
+		FBPostProcessor& postProcessor_, InfoCommand& machineInfoCommand,
+		const std::string& videoSource)
+	: InfoTopic(machineInfoCommand, strCat(videoSource, "_unchanged_lines"))
+	, postProcessor(postProcessor_)
+{
+}
+
+template <class Pixel>
+void FBPostProcessor<Pixel>::UnchangedLinesInfo::execute(
+	array_ref<TclObject> /*tokens*/, TclObject& result) const
+{
+	auto& pp = postProcessor;
+	result.setDouble(pp.paintedLines
+		? double(pp.unchangedLines) / pp.paintedLines
+		: 0.0);
+}
+
+template <class Pixel>
+std::string FBPostProcessor<Pixel>::UnchangedLinesInfo::help(
+	const std::vector<std::string>& /*tokens*/) const
+{
+	return "The fraction of the output lines of the last painted frame "
+	       "that were copied from the previous frame instead of being "
+	       "scaled again, because the MSX image didn't change there. "
+	       "Only for the SDL renderers and only for some scale algorithms.";
+}
+
+
 // Force template instantiation.
 #if HAVE_16BPP
 template class FBPostProcessor<uint16_t>;
@@ -4,6 +4,8 @@
 #include "PostProcessor.hh"
 #include "RenderSettings.hh"
 #include "PixelOperations.hh"
+#include "InfoTopic.hh"
+#include "MemBuffer.hh"
 #include <vector>
 
 namespace openmsx {
@@ -11,6 +13,7 @@ namespace openmsx {
 class MSXMotherBoard;
 class Display;
 template<typename Pixel> class Scaler;
+class ThreadPool;
 
 /** Rasterizer using SDL.
   */
@@ -31,6 +34,25 @@ public:
 		std::unique_ptr<RawFrame> finishedFrame, EmuTime::param time) override;
 
 private:
+	/** Scale the part of the 'regions' that lies within the output lines
+	  * [stripeStartY, stripeEndY). Both must be multiples of 'dstStep'.
+	  */
+	void scaleStripe(OutputSurface& output, unsigned inWidth,
+	                 unsigned srcStep, unsigned dstStep,
+	                 unsigned stripeStartY, unsigned stripeEndY);
+
+	/** Compare the source lines of 'paintFrame' with those of the
+	  * previously painted frame and mark the groups of output lines that
+	  * must be scaled again in 'changedUnits'. Returns the number of
+	  * groups that can be copied from 'prevOutput' instead.
+	  */
+	unsigned findChangedUnits(unsigned srcHeight, unsigned srcStep,
+	                          unsigned numUnits);
+
+	/** Copy output lines [startY, endY) to or from 'prevOutput'. */
+	void saveOutput(OutputSurface& output, unsigned startY, unsigned endY);
+	void restoreOutput(OutputSurface& output, unsigned startY, unsigned endY);
+
 	void preCalcNoise(float factor);
 	void drawNoise(OutputSurface& output);
 	void drawNoiseLine(Pixel* buf, signed char* noise,
@@ -51,6 +73,58 @@ private:
 	  */
 	unsigned scaleFactor;
 
+	/** A range of source lines with equal width, and the output lines
+	  * they are scaled to.
+	  */
+	struct Region {
+		unsigned srcStartY, srcEndY;
+		unsigned dstStartY, dstEndY;
+		unsigned lineWidth;
+	};
+	/** The regions of the frame that is being painted. */
+	std::vector<Region> regions;
+
+	/** Helper threads for scaling in stripes, see 'scale_threads'
+	  * setting. Only created when needed.
+	  */
+	std::unique_ptr<ThreadPool> scaleThreads;
+
+	/** Most MSX frames are largely the same as the previous one. For
+	  * scalers that only look at the direct neighbour lines (those that
+	  * are stripe-safe) we keep a copy of the previous source lines and
+	  * of the scaled output, and only scale the groups of 'dstStep'
+	  * output lines whose source lines (or their neighbours) changed.
+	  * The other lines are copied from 'prevOutput'.
+	  */
+	MemBuffer<Pixel> prevSrcLines; // 'srcPitch' pixels per line
+	std::vector<unsigned> prevSrcWidths;
+	MemBuffer<Pixel, 64> prevOutput; // 'prevOutputWidth' pixels per line
+	std::vector<bool> changedUnits; // per group of 'dstStep' output lines
+	unsigned srcPitch;
+	unsigned prevSrcHeight;
+	unsigned prevOutputWidth;
+	unsigned prevOutputHeight;
+	unsigned prevInWidth;
+	bool prevValid;
+
+	/** Number of output lines of the last painted frame, and how many of
+	  * those were copied instead of scaled.
+	  */
+	unsigned paintedLines;
+	unsigned unchangedLines;
+
+	class UnchangedLinesInfo final : public InfoTopic {
+	public:
+		UnchangedLinesInfo(FBPostProcessor& postProcessor,
+		                   InfoCommand& machineInfoCommand,
+		                   const std::string& videoSource);
+		void execute(array_ref<TclObject> tokens,
+		             TclObject& result) const override;
+		std::string help(const std::vector<std::string>& tokens) const override;
+	private:
+		FBPostProcessor& postProcessor;
+	} unchangedLinesInfo;
+
 	/** Remember the noise values to get a stable image when paused.
 	 */
 	std::vector<unsigned> noiseShift;
@@ -26,11 +26,17 @@ TODO:
 
 namespace openmsx {
 
+/** When drawing in parallel, each thread draws at least this many lines,
+  * for fewer lines the overhead of the threads isn't worth it.
+  */
+static const int MIN_BAND_LINES = 16;
+
 void PixelRenderer::draw(
 	int startX, int startY, int endX, int endY, DrawType drawType, bool atEnd)
 {
 	if (drawType == DRAW_BORDER) {
-		rasterizer->drawBorder(startX, startY, endX, endY);
+		rasterize({DrawCmd::BORDER, startX, startY, endX, 0, 0, 0,
+		           endY - startY});
 	} else {
 		assert(drawType == DRAW_DISPLAY);
 
@@ -58,20 +64,86 @@ void PixelRenderer::draw(
 		assert(0 <= displayX);
 		assert(displayX + displayWidth <= 512);
 
-		rasterizer->drawDisplay(
-			startX, startY,
+		rasterize({DrawCmd::DISPLAY, startX, startY, 0,
 			displayX - vdp.getHorizontalScrollLow() * 2, displayY,
-			displayWidth, displayHeight
-			);
+			displayWidth, displayHeight});
 		if (vdp.spritesEnabled() && !renderSettings.getDisableSprites()) {
-			rasterizer->drawSprites(
-				startX, startY,
+			rasterize({DrawCmd::SPRITES, startX, startY, 0,
 				displayX / 2, displayY,
-				(displayWidth + 1) / 2, displayHeight);
+				(displayWidth + 1) / 2, displayHeight});
 		}
 	}
 }
 
+void PixelRenderer::rasterize(const DrawCmd& cmd)
+{
+	if (parallelRender) {
+		drawQueue.push_back(cmd);
+	} else {
+		execute(cmd, cmd.y, cmd.y + cmd.height);
+	}
+}
+
+void PixelRenderer::execute(const DrawCmd& cmd, int bandY, int bandLimitY)
+{
+	int y = std::max(cmd.y, bandY);
+	int limitY = std::min(cmd.y + cmd.height, bandLimitY);
+	if (y >= limitY) return;
+	int displayY = (cmd.displayY + (y - cmd.y)) & 255; // Page wrap.
+
+	switch (cmd.type) {
+	case DrawCmd::BORDER:
+		rasterizer->drawBorder(cmd.fromX, y, cmd.limitX, limitY);
+		break;
+	case DrawCmd::DISPLAY:
+		rasterizer->drawDisplay(
+			cmd.fromX, y, cmd.displayX, displayY,
+			cmd.displayWidth, limitY - y);
+		break;
+	case DrawCmd::SPRITES:
+		rasterizer->drawSprites(
+			cmd.fromX, y, cmd.displayX, displayY,
+			cmd.displayWidth, limitY - y);
+		break;
+	default:
+		UNREACHABLE;
+	}
+}
+
+void PixelRenderer::flushDrawQueue()
+{
+	int firstY = drawQueue.front().y;
+	int limitY = firstY;
+	for (auto& cmd : drawQueue) {
+		firstY = std::min(firstY, cmd.y);
+		limitY = std::max(limitY, cmd.y + cmd.height);
+	}
+	int numBands = std::min<int>(renderThreads.getNumThreads() + 1,
+	                             (limitY - firstY) / MIN_BAND_LINES);
+	if (numBands <= 1) {
+		for (auto& cmd : drawQueue) execute(cmd, firstY, limitY);
+	} else {
+		// Each band is drawn by a different thread. Within a band the
+		// commands are executed in their original order, that's what
+		// matters for commands that draw (partly) the same lines.
+		auto bandY = [&](int band) {
+			return firstY + (limitY - firstY) * band / numBands;
+		};
+		rasterizer->prepareConcurrentDraw();
+		for (int band = 1; band < numBands; ++band) {
+			int y0 = bandY(band);
+			int y1 = bandY(band + 1);
+			renderThreads.add([this, y0, y1] {
+				for (auto& cmd : drawQueue) execute(cmd, y0, y1);
+			});
+		}
+		int y1 = bandY(1);
+		for (auto& cmd : drawQueue) execute(cmd, firstY, y1);
+		renderThreads.wait();
+	}
+	drawQueue.clear();
+}
+
 void PixelRenderer::subdivide(
 	int startX, int startY, int endX, int endY, int clipL, int clipR,
 	DrawType drawType )
@@ -112,6 +184,8 @@ PixelRenderer::PixelRenderer(VDP& vdp_, Display& display)
 	, videoSourceSetting(vdp.getMotherBoard().getVideoSource())
 	, spriteChecker(vdp.getSpriteChecker())
 	, rasterizer(display.getVideoSystem().createRasterizer(vdp))
+	, renderThreads(ThreadPool::defaultNumThreads())
+	, parallelRender(false)
 {
 	// In case of loadstate we can't yet query any state from the VDP
 	// (because that object is not yet fully deserialized). But
@@ -192,6 +266,7 @@ void PixelRenderer::frameStart(EmuTime::param time)
 	rasterizer->frameStart(time);
 
 	accuracy = renderSettings.getAccuracy();
+	parallelRender = renderSettings.getParallelRender();
 
 	nextX = 0;
 	nextY = 0;
@@ -402,6 +477,18 @@ static inline bool overlap(
 	return false;
 }
 
+inline bool PixelRenderer::isInVisiblePage(int offset) const
+{
+	int visiblePage = vram.nameTable.getMask()
+		& (0x10000 | (vdp.getEvenOddMask() << 7));
+	if (vdp.isMultiPageScrolling()) {
+		return (offset & 0x18000) == visiblePage
+			|| (offset & 0x18000) == (visiblePage & 0x10000);
+	} else {
+		return (offset & 0x18000) == visiblePage;
+	}
+}
+
 inline bool PixelRenderer::checkSync(int offset, EmuTime::param time)
 {
 	// TODO: Because range is entire VRAM, offset == address.
@@ -464,18 +551,9 @@ inline bool PixelRenderer::checkSync(int offset, EmuTime::param time)
 		}
 		return false;
 	case DisplayMode::GRAPHIC4:
-	case DisplayMode::GRAPHIC5: {
-		// Is the address inside the visual page(s)?
+	case DisplayMode::GRAPHIC5:
 		// TODO: Also look at which lines are touched inside pages.
-		int visiblePage = vram.nameTable.getMask()
-			& (0x10000 | (vdp.getEvenOddMask() << 7));
-		if (vdp.isMultiPageScrolling()) {
-			return (offset & 0x18000) == visiblePage
-				|| (offset & 0x18000) == (visiblePage & 0x10000);
-		} else {
-			return (offset & 0x18000) == visiblePage;
-		}
-	}
+		return isInVisiblePage(offset);
 	case DisplayMode::GRAPHIC6:
 	case DisplayMode::GRAPHIC7:
 		return true; // TODO: Implement better detection.
@@ -487,6 +565,25 @@ inline bool PixelRenderer::checkSync(int offset, EmuTime::param time)
 	}
 }
 
+bool PixelRenderer::isVRAMObserved(unsigned address, unsigned size) const
+{
+	// Must be true if updateVRAM() might sync for any of the addresses
+	// in this range. See checkSync(): only in Graphic 4 and 5 mode the
+	// answer doesn't depend on the (rendering) time.
+	if (!renderFrame || !displayEnabled) return false;
+	if (accuracy == RenderSettings::ACC_SCREEN) return false;
+	switch (vdp.getDisplayMode().getBase()) {
+	case DisplayMode::GRAPHIC4:
+	case DisplayMode::GRAPHIC5: {
+		unsigned last = address + size - 1;
+		if ((address & 0x18000) != (last & 0x18000)) return true;
+		return isInVisiblePage(address);
+	}
+	default:
+		return true;
+	}
+}
+
 void PixelRenderer::updateVRAM(unsigned offset, EmuTime::param time)
 {
 	// Note: No need to sync if display is disabled, because then the
@@ -595,6 +692,7 @@ void PixelRenderer::renderUntil(EmuTime::param time)
 		subdivide(nextX, nextY, limitX, limitY,
 			0, VDP::TICKS_PER_LINE, DRAW_BORDER);
 	}
+	if (!drawQueue.empty()) flushDrawQueue();
 
 	nextX = limitX;
 	nextY = limitY;
@@ -4,8 +4,10 @@
 #include "Renderer.hh"
 #include "Observer.hh"
 #include "RenderSettings.hh"
+#include "ThreadPool.hh"
 #include "openmsx.hh"
 #include <memory>
+#include <vector>
 
 namespace openmsx {
 
@@ -22,6 +24,13 @@ class VideoSourceSetting;
 
 /** Generic implementation of a pixel-based Renderer.
   * Uses a Rasterizer to plot actual pixels for a specific video system.
+  *
+  * When the 'parallel_render' setting is enabled, the draw calls made by one
+  * renderUntil() are not executed immediately but collected. At the end of
+  * renderUntil() the lines they cover are split in bands which are drawn by
+  * several threads at the same time. renderUntil() only returns when all
+  * bands are done, so the Rasterizer (which reads the VDP, VRAM and sprite
+  * state directly) never sees a state change while it is drawing.
   */
 class PixelRenderer final : public Renderer, private Observer<Setting>
 {
@@ -54,6 +63,7 @@ public:
 	void updatePatternBase(int addr, EmuTime::param time) override;
 	void updateColorBase(int addr, EmuTime::param time) override;
 	void updateSpritesEnabled(bool enabled, EmuTime::param time) override;
+	bool isVRAMObserved(unsigned address, unsigned size) const override;
 	void updateVRAM(unsigned offset, EmuTime::param time) override;
 	void updateWindow(bool enabled, EmuTime::param time) override;
 
@@ -61,6 +71,17 @@ private:
 	/** Indicates whether the area to be drawn is border or display. */
 	enum DrawType { DRAW_BORDER, DRAW_DISPLAY };
 
+	/** The parameters of a call to one of the Rasterizer draw methods.
+	  * For all types 'y' and 'height' are the range of absolute lines.
+	  */
+	struct DrawCmd {
+		enum Type { BORDER, DISPLAY, SPRITES } type;
+		int fromX, y;
+		int limitX; // BORDER only
+		int displayX, displayY, displayWidth; // DISPLAY and SPRITES only
+		int height;
+	};
+
 	// Observer<Setting> interface:
 	void update(const Setting& setting) override;
 
@@ -82,8 +103,28 @@ private:
 		int startX, int startY, int endX, int endY,
 		int clipL, int clipR, DrawType drawType );
 
+	/** Execute the given draw command, or when drawing in parallel, queue
+	  * it till the end of renderUntil().
+	  */
+	void rasterize(const DrawCmd& cmd);
+
+	/** Execute the part of the given draw command that lies within the
+	  * lines [bandY, bandLimitY).
+	  */
+	void execute(const DrawCmd& cmd, int bandY, int bandLimitY);
+
+	/** Execute (and clear) all queued draw commands, spread over the
+	  * render threads.
+	  */
+	void flushDrawQueue();
+
 	inline bool checkSync(int offset, EmuTime::param time);
 
+	/** In Graphic 4 and 5 mode: is the given VRAM address part of the
+	  * displayed page(s)?
+	  */
+	inline bool isInVisiblePage(int offset) const;
+
 	/** Update renderer state to specified moment in time.
 	  * @param time Moment in emulated time to update to.
 	  * @param force When screen accuracy is used,
@@ -118,6 +159,14 @@ private:
 
 	const std::unique_ptr<Rasterizer> rasterizer;
 
+	/** Draw commands queued during the current renderUntil() call. */
+	std::vector<DrawCmd> drawQueue;
+
+	/** Helper threads for drawing in parallel. The thread that calls
+	  * renderUntil() draws one band itself.
+	  */
+	ThreadPool renderThreads;
+
 	float finishFrameDuration;
 	int frameSkipCounter;
 
@@ -148,6 +197,12 @@ private:
 	  */
 	bool renderFrame;
 	bool prevRenderFrame;
+
+	/** Are the lines of the current frame drawn in parallel?
+	  * Changes to the 'parallel_render' setting only take effect at the
+	  * start of the next frame.
+	  */
+	bool parallelRender;
 };
 
 } // namespace openmsx
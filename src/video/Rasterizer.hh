@@ -100,6 +100,13 @@ public:
 		int displayX, int displayY,
 		int displayWidth, int displayHeight) = 0;
 
+	/** Prepare for calls to drawBorder(), drawDisplay() and drawSprites()
+	  * from several threads at the same time, each for a different range
+	  * of lines. Until any other method is called, the draw methods will
+	  * then only modify the lines they draw.
+	  */
+	virtual void prepareConcurrentDraw() = 0;
+
 	/** Is video recording active?
 	  */
 	virtual bool isRecording() const = 0;
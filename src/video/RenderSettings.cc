@@ -126,6 +126,10 @@ RenderSettings::RenderSettings(CommandController& commandController)
 		"scale_factor", "scale factor",
 		std::min(2, MAX_SCALE_FACTOR), MIN_SCALE_FACTOR, MAX_SCALE_FACTOR)
 
+	, scaleThreadsSetting(commandController,
+		"scale_threads", "number of threads used to scale the MSX image "
+		"(only for some scale algorithms)", 1, 1, 16)
+
 	, scanlineAlphaSetting(commandController,
 		"scanline", "amount of scanline effect: 0 = none, 100 = full",
 		20, 0, 100)
@@ -186,6 +190,12 @@ RenderSettings::RenderSettings(CommandController& commandController)
 		"Useful on (100Hz+) lightboost enabled monitors to reduce "
 		"motion blur and double frame artifacts.",
 		false)
+
+	, parallelRenderSetting(commandController,
+		"parallel_render",
+		"Draw the MSX screen with multiple threads, this only helps "
+		"when there are enough free CPU cores.",
+		false)
 {
 	brightnessSetting.attach(*this);
 	contrastSetting  .attach(*this);
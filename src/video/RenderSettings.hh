@@ -120,6 +120,9 @@ public:
 	IntegerSetting& getScaleFactorSetting() { return scaleFactorSetting; }
 	int getScaleFactor() const { return scaleFactorSetting.getInt(); }
 
+	/** The number of threads used to scale the MSX image. */
+	int getScaleThreads() const { return scaleThreadsSetting.getInt(); }
+
 	/** Limit number of sprites per line?
 	  * If true, limit number of sprites per line as real VDP does.
 	  * If false, display all sprites.
@@ -169,6 +172,11 @@ public:
 		return interleaveBlackFrameSetting.getBoolean();
 	}
 
+	/** Draw the MSX screen with multiple threads? */
+	bool getParallelRender() const {
+		return parallelRenderSetting.getBoolean();
+	}
+
 	/** Apply brightness, contrast and gamma transformation on the input
 	  * color component. The component is expected to be in the range
 	  * [0.0 .. 1.0] but it's not an error if it lays outside of this range.
@@ -216,6 +224,7 @@ private:
 	IntegerSetting horizontalBlurSetting;
 	EnumSetting<ScaleAlgorithm> scaleAlgorithmSetting;
 	IntegerSetting scaleFactorSetting;
+	IntegerSetting scaleThreadsSetting;
 	IntegerSetting scanlineAlphaSetting;
 	BooleanSetting limitSpritesSetting;
 	BooleanSetting disableSpritesSetting;
@@ -225,6 +234,7 @@ private:
 	FloatSetting horizontalStretchSetting;
 	FloatSetting pointerHideDelaySetting;
 	BooleanSetting interleaveBlackFrameSetting;
+	BooleanSetting parallelRenderSetting;
 
 	float brightness;
 	float contrast;
@@ -177,6 +177,16 @@ public:
 	  */
 	virtual void updateSpritesEnabled(bool enabled, EmuTime::param time) = 0;
 
+	/** Might a change to one of the VRAM addresses [address, address +
+	  * size) require a sync in updateVRAM()? If not, the VDP command
+	  * engine can skip the (per byte) updateVRAM() calls for that range.
+	  * The answer must only depend on state that changes after the
+	  * command engine has been synced (e.g. display mode, visible page).
+	  * @param address The first address of the range.
+	  * @param size The number of bytes in the range.
+	  */
+	virtual bool isVRAMObserved(unsigned address, unsigned size) const = 0;
+
 	/** Sprite palette in Graphic 7 mode.
 	  * Each palette entry is a word in GRB format:
 	  * bit 10..8 is green, bit 6..4 is red and bit 2..0 is blue.
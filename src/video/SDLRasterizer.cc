@@ -669,6 +669,12 @@ void SDLRasterizer<Pixel>::drawSprites(
 	}
 }
 
+template <class Pixel>
+void SDLRasterizer<Pixel>::prepareConcurrentDraw()
+{
+	bitmapConverter.prepareConcurrentUse();
+}
+
 template <class Pixel>
 bool SDLRasterizer<Pixel>::isRecording() const
 {
@@ -60,6 +60,7 @@ public:
 		int fromX, int fromY,
 		int displayX, int displayY,
 		int displayWidth, int displayHeight) override;
+	void prepareConcurrentDraw() override;
 	bool isRecording() const override;
 
 private:
@@ -30,6 +30,7 @@ TODO:
 #include "TclObject.hh"
 #include "MSXCPU.hh"
 #include "MSXMotherBoard.hh"
+#include "Scheduler.hh"
 #include "Reactor.hh"
 #include "MSXException.hh"
 #include "CliComm.hh"
@@ -697,6 +698,70 @@ void VDP::writeIO(word port, byte value, EmuTime::param time_)
 	}
 }
 
+bool VDP::canWriteIOBurst(word port) const
+{
+	// Only VRAM data writes. With an I/O delay each write also stalls the
+	// CPU, that's not possible in a burst.
+	return ((port & (isMSX1VDP() ? 0x01 : 0x03)) == 0) &&
+	       (fixedVDPIOdelayCycles == 0);
+}
+
+unsigned VDP::writeIOBurst(word port, array_ref<byte> values,
+                           EmuTime::param time, EmuDuration::param interval)
+{
+	// Same as a series of vramWrite() calls, but the CPU-VRAM accesses
+	// scheduled by earlier writes in the burst are executed right here
+	// instead of via the scheduler. This is only possible up to the first
+	// sync point of another device (or another VDP sync point): the write
+	// at that time (or later) must happen after that sync point was
+	// executed, so leave those writes to the caller.
+	assert(canWriteIOBurst(port)); (void)port;
+	EmuTime pendingTime = EmuTime::zero;
+	bool pending = pendingCpuAccess;
+	if (pending) {
+		syncCpuVramAccess.pendingSyncPoint(pendingTime);
+		syncCpuVramAccess.removeSyncPoint();
+	}
+	auto& scheduler = getScheduler();
+	EmuTime limit = scheduler.getNext();
+	auto delta = isMSX1VDP() ? VDPAccessSlots::DELTA_28
+	                         : VDPAccessSlots::DELTA_16;
+
+	unsigned num = 0;
+	EmuTime t = time;
+	for (auto value : values) {
+		if (t >= limit) break;
+		assert(isInsideFrame(t));
+		if (pending && (pendingTime <= t)) {
+			pending = false;
+			executeCpuVramAccess(pendingTime);
+		}
+		cpuVramData = value;
+		cpuVramReqIsRead = false;
+		if (unlikely(pending)) {
+			// see scheduleCpuVramAccess()
+			assert(!allowTooFastAccess);
+			tooFastCallback.execute();
+			// the callback may have (un)scheduled sync points
+			limit = scheduler.getNext();
+		} else if (unlikely(allowTooFastAccess)) {
+			executeCpuVramAccess(t);
+		} else {
+			pending = true;
+			pendingTime = getAccessSlot(t, delta);
+		}
+		t += interval;
+		++num;
+	}
+	if (num) registerDataStored = false;
+
+	pendingCpuAccess = pending;
+	if (pending) {
+		syncCpuVramAccess.setSyncPoint(pendingTime);
+	}
+	return num;
+}
+
 void VDP::setPalette(int index, word grb, EmuTime::param time)
 {
 	if (palette[index] != grb) {
@@ -79,6 +79,10 @@ public:
 	byte readIO(word port, EmuTime::param time) override;
 	byte peekIO(word port, EmuTime::param time) const override;
 	void writeIO(word port, byte value, EmuTime::param time) override;
+	bool canWriteIOBurst(word port) const override;
+	unsigned writeIOBurst(word port, array_ref<byte> values,
+	                      EmuTime::param time,
+	                      EmuDuration::param interval) override;
 
 	/** Used by Video9000 to be able to couple the VDP and V9990 output.
 	 * Can return nullptr in case of renderer=none. This value can change
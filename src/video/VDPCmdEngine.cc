@@ -173,9 +173,10 @@ struct Graphic4Mode
 	static const byte PIXELS_PER_BYTE_SHIFT = 1;
 	static const unsigned PIXELS_PER_LINE = 256;
 	static inline unsigned addressOf(unsigned x, unsigned y, bool extVRAM);
+	static inline byte* lineWriteArea(VDPVRAM& vram, unsigned y, bool extVRAM);
 	static inline byte point(VDPVRAM& vram, unsigned x, unsigned y, bool extVRAM);
-	template <typename LogOp>
-	static inline void pset(EmuTime::param time, VDPVRAM& vram,
+	template<typename VRAM, typename LogOp>
+	static inline void pset(EmuTime::param time, VRAM& vram,
 		unsigned x, unsigned addr, byte src, byte color, LogOp op);
 	static inline byte duplicate(byte color);
 };
@@ -188,6 +189,12 @@ inline unsigned Graphic4Mode::addressOf(
 		: (((y &  511) << 7) | ((x & 255) >> 1) | 0x20000);
 }
 
+inline byte* Graphic4Mode::lineWriteArea(
+	VDPVRAM& vram, unsigned y, bool extVRAM)
+{
+	return vram.getCmdWriteArea(addressOf(0, y, extVRAM), 128);
+}
+
 inline byte Graphic4Mode::point(
 	VDPVRAM& vram, unsigned x, unsigned y, bool extVRAM)
 {
@@ -195,9 +202,9 @@ inline byte Graphic4Mode::point(
 		>> (((~x) & 1) << 2) ) & 15;
 }
 
-template<typename LogOp>
+template<typename VRAM, typename LogOp>
 inline void Graphic4Mode::pset(
-	EmuTime::param time, VDPVRAM& vram, unsigned x, unsigned addr,
+	EmuTime::param time, VRAM& vram, unsigned x, unsigned addr,
 	byte src, byte color, LogOp op)
 {
 	byte sh = ((~x) & 1) << 2;
@@ -223,9 +230,10 @@ struct Graphic5Mode
 	static const byte PIXELS_PER_BYTE_SHIFT = 2;
 	static const unsigned PIXELS_PER_LINE = 512;
 	static inline unsigned addressOf(unsigned x, unsigned y, bool extVRAM);
+	static inline byte* lineWriteArea(VDPVRAM& vram, unsigned y, bool extVRAM);
 	static inline byte point(VDPVRAM& vram, unsigned x, unsigned y, bool extVRAM);
-	template <typename LogOp>
-	static inline void pset(EmuTime::param time, VDPVRAM& vram,
+	template<typename VRAM, typename LogOp>
+	static inline void pset(EmuTime::param time, VRAM& vram,
 		unsigned x, unsigned addr, byte src, byte color, LogOp op);
 	static inline byte duplicate(byte color);
 };
@@ -238,6 +246,12 @@ inline unsigned Graphic5Mode::addressOf(
 		: (((y &  511) << 7) | ((x & 511) >> 2) | 0x20000);
 }
 
+inline byte* Graphic5Mode::lineWriteArea(
+	VDPVRAM& vram, unsigned y, bool extVRAM)
+{
+	return vram.getCmdWriteArea(addressOf(0, y, extVRAM), 128);
+}
+
 inline byte Graphic5Mode::point(
 	VDPVRAM& vram, unsigned x, unsigned y, bool extVRAM)
 {
@@ -245,9 +259,9 @@ inline byte Graphic5Mode::point(
 		>> (((~x) & 3) << 1) ) & 3;
 }
 
-template<typename LogOp>
+template<typename VRAM, typename LogOp>
 inline void Graphic5Mode::pset(
-	EmuTime::param time, VDPVRAM& vram, unsigned x, unsigned addr,
+	EmuTime::param time, VRAM& vram, unsigned x, unsigned addr,
 	byte src, byte color, LogOp op)
 {
 	byte sh = ((~x) & 3) << 1;
@@ -275,9 +289,10 @@ struct Graphic6Mode
 	static const byte PIXELS_PER_BYTE_SHIFT = 1;
 	static const unsigned PIXELS_PER_LINE = 512;
 	static inline unsigned addressOf(unsigned x, unsigned y, bool extVRAM);
+	static inline byte* lineWriteArea(VDPVRAM& vram, unsigned y, bool extVRAM);
 	static inline byte point(VDPVRAM& vram, unsigned x, unsigned y, bool extVRAM);
-	template <typename LogOp>
-	static inline void pset(EmuTime::param time, VDPVRAM& vram,
+	template<typename VRAM, typename LogOp>
+	static inline void pset(EmuTime::param time, VRAM& vram,
 		unsigned x, unsigned addr, byte src, byte color, LogOp op);
 	static inline byte duplicate(byte color);
 };
@@ -290,6 +305,18 @@ inline unsigned Graphic6Mode::addressOf(
 		: (0x20000         | ((y & 511) << 7) | ((x & 511) >> 2));
 }
 
+inline byte* Graphic6Mode::lineWriteArea(
+	VDPVRAM& vram, unsigned y, bool extVRAM)
+{
+	// planar: the line is split over two blocks (except in extended VRAM)
+	byte* area = vram.getCmdWriteArea(addressOf(0, y, extVRAM), 128);
+	if (area && !extVRAM &&
+	    !vram.getCmdWriteArea(addressOf(2, y, extVRAM), 128)) {
+		return nullptr;
+	}
+	return area;
+}
+
 inline byte Graphic6Mode::point(
 	VDPVRAM& vram, unsigned x, unsigned y, bool extVRAM)
 {
@@ -297,9 +324,9 @@ inline byte Graphic6Mode::point(
 		>> (((~x) & 1) << 2) ) & 15;
 }
 
-template<typename LogOp>
+template<typename VRAM, typename LogOp>
 inline void Graphic6Mode::pset(
-	EmuTime::param time, VDPVRAM& vram, unsigned x, unsigned addr,
+	EmuTime::param time, VRAM& vram, unsigned x, unsigned addr,
 	byte src, byte color, LogOp op)
 {
 	byte sh = ((~x) & 1) << 2;
@@ -325,9 +352,10 @@ struct Graphic7Mode
 	static const byte PIXELS_PER_BYTE_SHIFT = 0;
 	static const unsigned PIXELS_PER_LINE = 256;
 	static inline unsigned addressOf(unsigned x, unsigned y, bool extVRAM);
+	static inline byte* lineWriteArea(VDPVRAM& vram, unsigned y, bool extVRAM);
 	static inline byte point(VDPVRAM& vram, unsigned x, unsigned y, bool extVRAM);
-	template<typename LogOp>
-	static inline void pset(EmuTime::param time, VDPVRAM& vram,
+	template<typename VRAM, typename LogOp>
+	static inline void pset(EmuTime::param time, VRAM& vram,
 		unsigned x, unsigned addr, byte src, byte color, LogOp op);
 	static inline byte duplicate(byte color);
 };
@@ -340,15 +368,27 @@ inline unsigned Graphic7Mode::addressOf(
 		: (0x20000         | ((y & 511) << 7) | ((x & 255) >> 1));
 }
 
+inline byte* Graphic7Mode::lineWriteArea(
+	VDPVRAM& vram, unsigned y, bool extVRAM)
+{
+	// planar: the line is split over two blocks (except in extended VRAM)
+	byte* area = vram.getCmdWriteArea(addressOf(0, y, extVRAM), 128);
+	if (area && !extVRAM &&
+	    !vram.getCmdWriteArea(addressOf(1, y, extVRAM), 128)) {
+		return nullptr;
+	}
+	return area;
+}
+
 inline byte Graphic7Mode::point(
 	VDPVRAM& vram, unsigned x, unsigned y, bool extVRAM)
 {
 	return vram.cmdReadWindow.readNP(addressOf(x, y, extVRAM));
 }
 
-template<typename LogOp>
+template<typename VRAM, typename LogOp>
 inline void Graphic7Mode::pset(
-	EmuTime::param time, VDPVRAM& vram, unsigned /*x*/, unsigned addr,
+	EmuTime::param time, VRAM& vram, unsigned /*x*/, unsigned addr,
 	byte src, byte color, LogOp op)
 {
 	op(time, vram, addr, src, color, 0);
@@ -373,9 +413,10 @@ struct NonBitmapMode
 	static const byte PIXELS_PER_BYTE_SHIFT = 0;
 	static const unsigned PIXELS_PER_LINE = 256;
 	static inline unsigned addressOf(unsigned x, unsigned y, bool extVRAM);
+	static inline byte* lineWriteArea(VDPVRAM& vram, unsigned y, bool extVRAM);
 	static inline byte point(VDPVRAM& vram, unsigned x, unsigned y, bool extVRAM);
-	template<typename LogOp>
-	static inline void pset(EmuTime::param time, VDPVRAM& vram,
+	template<typename VRAM, typename LogOp>
+	static inline void pset(EmuTime::param time, VRAM& vram,
 		unsigned x, unsigned addr, byte src, byte color, LogOp op);
 	static inline byte duplicate(byte color);
 };
@@ -388,15 +429,21 @@ inline unsigned NonBitmapMode::addressOf(
 		: (((y & 255) << 8) | (x & 255) | 0x20000);
 }
 
+inline byte* NonBitmapMode::lineWriteArea(
+	VDPVRAM& vram, unsigned y, bool extVRAM)
+{
+	return vram.getCmdWriteArea(addressOf(0, y, extVRAM), 256);
+}
+
 inline byte NonBitmapMode::point(
 	VDPVRAM& vram, unsigned x, unsigned y, bool extVRAM)
 {
 	return vram.cmdReadWindow.readNP(addressOf(x, y, extVRAM));
 }
 
-template<typename LogOp>
+template<typename VRAM, typename LogOp>
 inline void NonBitmapMode::pset(
-	EmuTime::param time, VDPVRAM& vram, unsigned /*x*/, unsigned addr,
+	EmuTime::param time, VRAM& vram, unsigned /*x*/, unsigned addr,
 	byte src, byte color, LogOp op)
 {
 	op(time, vram, addr, src, color, 0);
@@ -650,10 +697,33 @@ struct IncrShift7
 };
 
 
+/** Stand-in for VDPVRAM in the Mode::pset() and LogOp calls of the block
+  * commands, for lines of VRAM that nobody observes (see
+  * VDPVRAM::getCmdWriteArea()). Writes go directly to VRAM, without the per
+  * byte synchronisation with the renderer and the sprite checker.
+  */
+class DirectVRAM
+{
+public:
+	explicit DirectVRAM(byte* data_) : data(data_) {}
+
+	/** False when the line is observed, use VDPVRAM::cmdWrite() then. */
+	bool isValid() const { return data != nullptr; }
+
+	void cmdWrite(unsigned address, byte value, EmuTime::param /*time*/) {
+		data[address] = value;
+	}
+
+private:
+	byte* data;
+};
+
+
 // Logical operations:
 
 struct DummyOp {
-	void operator()(EmuTime::param /*time*/, VDPVRAM& /*vram*/, unsigned /*addr*/,
+	template<typename VRAM>
+	void operator()(EmuTime::param /*time*/, VRAM& /*vram*/, unsigned /*addr*/,
 	                byte /*src*/, byte /*color*/, byte /*mask*/) const
 	{
 		// Undefined logical operations do nothing.
@@ -661,7 +731,8 @@ struct DummyOp {
 };
 
 struct ImpOp {
-	void operator()(EmuTime::param time, VDPVRAM& vram, unsigned addr,
+	template<typename VRAM>
+	void operator()(EmuTime::param time, VRAM& vram, unsigned addr,
 	                byte src, byte color, byte mask) const
 	{
 		vram.cmdWrite(addr, (src & mask) | color, time);
@@ -669,7 +740,8 @@ struct ImpOp {
 };
 
 struct AndOp {
-	void operator()(EmuTime::param time, VDPVRAM& vram, unsigned addr,
+	template<typename VRAM>
+	void operator()(EmuTime::param time, VRAM& vram, unsigned addr,
 	                byte src, byte color, byte mask) const
 	{
 		vram.cmdWrite(addr, src & (color | mask), time);
@@ -677,7 +749,8 @@ struct AndOp {
 };
 
 struct OrOp {
-	void operator()(EmuTime::param time, VDPVRAM& vram, unsigned addr,
+	template<typename VRAM>
+	void operator()(EmuTime::param time, VRAM& vram, unsigned addr,
 	                byte src, byte color, byte /*mask*/) const
 	{
 		vram.cmdWrite(addr, src | color, time);
@@ -685,7 +758,8 @@ struct OrOp {
 };
 
 struct XorOp {
-	void operator()(EmuTime::param time, VDPVRAM& vram, unsigned addr,
+	template<typename VRAM>
+	void operator()(EmuTime::param time, VRAM& vram, unsigned addr,
 	                byte src, byte color, byte /*mask*/) const
 	{
 		vram.cmdWrite(addr, src ^ color, time);
@@ -693,7 +767,8 @@ struct XorOp {
 };
 
 struct NotOp {
-	void operator()(EmuTime::param time, VDPVRAM& vram, unsigned addr,
+	template<typename VRAM>
+	void operator()(EmuTime::param time, VRAM& vram, unsigned addr,
 	                byte src, byte color, byte mask) const
 	{
 		vram.cmdWrite(addr, (src & mask) | ~(color | mask), time);
@@ -702,7 +777,8 @@ struct NotOp {
 
 template<typename Op>
 struct TransparentOp : Op {
-	void operator()(EmuTime::param time, VDPVRAM& vram, unsigned addr,
+	template<typename VRAM>
+	void operator()(EmuTime::param time, VRAM& vram, unsigned addr,
 	                byte src, byte color, byte mask) const
 	{
 		// TODO does this skip the write or re-write the original value
@@ -964,6 +1040,7 @@ void VDPCmdEngine::executeLmmv(EmuTime::param limit)
 	bool dstExt = (ARG & MXD) != 0;
 	bool doPset = !dstExt || hasExtendedVRAM;
 	unsigned addr = Mode::addressOf(ADX, DY, dstExt);
+	DirectVRAM direct(Mode::lineWriteArea(vram, DY, dstExt));
 	auto calculator = getSlotCalculator(limit);
 
 	switch (phase) {
@@ -977,8 +1054,13 @@ loop:		if (unlikely(calculator.limitReached())) { phase = 0; break; }
 	case 1: {
 		if (unlikely(calculator.limitReached())) { phase = 1; break; }
 		if (likely(doPset)) {
-			Mode::pset(calculator.getTime(), vram, ADX, addr,
-			           tmpDst, CL, LogOp());
+			if (direct.isValid()) {
+				Mode::pset(calculator.getTime(), direct, ADX,
+				           addr, tmpDst, CL, LogOp());
+			} else {
+				Mode::pset(calculator.getTime(), vram, ADX,
+				           addr, tmpDst, CL, LogOp());
+			}
 		}
 		ADX += TX;
 		Delta delta = DELTA_72;
@@ -990,6 +1072,7 @@ loop:		if (unlikely(calculator.limitReached())) { phase = 0; break; }
 				commandDone(calculator.getTime());
 				break;
 			}
+			direct = DirectVRAM(Mode::lineWriteArea(vram, DY, dstExt));
 		}
 		addr = Mode::addressOf(ADX, DY, dstExt);
 		calculator.next(delta);
@@ -1090,6 +1173,7 @@ void VDPCmdEngine::executeLmmm(EmuTime::param limit)
 	bool doPoint = !srcExt || hasExtendedVRAM;
 	bool doPset  = !dstExt || hasExtendedVRAM;
 	unsigned dstAddr = Mode::addressOf(ADX, DY, dstExt);
+	DirectVRAM direct(Mode::lineWriteArea(vram, DY, dstExt));
 	auto calculator = getSlotCalculator(limit);
 
 	switch (phase) {
@@ -1110,8 +1194,13 @@ loop:		if (unlikely(calculator.limitReached())) { phase = 0; break; }
 	case 2: {
 		if (unlikely(calculator.limitReached())) { phase = 2; break; }
 		if (likely(doPset)) {
-			Mode::pset(calculator.getTime(), vram, ADX, dstAddr,
-			           tmpDst, tmpSrc, LogOp());
+			if (direct.isValid()) {
+				Mode::pset(calculator.getTime(), direct, ADX,
+				           dstAddr, tmpDst, tmpSrc, LogOp());
+			} else {
+				Mode::pset(calculator.getTime(), vram, ADX,
+				           dstAddr, tmpDst, tmpSrc, LogOp());
+			}
 		}
 		ASX += TX; ADX += TX;
 		Delta delta = DELTA_64;
@@ -1123,6 +1212,7 @@ loop:		if (unlikely(calculator.limitReached())) { phase = 0; break; }
 				commandDone(calculator.getTime());
 				break;
 			}
+			direct = DirectVRAM(Mode::lineWriteArea(vram, DY, dstExt));
 		}
 		dstAddr = Mode::addressOf(ADX, DY, dstExt);
 		calculator.next(delta);
@@ -1341,12 +1431,17 @@ void VDPCmdEngine::executeHmmv(EmuTime::param limit)
 		ADX, ANX << Mode::PIXELS_PER_BYTE_SHIFT, ARG );
 	bool dstExt = (ARG & MXD) != 0;
 	bool doPset = !dstExt || hasExtendedVRAM;
+	DirectVRAM direct(Mode::lineWriteArea(vram, DY, dstExt));
 	auto calculator = getSlotCalculator(limit);
 
 	while (!calculator.limitReached()) {
 		if (likely(doPset)) {
-			vram.cmdWrite(Mode::addressOf(ADX, DY, dstExt),
-			              COL, calculator.getTime());
+			unsigned addr = Mode::addressOf(ADX, DY, dstExt);
+			if (direct.isValid()) {
+				direct.cmdWrite(addr, COL, calculator.getTime());
+			} else {
+				vram.cmdWrite(addr, COL, calculator.getTime());
+			}
 		}
 		ADX += TX;
 		Delta delta = DELTA_48;
@@ -1358,6 +1453,7 @@ void VDPCmdEngine::executeHmmv(EmuTime::param limit)
 				commandDone(calculator.getTime());
 				break;
 			}
+			direct = DirectVRAM(Mode::lineWriteArea(vram, DY, dstExt));
 		}
 		calculator.next(delta);
 	}
@@ -1449,6 +1545,7 @@ void VDPCmdEngine::executeHmmm(EmuTime::param limit)
 	bool dstExt  = (ARG & MXD) != 0;
 	bool doPoint = !srcExt || hasExtendedVRAM;
 	bool doPset  = !dstExt || hasExtendedVRAM;
+	DirectVRAM direct(Mode::lineWriteArea(vram, DY, dstExt));
 	auto calculator = getSlotCalculator(limit);
 
 	switch (phase) {
@@ -1463,8 +1560,12 @@ loop:		if (unlikely(calculator.limitReached())) { phase = 0; break; }
 	case 1: {
 		if (unlikely(calculator.limitReached())) { phase = 1; break; }
 		if (likely(doPset)) {
-			vram.cmdWrite(Mode::addressOf(ADX, DY, dstExt),
-			              tmpSrc, calculator.getTime());
+			unsigned addr = Mode::addressOf(ADX, DY, dstExt);
+			if (direct.isValid()) {
+				direct.cmdWrite(addr, tmpSrc, calculator.getTime());
+			} else {
+				vram.cmdWrite(addr, tmpSrc, calculator.getTime());
+			}
 		}
 		ASX += TX; ADX += TX;
 		Delta delta = DELTA_64;
@@ -1476,6 +1577,7 @@ loop:		if (unlikely(calculator.limitReached())) { phase = 0; break; }
 				commandDone(calculator.getTime());
 				break;
 			}
+			direct = DirectVRAM(Mode::lineWriteArea(vram, DY, dstExt));
 		}
 		calculator.next(delta);
 		goto loop;
@@ -1583,6 +1685,7 @@ void VDPCmdEngine::executeYmmm(EmuTime::param limit)
 	//  OTOH YMMM also uses DX for both read and write
 	bool dstExt = (ARG & MXD) != 0;
 	bool doPset  = !dstExt || hasExtendedVRAM;
+	DirectVRAM direct(Mode::lineWriteArea(vram, DY, dstExt));
 	auto calculator = getSlotCalculator(limit);
 
 	switch (phase) {
@@ -1597,8 +1700,12 @@ loop:		if (unlikely(calculator.limitReached())) { phase = 0; break; }
 	case 1:
 		if (unlikely(calculator.limitReached())) { phase = 1; break; }
 		if (likely(doPset)) {
-			vram.cmdWrite(Mode::addressOf(ADX, DY, dstExt),
-			              tmpSrc, calculator.getTime());
+			unsigned addr = Mode::addressOf(ADX, DY, dstExt);
+			if (direct.isValid()) {
+				direct.cmdWrite(addr, tmpSrc, calculator.getTime());
+			} else {
+				vram.cmdWrite(addr, tmpSrc, calculator.getTime());
+			}
 		}
 		ADX += TX;
 		if (--ANX == 0) {
@@ -1609,6 +1716,7 @@ loop:		if (unlikely(calculator.limitReached())) { phase = 0; break; }
 				commandDone(calculator.getTime());
 				break;
 			}
+			direct = DirectVRAM(Mode::lineWriteArea(vram, DY, dstExt));
 		}
 		calculator.next(DELTA_40);
 		goto loop;
@@ -13,7 +13,7 @@ namespace openmsx {
 
 DummyVRAMOBserver VRAMWindow::dummyObserver;
 
-VRAMWindow::VRAMWindow(Ram& vram)
+VRAMWindow::VRAMWindow(TrackedRam& vram)
 	: data(&vram[0])
 {
 	observer = &dummyObserver;
@@ -146,7 +146,8 @@ void VDPVRAM::clear()
 		// Read from unconnected VRAM returns random data.
 		// TODO reading same location multiple times does not always
 		// give the same value.
-		memset(&data[actualSize], 0xFF, data.getSize() - actualSize);
+		memset(data.getWriteBackdoor() + actualSize, 0xFF,
+		       data.getSize() - actualSize);
 	}
 }
 
@@ -174,6 +175,25 @@ void VDPVRAM::updateSpritesEnabled(bool enabled, EmuTime::param time)
 	spriteChecker->updateSpritesEnabled(enabled, time);
 }
 
+byte* VDPVRAM::getCmdWriteArea(unsigned address, unsigned size)
+{
+	assert(Math::isPowerOfTwo(size));
+	assert((address & (size - 1)) == 0);
+	unsigned last = address | (size - 1);
+	if (((last & ~sizeMask) != 0) || (last >= actualSize)) {
+		// mirrored or (partly) not present
+		return nullptr;
+	}
+	if ((bitmapVisibleWindow.isInside(address, size) &&
+	     renderer->isVRAMObserved(address, size)) ||
+	    spriteAttribTable .isInside(address, size) ||
+	    spritePatternTable.isInside(address, size)) {
+		return nullptr;
+	}
+	// The other windows have no observers, see writeCommon().
+	return data.getWriteBackdoor(address, size) - address;
+}
+
 void VDPVRAM::setSizeMask(EmuTime::param time)
 {
 	sizeMask = (
@@ -212,15 +232,16 @@ void VDPVRAM::updateVRMode(bool newVRmode, EmuTime::param time)
 	vrMode = newVRmode;
 	setSizeMask(time);
 
+	byte* vram = data.getWriteBackdoor();
 	if (vrMode) {
 		// switch from VR=0 to VR=1
 		for (int i = 0x7FFF; i >=0; --i) {
-			std::swap(data[i], data[swapAddr(i)]);
+			std::swap(vram[i], vram[swapAddr(i)]);
 		}
 	} else {
 		// switch from VR=1 to VR=0
 		for (int i = 0; i < 0x8000; ++i) {
-			std::swap(data[i], data[swapAddr(i)]);
+			std::swap(vram[i], vram[swapAddr(i)]);
 		}
 	}
 }
@@ -304,7 +325,7 @@ void VDPVRAM::change4k8kMapping(bool mapping8k)
 			memcpy(dst, src, 64);
 		}
 	}
-	memcpy(&data[0], tmp, sizeof(tmp));
+	memcpy(data.getWriteBackdoor(), tmp, sizeof(tmp));
 }
 
 
@@ -329,7 +350,7 @@ void VDPVRAM::serialize(Archive& ar, unsigned /*version*/)
 		setSizeMask(static_cast<MSXDevice&>(vdp).getCurrentTime());
 	}
 
-	ar.serialize_blob("data", &data[0], actualSize);
+	data.serializeBlob(ar, "data", actualSize);
 	ar.serialize("cmdReadWindow",       cmdReadWindow);
 	ar.serialize("cmdWriteWindow",      cmdWriteWindow);
 	ar.serialize("nameTable",           nameTable);
@@ -5,7 +5,7 @@
 #include "VDP.hh"
 #include "VDPCmdEngine.hh"
 #include "SimpleDebuggable.hh"
-#include "Ram.hh"
+#include "TrackedRam.hh"
 #include "Math.hh"
 #include "openmsx.hh"
 #include "likely.hh"
@@ -297,6 +297,17 @@ public:
 		return (address & combiMask) == unsigned(baseAddr);
 	}
 
+	/** Test whether (at least) one address of the block [address,
+	  * address + size) is inside this window. The block must be aligned
+	  * and 'size' must be a power of 2.
+	  */
+	inline bool isInside(unsigned address, unsigned size) const {
+		assert(Math::isPowerOfTwo(size));
+		assert((address & (size - 1)) == 0);
+		return isEnabled() &&
+		       (((address ^ unsigned(baseAddr)) & combiMask & ~(size - 1)) == 0);
+	}
+
 	/** Notifies the observer of this window of a VRAM change,
 	  * if the changes address is inside this window.
 	  * @param address The address to test.
@@ -334,11 +345,11 @@ private:
 	/** Create a new window.
 	  * Initially, the window is disabled; use setRange to enable it.
 	  */
-	explicit VRAMWindow(Ram& vram);
+	explicit VRAMWindow(TrackedRam& vram);
 
 	/** Pointer to the entire VRAM data.
 	  */
-	byte* data;
+	const byte* data;
 
 	/** Observer associated with this VRAM window.
 	  * It will be called when changes occur within the window.
@@ -428,6 +439,19 @@ public:
 		writeCommon(address, value, time);
 	}
 
+	/** Get direct write access to VRAM for the command engine.
+	  * Writes through the returned pointer skip the synchronisation with
+	  * the renderer and the sprite checker, so that's only allowed when
+	  * none of them is interested in any address of the block [address,
+	  * address + size) (aligned, 'size' a power of 2). In that case a
+	  * pointer to the start of VRAM is returned (index it with the same
+	  * addresses as cmdWrite()), otherwise (also for mirrored or not
+	  * present VRAM) nullptr.
+	  * The answer only changes after the command engine is synced, so
+	  * the result can be used till the end of the current sync.
+	  */
+	byte* getCmdWriteArea(unsigned address, unsigned size);
+
 	/** Write a byte to VRAM through the CPU interface.
 	  * @param address The address to write.
 	  * @param value The value to write.
@@ -567,7 +591,7 @@ private:
 		spriteAttribTable.notify(address, time);
 		spritePatternTable.notify(address, time);
 
-		data[address] = value;
+		data.write(address, value);
 
 		// Cache dirty marking should happen after the commit,
 		// otherwise the cache could be re-validated based on old state.
@@ -603,7 +627,7 @@ private:
 
 	/** VRAM data block.
 	  */
-	Ram data;
+	TrackedRam data;
 
 	/** Debuggable with mode dependend view on the vram
 	  *   Screen7/8 are not interleaved in this mode.
@@ -31,6 +31,8 @@ public:
 		unsigned srcStartY, unsigned srcEndY, unsigned srcWidth,
 		ScalerOutput<Pixel>& dst, unsigned dstStartY, unsigned dstEndY) override;
 
+	bool isStripeSafe() const override { return true; }
+
 private:
 	PixelOperations<Pixel> pixelOps;
 };
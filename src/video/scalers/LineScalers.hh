@@ -2,6 +2,7 @@
 #define LINESCALERS_HH
 
 #include "PixelOperations.hh"
+#include "LineScalersAVX2.hh"
 #include "likely.hh"
 #include <type_traits>
 #include <cstring>
@@ -361,7 +362,7 @@ static inline void scale_1onN(
 	const Pixel* __restrict in, Pixel* __restrict out, size_t width)
 {
 	unsigned i = 0, j = 0;
-	for (/* */; i < (width - (N - 1)); i += N, j += 1) {
+	for (/* */; (i + N) <= width; i += N, j += 1) {
 		Pixel pix = in[j];
 		for (unsigned k = 0; k < N; ++k) {
 			out[i + k] = pix;
@@ -375,6 +376,15 @@ static inline void scale_1onN(
 template <typename Pixel>
 void Scale_1on3<Pixel>::operator()(const Pixel* in, Pixel* out, size_t width)
 {
+#ifdef LINE_SCALERS_AVX2
+	if (LineScalersAVX2::enabled()) {
+		size_t srcWidth = (width / 3) & ~7;
+		LineScalersAVX2::scale_1on3(in, out, srcWidth);
+		in    +=     srcWidth;
+		out   += 3 * srcWidth;
+		width -= 3 * srcWidth;
+	}
+#endif
 	scale_1onN<Pixel, 3>(in, out, width);
 }
 
@@ -470,13 +480,25 @@ void Scale_1on2<Pixel>::operator()(
 	// the instrinsic version is no longer needed.
 	size_t srcWidth = dstWidth / 2;
 
+#ifdef LINE_SCALERS_AVX2
+	if (LineScalersAVX2::enabled()) {
+		size_t chunk = 32 / sizeof(Pixel);
+		size_t srcWidth2 = srcWidth & ~(chunk - 1);
+		LineScalersAVX2::scale_1on2(in, out, srcWidth2);
+		in  +=      srcWidth2;
+		out +=  2 * srcWidth2;
+		srcWidth -= srcWidth2;
+	}
+#endif
 #ifdef __SSE2__
 	size_t chunk = 4 * sizeof(__m128i) / sizeof(Pixel);
 	size_t srcWidth2 = srcWidth & ~(chunk - 1);
-	scale_1on2_SSE(in, out, srcWidth2);
-	in  +=      srcWidth2;
-	out +=  2 * srcWidth2;
-	srcWidth -= srcWidth2;
+	if (srcWidth2 != 0) {
+		scale_1on2_SSE(in, out, srcWidth2);
+		in  +=      srcWidth2;
+		out +=  2 * srcWidth2;
+		srcWidth -= srcWidth2;
+	}
 #endif
 
 	// C++ version. Used both on non-x86 machines and (possibly) on x86 for
@@ -670,10 +692,23 @@ template <typename Pixel>
 void Scale_2on1<Pixel>::operator()(
 	const Pixel* __restrict in, Pixel* __restrict out, size_t dstWidth)
 {
+#ifdef LINE_SCALERS_AVX2
+	if (LineScalersAVX2::enabled()) {
+		// Same granularity as the SSE2 version, for 32bpp that version
+		// rounds differently than the C++ version.
+		size_t n = dstWidth & ~(64 / sizeof(Pixel) - 1);
+		LineScalersAVX2::scale_2on1(in, out, n, pixelOps.getBlendMask());
+		in  += 2 * n;
+		out +=     n;
+		dstWidth -= n;
+	}
+#endif
 #ifdef __SSE2__
 	size_t n64 = (dstWidth * sizeof(Pixel)) & ~63;
-	Pixel mask = pixelOps.getBlendMask();
-	scale_2on1_SSE(in, out, n64, mask); // process 64 byte chunks
+	if (n64 != 0) {
+		Pixel mask = pixelOps.getBlendMask();
+		scale_2on1_SSE(in, out, n64, mask); // process 64 byte chunks
+	}
 	dstWidth &= ((64 / sizeof(Pixel)) - 1); // remaning pixels (if any)
 	if (likely(dstWidth == 0)) return;
 	in  += (2 * n64) / sizeof(Pixel);
@@ -815,8 +850,18 @@ template <typename Pixel>
 void Scale_2on3<Pixel>::operator()(
 	const Pixel* __restrict in, Pixel* __restrict out, size_t width)
 {
+#ifdef LINE_SCALERS_AVX2
+	if (LineScalersAVX2::enabled()) {
+		size_t srcWidth = ((width / 3) * 2) & ~15;
+		LineScalersAVX2::scale_2on3(in, out, srcWidth,
+		                            pixelOps.getBlendMask());
+		in    +=     srcWidth;
+		out   += 3 * srcWidth / 2;
+		width -= 3 * srcWidth / 2;
+	}
+#endif
 	unsigned i = 0, j = 0;
-	for (/* */; i < (width - 2); i += 3, j += 2) {
+	for (/* */; (i + 3) <= width; i += 3, j += 2) {
 		out[i + 0] =                                 in[j + 0];
 		out[i + 1] = pixelOps.template blend2<1, 1>(&in[j + 0]);
 		out[i + 2] =                                 in[j + 1];
@@ -1085,7 +1130,18 @@ void BlendLines<Pixel, w1, w2>::operator()(
 	const Pixel* in1, const Pixel* in2, Pixel* out, unsigned width)
 {
 	// It _IS_ allowed that the output is the same as one of the inputs.
-	// TODO SSE optimizations
+#ifdef LINE_SCALERS_AVX2
+	if ((w1 == w2) && LineScalersAVX2::enabled()) {
+		// blend<w1, w2>() is the same as blend<1, 1>() in this case
+		unsigned n = width & ~(32 / sizeof(Pixel) - 1);
+		LineScalersAVX2::blendLines(in1, in2, out, n,
+		                            pixelOps.getBlendMask());
+		in1 += n;
+		in2 += n;
+		out += n;
+		width -= n;
+	}
+#endif
 	// pure C++ version
 	for (unsigned i = 0; i < width; ++i) {
 		out[i] = pixelOps.template blend<w1, w2>(in1[i], in2[i]);
@@ -1128,6 +1184,17 @@ void AlphaBlendLines<Pixel>::operator()(
 	const Pixel* in1, const Pixel* in2, Pixel* out, unsigned width)
 {
 	// It _IS_ allowed that the output is the same as one of the inputs.
+#ifdef LINE_SCALERS_AVX2
+	if (LineScalersAVX2::enabled()) {
+		unsigned n = width & ~(32 / sizeof(Pixel) - 1);
+		LineScalersAVX2::alphaBlendLines(in1, in2, out, n,
+		                                 pixelOps.getAshift());
+		in1 += n;
+		in2 += n;
+		out += n;
+		width -= n;
+	}
+#endif
 	for (unsigned i = 0; i < width; ++i) {
 		out[i] = pixelOps.alphaBlend(in1[i], in2[i]);
 	}
@@ -1153,6 +1220,17 @@ void AlphaBlendLines<Pixel>::operator()(
 	//    }
 	Pixel in1M = pixelOps.multiply(in1, alpha);
 	unsigned alpha2 = 256 - alpha;
+#ifdef LINE_SCALERS_AVX2
+	if (LineScalersAVX2::enabled()) {
+		unsigned n = width & ~7;
+		LineScalersAVX2::alphaBlendLines(
+			in1M, alpha2, reinterpret_cast<const uint32_t*>(in2),
+			reinterpret_cast<uint32_t*>(out), n);
+		in2 += n;
+		out += n;
+		width -= n;
+	}
+#endif
 	for (unsigned i = 0; i < width; ++i) {
 		out[i] = in1M + pixelOps.multiply(in2[i], alpha2);
 	}
@@ -0,0 +1,456 @@
+#include "LineScalersAVX2.hh"
+#ifdef LINE_SCALERS_AVX2
+#include "unreachable.hh"
+#include <atomic>
+#include <cassert>
+#include <immintrin.h>
+#endif
+
+namespace openmsx {
+namespace LineScalersAVX2 {
+
+#ifdef LINE_SCALERS_AVX2
+
+// --- Run-time CPU detection ---
+
+static bool detectAVX2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+static const bool cpuHasAVX2 = detectAVX2();
+static std::atomic<bool> useAVX2(cpuHasAVX2);
+
+bool enabled()
+{
+	return useAVX2.load(std::memory_order_relaxed);
+}
+
+bool setEnabled(bool enable)
+{
+	return useAVX2.exchange(enable && cpuHasAVX2);
+}
+
+
+// --- Helpers ---
+
+#define TARGET_AVX2 LINE_SCALERS_AVX2_TARGET
+
+TARGET_AVX2 static inline __m256i load(const void* p)
+{
+	return _mm256_loadu_si256(static_cast<const __m256i*>(p));
+}
+TARGET_AVX2 static inline void store(void* p, __m256i v)
+{
+	_mm256_storeu_si256(static_cast<__m256i*>(p), v);
+}
+
+// Load 8 pixels, each in the lower bits of a 32-bit element.
+template<typename Pixel> TARGET_AVX2 static inline __m256i load8(const Pixel* p)
+{
+	if (sizeof(Pixel) == 4) {
+		return load(p);
+	} else {
+		return _mm256_cvtepu16_epi32(
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+	}
+}
+// Inverse of load8().
+template<typename Pixel> TARGET_AVX2 static inline void store8(Pixel* p, __m256i v)
+{
+	if (sizeof(Pixel) == 4) {
+		store(p, v);
+	} else {
+		__m256i w = _mm256_permute4x64_epi64(_mm256_packus_epi32(v, v), 0x08);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p),
+		                 _mm256_castsi256_si128(w));
+	}
+}
+
+template<typename Pixel> TARGET_AVX2 static inline __m256i set1(Pixel p)
+{
+	if (sizeof(Pixel) == 4) {
+		return _mm256_set1_epi32(p);
+	} else {
+		return _mm256_set1_epi16(p);
+	}
+}
+
+// Note: like all AVX2 unpack instructions these work within 128-bit lanes.
+template<typename Pixel> TARGET_AVX2 static inline __m256i unpacklo(__m256i x, __m256i y)
+{
+	if (sizeof(Pixel) == 4) {
+		return _mm256_unpacklo_epi32(x, y);
+	} else if (sizeof(Pixel) == 2) {
+		return _mm256_unpacklo_epi16(x, y);
+	} else {
+		UNREACHABLE;
+	}
+}
+template<typename Pixel> TARGET_AVX2 static inline __m256i unpackhi(__m256i x, __m256i y)
+{
+	if (sizeof(Pixel) == 4) {
+		return _mm256_unpackhi_epi32(x, y);
+	} else if (sizeof(Pixel) == 2) {
+		return _mm256_unpackhi_epi16(x, y);
+	} else {
+		UNREACHABLE;
+	}
+}
+
+template<typename Pixel> TARGET_AVX2 static inline __m256i isEqual(__m256i x, __m256i y)
+{
+	if (sizeof(Pixel) == 4) {
+		return _mm256_cmpeq_epi32(x, y);
+	} else {
+		return _mm256_cmpeq_epi16(x, y);
+	}
+}
+
+template<typename Pixel> TARGET_AVX2 static inline __m256i srli1(__m256i x)
+{
+	if (sizeof(Pixel) == 4) {
+		return _mm256_srli_epi32(x, 1);
+	} else {
+		return _mm256_srli_epi16(x, 1);
+	}
+}
+template<typename Pixel> TARGET_AVX2 static inline __m256i add(__m256i x, __m256i y)
+{
+	if (sizeof(Pixel) == 4) {
+		return _mm256_add_epi32(x, y);
+	} else {
+		return _mm256_add_epi16(x, y);
+	}
+}
+
+// Same as PixelOperations::avgDown(), for 8 (32bpp) or 16 (16bpp) pixels.
+// Also works for 16bpp pixels stored in 32-bit elements (see load8()).
+template<typename Pixel> TARGET_AVX2 static inline __m256i avgDown(
+	__m256i p, __m256i q, __m256i mask)
+{
+	// (p & q) + (((p ^ q) & mask) >> 1)
+	return add<Pixel>(_mm256_and_si256(p, q),
+	                  srli1<Pixel>(_mm256_and_si256(_mm256_xor_si256(p, q), mask)));
+}
+
+// Same as select() in Scale2xScaler.cc.
+TARGET_AVX2 static inline __m256i select(__m256i a0, __m256i a1, __m256i mask)
+{
+	return _mm256_xor_si256(_mm256_and_si256(_mm256_xor_si256(a0, a1), mask), a0);
+}
+
+// Put the 128-bit halves of the result of a lane-wise unpack in the right
+// order: returns the low halves of 'l' and 'h' (first = true), or the high
+// halves.
+TARGET_AVX2 static inline __m256i lanes(__m256i l, __m256i h, bool first)
+{
+	return first ? _mm256_permute2x128_si256(l, h, 0x20)
+	             : _mm256_permute2x128_si256(l, h, 0x31);
+}
+
+
+// --- Line scalers ---
+
+template<typename Pixel>
+TARGET_AVX2 void scale_1on2(const Pixel* in, Pixel* out, size_t srcWidth)
+{
+	static const size_t UNIT = sizeof(__m256i) / sizeof(Pixel);
+	assert((srcWidth % UNIT) == 0);
+	for (size_t x = 0; x < srcWidth; x += UNIT) {
+		__m256i a = load(in + x);
+		__m256i l = unpacklo<Pixel>(a, a);
+		__m256i h = unpackhi<Pixel>(a, a);
+		store(out + 2 * x +    0, lanes(l, h, true));
+		store(out + 2 * x + UNIT, lanes(l, h, false));
+	}
+}
+
+template<typename Pixel>
+TARGET_AVX2 void scale_2on1(const Pixel* in, Pixel* out, size_t dstWidth, Pixel blendMask)
+{
+	static const size_t UNIT = sizeof(__m256i) / sizeof(Pixel);
+	assert((dstWidth % UNIT) == 0);
+	__m256i mask = set1<Pixel>(blendMask);
+	for (size_t x = 0; x < dstWidth; x += UNIT) {
+		__m256i a = load(in + 2 * x +    0);
+		__m256i b = load(in + 2 * x + UNIT);
+		__m256i r;
+		if (sizeof(Pixel) == 4) {
+			// Same as the SSE2 version: _mm_avg_epu8() (rounds up).
+			__m256 fa = _mm256_castsi256_ps(a);
+			__m256 fb = _mm256_castsi256_ps(b);
+			__m256i p = _mm256_castps_si256(_mm256_shuffle_ps(fa, fb, 0x88));
+			__m256i q = _mm256_castps_si256(_mm256_shuffle_ps(fa, fb, 0xDD));
+			r = _mm256_avg_epu8(p, q);
+		} else {
+			// Separate the even and odd pixels.
+			__m256i low = _mm256_set1_epi32(0xFFFF);
+			__m256i p = _mm256_packus_epi32(_mm256_and_si256(a, low),
+			                                _mm256_and_si256(b, low));
+			__m256i q = _mm256_packus_epi32(_mm256_srli_epi32(a, 16),
+			                                _mm256_srli_epi32(b, 16));
+			r = avgDown<Pixel>(p, q, mask);
+		}
+		// Both cases above work within 128-bit lanes, the result has
+		// the 64-bit parts in the order a0 b0 a1 b1.
+		store(out + x, _mm256_permute4x64_epi64(r, 0xD8));
+	}
+}
+
+template<typename Pixel>
+TARGET_AVX2 void scale_1on3(const Pixel* in, Pixel* out, size_t srcWidth)
+{
+	assert((srcWidth % 8) == 0);
+	const __m256i i0 = _mm256_setr_epi32(0, 0, 0, 1, 1, 1, 2, 2);
+	const __m256i i1 = _mm256_setr_epi32(2, 3, 3, 3, 4, 4, 4, 5);
+	const __m256i i2 = _mm256_setr_epi32(5, 5, 6, 6, 6, 7, 7, 7);
+	for (size_t x = 0; x < srcWidth; x += 8) {
+		__m256i a = load8(in + x);
+		store8(out + 3 * x +  0, _mm256_permutevar8x32_epi32(a, i0));
+		store8(out + 3 * x +  8, _mm256_permutevar8x32_epi32(a, i1));
+		store8(out + 3 * x + 16, _mm256_permutevar8x32_epi32(a, i2));
+	}
+}
+
+template<typename Pixel>
+TARGET_AVX2 void scale_2on3(const Pixel* in, Pixel* out, size_t srcWidth, Pixel blendMask)
+{
+	// Each pair of input pixels 'p q' becomes 'p avg(p,q) q'. Pixels are
+	// processed in 32-bit elements (also for 16bpp), 16 input pixels
+	// (A and B) at a time. These are the pixel positions in the 3 output
+	// vectors (A0..A7 and B0..B7 are the input, M0..M7 the averages):
+	//   A0 M0 A1 A2 M1 A3 A4 M2
+	//   A5 A6 M3 A7 B0 M4 B1 B2
+	//   M5 B3 B4 M6 B5 B6 M7 B7
+	assert((srcWidth % 16) == 0);
+	__m256i mask = _mm256_set1_epi32(blendMask);
+	const __m256i EVEN_A = _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0);
+	const __m256i EVEN_B = _mm256_setr_epi32(0, 0, 0, 0, 0, 2, 4, 6);
+	const __m256i ODD_A  = _mm256_setr_epi32(1, 3, 5, 7, 0, 0, 0, 0);
+	const __m256i ODD_B  = _mm256_setr_epi32(0, 0, 0, 0, 1, 3, 5, 7);
+	const __m256i OUT0_A = _mm256_setr_epi32(0, 0, 1, 2, 0, 3, 4, 0);
+	const __m256i OUT0_M = _mm256_setr_epi32(0, 0, 0, 0, 1, 0, 0, 2);
+	const __m256i OUT1_A = _mm256_setr_epi32(5, 6, 0, 7, 0, 0, 0, 0);
+	const __m256i OUT1_B = _mm256_setr_epi32(0, 0, 0, 0, 0, 0, 1, 2);
+	const __m256i OUT1_M = _mm256_setr_epi32(0, 0, 3, 0, 0, 4, 0, 0);
+	const __m256i OUT2_B = _mm256_setr_epi32(0, 3, 4, 0, 5, 6, 0, 7);
+	const __m256i OUT2_M = _mm256_setr_epi32(5, 0, 0, 6, 0, 0, 7, 0);
+	for (size_t x = 0; x < srcWidth; x += 16) {
+		__m256i a = load8(in + x + 0);
+		__m256i b = load8(in + x + 8);
+		__m256i even = _mm256_blend_epi32(
+			_mm256_permutevar8x32_epi32(a, EVEN_A),
+			_mm256_permutevar8x32_epi32(b, EVEN_B), 0xF0);
+		__m256i odd = _mm256_blend_epi32(
+			_mm256_permutevar8x32_epi32(a, ODD_A),
+			_mm256_permutevar8x32_epi32(b, ODD_B), 0xF0);
+		__m256i m = avgDown<uint32_t>(even, odd, mask);
+
+		__m256i o0 = _mm256_blend_epi32(
+			_mm256_permutevar8x32_epi32(a, OUT0_A),
+			_mm256_permutevar8x32_epi32(m, OUT0_M), 0x92);
+		__m256i o1 = _mm256_blend_epi32(
+			_mm256_blend_epi32(
+				_mm256_permutevar8x32_epi32(a, OUT1_A),
+				_mm256_permutevar8x32_epi32(b, OUT1_B), 0xD0),
+			_mm256_permutevar8x32_epi32(m, OUT1_M), 0x24);
+		__m256i o2 = _mm256_blend_epi32(
+			_mm256_permutevar8x32_epi32(b, OUT2_B),
+			_mm256_permutevar8x32_epi32(m, OUT2_M), 0x49);
+		Pixel* o = out + (3 * x) / 2;
+		store8(o +  0, o0);
+		store8(o +  8, o1);
+		store8(o + 16, o2);
+	}
+}
+
+template<typename Pixel>
+TARGET_AVX2 void blendLines(const Pixel* in1, const Pixel* in2, Pixel* out,
+                            size_t width, Pixel blendMask)
+{
+	static const size_t UNIT = sizeof(__m256i) / sizeof(Pixel);
+	assert((width % UNIT) == 0);
+	__m256i mask = set1<Pixel>(blendMask);
+	for (size_t x = 0; x < width; x += UNIT) {
+		store(out + x, avgDown<Pixel>(load(in1 + x), load(in2 + x), mask));
+	}
+}
+
+// Same as PixelOperations<uint32_t>::lerp(p1, p2, x), but with a different
+// 'x' per pixel.
+TARGET_AVX2 static inline __m256i lerp(__m256i p1, __m256i p2, __m256i x)
+{
+	__m256i RB = _mm256_set1_epi32(0x00FF00FF);
+	__m256i AG = _mm256_set1_epi32(0xFF00FF00);
+	__m256i rb1 = _mm256_and_si256(p1, RB);
+	__m256i ag1 = _mm256_and_si256(_mm256_srli_epi32(p1, 8), RB);
+	__m256i rb2 = _mm256_and_si256(p2, RB);
+	__m256i ag2 = _mm256_and_si256(_mm256_srli_epi32(p2, 8), RB);
+	__m256i trb = _mm256_srli_epi32(
+		_mm256_mullo_epi32(_mm256_sub_epi32(rb2, rb1), x), 8);
+	__m256i tag = _mm256_mullo_epi32(_mm256_sub_epi32(ag2, ag1), x);
+	__m256i rb = _mm256_and_si256(_mm256_add_epi32(trb, rb1), RB);
+	__m256i ag = _mm256_and_si256(
+		_mm256_add_epi32(tag, _mm256_slli_epi32(ag1, 8)), AG);
+	return _mm256_or_si256(rb, ag);
+}
+
+template<typename Pixel>
+TARGET_AVX2 void alphaBlendLines(const Pixel* in1, const Pixel* in2, Pixel* out,
+                                 size_t width, unsigned alphaShift)
+{
+	static const size_t UNIT = sizeof(__m256i) / sizeof(Pixel);
+	assert((width % UNIT) == 0);
+	if (sizeof(Pixel) == 4) {
+		__m128i shift = _mm_cvtsi32_si128(alphaShift);
+		__m256i FF = _mm256_set1_epi32(0xFF);
+		for (size_t x = 0; x < width; x += UNIT) {
+			__m256i p1 = load(in1 + x);
+			__m256i p2 = load(in2 + x);
+			__m256i a = _mm256_and_si256(_mm256_srl_epi32(p1, shift), FF);
+			store(out + x, lerp(p2, p1, a));
+		}
+	} else {
+		// See PixelOperations::alphaBlend(): 0x0001 is the transparent
+		// color in 16bpp.
+		__m256i key = _mm256_set1_epi16(1);
+		for (size_t x = 0; x < width; x += UNIT) {
+			__m256i p1 = load(in1 + x);
+			__m256i p2 = load(in2 + x);
+			store(out + x, _mm256_blendv_epi8(p1, p2,
+			                                  _mm256_cmpeq_epi16(p1, key)));
+		}
+	}
+}
+
+TARGET_AVX2 void alphaBlendLines(uint32_t in1M, unsigned alpha2,
+                                 const uint32_t* in2, uint32_t* out,
+                                 size_t width)
+{
+	// out = in1M + PixelOperations<uint32_t>::multiply(in2, alpha2)
+	assert((width % 8) == 0);
+	__m256i RB = _mm256_set1_epi32(0x00FF00FF);
+	__m256i AG = _mm256_set1_epi32(0xFF00FF00);
+	__m256i c = _mm256_set1_epi32(in1M);
+	__m256i f = _mm256_set1_epi32(alpha2);
+	for (size_t x = 0; x < width; x += 8) {
+		__m256i p = load(in2 + x);
+		__m256i rb = _mm256_srli_epi32(_mm256_and_si256(
+			_mm256_mullo_epi32(_mm256_and_si256(p, RB), f), AG), 8);
+		__m256i ag = _mm256_and_si256(_mm256_mullo_epi32(
+			_mm256_and_si256(_mm256_srli_epi32(p, 8), RB), f), AG);
+		store(out + x, _mm256_add_epi32(c, _mm256_or_si256(rb, ag)));
+	}
+}
+
+
+// --- Scale2x ---
+
+// AVX2 version of scale1() in Scale2xScaler.cc, for 16 (16bpp) or 8 (32bpp)
+// pixels. 'prev' and 'next' are the neighbouring units of 'mid'.
+template<typename Pixel, bool DOUBLE_X>
+TARGET_AVX2 static inline void scale2xUnit(
+	__m256i top, __m256i bottom, __m256i prev, __m256i mid, __m256i next,
+	Pixel* out0, Pixel* out1)
+{
+	// _mm256_alignr_epi8() works within 128-bit lanes, the cross-lane
+	// permutes provide the pixels that shift in from the other lane.
+	__m256i left = _mm256_alignr_epi8(
+		mid, _mm256_permute2x128_si256(prev, mid, 0x21),
+		16 - sizeof(Pixel));
+	__m256i right = _mm256_alignr_epi8(
+		_mm256_permute2x128_si256(mid, next, 0x21), mid,
+		sizeof(Pixel));
+
+	__m256i teqb = isEqual<Pixel>(top, bottom);
+	__m256i leqt = isEqual<Pixel>(left, top);
+	__m256i reqt = isEqual<Pixel>(right, top);
+	__m256i leqb = isEqual<Pixel>(left, bottom);
+	__m256i reqb = isEqual<Pixel>(right, bottom);
+
+	__m256i cnda = _mm256_andnot_si256(_mm256_or_si256(teqb, reqt), leqt);
+	__m256i cndb = _mm256_andnot_si256(_mm256_or_si256(teqb, leqt), reqt);
+	__m256i cndc = _mm256_andnot_si256(_mm256_or_si256(teqb, reqb), leqb);
+	__m256i cndd = _mm256_andnot_si256(_mm256_or_si256(teqb, leqb), reqb);
+
+	__m256i a = select(mid, top,    cnda);
+	__m256i b = select(mid, top,    cndb);
+	__m256i c = select(mid, bottom, cndc);
+	__m256i d = select(mid, bottom, cndd);
+
+	if (DOUBLE_X) {
+		static const size_t UNIT = sizeof(__m256i) / sizeof(Pixel);
+		__m256i ab0 = unpacklo<Pixel>(a, b);
+		__m256i ab1 = unpackhi<Pixel>(a, b);
+		__m256i cd0 = unpacklo<Pixel>(c, d);
+		__m256i cd1 = unpackhi<Pixel>(c, d);
+		store(out0 +    0, lanes(ab0, ab1, true));
+		store(out0 + UNIT, lanes(ab0, ab1, false));
+		store(out1 +    0, lanes(cd0, cd1, true));
+		store(out1 + UNIT, lanes(cd0, cd1, false));
+	} else {
+		store(out0, a);
+		store(out1, c);
+	}
+}
+
+template<typename Pixel, bool DOUBLE_X>
+TARGET_AVX2 void scale2x(Pixel* out0, Pixel* out1,
+                         const Pixel* in0, const Pixel* in1, const Pixel* in2,
+                         size_t srcWidth)
+{
+	static const size_t UNIT = sizeof(__m256i) / sizeof(Pixel);
+	static const size_t SCALE = DOUBLE_X ? 2 : 1;
+	assert((srcWidth % UNIT) == 0);
+	assert(srcWidth != 0);
+
+	// Outside the line, the first and last pixel are repeated.
+	__m256i prev = set1<Pixel>(in1[0]);
+	__m256i mid = load(in1);
+	size_t last = srcWidth - UNIT;
+	for (size_t x = 0; x < last; x += UNIT) {
+		__m256i next = load(in1 + x + UNIT);
+		scale2xUnit<Pixel, DOUBLE_X>(
+			load(in0 + x), load(in2 + x), prev, mid, next,
+			out0 + SCALE * x, out1 + SCALE * x);
+		prev = mid;
+		mid = next;
+	}
+	__m256i next = set1<Pixel>(in1[srcWidth - 1]);
+	scale2xUnit<Pixel, DOUBLE_X>(
+		load(in0 + last), load(in2 + last), prev, mid, next,
+		out0 + SCALE * last, out1 + SCALE * last);
+}
+
+
+// Force template instantiation.
+#define INSTANTIATE(Pixel) \
+template void scale_1on2<Pixel>(const Pixel*, Pixel*, size_t); \
+template void scale_2on1<Pixel>(const Pixel*, Pixel*, size_t, Pixel); \
+template void scale_1on3<Pixel>(const Pixel*, Pixel*, size_t); \
+template void scale_2on3<Pixel>(const Pixel*, Pixel*, size_t, Pixel); \
+template void blendLines<Pixel>(const Pixel*, const Pixel*, Pixel*, size_t, Pixel); \
+template void alphaBlendLines<Pixel>(const Pixel*, const Pixel*, Pixel*, size_t, unsigned); \
+template void scale2x<Pixel, false>(Pixel*, Pixel*, const Pixel*, const Pixel*, const Pixel*, size_t); \
+template void scale2x<Pixel, true >(Pixel*, Pixel*, const Pixel*, const Pixel*, const Pixel*, size_t);
+
+INSTANTIATE(uint16_t)
+INSTANTIATE(uint32_t)
+
+#else // LINE_SCALERS_AVX2
+
+bool enabled()
+{
+	return false;
+}
+
+bool setEnabled(bool /*enable*/)
+{
+	return false;
+}
+
+#endif // LINE_SCALERS_AVX2
+
+} // namespace LineScalersAVX2
+} // namespace openmsx
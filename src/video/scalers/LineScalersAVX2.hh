@@ -0,0 +1,89 @@
+#ifndef LINESCALERSAVX2_HH
+#define LINESCALERSAVX2_HH
+
+#include <cstddef>
+#include <cstdint>
+
+// AVX2 versions of some of the hot loops in LineScalers.hh and in the Scale2x
+// scaler. Not all x86_64 CPUs support AVX2 (all do support SSE2), so these are
+// compiled with a function-specific target attribute and only used after a
+// run-time check, see enabled().
+//
+// Each routine only handles a multiple of a fixed number of pixels (given per
+// routine), the caller takes care of the remaining pixels (if any). Input and
+// output don't need to be aligned. The results are bit-identical to the
+// SSE2 code (if there is one) and otherwise to the C++ code.
+#if defined(__x86_64__) && defined(__GNUC__)
+#define LINE_SCALERS_AVX2
+// Note: this attribute must also be present on the declarations, otherwise gcc
+// ignores it on the (template) definitions.
+#define LINE_SCALERS_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace openmsx {
+namespace LineScalersAVX2 {
+
+/** Should the AVX2 routines be used? By default this is the case when the
+  * CPU supports AVX2.
+  */
+bool enabled();
+
+/** Enable or disable the AVX2 routines (they're only used when the CPU
+  * supports AVX2). Only meant for testing and benchmarking. Returns the
+  * previous setting.
+  */
+bool setEnabled(bool enable);
+
+#ifdef LINE_SCALERS_AVX2
+
+/** Like Scale_1on2. 'srcWidth' must be a multiple of 32 / sizeof(Pixel). */
+template<typename Pixel> LINE_SCALERS_AVX2_TARGET
+void scale_1on2(const Pixel* in, Pixel* out, size_t srcWidth);
+
+/** Like the SSE2 version of Scale_2on1. 'dstWidth' must be a multiple of
+  * 32 / sizeof(Pixel). */
+template<typename Pixel> LINE_SCALERS_AVX2_TARGET
+void scale_2on1(const Pixel* in, Pixel* out, size_t dstWidth, Pixel blendMask);
+
+/** Like Scale_1on3. 'srcWidth' must be a multiple of 8. */
+template<typename Pixel> LINE_SCALERS_AVX2_TARGET
+void scale_1on3(const Pixel* in, Pixel* out, size_t srcWidth);
+
+/** Like Scale_2on3. 'srcWidth' must be a multiple of 16. */
+template<typename Pixel> LINE_SCALERS_AVX2_TARGET
+void scale_2on3(const Pixel* in, Pixel* out, size_t srcWidth, Pixel blendMask);
+
+/** Like BlendLines<Pixel, 1, 1>. 'width' must be a multiple of
+  * 32 / sizeof(Pixel). The output may be the same as one of the inputs. */
+template<typename Pixel> LINE_SCALERS_AVX2_TARGET
+void blendLines(const Pixel* in1, const Pixel* in2, Pixel* out, size_t width,
+                Pixel blendMask);
+
+/** Like AlphaBlendLines (the version with two input lines). 'width' must be
+  * a multiple of 32 / sizeof(Pixel). The output may be the same as one of
+  * the inputs. 'alphaShift' is only used for 32bpp. */
+template<typename Pixel> LINE_SCALERS_AVX2_TARGET
+void alphaBlendLines(const Pixel* in1, const Pixel* in2, Pixel* out,
+                     size_t width, unsigned alphaShift);
+
+/** Like AlphaBlendLines (the version with a constant color), but with the
+  * pre-multiplied color and the inverse alpha value as parameters.
+  * 'width' must be a multiple of 8. */
+LINE_SCALERS_AVX2_TARGET
+void alphaBlendLines(uint32_t in1M, unsigned alpha2, const uint32_t* in2,
+                     uint32_t* out, size_t width);
+
+/** The Scale2x algorithm on one line: calculates 2 output lines from 3 input
+  * lines, optionally doubling the number of pixels per line. 'srcWidth' must
+  * be a (non-zero) multiple of 32 / sizeof(Pixel). */
+template<typename Pixel, bool DOUBLE_X> LINE_SCALERS_AVX2_TARGET
+void scale2x(Pixel* out0, Pixel* out1,
+             const Pixel* in0, const Pixel* in1, const Pixel* in2,
+             size_t srcWidth);
+
+#endif
+
+} // namespace LineScalersAVX2
+} // namespace openmsx
+
+#endif
@@ -12,6 +12,7 @@ Visit the Scale2x site for info:
 
 #include "Scale2xScaler.hh"
 #include "FrameSource.hh"
+#include "LineScalersAVX2.hh"
 #include "ScalerOutput.hh"
 #include "unreachable.hh"
 #include "vla.hh"
@@ -221,6 +222,14 @@ inline void Scale2xScaler<Pixel>::scaleLine_1on2(
 	// though a single loop only has to fetch the inputs once and can
 	// eliminate some common sub-expressions). For the asm version the
 	// situation is reversed.
+#ifdef LINE_SCALERS_AVX2
+	if (LineScalersAVX2::enabled() &&
+	    (((srcWidth * sizeof(Pixel)) % 32) == 0)) {
+		LineScalersAVX2::scale2x<Pixel, true>(
+			dst0, dst1, src0, src1, src2, srcWidth);
+		return;
+	}
+#endif
 #ifdef __SSE2__
 	scaleSSE<true>(dst0, dst1, src0, src1, src2, srcWidth);
 #else
@@ -273,6 +282,14 @@ inline void Scale2xScaler<Pixel>::scaleLine_1on1(
 	const Pixel* __restrict src0, const Pixel* __restrict src1,
 	const Pixel* __restrict src2, size_t srcWidth) __restrict
 {
+#ifdef LINE_SCALERS_AVX2
+	if (LineScalersAVX2::enabled() &&
+	    (((srcWidth * sizeof(Pixel)) % 32) == 0)) {
+		LineScalersAVX2::scale2x<Pixel, false>(
+			dst0, dst1, src0, src1, src2, srcWidth);
+		return;
+	}
+#endif
 #ifdef __SSE2__
 	scaleSSE<false>(dst0, dst1, src0, src1, src2, srcWidth);
 #else
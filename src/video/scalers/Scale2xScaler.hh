@@ -20,6 +20,8 @@ public:
 		unsigned srcStartY, unsigned srcEndY, unsigned srcWidth,
 		ScalerOutput<Pixel>& dst, unsigned dstStartY, unsigned dstEndY) override;
 
+	bool isStripeSafe() const override { return true; }
+
 private:
 	void scaleLine_1on2(Pixel* dst0, Pixel* dst1,
 		const Pixel* src0, const Pixel* src1, const Pixel* src2,
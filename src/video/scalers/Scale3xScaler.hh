@@ -17,6 +17,8 @@ public:
 		unsigned srcStartY, unsigned srcEndY, unsigned srcWidth,
 		ScalerOutput<Pixel>& dst, unsigned dstStartY, unsigned dstEndY) override;
 
+	bool isStripeSafe() const override { return true; }
+
 private:
 	void scaleLine1on3Half(Pixel* dst,
 		const Pixel* src0, const Pixel* src1, const Pixel* src2,
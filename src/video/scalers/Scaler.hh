@@ -30,6 +30,16 @@ public:
 	virtual void scaleImage(FrameSource& src, const RawFrame* superImpose,
 		unsigned srcStartY, unsigned srcEndY, unsigned srcWidth,
 		ScalerOutput<Pixel>& dst, unsigned dstStartY, unsigned dstEndY) = 0;
+
+	/** Can scaleImage() be called from several threads at the same time,
+	  * each for a different part of the image? And is the result then
+	  * the same as when the whole image is scaled in one call?
+	  * This requires that the scaler doesn't modify its own state and
+	  * that the result for a line doesn't depend on the region boundaries
+	  * (neighbour lines are read from the source frame, not clipped to
+	  * [srcStartY, srcEndY)).
+	  */
+	virtual bool isStripeSafe() const { return false; }
 };
 
 } // namespace openmsx
@@ -16,6 +16,8 @@ public:
 		unsigned srcStartY, unsigned srcEndY, unsigned srcWidth,
 		ScalerOutput<Pixel>& dst, unsigned dstStartY, unsigned dstEndY) override;
 
+	bool isStripeSafe() const override { return true; }
+
 protected:
 	void dispatchScale(FrameSource& src,
 		unsigned srcStartY, unsigned srcEndY, unsigned srcWidth,